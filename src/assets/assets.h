@@ -14,6 +14,7 @@
 #include "kangaroo_twelve.h"
 #include "four_q.h"
 #include "common_buffers.h"
+#include "node_state_delta.h"
 
 
 
@@ -22,6 +23,9 @@ GLOBAL_VAR_DECL Asset* assets GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL m256i* assetDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY * 2 - 1) * 32ULL;
 GLOBAL_VAR_DECL unsigned long long* assetChangeFlags GLOBAL_VAR_INIT(nullptr);
+
+// Pages of 64 assets changed since the last node state snapshot (marked when computing the universe digest)
+GLOBAL_VAR_DECL DirtyPageBitmap<ASSETS_CAPACITY / 64> assetDirtyPagesSinceSnapshot;
 static constexpr char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 static bool initAssets()
@@ -34,6 +38,7 @@ static bool initAssets()
         return false;
     }
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    assetDirtyPagesSinceSnapshot.markAll();
     return true;
 }
 
@@ -258,6 +263,7 @@ static void getUniverseDigest(m256i& digest)
         if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
         {
             KangarooTwelve(&assets[digestIndex], sizeof(Asset), &assetDigests[digestIndex], 32);
+            assetDirtyPagesSinceSnapshot.markPage(digestIndex >> 6);
         }
     }
     unsigned int previousLevelBeginning = 0;
@@ -283,14 +289,17 @@ static void getUniverseDigest(m256i& digest)
 }
 
 
-static bool saveUniverse(CHAR16* directory = NULL)
+// Save universe to file, optionally in compressed format (supported by loadUniverse())
+static bool saveUniverse(CHAR16* directory = NULL, bool compressed = false)
 {
     logToConsole(L"Saving universe file...");
 
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(universeLock);
-    long long savedSize = save(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
+    long long savedSize = (compressed)
+        ? saveCompressed(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, sizeof(Asset), directory)
+        : save(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
     RELEASE(universeLock);
 
     if (savedSize == ASSETS_CAPACITY * sizeof(Asset))
@@ -307,7 +316,7 @@ static bool saveUniverse(CHAR16* directory = NULL)
 
 static bool loadUniverse(CHAR16* directory = NULL)
 {
-    long long loadedSize = load(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
+    long long loadedSize = loadCompressed(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
     if (loadedSize != ASSETS_CAPACITY * sizeof(Asset))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
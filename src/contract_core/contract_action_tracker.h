@@ -23,14 +23,41 @@ struct ContractAction
 };
 
 
+// Default capacity of the net balance hash map of ContractActionTracker: enough for all entities that can be
+// involved in maxActions transfers, but limited to 64k entries to keep memory footprint small.
+static constexpr unsigned int contractActionTrackerDefaultBalanceMapCapacity(unsigned int maxActions)
+{
+    unsigned int capacity = 8;
+    while (capacity < 2 * maxActions && capacity < (1 << 16))
+        capacity <<= 1;
+    return capacity;
+}
+
 // Class for tracking changes in spectrum and universe during a contract procedure invocation
-template <unsigned int maxActions>
+template <unsigned int maxActions, unsigned int balanceMapCapacity = contractActionTrackerDefaultBalanceMapCapacity(maxActions)>
 class ContractActionTracker
 {
+    static_assert((balanceMapCapacity & (balanceMapCapacity - 1)) == 0, "balanceMapCapacity must be 2^N");
+
 public:
     void init()
     {
         numActions = 0;
+
+        // Reset balance map in O(1) by starting a new generation (all entries of older generations count as empty).
+        // Entries are only cleared at first use and if the generation counter wraps around.
+        if (currentGeneration == 0 || currentGeneration == 0xffffffff)
+        {
+            for (unsigned int i = 0; i < balanceMapCapacity; ++i)
+                balances[i].generation = 0;
+            currentGeneration = 1;
+        }
+        else
+        {
+            ++currentGeneration;
+        }
+        numBalances = 0;
+        balanceMapOverflow = false;
     }
 
     bool addQuTransfer(const m256i& sourcePublicKey, const m256i& destinationPublicKey, long long amount)
@@ -44,15 +71,29 @@ public:
         qa.quTransfer.destinationPublicKey = destinationPublicKey;
         qa.quTransfer.amount = amount;
 
+        if (!balanceMapOverflow)
+        {
+            addToBalance(sourcePublicKey, -amount);
+            addToBalance(destinationPublicKey, amount);
+        }
+
         return true;
     }
 
-    long long getOverallQuTransferBalance(const m256i& publicKey)
+    // Return net amount of QU transferred to (positive) or from (negative) the entity since init().
+    // Constant time unless the balance map overflowed, in which case the action log is scanned.
+    long long getOverallQuTransferBalance(const m256i& publicKey) const
     {
+        if (!balanceMapOverflow)
+        {
+            const BalanceEntry* entry = findBalance(publicKey);
+            return (entry) ? entry->amount : 0;
+        }
+
         long long amount = 0;
         for (unsigned int i = 0; i < numActions; ++i)
         {
-            ContractAction& qa = actions[i];
+            const ContractAction& qa = actions[i];
             if (qa.type == ContractAction::quTransferType)
             {
                 if (qa.quTransfer.sourcePublicKey == publicKey)
@@ -65,6 +106,66 @@ public:
     }
 
 private:
+    struct BalanceEntry
+    {
+        m256i publicKey;
+        long long amount;
+        unsigned int generation;
+    };
+
+    const BalanceEntry* findBalance(const m256i& publicKey) const
+    {
+        // Before first init(), no entry has the current generation 0 set and lookup would not terminate
+        if (!currentGeneration)
+            return nullptr;
+
+        unsigned int index = publicKey.m256i_u32[0] & (balanceMapCapacity - 1);
+        while (balances[index].generation == currentGeneration)
+        {
+            if (balances[index].publicKey == publicKey)
+                return &balances[index];
+            index = (index + 1) & (balanceMapCapacity - 1);
+        }
+        return nullptr;
+    }
+
+    void addToBalance(const m256i& publicKey, long long amount)
+    {
+        if (!currentGeneration)
+        {
+            balanceMapOverflow = true;
+            return;
+        }
+
+        unsigned int index = publicKey.m256i_u32[0] & (balanceMapCapacity - 1);
+        while (balances[index].generation == currentGeneration)
+        {
+            if (balances[index].publicKey == publicKey)
+            {
+                balances[index].amount += amount;
+                return;
+            }
+            index = (index + 1) & (balanceMapCapacity - 1);
+        }
+
+        // Keep load factor low for short probe sequences, fall back to scanning action log if map is too full
+        if (numBalances >= balanceMapCapacity / 4 * 3)
+        {
+            balanceMapOverflow = true;
+            return;
+        }
+        BalanceEntry& entry = balances[index];
+        entry.publicKey = publicKey;
+        entry.amount = amount;
+        entry.generation = currentGeneration;
+        ++numBalances;
+    }
+
     ContractAction actions[maxActions];
-    unsigned int numActions;
+    unsigned int numActions = 0;
+
+    BalanceEntry balances[balanceMapCapacity];
+    unsigned int numBalances = 0;
+    unsigned int currentGeneration = 0;
+    bool balanceMapOverflow = false;
 };
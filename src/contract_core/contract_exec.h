@@ -12,6 +12,8 @@
 #include "contract_core/contract_def.h"
 #include "contract_core/stack_buffer.h"
 #include "contract_core/contract_action_tracker.h"
+#include "contract_core/contract_profiler.h"
+#include "contract_core/contract_state_snapshot.h"
 
 #include "logging/logging.h"
 #include "common_buffers.h"
@@ -32,12 +34,22 @@ enum ContractError
 };
 
 // Used to store: locals and for first invocation level also input and output
-typedef StackBuffer<unsigned int, 32 * 1024 * 1024> ContractLocalsStack;
+// (zeroed lazily, blocks of 1 MB or more are zeroed with non-temporal stores)
+typedef ZeroedStackBuffer<unsigned int, 32 * 1024 * 1024, 1024 * 1024> ContractLocalsStack;
 GLOBAL_VAR_DECL ContractLocalsStack contractLocalsStack[NUMBER_OF_CONTRACT_EXECUTION_BUFFERS];
 GLOBAL_VAR_DECL volatile char contractLocalsStackLock[NUMBER_OF_CONTRACT_EXECUTION_BUFFERS];
 GLOBAL_VAR_DECL volatile long contractLocalsStackLockWaitingCount;
 GLOBAL_VAR_DECL long contractLocalsStackLockWaitingCountMax;
 
+// Ticket queue of low-priority processors waiting for a stack (served in FIFO order)
+GLOBAL_VAR_DECL volatile long long contractLocalsStackQueueNextTicket;
+GLOBAL_VAR_DECL volatile long long contractLocalsStackQueueServedTicket;
+
+// Histogram of peak stack usage per acquisition: element i counts acquisitions that used less than 2^i bytes
+// (and at least 2^(i-1) bytes)
+constexpr unsigned int contractLocalsStackUsageHistogramSize = 33;
+GLOBAL_VAR_DECL volatile long long contractLocalsStackUsageHistogram[contractLocalsStackUsageHistogramSize];
+
 
 GLOBAL_VAR_DECL ReadWriteLock contractStateLock[contractCount];
 GLOBAL_VAR_DECL unsigned char* contractStates[contractCount];
@@ -48,8 +60,33 @@ GLOBAL_VAR_DECL unsigned int contractError[contractCount];
 // access to contractStateChangeFlags thread-safe
 GLOBAL_VAR_DECL unsigned long long* contractStateChangeFlags GLOBAL_VAR_INIT(nullptr);
 
+// Incremented whenever a contract state is changed (before releasing the write lock), used to detect outdated cached data
+GLOBAL_VAR_DECL volatile long long contractStateVersions[contractCount];
+
+// Set if a function running on the stack has read the state of another contract, the spectrum, or the universe, so its
+// result depends on more than the state of the called contract
+GLOBAL_VAR_DECL bool contractLocalsStackReadExternalData[NUMBER_OF_CONTRACT_EXECUTION_BUFFERS];
+
 GLOBAL_VAR_DECL ContractActionTracker<1024*1024> contractActionTracker;
 
+#if CONTRACT_PROFILER_ENTRIES
+// Profile of contract entry points called by the core in the current epoch (reset in beginEpoch())
+GLOBAL_VAR_DECL ContractProfiler<contractCount, CONTRACT_PROFILER_ENTRIES> contractProfiler;
+#endif
+
+#if USE_CONTRACT_STATE_SNAPSHOTS
+// Snapshots of contract states used by user function calls requested from the network (QpiContextUserFunctionCall).
+// A snapshot is updated by the tick processor after the state has changed (in getComputerDigest()), so it reflects the
+// state of the last completed tick and functions reading it neither need nor block contractStateLock. If the snapshot
+// cannot be updated without waiting for function calls still using it, it is invalidated and function calls fall back
+// to reading the current state with read lock until the next successful update. Updates only copy changed pages, but
+// compare the full state (see ContractStateSnapshot).
+GLOBAL_VAR_DECL ContractStateSnapshot contractStateSnapshots[contractCount];
+GLOBAL_VAR_DECL unsigned long long contractStateSnapshotUpdates GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL unsigned long long contractStateSnapshotInvalidations GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL unsigned long long contractStateSnapshotCopiedBytes GLOBAL_VAR_INIT(0);
+#endif
+
 
 static bool initContractExec()
 {
@@ -73,13 +110,30 @@ static bool initContractExec()
     setMem((void*)contractLocalsStackLock, sizeof(contractLocalsStackLock), 0);
     contractLocalsStackLockWaitingCount = 0;
     contractLocalsStackLockWaitingCountMax = 0;
+    contractLocalsStackQueueNextTicket = 0;
+    contractLocalsStackQueueServedTicket = 0;
+    setMem((void*)contractLocalsStackUsageHistogram, sizeof(contractLocalsStackUsageHistogram), 0);
 
     setMem((void*)contractTotalExecutionTicks, sizeof(contractTotalExecutionTicks), 0);
     setMem((void*)contractError, sizeof(contractError), 0);
+    setMem((void*)contractStateVersions, sizeof(contractStateVersions), 0);
+    setMem(contractLocalsStackReadExternalData, sizeof(contractLocalsStackReadExternalData), 0);
+#if CONTRACT_PROFILER_ENTRIES
+    contractProfiler.reset();
+#endif
     for (int i = 0; i < contractCount; ++i)
     {
         contractStateLock[i].reset();
     }
+#if USE_CONTRACT_STATE_SNAPSHOTS
+    for (int i = 0; i < contractCount; ++i)
+    {
+        contractStateSnapshots[i].init(nullptr);
+    }
+    contractStateSnapshotUpdates = 0;
+    contractStateSnapshotInvalidations = 0;
+    contractStateSnapshotCopiedBytes = 0;
+#endif
 
     if (!allocatePool(MAX_NUMBER_OF_CONTRACTS / 8, (void**)&contractStateChangeFlags))
     {
@@ -91,8 +145,55 @@ static bool initContractExec()
     return true;
 }
 
+#if USE_CONTRACT_STATE_SNAPSHOTS
+// Copy changed pages of current state of contract to its snapshot without waiting. Invalidates the snapshot if it is
+// currently in use. Caller needs to hold read lock of contractStateLock[contractIndex]. Only call from tick processor.
+static void updateContractStateSnapshot(unsigned int contractIndex)
+{
+    ASSERT(contractIndex < contractCount);
+    ContractStateSnapshot& snapshot = contractStateSnapshots[contractIndex];
+    if (!snapshot.buffer())
+        return;
+
+    const bool wasValid = snapshot.isValid();
+    unsigned long long copiedBytes;
+    if (snapshot.tryUpdate(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize, contractStateVersions[contractIndex], copiedBytes))
+    {
+        ++contractStateSnapshotUpdates;
+        contractStateSnapshotCopiedBytes += copiedBytes;
+    }
+    else if (wasValid)
+    {
+        ++contractStateSnapshotInvalidations;
+    }
+}
+
+// Retry to validate invalidated snapshot of contract state that has not changed in the current tick. Nothing is
+// copied if the snapshot has only been invalidated because it was in use. Only call from tick processor.
+static void retryInvalidContractStateSnapshot(unsigned int contractIndex)
+{
+    ASSERT(contractIndex < contractCount);
+    if (!contractStateSnapshots[contractIndex].buffer() || contractStateSnapshots[contractIndex].isValid())
+        return;
+
+    contractStateLock[contractIndex].acquireRead();
+    updateContractStateSnapshot(contractIndex);
+    contractStateLock[contractIndex].releaseRead();
+}
+#endif
+
+// Mark function running on the stack as depending on data outside of the state of the called contract, which excludes
+// its output from the contract function result cache
+static void markContractLocalsStackReadExternalData(int stackIndex)
+{
+    if (stackIndex >= 0 && stackIndex < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS)
+        contractLocalsStackReadExternalData[stackIndex] = true;
+}
+
 // Acquire lock of an currently unused stack (may block if all in use)
 // stacksToIgnore > 0 can be passed by low priority tasks to keep some stacks reserved for high prio purposes.
+// Low priority tasks wait in a FIFO ticket queue, so only the first one in the queue is polling the stack locks and
+// no request processor can starve. High priority tasks (stacksToIgnore == 0) bypass the queue.
 static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnore = 0)
 {
     static_assert(NUMBER_OF_CONTRACT_EXECUTION_BUFFERS >= 2, "NUMBER_OF_CONTRACT_EXECUTION_BUFFERS should be at least 2.");
@@ -103,6 +204,14 @@ static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnor
     if (contractLocalsStackLockWaitingCountMax < waitingCount)
         contractLocalsStackLockWaitingCountMax = waitingCount;
 
+    long long ticket = -1;
+    if (stacksToIgnore)
+    {
+        ticket = _InterlockedIncrement64(&contractLocalsStackQueueNextTicket) - 1;
+        while (contractLocalsStackQueueServedTicket != ticket)
+            _mm_pause();
+    }
+
     int i = stacksToIgnore;
     while (TRY_ACQUIRE(contractLocalsStackLock[i]) == false)
     {
@@ -112,6 +221,9 @@ static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnor
             i = stacksToIgnore;
     }
 
+    if (stacksToIgnore)
+        _InterlockedIncrement64(&contractLocalsStackQueueServedTicket);
+
     _InterlockedDecrement(&contractLocalsStackLockWaitingCount);
 
     stackIdx = i;
@@ -120,6 +232,7 @@ static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnor
     ASSERT(contractLocalsStack[stackIdx].size() == 0);
     if (contractLocalsStack[stackIdx].size())
         contractLocalsStack[stackIdx].freeAll();
+    contractLocalsStack[stackIdx].resetPeakSize();
 }
 
 // Release locked stack (and reset stackIdx)
@@ -128,6 +241,12 @@ static void releaseContractLocalsStack(int& stackIdx)
     ASSERT(stackIdx >= 0);
     ASSERT(stackIdx < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS);
     ASSERT(contractLocalsStackLock[stackIdx]);
+
+    // update histogram of stack usage
+    const unsigned int peakSize = contractLocalsStack[stackIdx].peakSize();
+    const unsigned int histogramIndex = (peakSize) ? 32 - __lzcnt(peakSize) : 0;
+    _InterlockedIncrement64(&contractLocalsStackUsageHistogram[histogramIndex]);
+
     RELEASE(contractLocalsStackLock[stackIdx]);
     stackIdx = -1;
 }
@@ -149,7 +268,7 @@ void* QPI::QpiContextFunctionCall::__qpiAllocLocals(unsigned int sizeOfLocals) c
         // abort execution of contract here
         __qpiAbort(ContractErrorAllocLocalsFailed);
     }
-    void* p = contractLocalsStack[_stackIndex].allocate(sizeOfLocals);
+    void* p = contractLocalsStack[_stackIndex].allocateZeroed(sizeOfLocals);
     if (!p)
     {
 #ifndef NDEBUG
@@ -168,7 +287,6 @@ void* QPI::QpiContextFunctionCall::__qpiAllocLocals(unsigned int sizeOfLocals) c
         // abort execution of contract here
         __qpiAbort(ContractErrorAllocLocalsFailed);
     }
-    setMem(p, sizeOfLocals, 0);
     return p;
 }
 
@@ -206,6 +324,9 @@ const QpiContextFunctionCall& QPI::QpiContextFunctionCall::__qpiConstructContext
     }
     QpiContextFunctionCall& newContext = *reinterpret_cast<QpiContextFunctionCall*>(buffer);
     newContext.init(otherContractIndex, _originator, _currentContractId, _invocationReward);
+#if CONTRACT_PROFILER_ENTRIES
+    contractProfiler.recordCallEdge(_currentContractIndex, otherContractIndex);
+#endif
     return newContext;
 }
 
@@ -236,6 +357,9 @@ const QpiContextProcedureCall& QPI::QpiContextProcedureCall::__qpiConstructConte
     if (transfer(QPI::id(otherContractIndex, 0, 0, 0), invocationReward) < 0)
         invocationReward = 0;
     newContext.init(otherContractIndex, _originator, _currentContractId, invocationReward);
+#if CONTRACT_PROFILER_ENTRIES
+    contractProfiler.recordCallEdge(_currentContractIndex, otherContractIndex);
+#endif
     return newContext;
 }
 
@@ -250,6 +374,7 @@ void QPI::QpiContextFunctionCall::__qpiFreeContextOtherContract() const
 void* QPI::QpiContextFunctionCall::__qpiAcquireStateForReading(unsigned int contractIndex) const
 {
     ASSERT(contractIndex < contractCount);
+    markContractLocalsStackReadExternalData(_stackIndex);
     contractStateLock[contractIndex].acquireRead();
     return contractStates[contractIndex];
 }
@@ -273,6 +398,7 @@ void* QPI::QpiContextProcedureCall::__qpiAcquireStateForWriting(unsigned int con
 void QPI::QpiContextProcedureCall::__qpiReleaseStateForWriting(unsigned int contractIndex) const
 {
     ASSERT(contractIndex < contractCount);
+    _InterlockedIncrement64(&contractStateVersions[contractIndex]);
     contractStateLock[contractIndex].releaseWrite();
     contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
 }
@@ -308,10 +434,9 @@ void QPI::QpiContextProcedureCall::__qpiCallSystemProcOfOtherContract(unsigned i
 
     // Alloc locals
     unsigned short localsSize = contractSystemProcedureLocalsSizes[otherContractIndex][sysProcId];
-    char* localsBuffer = contractLocalsStack[_stackIndex].allocate(localsSize);
+    char* localsBuffer = contractLocalsStack[_stackIndex].allocateZeroed(localsSize);
     if (!localsBuffer)
         __qpiAbort(ContractErrorAllocLocalsFailed);
-    setMem(localsBuffer, localsSize, 0);
 
     // Run procedure
     contractSystemProcedures[otherContractIndex][sysProcId](otherContractContext, otherContractState, &input, &output, localsBuffer);
@@ -424,6 +549,7 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
         contractStateLock[_currentContractIndex].acquireWrite();
 
         const unsigned long long startTick = __rdtsc();
+        unsigned long long stackSize = 0;
         unsigned short localsSize = contractSystemProcedureLocalsSizes[_currentContractIndex][systemProcId];
         if (localsSize == sizeof(QPI::NoData))
         {
@@ -434,22 +560,27 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
         {
             // locals required: reserve stack and use stack (should not block because stack 0 is reserved for procedures)
             acquireContractLocalsStack(_stackIndex);
-            char* localsBuffer = contractLocalsStack[_stackIndex].allocate(localsSize);
+            char* localsBuffer = contractLocalsStack[_stackIndex].allocateZeroed(localsSize);
             if (!localsBuffer)
                 __qpiAbort(ContractErrorAllocLocalsFailed);
-            setMem(localsBuffer, localsSize, 0);
 
             // call system proc
             contractSystemProcedures[_currentContractIndex][systemProcId](*this, contractStates[_currentContractIndex], &noInOutData, &noInOutData, localsBuffer);
+            stackSize = contractLocalsStack[_stackIndex].peakSize();
 
             // free data on stack and release stack
             contractLocalsStack[_stackIndex].free();
             ASSERT(contractLocalsStack[_stackIndex].size() == 0);
             releaseContractLocalsStack(_stackIndex);
         }
-        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], __rdtsc() - startTick);
+        const unsigned long long executionTicks = __rdtsc() - startTick;
+        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], executionTicks);
+#if CONTRACT_PROFILER_ENTRIES
+        contractProfiler.recordCall(_currentContractIndex, CONTRACT_ENTRY_POINT_SYSTEM_PROCEDURE, systemProcId, executionTicks, stackSize);
+#endif
 
         // release lock of contract state and set state to changed
+        _InterlockedIncrement64(&contractStateVersions[_currentContractIndex]);
         contractStateLock[_currentContractIndex].releaseWrite();
         contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
     }
@@ -499,7 +630,7 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
         unsigned short fullInputSize = contractUserProcedureInputSizes[_currentContractIndex][inputType];
         outputSize = contractUserProcedureOutputSizes[_currentContractIndex][inputType];
         unsigned int localsSize = contractUserProcedureLocalsSizes[_currentContractIndex][inputType];
-        char* inputBuffer = contractLocalsStack[_stackIndex].allocate(fullInputSize + outputSize + localsSize);
+        char* inputBuffer = contractLocalsStack[_stackIndex].allocateZeroed(fullInputSize + outputSize + localsSize);
         if (!inputBuffer)
         {
 #ifndef NDEBUG
@@ -527,18 +658,13 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         outputBuffer = inputBuffer + fullInputSize;
         char* localsBuffer = outputBuffer + outputSize;
-        if (inputSize < fullInputSize)
-        {
-            // less input data than expected by contract -> fill with 0
-            setMem(inputBuffer + inputSize, fullInputSize - inputSize, 0);
-        }
-        else if (inputSize > fullInputSize)
+        if (inputSize > fullInputSize)
         {
             // more input data than expected by contract -> discard additional bytes
+            // (if there is less input data than expected, the rest stays 0)
             inputSize = fullInputSize;
         }
         copyMem(inputBuffer, inputPtr, inputSize);
-        setMem(outputBuffer, outputSize + localsSize, 0);
 
         // acquire lock of contract state for writing (shouldn't block because 1 stack is not used by functions and thus kept free for procedures)
         contractStateLock[_currentContractIndex].acquireWrite();
@@ -546,9 +672,14 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
         // run procedure
         const unsigned long long startTick = __rdtsc();
         contractUserProcedures[_currentContractIndex][inputType](*this, contractStates[_currentContractIndex], inputBuffer, outputBuffer, localsBuffer);
-        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], __rdtsc() - startTick);
+        const unsigned long long executionTicks = __rdtsc() - startTick;
+        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], executionTicks);
+#if CONTRACT_PROFILER_ENTRIES
+        contractProfiler.recordCall(_currentContractIndex, CONTRACT_ENTRY_POINT_USER_PROCEDURE, inputType, executionTicks, contractLocalsStack[_stackIndex].peakSize());
+#endif
 
         // release lock of contract state and set state to changed
+        _InterlockedIncrement64(&contractStateVersions[_currentContractIndex]);
         contractStateLock[_currentContractIndex].releaseWrite();
         contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
     }
@@ -574,10 +705,22 @@ struct QpiContextUserFunctionCall : public QPI::QpiContextFunctionCall
     char* outputBuffer;
     unsigned short outputSize;
 
-    QpiContextUserFunctionCall(unsigned int contractIndex) : QPI::QpiContextFunctionCall(contractIndex, NULL_ID, 0)
+    // Version of contract state the function has been executed on and whether the output only depends on this state
+    // (and the input and tick), so it may be cached
+    long long stateVersion;
+    bool outputCacheable;
+
+    // If true, the function may run on the snapshot of the state of the last completed tick (see
+    // USE_CONTRACT_STATE_SNAPSHOTS). Only for requests from the network, calls by the core need the current state.
+    bool allowStateSnapshot;
+
+    QpiContextUserFunctionCall(unsigned int contractIndex, bool allowStateSnapshot = false) : QPI::QpiContextFunctionCall(contractIndex, NULL_ID, 0)
     {
         outputBuffer = nullptr;
         outputSize = 0;
+        stateVersion = 0;
+        outputCacheable = false;
+        this->allowStateSnapshot = allowStateSnapshot;
     }
 
     ~QpiContextUserFunctionCall()
@@ -612,7 +755,7 @@ struct QpiContextUserFunctionCall : public QPI::QpiContextFunctionCall
         unsigned short fullInputSize = contractUserFunctionInputSizes[_currentContractIndex][inputType];
         outputSize = contractUserFunctionOutputSizes[_currentContractIndex][inputType];
         unsigned int localsSize = contractUserFunctionLocalsSizes[_currentContractIndex][inputType];
-        char* inputBuffer = contractLocalsStack[_stackIndex].allocate(fullInputSize + outputSize + localsSize);
+        char* inputBuffer = contractLocalsStack[_stackIndex].allocateZeroed(fullInputSize + outputSize + localsSize);
         if (!inputBuffer)
         {
 #ifndef NDEBUG
@@ -639,29 +782,52 @@ struct QpiContextUserFunctionCall : public QPI::QpiContextFunctionCall
         }
         outputBuffer = inputBuffer + fullInputSize;
         char* localsBuffer = outputBuffer + outputSize;
-        if (inputSize < fullInputSize)
-        {
-            // less input data than expected by contract -> fill with 0
-            setMem(inputBuffer + inputSize, fullInputSize - inputSize, 0);
-        }
-        else if (inputSize > fullInputSize)
+        if (inputSize > fullInputSize)
         {
             // more input data than expected by contract -> discard additional bytes
+            // (if there is less input data than expected, the rest stays 0)
             inputSize = fullInputSize;
         }
         copyMem(inputBuffer, inputPtr, inputSize);
-        setMem(outputBuffer, outputSize + localsSize, 0);
+
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        // use snapshot of state of last completed tick if available, which does not block writers of current state
+        // (functions of other contracts invoked by this function still access the current state of the other contract)
+        unsigned char* snapshotState = (allowStateSnapshot) ? contractStateSnapshots[_currentContractIndex].tryAcquireRead() : nullptr;
+        const bool useSnapshot = (snapshotState != nullptr);
+        unsigned char* state = (useSnapshot) ? snapshotState : contractStates[_currentContractIndex];
+#else
+        constexpr bool useSnapshot = false;
+        unsigned char* state = contractStates[_currentContractIndex];
+#endif
 
         // acquire lock of contract state for reading (may block)
-        contractStateLock[_currentContractIndex].acquireRead();
+        if (!useSnapshot)
+            contractStateLock[_currentContractIndex].acquireRead();
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        stateVersion = (useSnapshot) ? contractStateSnapshots[_currentContractIndex].getVersion() : contractStateVersions[_currentContractIndex];
+#else
+        stateVersion = contractStateVersions[_currentContractIndex];
+#endif
+        contractLocalsStackReadExternalData[_stackIndex] = false;
 
         // run function
         const unsigned long long startTick = __rdtsc();
-        contractUserFunctions[_currentContractIndex][inputType](*this, contractStates[_currentContractIndex], inputBuffer, outputBuffer, localsBuffer);
-        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], __rdtsc() - startTick);
+        contractUserFunctions[_currentContractIndex][inputType](*this, state, inputBuffer, outputBuffer, localsBuffer);
+        const unsigned long long executionTicks = __rdtsc() - startTick;
+        _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], executionTicks);
+#if CONTRACT_PROFILER_ENTRIES
+        contractProfiler.recordCall(_currentContractIndex, CONTRACT_ENTRY_POINT_USER_FUNCTION, inputType, executionTicks, contractLocalsStack[_stackIndex].peakSize());
+#endif
+        outputCacheable = !contractLocalsStackReadExternalData[_stackIndex];
 
         // release lock of contract state
-        contractStateLock[_currentContractIndex].releaseRead();
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        if (useSnapshot)
+            contractStateSnapshots[_currentContractIndex].releaseRead();
+        else
+#endif
+            contractStateLock[_currentContractIndex].releaseRead();
     }
 
     // free buffer after output has been copied
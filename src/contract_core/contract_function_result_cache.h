@@ -0,0 +1,174 @@
+#pragma once
+
+#include "../platform/m256.h"
+#include "../platform/memory.h"
+#include "../platform/concurrency.h"
+
+#include "../kangaroo_twelve.h"
+
+/// Key identifying the result of a contract user function call
+struct ContractFunctionResultCacheKey
+{
+    m256i inputDigest;              // K12 of input data
+    unsigned long long stateVersion;// version of contract state the function reads
+    unsigned int tick;              // tick the function is called in (functions may read tick-dependent data like time)
+    unsigned int contractIndex;
+    unsigned short inputType;
+    unsigned short inputSize;
+
+    /// Init key, computing digest of input
+    void set(unsigned int contractIndex, unsigned short inputType, const void* input, unsigned short inputSize,
+        unsigned long long stateVersion, unsigned int tick)
+    {
+        KangarooTwelve(input, inputSize, &inputDigest, sizeof(inputDigest));
+        this->stateVersion = stateVersion;
+        this->tick = tick;
+        this->contractIndex = contractIndex;
+        this->inputType = inputType;
+        this->inputSize = inputSize;
+    }
+
+    bool operator==(const ContractFunctionResultCacheKey& other) const
+    {
+        return inputDigest == other.inputDigest && stateVersion == other.stateVersion && tick == other.tick
+            && contractIndex == other.contractIndex && inputType == other.inputType && inputSize == other.inputSize;
+    }
+};
+
+/// Bounded cache of outputs of read-only contract user function calls (set-associative with LRU replacement per set).
+/// Entries are never explicitly invalidated: keys contain the state version and tick, so outdated entries are not
+/// hit anymore and are replaced by LRU.
+template <unsigned int numberOfEntries, unsigned int maxOutputSize, unsigned int ways = 8>
+class ContractFunctionResultCache
+{
+    static_assert(numberOfEntries % ways == 0, "numberOfEntries must be multiple of ways");
+    static constexpr unsigned int numberOfSets = numberOfEntries / ways;
+    static_assert((numberOfSets & (numberOfSets - 1)) == 0, "numberOfEntries / ways must be 2^N");
+    static_assert(maxOutputSize <= 0xffff, "Output size of contract function is limited to 16 bits");
+
+public:
+    /// Reset all cache entries and counters
+    void reset()
+    {
+        for (unsigned int i = 0; i < numberOfSets; ++i)
+        {
+            ACQUIRE(sets[i].lock);
+            for (unsigned int j = 0; j < ways; ++j)
+                sets[i].entries[j].lastUsed = 0;
+            RELEASE(sets[i].lock);
+        }
+        useCounter = 0;
+        hits = 0;
+        misses = 0;
+        insertions = 0;
+    }
+
+    /// Return maximum number of entries that can be stored in cache
+    constexpr unsigned int capacity() const
+    {
+        return numberOfEntries;
+    }
+
+    /// Return maximum size of output that can be cached
+    constexpr unsigned int maxOutput() const
+    {
+        return maxOutputSize;
+    }
+
+    /// Try to get cached output. If found, copy it to outputBuffer (needs to have maxOutputSize bytes), set outputSize,
+    /// and return true. Otherwise return false. Increments counter of hits or misses.
+    bool tryFetching(const ContractFunctionResultCacheKey& key, void* outputBuffer, unsigned short& outputSize)
+    {
+        Set& set = sets[setIndex(key)];
+        ACQUIRE(set.lock);
+        for (unsigned int j = 0; j < ways; ++j)
+        {
+            Entry& entry = set.entries[j];
+            if (entry.lastUsed && entry.key == key)
+            {
+                entry.lastUsed = _InterlockedIncrement64(&useCounter);
+                outputSize = entry.outputSize;
+                copyMem(outputBuffer, entry.output, entry.outputSize);
+                RELEASE(set.lock);
+                _InterlockedIncrement64(&hits);
+                return true;
+            }
+        }
+        RELEASE(set.lock);
+        _InterlockedIncrement64(&misses);
+        return false;
+    }
+
+    /// Add output to cache, replacing the least recently used entry of the set. Outputs that are too large are ignored.
+    void add(const ContractFunctionResultCacheKey& key, const void* output, unsigned short outputSize)
+    {
+        if (outputSize > maxOutputSize)
+            return;
+
+        Set& set = sets[setIndex(key)];
+        ACQUIRE(set.lock);
+        Entry* replace = &set.entries[0];
+        for (unsigned int j = 0; j < ways; ++j)
+        {
+            Entry& entry = set.entries[j];
+            if (entry.lastUsed && entry.key == key)
+            {
+                // Already added by other processor in the meantime
+                replace = nullptr;
+                break;
+            }
+            if (entry.lastUsed < replace->lastUsed)
+                replace = &entry;
+        }
+        if (replace)
+        {
+            replace->key = key;
+            replace->outputSize = outputSize;
+            copyMem(replace->output, output, outputSize);
+            replace->lastUsed = _InterlockedIncrement64(&useCounter);
+            _InterlockedIncrement64(&insertions);
+        }
+        RELEASE(set.lock);
+    }
+
+    long long hitCount() const
+    {
+        return hits;
+    }
+
+    long long missCount() const
+    {
+        return misses;
+    }
+
+    long long insertionCount() const
+    {
+        return insertions;
+    }
+
+private:
+    struct Entry
+    {
+        ContractFunctionResultCacheKey key;
+        long long lastUsed; // 0 means empty
+        unsigned short outputSize;
+        unsigned char output[maxOutputSize];
+    };
+
+    struct Set
+    {
+        Entry entries[ways];
+        volatile char lock;
+    };
+
+    static unsigned int setIndex(const ContractFunctionResultCacheKey& key)
+    {
+        return (key.inputDigest.m256i_u32[0] ^ key.contractIndex ^ key.inputType) & (numberOfSets - 1);
+    }
+
+    Set sets[numberOfSets];
+    volatile long long useCounter;
+    volatile long long hits;
+    volatile long long misses;
+    volatile long long insertions;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "../platform/memory.h"
+#include "../platform/histogram.h"
+
+/// Kinds of contract entry points distinguished by ContractProfiler
+enum ContractEntryPointKind
+{
+    CONTRACT_ENTRY_POINT_SYSTEM_PROCEDURE = 0,  // inputType is SystemProcedureID
+    CONTRACT_ENTRY_POINT_USER_PROCEDURE,
+    CONTRACT_ENTRY_POINT_USER_FUNCTION,
+};
+
+/// Execution profile of contract entry points (contract, kind, inputType) called by the core, with call counts, cycle
+/// histograms, and peak usage of the contract locals stack, as well as counts of calls from one contract to another.
+/// Cycles and stack usage are inclusive, that is, they contain the calls of other contracts. Entry points are stored
+/// in a hash map with linear probing and are never removed except by reset(). If the map is full, calls of new entry
+/// points are only counted in numberOfDroppedCalls(). All record functions may be called concurrently (lock-free).
+template <unsigned int numberOfContracts, unsigned int numberOfEntries>
+class ContractProfiler
+{
+    static_assert((numberOfEntries & (numberOfEntries - 1)) == 0, "numberOfEntries must be 2^N");
+
+public:
+    struct EntryPoint
+    {
+        volatile long long key;     // 0 if slot is unused
+        volatile long long numberOfCalls;
+        volatile long long totalCycles;
+        volatile long long maxStackSize;
+        LatencyHistogram cycles;
+
+        unsigned int contractIndex() const
+        {
+            return (unsigned int)((key - 1) >> 18);
+        }
+
+        unsigned char kind() const
+        {
+            return (unsigned char)(((key - 1) >> 16) & 3);
+        }
+
+        unsigned short inputType() const
+        {
+            return (unsigned short)(key - 1);
+        }
+    };
+
+    /// Remove all entry points and call edges
+    void reset()
+    {
+        for (unsigned int i = 0; i < numberOfEntries; ++i)
+        {
+            entryPoints[i].key = 0;
+            entryPoints[i].numberOfCalls = 0;
+            entryPoints[i].totalCycles = 0;
+            entryPoints[i].maxStackSize = 0;
+            entryPoints[i].cycles.reset();
+        }
+        setMem((void*)callEdges, sizeof(callEdges), 0);
+        droppedCalls = 0;
+    }
+
+    /// Return maximum number of entry points that can be stored
+    constexpr unsigned int capacity() const
+    {
+        return numberOfEntries;
+    }
+
+    /// Record finished call of entry point that took cycles CPU ticks and used stackSize bytes of the locals stack
+    void recordCall(unsigned int contractIndex, ContractEntryPointKind kind, unsigned short inputType, unsigned long long cycles, unsigned long long stackSize)
+    {
+        EntryPoint* entryPoint = findOrInsert(((long long)contractIndex << 18 | (long long)kind << 16 | inputType) + 1);
+        if (!entryPoint)
+        {
+            _InterlockedIncrement64(&droppedCalls);
+            return;
+        }
+        _InterlockedIncrement64(&entryPoint->numberOfCalls);
+        _InterlockedExchangeAdd64(&entryPoint->totalCycles, (long long)cycles);
+        entryPoint->cycles.add(cycles);
+        long long currentMax = entryPoint->maxStackSize;
+        while (currentMax < (long long)stackSize)
+        {
+            const long long previousMax = _InterlockedCompareExchange64(&entryPoint->maxStackSize, (long long)stackSize, currentMax);
+            if (previousMax == currentMax)
+                break;
+            currentMax = previousMax;
+        }
+    }
+
+    /// Record call from contract callerIndex to function or procedure of contract calleeIndex
+    void recordCallEdge(unsigned int callerIndex, unsigned int calleeIndex)
+    {
+        if (callerIndex < numberOfContracts && calleeIndex < numberOfContracts)
+            _InterlockedIncrement64(&callEdges[callerIndex][calleeIndex]);
+    }
+
+    /// Return entry point stored in slot or nullptr if slot is unused (slot < capacity())
+    const EntryPoint* entryPoint(unsigned int slot) const
+    {
+        return (entryPoints[slot].key) ? &entryPoints[slot] : nullptr;
+    }
+
+    /// Return number of calls from contract callerIndex to contract calleeIndex
+    long long numberOfCallEdgeCalls(unsigned int callerIndex, unsigned int calleeIndex) const
+    {
+        return callEdges[callerIndex][calleeIndex];
+    }
+
+    /// Return number of calls not recorded because the hash map was full
+    long long numberOfDroppedCalls() const
+    {
+        return droppedCalls;
+    }
+
+private:
+    EntryPoint* findOrInsert(long long key)
+    {
+        unsigned int slot = (unsigned int)((unsigned long long)key * 0x9E3779B97F4A7C15ULL >> 40) & (numberOfEntries - 1);
+        for (unsigned int i = 0; i < numberOfEntries; ++i)
+        {
+            const long long slotKey = entryPoints[slot].key;
+            if (slotKey == key)
+                return &entryPoints[slot];
+            if (!slotKey)
+            {
+                const long long previousKey = _InterlockedCompareExchange64(&entryPoints[slot].key, key, 0);
+                if (!previousKey || previousKey == key)
+                    return &entryPoints[slot];
+            }
+            slot = (slot + 1) & (numberOfEntries - 1);
+        }
+        return nullptr;
+    }
+
+    EntryPoint entryPoints[numberOfEntries];
+    volatile long long callEdges[numberOfContracts][numberOfContracts];
+    volatile long long droppedCalls;
+};
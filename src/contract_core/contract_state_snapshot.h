@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../platform/memory.h"
+#include "../platform/read_write_lock.h"
+
+/// Copy of a contract state that contract functions requested via network can read without locking the current state.
+/// The snapshot is only written by one thread (the tick processor) and never waits for readers: if it is in use while
+/// the state has changed, it is invalidated and readers fall back to the current state until the next update succeeds.
+///
+/// Contract states are written directly by contract code, so there is no tracking of dirty memory. Instead, an update
+/// compares the state with the snapshot page by page and only copies pages that differ. Thus, each update reads the
+/// full state once (twice the state size in memory bandwidth if nothing changed, stopping early in changed pages)
+/// but only writes the pages that changed, which is usually a small part of large states.
+class ContractStateSnapshot
+{
+public:
+    static constexpr unsigned long long pageSize = 4096;
+
+    /// Set buffer of snapshot (nullptr = disabled) and mark it as invalid and outdated.
+    void init(unsigned char* buffer)
+    {
+        lock.reset();
+        data = buffer;
+        valid = false;
+        version = -1; // never equal to state version before first update
+    }
+
+    /// Return buffer passed to init(), for freeing it.
+    unsigned char* buffer() const
+    {
+        return data;
+    }
+
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /// Version of the state the snapshot has been updated to, only consistent with content while holding read access.
+    long long getVersion() const
+    {
+        return version;
+    }
+
+    /// Try to get read access to valid snapshot without waiting. Returns snapshot data on success, which requires
+    /// calling releaseRead() after reading. Returns nullptr if no valid snapshot is available.
+    unsigned char* tryAcquireRead()
+    {
+        if (!valid || !lock.tryAcquireRead())
+            return nullptr;
+        if (!valid)
+        {
+            // invalidated before getting access
+            lock.releaseRead();
+            return nullptr;
+        }
+        return data;
+    }
+
+    /// Release read access after successful tryAcquireRead().
+    void releaseRead()
+    {
+        lock.releaseRead();
+    }
+
+    /// Update snapshot to state of given version without waiting. If the snapshot is in use, it is invalidated and
+    /// false is returned. Otherwise, copiedBytes is set to the number of bytes of changed pages copied and true is
+    /// returned. The state must not be changed while calling this. Only call from one thread.
+    bool tryUpdate(const unsigned char* state, unsigned long long size, long long stateVersion, unsigned long long& copiedBytes)
+    {
+        copiedBytes = 0;
+        if (!data)
+            return false;
+
+        if (!lock.tryAcquireWrite())
+        {
+            valid = false;
+            return false;
+        }
+        if (version != stateVersion)
+        {
+            for (unsigned long long offset = 0; offset < size; offset += pageSize)
+            {
+                const unsigned long long pageBytes = (size - offset < pageSize) ? size - offset : pageSize;
+                if (!isEqual(data + offset, state + offset, pageBytes))
+                {
+                    copyMem(data + offset, state + offset, pageBytes);
+                    copiedBytes += pageBytes;
+                }
+            }
+            version = stateVersion;
+        }
+        valid = true;
+        lock.releaseWrite();
+        return true;
+    }
+
+private:
+    // Compare memory, stopping at the first difference
+    static bool isEqual(const unsigned char* a, const unsigned char* b, unsigned long long size)
+    {
+        unsigned long long i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            if (*(const unsigned long long*)(a + i) != *(const unsigned long long*)(b + i))
+                return false;
+        }
+        for (; i < size; ++i)
+        {
+            if (a[i] != b[i])
+                return false;
+        }
+        return true;
+    }
+
+    ReadWriteLock lock;
+    unsigned char* data;
+    volatile bool valid;
+    volatile long long version;
+};
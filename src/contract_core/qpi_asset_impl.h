@@ -2,6 +2,7 @@
 
 #include "contracts/qpi.h"
 
+#include "contract_core/contract_exec.h"
 #include "assets/assets.h"
 #include "../spectrum.h"
 
@@ -139,6 +140,8 @@ long long QPI::QpiContextProcedureCall::issueAsset(unsigned long long name, cons
 
 long long QPI::QpiContextFunctionCall::numberOfPossessedShares(unsigned long long assetName, const m256i& issuer, const m256i& owner, const m256i& possessor, unsigned short ownershipManagingContractIndex, unsigned short possessionManagingContractIndex) const
 {
+    markContractLocalsStackReadExternalData(_stackIndex);
+
     ACQUIRE(universeLock);
 
     int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
@@ -6,6 +6,8 @@
 
 bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity) const
 {
+    markContractLocalsStackReadExternalData(_stackIndex);
+
     int index = spectrumIndex(id);
     if (index < 0)
     {
@@ -33,13 +35,20 @@ bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity
     }
 }
 
-// Return reference to fee reserve of contract for changing its value (data stored in state of contract 0)
-static long long& contractFeeReserve(unsigned int contractIndex)
+// Return fee reserve of contract (data stored in state of contract 0)
+static long long getContractFeeReserve(unsigned int contractIndex)
 {
-    contractStateChangeFlags[0] |= 1ULL;
     return ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex];
 }
 
+// Change fee reserve of contract, caller needs to hold write lock of contractStateLock[0]
+static void setContractFeeReserve(unsigned int contractIndex, long long newValue)
+{
+    ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex] = newValue;
+    contractStateChangeFlags[0] |= 1ULL;
+    _InterlockedIncrement64(&contractStateVersions[0]);
+}
+
 long long QPI::QpiContextProcedureCall::burn(long long amount) const
 {
     if (amount < 0 || amount > MAX_AMOUNT)
@@ -64,7 +73,7 @@ long long QPI::QpiContextProcedureCall::burn(long long amount) const
     if (decreaseEnergy(index, amount))
     {
         contractStateLock[0].acquireWrite();
-        contractFeeReserve(_currentContractIndex) += amount;
+        setContractFeeReserve(_currentContractIndex, getContractFeeReserve(_currentContractIndex) + amount);
         contractStateLock[0].releaseWrite();
 
         const Burning burning = { _currentContractId , amount };
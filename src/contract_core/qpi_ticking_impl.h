@@ -0,0 +1,140 @@
+#pragma once
+
+#include "contracts/qpi.h"
+
+#include "contract_core/contract_exec.h"
+#include "spectrum.h"
+#include "kangaroo_twelve.h"
+#include "four_q.h"
+#include "platform/time.h"
+
+// QPI functions depending on the state of tick processing. etalonTick, broadcastedComputors, and arbitratorPublicKey
+// need to be defined before including this file (by qubic.cpp or tools replaying ticks).
+
+QPI::id QPI::QpiContextFunctionCall::arbitrator() const
+{
+    return arbitratorPublicKey;
+}
+
+bool QPI::QpiContextProcedureCall::acquireShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 sourceOwnershipManagingContractIndex, uint16 sourcePossessionManagingContractIndex) const
+{
+    // Just examples, to make it compile, move these to parameter list
+    unsigned int contractIndex = QX_CONTRACT_INDEX;
+    QPI::sint64 invocationReward = 10;
+
+    if (contractIndex >= contractCount)
+        return false;
+    if (invocationReward < 0)
+        return false;
+    // ...
+
+    // TODO: Init input
+    QPI::PreManagementRightsTransfer_input pre_input;
+    // output is zeroed in __qpiCallSystemProcOfOtherContract
+    QPI::PreManagementRightsTransfer_output pre_output;
+
+    // Call PRE_ACQUIRE_SHARES in other contract after transferring invocationReward
+    __qpiCallSystemProcOfOtherContract<PRE_ACQUIRE_SHARES>(contractIndex, pre_input, pre_output, invocationReward);
+
+    if (pre_output.ok)
+    {
+        // TODO: transfer
+
+        // TODO: init input
+        QPI::PostManagementRightsTransfer_input post_input;
+        // Output is unused, but needed for generalized interface
+        QPI::NoData post_output;
+
+        // Call POST_ACQUIRE_SHARES in other contract without transferring an invocationReward
+        __qpiCallSystemProcOfOtherContract<POST_ACQUIRE_SHARES>(contractIndex, post_input, post_output, 0);
+    }
+
+    return pre_output.ok;
+}
+
+QPI::id QPI::QpiContextFunctionCall::computor(unsigned short computorIndex) const
+{
+    return broadcastedComputors.computors.publicKeys[computorIndex % NUMBER_OF_COMPUTORS];
+}
+
+unsigned char QPI::QpiContextFunctionCall::day() const
+{
+    return etalonTick.day;
+}
+
+unsigned char QPI::QpiContextFunctionCall::dayOfWeek(unsigned char year, unsigned char month, unsigned char day) const
+{
+    return dayIndex(year, month, day) % 7;
+}
+
+unsigned char QPI::QpiContextFunctionCall::hour() const
+{
+    return etalonTick.hour;
+}
+
+unsigned short QPI::QpiContextFunctionCall::millisecond() const
+{
+    return etalonTick.millisecond;
+}
+
+unsigned char QPI::QpiContextFunctionCall::minute() const
+{
+    return etalonTick.minute;
+}
+
+unsigned char QPI::QpiContextFunctionCall::month() const
+{
+    return etalonTick.month;
+}
+
+m256i QPI::QpiContextFunctionCall::nextId(const m256i& currentId) const
+{
+    int index = spectrumIndex(currentId);
+    while (++index < SPECTRUM_CAPACITY)
+    {
+        const m256i& nextId = spectrum[index].publicKey;
+        if (!isZero(nextId))
+        {
+            return nextId;
+        }
+    }
+
+    return m256i::zero();
+}
+
+int QPI::QpiContextFunctionCall::numberOfTickTransactions() const
+{
+    return -1; // TODO: Return -1 if the current tick is empty, return the number of the transactions in the tick otherwise, including 0
+}
+
+bool QPI::QpiContextProcedureCall::releaseShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 destinationOwnershipManagingContractIndex, uint16 destinationPossessionManagingContractIndex) const
+{
+    // TODO
+
+    return false;
+}
+
+unsigned char QPI::QpiContextFunctionCall::second() const
+{
+    return etalonTick.second;
+}
+
+bool QPI::QpiContextFunctionCall::signatureValidity(const m256i& entity, const m256i& digest, const array<signed char, 64>& signature) const
+{
+    return verify(entity.m256i_u8, digest.m256i_u8, reinterpret_cast<const unsigned char*>(&signature));
+}
+
+unsigned char QPI::QpiContextFunctionCall::year() const
+{
+    return etalonTick.year;
+}
+
+template <typename T>
+m256i QPI::QpiContextFunctionCall::K12(const T& data) const
+{
+    m256i digest;
+
+    KangarooTwelve(&data, sizeof(data), &digest, sizeof(digest));
+
+    return digest;
+}
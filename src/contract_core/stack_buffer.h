@@ -1,6 +1,9 @@
 #pragma once
 
+#include <intrin.h>
+
 #include "../platform/debugging.h"
+#include "../platform/memory.h"
 
 // Last-In-First-Out storage for data of different size.
 // Size type used for StackBuffer needs to be unsigned.
@@ -159,3 +162,149 @@ protected:
     unsigned int _failedAllocAttempts;
 #endif
 };
+
+// StackBuffer providing storage initialized with zeros at low cost.
+// The whole buffer is zeroed once in init(). After that, the buffer tracks its high-water mark (end of the region that
+// may have been written) and allocateZeroed() only zeroes the part of a new block that lies below this mark, because
+// the part above is still zero. free() zeroes the freed block and lowers the mark, so the mark follows the stack down
+// when a deep call returns. The data is zeroed while it is still in the cache and allocateZeroed() on the call path
+// usually has nothing left to zero. Blocks of at least nonTemporalThreshold bytes are zeroed with non-temporal
+// stores, which do not evict the working set from the caches (nonTemporalThreshold = 0 disables this).
+template <typename StackBufferSizeType, StackBufferSizeType bufferSize, StackBufferSizeType nonTemporalThreshold = 0>
+struct ZeroedStackBuffer : public StackBuffer<StackBufferSizeType, bufferSize>
+{
+    typedef StackBuffer<StackBufferSizeType, bufferSize> BaseType;
+    typedef typename BaseType::SizeType SizeType;
+
+    // Initialize as empty stack and zero whole buffer (expensive, should only be called at startup)
+    void init()
+    {
+        BaseType::init();
+        setMem(this->_buffer, bufferSize, 0);
+        _highWaterMark = 0;
+        _peakSize = 0;
+        _zeroedBytes = 0;
+        _zeroedOnFreeBytes = 0;
+        _zeroingSkippedBytes = 0;
+    }
+
+    // Allocate storage in buffer (not initialized).
+    char* allocate(SizeType size)
+    {
+        char* allocatedBuffer = BaseType::allocate(size);
+        if (allocatedBuffer)
+        {
+            if (this->_allocatedSize > _highWaterMark)
+                _highWaterMark = this->_allocatedSize;
+            if (this->_allocatedSize > _peakSize)
+                _peakSize = this->_allocatedSize;
+        }
+        return allocatedBuffer;
+    }
+
+    // Free storage allocated by last call to allocate() or allocateZeroed() and zero it.
+    bool free()
+    {
+        const bool okay = BaseType::free();
+        lowerHighWaterMark();
+        return okay;
+    }
+
+    // Free all storage allocated before and zero it.
+    void freeAll()
+    {
+        BaseType::freeAll();
+        lowerHighWaterMark();
+    }
+
+    // Allocate storage in buffer and initialize it with zeros.
+    char* allocateZeroed(SizeType size)
+    {
+        const SizeType dirtyEnd = _highWaterMark;
+        char* allocatedBuffer = allocate(size);
+        if (allocatedBuffer)
+        {
+            const SizeType begin = SizeType(allocatedBuffer - this->_buffer);
+            SizeType dirtySize = (begin < dirtyEnd) ? dirtyEnd - begin : 0;
+            if (dirtySize > size)
+                dirtySize = size;
+            zero(allocatedBuffer, dirtySize);
+            _zeroedBytes += dirtySize;
+            _zeroingSkippedBytes += size - dirtySize;
+        }
+        return allocatedBuffer;
+    }
+
+    // End of region that may contain non-zero data.
+    SizeType highWaterMark() const
+    {
+        return _highWaterMark;
+    }
+
+    // Max size observed since last call of resetPeakSize() (or init()).
+    SizeType peakSize() const
+    {
+        return _peakSize;
+    }
+
+    void resetPeakSize()
+    {
+        _peakSize = this->_allocatedSize;
+    }
+
+    // Number of bytes zeroed by allocateZeroed() since init().
+    unsigned long long zeroedBytes() const
+    {
+        return _zeroedBytes;
+    }
+
+    // Number of bytes zeroed by free() and freeAll() since init().
+    unsigned long long zeroedOnFreeBytes() const
+    {
+        return _zeroedOnFreeBytes;
+    }
+
+    // Number of bytes allocateZeroed() did not need to zero because they were still zero since init().
+    unsigned long long zeroingSkippedBytes() const
+    {
+        return _zeroingSkippedBytes;
+    }
+
+protected:
+    // Zero region between end of allocated storage and high-water mark
+    void lowerHighWaterMark()
+    {
+        if (_highWaterMark > this->_allocatedSize)
+        {
+            zero(this->_buffer + this->_allocatedSize, _highWaterMark - this->_allocatedSize);
+            _zeroedOnFreeBytes += _highWaterMark - this->_allocatedSize;
+            _highWaterMark = this->_allocatedSize;
+        }
+    }
+
+    static void zero(char* ptr, SizeType size)
+    {
+        if (nonTemporalThreshold && size >= nonTemporalThreshold && size >= 64)
+        {
+            char* end = ptr + size;
+            char* alignedBegin = reinterpret_cast<char*>((reinterpret_cast<unsigned long long>(ptr) + 31) & ~31ULL);
+            char* alignedEnd = reinterpret_cast<char*>(reinterpret_cast<unsigned long long>(end) & ~31ULL);
+            setMem(ptr, alignedBegin - ptr, 0);
+            const __m256i zeros = _mm256_setzero_si256();
+            for (char* p = alignedBegin; p < alignedEnd; p += 32)
+                _mm256_stream_si256(reinterpret_cast<__m256i*>(p), zeros);
+            _mm_sfence();
+            setMem(alignedEnd, end - alignedEnd, 0);
+        }
+        else if (size)
+        {
+            setMem(ptr, size, 0);
+        }
+    }
+
+    SizeType _highWaterMark;
+    SizeType _peakSize;
+    unsigned long long _zeroedBytes;
+    unsigned long long _zeroedOnFreeBytes;
+    unsigned long long _zeroingSkippedBytes;
+};
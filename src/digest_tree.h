@@ -0,0 +1,199 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/debugging.h"
+#include "platform/file_io.h"
+
+#include "kangaroo_twelve.h"
+
+// Computation of the digest trees of spectrum, universe, and computer at node startup distributed to all processors
+// (see runOnIdleProcessors in concurrency.h), and trusted digest tree files that can be loaded instead of recomputing
+// the tree if the checksum of the data matches.
+//
+// Digest trees are binary trees with numberOfLeafs (power of 2) leafs, stored level by level in an array of
+// 2 * numberOfLeafs - 1 digests (leafs first, root last), as in spectrumDigests, assetDigests, and contractStateDigests.
+
+// Run task(taskIndex, context) for all taskIndex < numberOfTasks, using the idle processors if available
+static void runTasksInParallel(unsigned long long numberOfTasks, void (*task)(unsigned long long taskIndex, void* context), void* context)
+{
+    struct Job
+    {
+        void (*task)(unsigned long long taskIndex, void* context);
+        void* context;
+        unsigned long long numberOfTasks;
+        volatile long long nextTask;
+
+        static void run(void* argument)
+        {
+            Job* job = (Job*)argument;
+            unsigned long long taskIndex;
+            while ((taskIndex = _InterlockedIncrement64(&job->nextTask) - 1) < job->numberOfTasks)
+            {
+                job->task(taskIndex, job->context);
+            }
+        }
+    } job;
+    job.task = task;
+    job.context = context;
+    job.numberOfTasks = numberOfTasks;
+    job.nextTask = 0;
+
+    if (runOnIdleProcessors && numberOfTasks > 1)
+    {
+        runOnIdleProcessors(Job::run, &job);
+    }
+    Job::run(&job);
+}
+
+// Compute digest tree. The leafs are computed with leafDigest(leafIndex, digest). Each task computes the subtree of
+// leafsPerTask leafs (power of 2), the levels above are computed by the calling processor.
+static void computeDigestTree(m256i* digests, unsigned long long numberOfLeafs, void (*leafDigest)(unsigned long long leafIndex, m256i& digest),
+    unsigned long long leafsPerTask)
+{
+    ASSERT((numberOfLeafs & (numberOfLeafs - 1)) == 0 && (leafsPerTask & (leafsPerTask - 1)) == 0);
+    if (leafsPerTask > numberOfLeafs)
+    {
+        leafsPerTask = numberOfLeafs;
+    }
+
+    struct Context
+    {
+        m256i* digests;
+        unsigned long long numberOfLeafs;
+        unsigned long long leafsPerTask;
+        void (*leafDigest)(unsigned long long leafIndex, m256i& digest);
+
+        static void subtree(unsigned long long taskIndex, void* argument)
+        {
+            const Context* context = (const Context*)argument;
+            const unsigned long long firstLeaf = taskIndex * context->leafsPerTask;
+            for (unsigned long long i = firstLeaf; i < firstLeaf + context->leafsPerTask; i++)
+            {
+                context->leafDigest(i, context->digests[i]);
+            }
+
+            unsigned long long previousLevelBeginning = 0;
+            unsigned long long levelSize = context->numberOfLeafs;
+            unsigned long long first = firstLeaf, count = context->leafsPerTask;
+            while (count > 1)
+            {
+                const unsigned long long levelBeginning = previousLevelBeginning + levelSize;
+                for (unsigned long long i = 0; i < count; i += 2)
+                {
+                    KangarooTwelve64To32(&context->digests[previousLevelBeginning + first + i], &context->digests[levelBeginning + ((first + i) >> 1)]);
+                }
+                previousLevelBeginning = levelBeginning;
+                levelSize >>= 1;
+                first >>= 1;
+                count >>= 1;
+            }
+        }
+    } context;
+    context.digests = digests;
+    context.numberOfLeafs = numberOfLeafs;
+    context.leafsPerTask = leafsPerTask;
+    context.leafDigest = leafDigest;
+    runTasksInParallel(numberOfLeafs / leafsPerTask, Context::subtree, &context);
+
+    // levels above the subtrees
+    unsigned long long previousLevelBeginning = 0;
+    unsigned long long numberOfNodes = numberOfLeafs;
+    while (numberOfNodes > 1)
+    {
+        const unsigned long long levelBeginning = previousLevelBeginning + numberOfNodes;
+        if (numberOfNodes <= numberOfLeafs / leafsPerTask)
+        {
+            for (unsigned long long i = 0; i < numberOfNodes; i += 2)
+            {
+                KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[levelBeginning + (i >> 1)]);
+            }
+        }
+        previousLevelBeginning = levelBeginning;
+        numberOfNodes >>= 1;
+    }
+}
+
+// Compute checksum of large buffer in parallel. Chunks of the buffer are hashed separately and the checksum is the
+// digest of the chunk digests. Returns false if memory cannot be allocated.
+static bool computeChecksum(const void* data, unsigned long long size, m256i& checksum)
+{
+    constexpr unsigned long long maxNumberOfChunks = 1024;
+    unsigned long long chunkSize = 16 * 1024 * 1024;
+    while ((size + chunkSize - 1) / chunkSize > maxNumberOfChunks)
+    {
+        chunkSize <<= 1;
+    }
+
+    struct Context
+    {
+        const unsigned char* data;
+        unsigned long long size;
+        unsigned long long chunkSize;
+        m256i chunkDigests[maxNumberOfChunks];
+
+        static void chunk(unsigned long long chunkIndex, void* argument)
+        {
+            Context* context = (Context*)argument;
+            const unsigned long long offset = chunkIndex * context->chunkSize;
+            const unsigned long long chunkSize = (context->size - offset < context->chunkSize) ? context->size - offset : context->chunkSize;
+            KangarooTwelve(context->data + offset, (unsigned int)chunkSize, &context->chunkDigests[chunkIndex], sizeof(m256i));
+        }
+    };
+    Context* context;
+    if (!allocatePool(sizeof(Context), (void**)&context))
+    {
+        logToConsole(L"Failed to allocate memory for checksum!");
+        return false;
+    }
+    context->data = (const unsigned char*)data;
+    context->size = size;
+    context->chunkSize = chunkSize;
+    const unsigned long long numberOfChunks = (size + chunkSize - 1) / chunkSize;
+    runTasksInParallel(numberOfChunks, Context::chunk, context);
+    KangarooTwelve(context->chunkDigests, (unsigned int)(numberOfChunks * sizeof(m256i)), &checksum, sizeof(checksum));
+    freePool(context);
+    return true;
+}
+
+
+static constexpr unsigned int digestTreeFileMagic = 0x45525444; // "DTRE"
+
+struct DigestTreeFileHeader
+{
+    unsigned int magic;
+    unsigned int reserved;
+    unsigned long long dataSize;
+    m256i dataChecksum;             // computeChecksum() of the data the tree has been computed from
+};
+
+// Save digest tree with checksum of data, so it can be loaded with loadDigestTree() instead of recomputing it
+static bool saveDigestTree(const CHAR16* fileName, const CHAR16* directory, const void* data, unsigned long long dataSize,
+    const m256i* digests, unsigned long long digestsSize)
+{
+    DigestTreeFileHeader header;
+    header.magic = digestTreeFileMagic;
+    header.reserved = 0;
+    header.dataSize = dataSize;
+    return computeChecksum(data, dataSize, header.dataChecksum)
+        && append(fileName, sizeof(header), (const unsigned char*)&header, directory, true) == sizeof(header)
+        && append(fileName, digestsSize, (const unsigned char*)digests, directory) == (long long)digestsSize;
+}
+
+// Load digest tree saved with saveDigestTree() if it has been computed from the same data. Returns false if the file
+// is missing or invalid, or if the data has changed (digests need to be recomputed in this case).
+static bool loadDigestTree(const CHAR16* fileName, const CHAR16* directory, const void* data, unsigned long long dataSize,
+    m256i* digests, unsigned long long digestsSize)
+{
+    DigestTreeFileHeader header;
+    m256i dataChecksum;
+    if (getFileSize((CHAR16*)fileName, (CHAR16*)directory) != (long long)(sizeof(header) + digestsSize)
+        || load(fileName, sizeof(header), (unsigned char*)&header, directory) != sizeof(header)
+        || header.magic != digestTreeFileMagic || header.dataSize != dataSize
+        || !computeChecksum(data, dataSize, dataChecksum) || header.dataChecksum != dataChecksum)
+    {
+        return false;
+    }
+    return load(fileName, digestsSize, (unsigned char*)digests, directory, sizeof(header)) == (long long)digestsSize;
+}
@@ -0,0 +1,605 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/debugging.h"
+#include "platform/file_io.h"
+
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+#include "kangaroo_twelve.h"
+#include "public_settings.h"
+
+// Sequential archive of the finalized ticks of an epoch for external indexers, which can ingest an epoch with
+// sequential reads instead of requesting tick data and transactions tick by tick (see tools/epoch_archive_reader).
+//
+// File format (one file per epoch):
+// - EpochArchiveFileHeader
+// - One record per finalized tick: EpochArchiveTickRecord, followed by EpochArchiveQuorumTick, TickData (if the tick
+//   is not empty), and the transactions of the tick in the order of TickData::transactionDigests (each transaction
+//   padded to a multiple of 8 bytes). The checksum covers all data following the EpochArchiveTickRecord.
+// - At the end of the epoch: one EpochArchiveIndexEntry per record followed by EpochArchiveFooter.
+// If the node has been stopped before the end of the epoch, the index and footer are missing and the records have to
+// be scanned sequentially (each record contains its size).
+//
+// Records are serialized to memory by the tick processor and appended to the file by the main loop, because file I/O
+// is only possible on the main processor. Two buffers are used, so the tick processor can continue while the main loop
+// writes. If both buffers are full, the tick is not archived and the archive of the epoch is marked as incomplete (the
+// missing ticks can be detected by readers, because records contain the tick number).
+//
+// After a restart within the epoch, reopen() continues the existing file: the valid records are kept and indexed,
+// a partially written record at the end is cut off, and ticks that are already archived are not added again.
+
+static constexpr unsigned int epochArchiveMagic = 0x43524151;           // "QARC"
+static constexpr unsigned int epochArchiveRecordMagic = 0x4b434954;     // "TICK"
+static constexpr unsigned int epochArchiveFooterMagic = 0x58444e49;     // "INDX"
+static constexpr unsigned int epochArchiveVersion = 1;
+
+struct EpochArchiveFileHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned short epoch;
+    unsigned short reserved0;
+    unsigned int initialTick;
+    unsigned int tickDataSize;      // sizeof(TickData), for detecting incompatible archives
+    unsigned int reserved1;
+};
+
+// Fields of the votes of a tick that all computors in the quorum agree on
+struct EpochArchiveQuorumTick
+{
+    unsigned short millisecond;
+    unsigned char second;
+    unsigned char minute;
+    unsigned char hour;
+    unsigned char day;
+    unsigned char month;
+    unsigned char year;
+
+    unsigned long long prevResourceTestingDigest;
+
+    m256i prevSpectrumDigest;
+    m256i prevUniverseDigest;
+    m256i prevComputerDigest;
+    m256i transactionDigest;
+    m256i expectedNextTickTransactionDigest;
+};
+
+struct EpochArchiveTickRecord
+{
+    enum
+    {
+        flagHasTickData = 1,
+    };
+
+    unsigned int magic;
+    unsigned int tick;
+    unsigned long long size;                // total size of record including this header
+    unsigned long long checksum;            // K12 of the data following this header
+    unsigned short numberOfTransactions;
+    unsigned short numberOfQuorumVotes;
+    unsigned int flags;
+};
+
+struct EpochArchiveIndexEntry
+{
+    unsigned int tick;
+    unsigned int reserved;
+    unsigned long long fileOffset;          // offset of EpochArchiveTickRecord in file
+};
+
+struct EpochArchiveFooter
+{
+    unsigned int magic;
+    unsigned int numberOfRecords;
+    unsigned long long indexOffset;         // offset of first EpochArchiveIndexEntry in file
+    unsigned long long indexChecksum;       // K12 of all EpochArchiveIndexEntry
+    unsigned int incomplete;                // 1 if ticks are missing (node could not write fast enough or was restarted)
+    unsigned int reserved;
+};
+
+static_assert(sizeof(EpochArchiveFileHeader) == 24, "Unexpected struct size");
+static_assert(sizeof(EpochArchiveQuorumTick) == 8 + 8 + 5 * 32, "Unexpected struct size");
+static_assert(sizeof(EpochArchiveTickRecord) == 32, "Unexpected struct size");
+static_assert(sizeof(EpochArchiveIndexEntry) == 16, "Unexpected struct size");
+static_assert(sizeof(EpochArchiveFooter) == 32, "Unexpected struct size");
+
+static inline unsigned long long epochArchiveChecksum(const void* data, unsigned long long size)
+{
+    unsigned long long checksum;
+    KangarooTwelve(data, (unsigned int)size, &checksum, sizeof(checksum));
+    return checksum;
+}
+
+static constexpr unsigned long long epochArchivePaddedSize(unsigned long long size)
+{
+    return (size + 7) & ~7ULL;
+}
+
+
+class EpochArchiveWriter
+{
+public:
+    // Allocate buffers at node startup. bufferSize is the size of each of the two buffers and needs to be larger than
+    // the largest possible tick record.
+    bool init(const CHAR16* directory, unsigned int maxNumberOfTicks, unsigned long long bufferSize)
+    {
+        ASSERT(bufferSize >= maxRecordSize());
+        this->directory = directory;
+        this->maxNumberOfTicks = maxNumberOfTicks;
+        this->bufferSize = bufferSize;
+        if (!allocatePool(bufferSize, (void**)&buffers[0])
+            || !allocatePool(bufferSize, (void**)&buffers[1])
+            || !allocatePool(maxNumberOfTicks * sizeof(EpochArchiveIndexEntry), (void**)&index))
+        {
+            logToConsole(L"Failed to allocate epoch archive memory!");
+            return false;
+        }
+        bufferUsed[0] = bufferUsed[1] = 0;
+        activeBuffer = 0;
+        numberOfRecords = 0;
+        fileSize = 0;
+        epoch = 0;
+        ending = false;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (buffers[0])
+            freePool(buffers[0]);
+        if (buffers[1])
+            freePool(buffers[1]);
+        if (index)
+            freePool(index);
+        buffers[0] = buffers[1] = nullptr;
+        index = nullptr;
+    }
+
+    // Start archive file of new epoch. The archive of the previous epoch needs to be written completely before
+    // (see endEpoch()).
+    void beginEpoch(unsigned short epoch, unsigned int initialTick)
+    {
+        ACQUIRE(lock);
+        ASSERT(!bufferUsed[0] && !bufferUsed[1]);
+        this->epoch = epoch;
+        this->initialTick = initialTick;
+        setText(fileName, L"archive.???");
+        addEpochToFileName(fileName, getTextSize(fileName, sizeof(fileName) / sizeof(fileName[0])) + 1, epoch);
+        truncateFile = true;
+        numberOfRecords = 0;
+        lastArchivedTick = 0;
+        incomplete = false;
+
+        EpochArchiveFileHeader* header = (EpochArchiveFileHeader*)buffers[activeBuffer];
+        setMem(header, sizeof(EpochArchiveFileHeader), 0);
+        header->magic = epochArchiveMagic;
+        header->version = epochArchiveVersion;
+        header->epoch = epoch;
+        header->initialTick = initialTick;
+        header->tickDataSize = sizeof(TickData);
+        bufferUsed[activeBuffer] = sizeof(EpochArchiveFileHeader);
+        fileSize = sizeof(EpochArchiveFileHeader);
+        RELEASE(lock);
+    }
+
+    // Continue archive file of the current epoch that has been written before the node was restarted, instead of
+    // overwriting it. nextTick is the first tick that will be processed after the restart. Returns false if there is
+    // no usable file (then a new file is started). Called by main processor at startup after beginEpoch(), before ticks
+    // are added.
+    bool reopen(unsigned int nextTick)
+    {
+        ASSERT(epoch && truncateFile && numberOfRecords == 0);
+        const long long existingFileSize = getFileSize(fileName, (CHAR16*)directory);
+        unsigned char* scanBuffer = buffers[activeBuffer ^ 1];
+        if (existingFileSize < (long long)sizeof(EpochArchiveFileHeader)
+            || load(fileName, sizeof(EpochArchiveFileHeader), scanBuffer, directory) != sizeof(EpochArchiveFileHeader)
+            || !bufferUsed[activeBuffer] || !isSameHeader(scanBuffer, buffers[activeBuffer]))
+        {
+            return false;
+        }
+
+        // Index records of the file chunk by chunk, stopping at the first record that is incomplete or corrupted. The
+        // index and footer written at the end of the epoch are also cut off, they are written again by flush().
+        unsigned long long offset = sizeof(EpochArchiveFileHeader);
+        unsigned int previousTick = 0;
+        bool endOfRecords = false;
+        while (!endOfRecords && offset < (unsigned long long)existingFileSize)
+        {
+            const unsigned long long chunkSize = (existingFileSize - offset < bufferSize) ? existingFileSize - offset : bufferSize;
+            if (load(fileName, chunkSize, scanBuffer, directory, offset) != (long long)chunkSize)
+            {
+                logToConsole(L"Failed to read epoch archive, starting new file!");
+                numberOfRecords = 0;
+                incomplete = false;
+                return false;
+            }
+            unsigned long long position = 0;
+            while (!endOfRecords && position + sizeof(EpochArchiveTickRecord) <= chunkSize)
+            {
+                const EpochArchiveTickRecord* record = (const EpochArchiveTickRecord*)(scanBuffer + position);
+                if (record->magic != epochArchiveRecordMagic || record->size < sizeof(EpochArchiveTickRecord) || record->size > maxRecordSize()
+                    || numberOfRecords >= maxNumberOfTicks || (numberOfRecords && record->tick <= previousTick))
+                {
+                    endOfRecords = true;
+                }
+                else if (position + record->size > chunkSize)
+                {
+                    // record continues in next chunk (records are smaller than the buffer)
+                    break;
+                }
+                else if (epochArchiveChecksum(scanBuffer + position + sizeof(EpochArchiveTickRecord), record->size - sizeof(EpochArchiveTickRecord)) != record->checksum)
+                {
+                    endOfRecords = true;
+                }
+                else
+                {
+                    if (numberOfRecords && record->tick != previousTick + 1)
+                    {
+                        incomplete = true;
+                    }
+                    index[numberOfRecords].tick = record->tick;
+                    index[numberOfRecords].reserved = 0;
+                    index[numberOfRecords].fileOffset = offset + position;
+                    ++numberOfRecords;
+                    previousTick = record->tick;
+                    position += record->size;
+                }
+            }
+            if (offset + chunkSize == (unsigned long long)existingFileSize && !endOfRecords)
+            {
+                // last chunk ends with partially written record
+                endOfRecords = true;
+            }
+            offset += position;
+        }
+
+        if (offset < (unsigned long long)existingFileSize && !setFileSize(fileName, offset, directory))
+        {
+            logToConsole(L"Failed to cut off end of epoch archive, starting new file!");
+            numberOfRecords = 0;
+            incomplete = false;
+            return false;
+        }
+
+        ACQUIRE(lock);
+        // header is already in the file
+        bufferUsed[activeBuffer] = 0;
+        fileSize = offset;
+        truncateFile = false;
+        lastArchivedTick = previousTick;
+        if ((numberOfRecords && index[0].tick != initialTick) || ((numberOfRecords) ? previousTick + 1 : initialTick) < nextTick)
+        {
+            // ticks processed before the restart are missing
+            incomplete = true;
+        }
+        RELEASE(lock);
+
+        CHAR16 text[64];
+        setText(text, L"Continuing epoch archive with ");
+        appendNumber(text, numberOfRecords, TRUE);
+        appendText(text, L" ticks");
+        logToConsole(text);
+        return true;
+    }
+
+    // Serialize finalized tick. tickData is nullptr for empty ticks, quorumTick is the vote the quorum agreed on, and
+    // transactions are the transactions of the tick. Returns false if there is no space in the buffer. Called by tick
+    // processor.
+    bool addTick(unsigned int tick, const TickData* tickData, const Tick& quorumTick, unsigned short numberOfQuorumVotes,
+        const Transaction* const* transactions, unsigned int numberOfTransactions)
+    {
+        unsigned long long recordSize = sizeof(EpochArchiveTickRecord) + sizeof(EpochArchiveQuorumTick);
+        if (tickData)
+            recordSize += sizeof(TickData);
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+            recordSize += epochArchivePaddedSize(transactions[i]->totalSize());
+
+        ACQUIRE(lock);
+        if (numberOfRecords && tick <= lastArchivedTick)
+        {
+            // already archived before restart (see reopen())
+            RELEASE(lock);
+            return true;
+        }
+        if (!epoch || numberOfRecords >= maxNumberOfTicks || bufferUsed[activeBuffer] + recordSize > bufferSize)
+        {
+            incomplete = true;
+            RELEASE(lock);
+            return false;
+        }
+
+        unsigned char* recordPtr = buffers[activeBuffer] + bufferUsed[activeBuffer];
+        EpochArchiveTickRecord* record = (EpochArchiveTickRecord*)recordPtr;
+        record->magic = epochArchiveRecordMagic;
+        record->tick = tick;
+        record->size = recordSize;
+        record->numberOfTransactions = numberOfTransactions;
+        record->numberOfQuorumVotes = numberOfQuorumVotes;
+        record->flags = (tickData) ? EpochArchiveTickRecord::flagHasTickData : 0;
+
+        unsigned char* data = recordPtr + sizeof(EpochArchiveTickRecord);
+        EpochArchiveQuorumTick quorum;
+        copyMem(&quorum, &quorumTick.millisecond, 8);
+        quorum.prevResourceTestingDigest = quorumTick.prevResourceTestingDigest;
+        quorum.prevSpectrumDigest = quorumTick.prevSpectrumDigest;
+        quorum.prevUniverseDigest = quorumTick.prevUniverseDigest;
+        quorum.prevComputerDigest = quorumTick.prevComputerDigest;
+        quorum.transactionDigest = quorumTick.transactionDigest;
+        quorum.expectedNextTickTransactionDigest = quorumTick.expectedNextTickTransactionDigest;
+        copyMem(data, &quorum, sizeof(quorum));
+        data += sizeof(quorum);
+        if (tickData)
+        {
+            copyMem(data, tickData, sizeof(TickData));
+            data += sizeof(TickData);
+        }
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+        {
+            const unsigned int size = transactions[i]->totalSize();
+            const unsigned long long paddedSize = epochArchivePaddedSize(size);
+            copyMem(data, transactions[i], size);
+            if (paddedSize > size)
+                setMem(data + size, paddedSize - size, 0);
+            data += paddedSize;
+        }
+        ASSERT(data == recordPtr + recordSize);
+        record->checksum = epochArchiveChecksum(recordPtr + sizeof(EpochArchiveTickRecord), recordSize - sizeof(EpochArchiveTickRecord));
+
+        index[numberOfRecords].tick = tick;
+        index[numberOfRecords].reserved = 0;
+        index[numberOfRecords].fileOffset = fileSize;
+        ++numberOfRecords;
+        lastArchivedTick = tick;
+        fileSize += recordSize;
+        bufferUsed[activeBuffer] += recordSize;
+        RELEASE(lock);
+        return true;
+    }
+
+    // Request writing index and footer of current epoch. Called by tick processor at the end of the epoch, which has
+    // to wait until isEnding() returns false before calling beginEpoch().
+    void endEpoch()
+    {
+        ACQUIRE(lock);
+        ending = true;
+        RELEASE(lock);
+    }
+
+    bool isEnding() const
+    {
+        return ending;
+    }
+
+    // Write serialized data to file. Called by main loop.
+    void flush()
+    {
+        // ending is read together with swapping the buffers, so all ticks added before endEpoch() are in flushBuffer
+        ACQUIRE(lock);
+        const bool end = ending;
+        const unsigned int flushBuffer = activeBuffer;
+        if (!bufferUsed[flushBuffer] && !end)
+        {
+            RELEASE(lock);
+            return;
+        }
+        // other buffer is empty, because it has been written in the previous call
+        activeBuffer ^= 1;
+        const bool truncate = truncateFile;
+        truncateFile = false;
+        RELEASE(lock);
+
+        if (bufferUsed[flushBuffer])
+        {
+            if (append(fileName, bufferUsed[flushBuffer], buffers[flushBuffer], directory, truncate) != (long long)bufferUsed[flushBuffer])
+            {
+                logToConsole(L"Failed to write epoch archive!");
+                incomplete = true;
+            }
+            bufferUsed[flushBuffer] = 0;
+        }
+
+        if (end)
+        {
+            // write index and footer only after all records have been written (tick processor does not add ticks
+            // while ending)
+            ACQUIRE(lock);
+            const bool drained = !bufferUsed[0] && !bufferUsed[1];
+            RELEASE(lock);
+            if (!drained)
+            {
+                return;
+            }
+
+            const unsigned long long indexSize = numberOfRecords * sizeof(EpochArchiveIndexEntry);
+            EpochArchiveFooter footer;
+            footer.magic = epochArchiveFooterMagic;
+            footer.numberOfRecords = numberOfRecords;
+            footer.indexOffset = fileSize;
+            footer.indexChecksum = epochArchiveChecksum(index, indexSize);
+            footer.incomplete = (incomplete) ? 1 : 0;
+            footer.reserved = 0;
+            if (epoch
+                && (append(fileName, indexSize, (unsigned char*)index, directory) != (long long)indexSize
+                    || append(fileName, sizeof(footer), (unsigned char*)&footer, directory) != sizeof(footer)))
+            {
+                logToConsole(L"Failed to write index of epoch archive!");
+            }
+            ACQUIRE(lock);
+            epoch = 0;
+            ending = false;
+            RELEASE(lock);
+        }
+    }
+
+    unsigned int recordCount() const
+    {
+        return numberOfRecords;
+    }
+
+    bool isIncomplete() const
+    {
+        return incomplete;
+    }
+
+    static constexpr unsigned long long maxRecordSize()
+    {
+        return sizeof(EpochArchiveTickRecord) + sizeof(EpochArchiveQuorumTick) + sizeof(TickData)
+            + NUMBER_OF_TRANSACTIONS_PER_TICK * epochArchivePaddedSize(MAX_TRANSACTION_SIZE);
+    }
+
+private:
+    static bool isSameHeader(const unsigned char* a, const unsigned char* b)
+    {
+        const EpochArchiveFileHeader* headerA = (const EpochArchiveFileHeader*)a;
+        const EpochArchiveFileHeader* headerB = (const EpochArchiveFileHeader*)b;
+        return headerA->magic == headerB->magic && headerA->version == headerB->version && headerA->epoch == headerB->epoch
+            && headerA->initialTick == headerB->initialTick && headerA->tickDataSize == headerB->tickDataSize;
+    }
+
+    const CHAR16* directory = nullptr;
+    CHAR16 fileName[16];
+    unsigned char* buffers[2] = { nullptr, nullptr };
+    unsigned long long bufferUsed[2] = { 0, 0 };
+    unsigned long long bufferSize = 0;
+    unsigned int activeBuffer = 0;
+    EpochArchiveIndexEntry* index = nullptr;
+    unsigned int maxNumberOfTicks = 0;
+    unsigned int numberOfRecords = 0;
+    unsigned long long fileSize = 0;
+    unsigned int initialTick = 0;
+    unsigned int lastArchivedTick = 0;
+    unsigned short epoch = 0;
+    bool truncateFile = false;
+    bool incomplete = false;
+    volatile bool ending = false;
+    volatile char lock = 0;
+};
+
+
+// Parse archive file that has been loaded to memory
+class EpochArchiveReader
+{
+public:
+    struct TickView
+    {
+        EpochArchiveTickRecord record;
+        EpochArchiveQuorumTick quorumTick;
+        unsigned long long fileOffset;
+        const unsigned char* tickData;      // sizeof(TickData) bytes or nullptr if tick is empty (not aligned, copy before use)
+        const unsigned char* transactions;  // record.numberOfTransactions transactions, see nextTransaction()
+    };
+
+    // Init with file content. Returns false if the file header is invalid.
+    bool init(const unsigned char* data, unsigned long long size)
+    {
+        this->data = data;
+        this->size = size;
+        position = sizeof(EpochArchiveFileHeader);
+        indexed = false;
+        if (size < sizeof(EpochArchiveFileHeader))
+            return false;
+        copyMem(&header, data, sizeof(header));
+        if (header.magic != epochArchiveMagic || header.version != epochArchiveVersion || header.tickDataSize != sizeof(TickData))
+            return false;
+
+        // check footer and index
+        recordsEnd = size;
+        if (size >= sizeof(EpochArchiveFileHeader) + sizeof(EpochArchiveFooter))
+        {
+            copyMem(&footer, data + size - sizeof(EpochArchiveFooter), sizeof(footer));
+            const unsigned long long indexSize = footer.numberOfRecords * sizeof(EpochArchiveIndexEntry);
+            if (footer.magic == epochArchiveFooterMagic && footer.indexOffset >= sizeof(EpochArchiveFileHeader)
+                && footer.indexOffset + indexSize + sizeof(EpochArchiveFooter) == size
+                && epochArchiveChecksum(data + footer.indexOffset, indexSize) == footer.indexChecksum)
+            {
+                indexed = true;
+                recordsEnd = footer.indexOffset;
+            }
+        }
+        return true;
+    }
+
+    const EpochArchiveFileHeader& getHeader() const
+    {
+        return header;
+    }
+
+    // Return true if the archive has a valid index and footer (epoch has been archived until the end)
+    bool hasIndex() const
+    {
+        return indexed;
+    }
+
+    // Return footer (only valid if hasIndex())
+    const EpochArchiveFooter& getFooter() const
+    {
+        return footer;
+    }
+
+    // Return index entry i (only valid if hasIndex())
+    EpochArchiveIndexEntry indexEntry(unsigned int i) const
+    {
+        ASSERT(indexed && i < footer.numberOfRecords);
+        EpochArchiveIndexEntry entry;
+        copyMem(&entry, data + footer.indexOffset + i * sizeof(EpochArchiveIndexEntry), sizeof(entry));
+        return entry;
+    }
+
+    // Move to record at file offset (for random access using the index)
+    void seek(unsigned long long fileOffset)
+    {
+        position = fileOffset;
+    }
+
+    // Read next tick record. Returns false at the end of the records or if the data is corrupted (see isComplete()).
+    bool nextTick(TickView& tick)
+    {
+        corrupted = false;
+        if (position + sizeof(EpochArchiveTickRecord) > recordsEnd)
+            return false;
+        copyMem(&tick.record, data + position, sizeof(tick.record));
+        const bool hasTickData = (tick.record.flags & EpochArchiveTickRecord::flagHasTickData) != 0;
+        const unsigned long long minSize = sizeof(EpochArchiveTickRecord) + sizeof(EpochArchiveQuorumTick) + ((hasTickData) ? sizeof(TickData) : 0);
+        if (tick.record.magic != epochArchiveRecordMagic || tick.record.size < minSize || position + tick.record.size > recordsEnd
+            || epochArchiveChecksum(data + position + sizeof(EpochArchiveTickRecord), tick.record.size - sizeof(EpochArchiveTickRecord)) != tick.record.checksum)
+        {
+            corrupted = true;
+            return false;
+        }
+        const unsigned char* recordData = data + position + sizeof(EpochArchiveTickRecord);
+        copyMem(&tick.quorumTick, recordData, sizeof(tick.quorumTick));
+        tick.fileOffset = position;
+        tick.tickData = (hasTickData) ? recordData + sizeof(EpochArchiveQuorumTick) : nullptr;
+        tick.transactions = data + position + minSize;
+        position += tick.record.size;
+        return true;
+    }
+
+    // Return true if the last call of nextTick() returned false because all records have been read
+    bool isComplete() const
+    {
+        return !corrupted && position == recordsEnd;
+    }
+
+    // Copy header of transaction at ptr to transaction and return pointer to the transaction following it (transactions
+    // of a record are stored consecutively)
+    static const unsigned char* nextTransaction(const unsigned char* ptr, Transaction& transaction)
+    {
+        copyMem(&transaction, ptr, sizeof(Transaction));
+        return ptr + epochArchivePaddedSize(transaction.totalSize());
+    }
+
+private:
+    const unsigned char* data = nullptr;
+    unsigned long long size = 0;
+    unsigned long long position = 0;
+    unsigned long long recordsEnd = 0;
+    EpochArchiveFileHeader header;
+    EpochArchiveFooter footer;
+    bool indexed = false;
+    bool corrupted = false;
+};
@@ -1832,5 +1832,5 @@ static bool verify(const unsigned char* publicKey, const unsigned char* messageD
 
     encode(A, (unsigned char*)A);
 
-    return *((__m256i*)A) == *((__m256i*)signature);
+    return *((m256i*)A) == *((m256i*)signature);
 }
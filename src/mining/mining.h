@@ -1,3 +1,5 @@
+#pragma once
+
 struct MiningSolutionTransaction : public Transaction
 {
 	static constexpr unsigned char transactionType()
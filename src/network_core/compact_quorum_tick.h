@@ -0,0 +1,117 @@
+// encoding of tick votes in CompactQuorumTick messages, for transferring the votes of many ticks to catching-up nodes
+
+#pragma once
+
+#include "platform/memory.h"
+
+#include "network_messages/tick.h"
+
+
+// Size of CompactQuorumTick payload with the given number of votes
+static constexpr unsigned int compactQuorumTickSize(unsigned int numberOfVotes)
+{
+    return sizeof(CompactQuorumTick) + numberOfVotes * sizeof(CompactVote);
+}
+
+// Return true if the votes agree on all fields that are not in CompactVote
+static bool haveSameSharedVoteFields(const Tick& a, const Tick& b)
+{
+    return a.epoch == b.epoch
+        && a.tick == b.tick
+        && *((unsigned long long*)&a.millisecond) == *((unsigned long long*)&b.millisecond)
+        && a.prevResourceTestingDigest == b.prevResourceTestingDigest
+        && a.prevSpectrumDigest == b.prevSpectrumDigest
+        && a.prevUniverseDigest == b.prevUniverseDigest
+        && a.prevComputerDigest == b.prevComputerDigest
+        && a.transactionDigest == b.transactionDigest
+        && a.expectedNextTickTransactionDigest == b.expectedNextTickTransactionDigest;
+}
+
+static void compactVote(const Tick& vote, CompactVote& compactVote)
+{
+    compactVote.saltedResourceTestingDigest = vote.saltedResourceTestingDigest;
+    copyMem(compactVote.saltedSpectrumDigest, &vote.saltedSpectrumDigest, 32);
+    copyMem(compactVote.saltedUniverseDigest, &vote.saltedUniverseDigest, 32);
+    copyMem(compactVote.saltedComputerDigest, &vote.saltedComputerDigest, 32);
+    copyMem(compactVote.signature, vote.signature, SIGNATURE_SIZE);
+}
+
+// Reconstruct vote of computor from the shared vote of the message and the computor's CompactVote
+static void expandCompactVote(const CompactQuorumTick& message, unsigned short computorIndex, const CompactVote& compactVote, Tick& vote)
+{
+    copyMem(&vote, &message.sharedVote, sizeof(Tick));
+    vote.computorIndex = computorIndex;
+    vote.saltedResourceTestingDigest = compactVote.saltedResourceTestingDigest;
+    copyMem(&vote.saltedSpectrumDigest, compactVote.saltedSpectrumDigest, 32);
+    copyMem(&vote.saltedUniverseDigest, compactVote.saltedUniverseDigest, 32);
+    copyMem(&vote.saltedComputerDigest, compactVote.saltedComputerDigest, 32);
+    copyMem(vote.signature, compactVote.signature, SIGNATURE_SIZE);
+}
+
+// Return number of votes in message with payloadSize bytes or -1 if the size does not match the vote flags
+static int getNumberOfCompactVotes(const CompactQuorumTick* message, unsigned int payloadSize)
+{
+    if (payloadSize < sizeof(CompactQuorumTick))
+    {
+        return -1;
+    }
+    unsigned int numberOfVotes = 0;
+    for (unsigned int i = 0; i < sizeof(message->voteFlags); i++)
+    {
+        numberOfVotes += __popcnt(message->voteFlags[i]);
+    }
+    return (numberOfVotes <= NUMBER_OF_COMPUTORS && payloadSize == compactQuorumTickSize(numberOfVotes)) ? (int)numberOfVotes : -1;
+}
+
+// Find the shared fields that most votes of a tick agree on. Only the first maxNumberOfCandidates different variants
+// are counted, which is enough because honest computors agree and sending the other votes in full is just less compact.
+class SharedVoteSelector
+{
+public:
+    static constexpr unsigned int maxNumberOfCandidates = 4;
+
+    void reset()
+    {
+        numberOfCandidates = 0;
+    }
+
+    void add(const Tick& vote)
+    {
+        for (unsigned int i = 0; i < numberOfCandidates; i++)
+        {
+            if (haveSameSharedVoteFields(candidates[i], vote))
+            {
+                counts[i]++;
+                return;
+            }
+        }
+        if (numberOfCandidates < maxNumberOfCandidates)
+        {
+            copyMem(&candidates[numberOfCandidates], &vote, sizeof(Tick));
+            counts[numberOfCandidates++] = 1;
+        }
+    }
+
+    // Return vote with the most common shared fields or nullptr if no vote has been added
+    const Tick* get() const
+    {
+        if (!numberOfCandidates)
+        {
+            return nullptr;
+        }
+        unsigned int best = 0;
+        for (unsigned int i = 1; i < numberOfCandidates; i++)
+        {
+            if (counts[i] > counts[best])
+            {
+                best = i;
+            }
+        }
+        return &candidates[best];
+    }
+
+private:
+    Tick candidates[maxNumberOfCandidates];
+    unsigned int counts[maxNumberOfCandidates];
+    unsigned int numberOfCandidates = 0;
+};
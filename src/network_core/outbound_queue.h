@@ -0,0 +1,436 @@
+// per-peer sending buffers with priority classes, so consensus messages are never delayed by bulk query responses
+
+#pragma once
+
+#include "platform/memory.h"
+
+#include "network_messages/header.h"
+#include "network_messages/common_response.h"
+#include "network_messages/public_peers.h"
+#include "network_messages/broadcast_message.h"
+#include "network_messages/computors.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+
+// Priority classes of messages sent to peers. Each peer has one sending buffer per class. When a transmission is
+// started, all buffered consensus messages are sent first. Transactions and query responses share the remaining
+// bandwidth by weighted (deficit) round robin, with one round per transmission. Thus, consensus messages wait for at
+// most one round of lower priority data, independently of how many bulk responses are queued.
+enum OutboundPriority
+{
+    OUTBOUND_PRIORITY_CONSENSUS = 0,
+    OUTBOUND_PRIORITY_TRANSACTIONS,
+    OUTBOUND_PRIORITY_QUERIES,
+    NUMBER_OF_OUTBOUND_PRIORITIES
+};
+
+// Bytes that each class may send per round (weights of round robin), consensus is not limited
+static constexpr unsigned int outboundQuantum[NUMBER_OF_OUTBOUND_PRIORITIES] = { 0, 512 * 1024, 128 * 1024 };
+
+// Share of the sending buffer memory of each class in eighths (query class needs to fit messages of maximum size)
+static constexpr unsigned int outboundBufferEighths[NUMBER_OF_OUTBOUND_PRIORITIES] = { 1, 1, 6 };
+
+// Flow control: a peer is congested if more than the high watermark is buffered, until less than the low watermark
+// is buffered (in eighths of the sending buffer memory). New query messages are dropped while the peer is congested,
+// transactions are dropped if their buffer is full. Only if the consensus buffer is full, the peer is too slow to keep.
+static constexpr unsigned int outboundHighWatermarkEighths = 4;
+static constexpr unsigned int outboundLowWatermarkEighths = 2;
+
+// Batching: consecutive messages of up to outboundMaxBatchedMessageSize bytes of the same class are packed into
+// BatchedMessages containers of up to outboundMaxBatchSize bytes if the peer supports it.
+static constexpr unsigned int outboundMaxBatchedMessageSize = 2048;
+static constexpr unsigned int outboundMaxBatchSize = 65536;
+
+enum OutboundPushResult
+{
+    OUTBOUND_PUSHED = 0,
+    OUTBOUND_DROPPED,
+    OUTBOUND_FULL
+};
+
+static unsigned char outboundPriorityOfMessageType[256];
+
+// Statistics of time (in CPU ticks) between adding a message to the sending buffer and starting its transmission,
+// only accessed by main thread
+static unsigned long long outboundQueueingTimeNumerator[NUMBER_OF_OUTBOUND_PRIORITIES] = { 0 };
+static unsigned long long outboundQueueingTimeDenominator[NUMBER_OF_OUTBOUND_PRIORITIES] = { 0 };
+static unsigned long long outboundQueueingTimeMax[NUMBER_OF_OUTBOUND_PRIORITIES] = { 0 };
+
+static void initOutboundPriorities()
+{
+    setMem(outboundPriorityOfMessageType, sizeof(outboundPriorityOfMessageType), OUTBOUND_PRIORITY_QUERIES);
+
+    outboundPriorityOfMessageType[ExchangePublicPeers::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[BroadcastComputors::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[RequestComputors::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[BroadcastTick::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[BroadcastFutureTickData::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[RequestQuorumTick::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[RequestCompactQuorumTicks::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[CompactQuorumTick::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[RequestTickData::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[TryAgain::type] = OUTBOUND_PRIORITY_CONSENSUS;
+    outboundPriorityOfMessageType[BatchedMessages::type] = OUTBOUND_PRIORITY_CONSENSUS;
+
+    outboundPriorityOfMessageType[BROADCAST_TRANSACTION] = OUTBOUND_PRIORITY_TRANSACTIONS;
+    outboundPriorityOfMessageType[REQUEST_TICK_TRANSACTIONS] = OUTBOUND_PRIORITY_TRANSACTIONS;
+    outboundPriorityOfMessageType[BroadcastMessage::type] = OUTBOUND_PRIORITY_TRANSACTIONS;
+    outboundPriorityOfMessageType[AnnounceTransactions::type] = OUTBOUND_PRIORITY_TRANSACTIONS;
+    outboundPriorityOfMessageType[RequestAnnouncedTransactions::type] = OUTBOUND_PRIORITY_TRANSACTIONS;
+}
+
+struct OutboundQueue
+{
+    // Each buffered message is preceded by the time it has been pushed
+    struct Class
+    {
+        char* buffer;
+        unsigned int capacity;
+        unsigned int begin, end;
+        unsigned int numberOfMessages;
+        unsigned int deficit;
+    } classes[NUMBER_OF_OUTBOUND_PRIORITIES];
+
+    // Priority of the last message pushed per dejavu. Responses to a request have the dejavu of the request, so the
+    // EndResponse of a request can be sent with the same priority as the data and does not overtake it. If a message
+    // of a response is dropped, the rest of the response (until EndResponse or end of congestion) is dropped as well,
+    // so the requester does not receive an incomplete response that looks complete.
+    // Only responses to requests of the peer are tracked, broadcasts and own requests never end with EndResponse.
+    // The table is 4-way set associative and indexed by the lower bits of the dejavu. An entry is released by the
+    // EndResponse, otherwise the least recently used one is replaced. Entries of dropped responses are not replaced,
+    // instead a message is dropped if all entries of its set belong to dropped responses. An entry that has not been
+    // used by the last recentResponseMaxAge tracked messages is released, including dropped ones, because some
+    // responses (for example a single transaction) do not end with EndResponse.
+    static constexpr unsigned int recentResponseWays = 4;
+    static constexpr unsigned int recentResponseMaxAge = 256;
+    struct RecentResponse
+    {
+        unsigned int dejavu;
+        unsigned int lastUse; // 0 if entry is free
+        unsigned char priority;
+        bool dropped;
+    } recentResponses[64];
+    unsigned int recentResponseUseCounter;
+
+    unsigned int highWatermark, lowWatermark;
+    volatile bool congested;
+
+    // Split memory (BUFFER_SIZE of a peer) into the buffers of the classes
+    void init(char* memory, unsigned int memorySize)
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+        {
+            classes[i].buffer = memory;
+            classes[i].capacity = memorySize / 8 * outboundBufferEighths[i];
+            memory += classes[i].capacity;
+        }
+        highWatermark = memorySize / 8 * outboundHighWatermarkEighths;
+        lowWatermark = memorySize / 8 * outboundLowWatermarkEighths;
+        reset();
+    }
+
+    void reset()
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+        {
+            classes[i].begin = classes[i].end = 0;
+            classes[i].numberOfMessages = 0;
+            classes[i].deficit = 0;
+        }
+        setMem(recentResponses, sizeof(recentResponses), 0);
+        recentResponseUseCounter = 0;
+        congested = false;
+    }
+
+    bool isEmpty() const
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+        {
+            if (classes[i].numberOfMessages)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Size of buffered messages (without timestamps)
+    unsigned long long size(unsigned int priority) const
+    {
+        return classes[priority].end - classes[priority].begin - classes[priority].numberOfMessages * sizeof(unsigned long long);
+    }
+
+    unsigned long long size() const
+    {
+        unsigned long long totalSize = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+        {
+            totalSize += size(i);
+        }
+        return totalSize;
+    }
+
+    // Only the main thread pushes and fills, but request processors may check for congestion to end responses early
+    bool isCongested() const
+    {
+        return congested;
+    }
+
+    // Add message to buffer of its class. Set isResponse if the message belongs to a response to a request of the peer.
+    // Returns OUTBOUND_DROPPED if a transaction or query message is dropped due to flow control and OUTBOUND_FULL if a
+    // consensus message does not fit.
+    OutboundPushResult push(const RequestResponseHeader* header, unsigned long long now, bool isResponse)
+    {
+        RecentResponse* recentResponse = isResponse ? findRecentResponse(header->dejavu()) : nullptr;
+        unsigned char priority;
+        if (header->type() == EndResponse::type)
+        {
+            if (recentResponse)
+            {
+                priority = recentResponse->priority;
+                const bool dropped = recentResponse->dropped;
+                recentResponse->lastUse = 0;
+                recentResponse = nullptr;
+                if (dropped)
+                {
+                    return OUTBOUND_DROPPED;
+                }
+            }
+            else
+            {
+                priority = OUTBOUND_PRIORITY_QUERIES;
+            }
+        }
+        else
+        {
+            priority = outboundPriorityOfMessageType[header->type()];
+            if (isResponse)
+            {
+                if (!recentResponse)
+                {
+                    recentResponse = allocRecentResponse(header->dejavu());
+                    if (!recentResponse && priority != OUTBOUND_PRIORITY_CONSENSUS)
+                    {
+                        // Cannot track response without replacing one that is being dropped
+                        return OUTBOUND_DROPPED;
+                    }
+                }
+                if (!++recentResponseUseCounter)
+                {
+                    recentResponseUseCounter = 1;
+                }
+                if (recentResponse)
+                {
+                    // Dropped response is kept alive by its remaining messages until it ends or ages out
+                    recentResponse->lastUse = recentResponseUseCounter;
+                    if (recentResponse->dropped && priority != OUTBOUND_PRIORITY_CONSENSUS)
+                    {
+                        return OUTBOUND_DROPPED;
+                    }
+                    recentResponse->priority = priority;
+                }
+            }
+        }
+
+        if (priority == OUTBOUND_PRIORITY_QUERIES && congested)
+        {
+            if (recentResponse)
+            {
+                recentResponse->dropped = true;
+            }
+            return OUTBOUND_DROPPED;
+        }
+
+        Class& cls = classes[priority];
+        const unsigned int recordSize = sizeof(unsigned long long) + header->size();
+        if (cls.end + recordSize > cls.capacity)
+        {
+            const unsigned int usedSize = cls.end - cls.begin;
+            if (usedSize + recordSize > cls.capacity)
+            {
+                if (priority == OUTBOUND_PRIORITY_CONSENSUS)
+                {
+                    return OUTBOUND_FULL;
+                }
+                if (recentResponse)
+                {
+                    recentResponse->dropped = true;
+                }
+                return OUTBOUND_DROPPED;
+            }
+
+            // Move buffered messages to beginning of buffer in chunks that do not overlap
+            for (unsigned int offset = 0; offset < usedSize; offset += cls.begin)
+            {
+                copyMem(cls.buffer + offset, cls.buffer + cls.begin + offset, (usedSize - offset < cls.begin) ? usedSize - offset : cls.begin);
+            }
+            cls.begin = 0;
+            cls.end = usedSize;
+        }
+
+        copyMem(cls.buffer + cls.end, &now, sizeof(now));
+        copyMem(cls.buffer + cls.end + sizeof(now), header, header->size());
+        cls.end += recordSize;
+        cls.numberOfMessages++;
+        if (size() > highWatermark)
+        {
+            congested = true;
+        }
+        return OUTBOUND_PUSHED;
+    }
+
+    // Fill transmission buffer (of at least the memory size passed to init()) with all consensus messages and one round
+    // of the other classes, packing small messages into BatchedMessages containers if batching is set. Returns number
+    // of bytes to transmit, which is 0 only if all buffers are empty.
+    unsigned int fill(char* fragment, unsigned long long now, bool batching = false)
+    {
+        unsigned int size = take(classes[OUTBOUND_PRIORITY_CONSENSUS], OUTBOUND_PRIORITY_CONSENSUS, fragment, 0xFFFFFFFF, now, batching);
+        do
+        {
+            // If only messages larger than the quantum are waiting, more rounds are needed until one can be sent
+            size += fillRound(fragment + size, now, batching);
+        } while (!size && !isEmpty());
+
+        if (congested && this->size() < lowWatermark)
+        {
+            congested = false;
+            for (unsigned int i = 0; i < sizeof(recentResponses) / sizeof(recentResponses[0]); i++)
+            {
+                recentResponses[i].dropped = false;
+            }
+        }
+        return size;
+    }
+
+private:
+    RecentResponse* recentResponseSet(unsigned int dejavu)
+    {
+        constexpr unsigned int numberOfSets = sizeof(recentResponses) / sizeof(recentResponses[0]) / recentResponseWays;
+        return &recentResponses[(dejavu & (numberOfSets - 1)) * recentResponseWays];
+    }
+
+    // Use counter may have wrapped around, so compare distances to current counter
+    bool isAgedOut(const RecentResponse& entry) const
+    {
+        return recentResponseUseCounter - entry.lastUse > recentResponseMaxAge;
+    }
+
+    RecentResponse* findRecentResponse(unsigned int dejavu)
+    {
+        RecentResponse* set = recentResponseSet(dejavu);
+        for (unsigned int i = 0; i < recentResponseWays; i++)
+        {
+            if (set[i].lastUse && set[i].dejavu == dejavu && !isAgedOut(set[i]))
+            {
+                return &set[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Get free, aged out, or least recently used entry that is not dropped, returns nullptr if all entries of set are
+    // dropped responses that are still active
+    RecentResponse* allocRecentResponse(unsigned int dejavu)
+    {
+        RecentResponse* set = recentResponseSet(dejavu);
+        RecentResponse* entry = nullptr;
+        for (unsigned int i = 0; i < recentResponseWays; i++)
+        {
+            if (!set[i].lastUse || isAgedOut(set[i]))
+            {
+                entry = &set[i];
+                break;
+            }
+            if (!set[i].dropped && (!entry || recentResponseUseCounter - set[i].lastUse > recentResponseUseCounter - entry->lastUse))
+            {
+                entry = &set[i];
+            }
+        }
+        if (entry)
+        {
+            entry->dejavu = dejavu;
+            entry->dropped = false;
+        }
+        return entry;
+    }
+
+    unsigned int fillRound(char* fragment, unsigned long long now, bool batching)
+    {
+        unsigned int size = 0;
+        for (unsigned int i = OUTBOUND_PRIORITY_CONSENSUS + 1; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+        {
+            if (classes[i].numberOfMessages)
+            {
+                classes[i].deficit += outboundQuantum[i];
+                const unsigned int sentSize = take(classes[i], i, fragment + size, classes[i].deficit, now, batching);
+                size += sentSize;
+                classes[i].deficit = (classes[i].numberOfMessages) ? classes[i].deficit - sentSize : 0;
+            }
+        }
+        return size;
+    }
+
+    static bool isBatchable(const RequestResponseHeader* header)
+    {
+        return header->size() <= outboundMaxBatchedMessageSize && header->type() != BatchedMessages::type;
+    }
+
+    // Copy messages of class to fragment as long as their total size does not exceed maxSize. With batching, a container
+    // is started if at least the next two messages are batchable.
+    static unsigned int take(Class& cls, unsigned int priority, char* fragment, unsigned int maxSize, unsigned long long now, bool batching)
+    {
+        unsigned int size = 0;
+        RequestResponseHeader* batch = nullptr;
+        while (cls.numberOfMessages)
+        {
+            const RequestResponseHeader* header = (const RequestResponseHeader*)(cls.buffer + cls.begin + sizeof(unsigned long long));
+            if (batch && (!isBatchable(header) || batch->size() + header->size() > outboundMaxBatchSize))
+            {
+                batch = nullptr;
+            }
+            unsigned int batchHeaderSize = 0;
+            if (batching && !batch && cls.numberOfMessages > 1 && isBatchable(header)
+                && isBatchable((const RequestResponseHeader*)((const char*)header + header->size() + sizeof(unsigned long long))))
+            {
+                batchHeaderSize = sizeof(RequestResponseHeader);
+            }
+            if (size + batchHeaderSize + header->size() > maxSize)
+            {
+                break;
+            }
+            if (batchHeaderSize)
+            {
+                batch = (RequestResponseHeader*)(fragment + size);
+                batch->setSize<sizeof(RequestResponseHeader)>();
+                batch->setType(BatchedMessages::type);
+                batch->setDejavu(0);
+                size += batchHeaderSize;
+            }
+
+            unsigned long long pushTime;
+            copyMem(&pushTime, cls.buffer + cls.begin, sizeof(pushTime));
+            const unsigned long long queueingTime = now - pushTime;
+            outboundQueueingTimeNumerator[priority] += queueingTime;
+            outboundQueueingTimeDenominator[priority]++;
+            if (outboundQueueingTimeMax[priority] < queueingTime)
+            {
+                outboundQueueingTimeMax[priority] = queueingTime;
+            }
+
+            copyMem(fragment + size, header, header->size());
+            size += header->size();
+            if (batch)
+            {
+                batch->checkAndSetSize(batch->size() + header->size());
+            }
+            cls.begin += sizeof(unsigned long long) + header->size();
+            cls.numberOfMessages--;
+        }
+        if (!cls.numberOfMessages)
+        {
+            cls.begin = cls.end = 0;
+        }
+        return size;
+    }
+};
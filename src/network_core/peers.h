@@ -4,6 +4,7 @@
 #pragma once
 
 #include "platform/uefi.h"
+#include "platform/assert.h"
 #include "platform/random.h"
 #include "platform/concurrency.h"
 
@@ -12,6 +13,7 @@
 #include "network_messages/common_response.h"
 
 #include "tcp4.h"
+#include "outbound_queue.h"
 #include "kangaroo_twelve.h"
 
 #include "text_output.h"
@@ -30,6 +32,7 @@
 #define NUMBER_OF_WHITE_LIST_PEERS sizeof(whiteListPeers) / sizeof(whiteListPeers[0])
 #define NUMBER_OF_INCOMING_CONNECTIONS_RESERVED_FOR_WHITELIST_IPS 16
 static_assert((NUMBER_OF_INCOMING_CONNECTIONS / NUMBER_OF_OUTGOING_CONNECTIONS) >= 11, "Number of incoming connections must be x11+ number of outgoing connections to keep healthy network");
+static_assert(BUFFER_SIZE / 8 * outboundBufferEighths[OUTBOUND_PRIORITY_QUERIES] >= RequestResponseHeader::max_size + sizeof(unsigned long long), "Sending buffer of query class must fit messages of maximum size");
 
 static volatile bool listOfPeersIsStatic = false;
 
@@ -44,8 +47,19 @@ struct Peer
     EFI_TCP4_IO_TOKEN receiveToken;
     EFI_TCP4_TRANSMIT_DATA transmitData;
     EFI_TCP4_IO_TOKEN transmitToken;
-    char* dataToTransmit;
-    unsigned int dataToTransmitSize;
+    char* dataToTransmit; // memory of outboundQueue
+    OutboundQueue outboundQueue;
+    // Transmission statistics (moving averages) for choosing peers that are not slowed down by the network
+    unsigned long long transmitStartTick;
+    unsigned long long averageTransmitTime; // CPU ticks from starting transmission until data is accepted by TCP
+    unsigned long long averageTransmitSize;
+    // Peer supports AnnounceTransactions, digests of transactions to announce are collected in a batch (main thread only)
+    BOOLEAN supportsTransactionAnnouncements;
+    unsigned short numberOfPendingAnnouncements;
+    unsigned long long firstPendingAnnouncementTick;
+    m256i pendingAnnouncements[MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS];
+    // Peer supports BatchedMessages containers (main thread only)
+    BOOLEAN supportsBatchedMessages;
     BOOLEAN isConnectingAccepting;
     BOOLEAN isConnectedAccepted;
     BOOLEAN isReceiving, isTransmitting;
@@ -78,6 +92,8 @@ static volatile long long numberOfProcessedRequests = 0, prevNumberOfProcessedRe
 static volatile long long numberOfDiscardedRequests = 0, prevNumberOfDiscardedRequests = 0;
 static volatile long long numberOfDuplicateRequests = 0, prevNumberOfDuplicateRequests = 0;
 static volatile long long numberOfDisseminatedRequests = 0, prevNumberOfDisseminatedRequests = 0;
+static long long numberOfDroppedOutboundMessages = 0, prevNumberOfDroppedOutboundMessages = 0;
+static long long numberOfReceivedBatches = 0, prevNumberOfReceivedBatches = 0;
 
 static unsigned char* requestQueueBuffer = NULL;
 static unsigned char* responseQueueBuffer = NULL;
@@ -86,6 +102,7 @@ static struct Request
 {
     Peer* peer;
     unsigned int offset;
+    unsigned long long enqueueTime; // CPU tick of adding the message to the queue
 } requestQueueElements[REQUEST_QUEUE_LENGTH];
 
 static struct Response
@@ -160,42 +177,76 @@ static void closePeer(Peer* peer)
 }
 
 // Add message to sending buffer of specific peer, can only called from main thread (not thread-safe).
-static void push(Peer* peer, RequestResponseHeader* requestResponseHeader)
+// Set isResponse if the message belongs to a response to a request of the peer (see OutboundQueue).
+static void push(Peer* peer, RequestResponseHeader* requestResponseHeader, bool isResponse = false)
 {
     // The sending buffer may queue multiple messages, each of which may need to transmitted in many small packets.
+    // Messages are buffered per priority class (see OutboundQueue).
     if (peer->tcp4Protocol && peer->isConnectedAccepted && !peer->isClosing)
     {
-        if (peer->dataToTransmitSize + requestResponseHeader->size() > BUFFER_SIZE)
+        switch (peer->outboundQueue.push(requestResponseHeader, __rdtsc(), isResponse))
         {
-            // Buffer is full, which indicates a problem
+        case OUTBOUND_PUSHED:
+            _InterlockedIncrement64(&numberOfDisseminatedRequests);
+            break;
+
+        case OUTBOUND_DROPPED:
+            // Peer is congested, lower priority message is dropped to keep the connection
+            numberOfDroppedOutboundMessages++;
+            break;
+
+        default:
+            // Even consensus messages cannot be sent fast enough, which indicates a problem
             closePeer(peer);
         }
-        else
-        {
-            // Add message to buffer
-            bs->CopyMem(&peer->dataToTransmit[peer->dataToTransmitSize], requestResponseHeader, requestResponseHeader->size());
-            peer->dataToTransmitSize += requestResponseHeader->size();
+    }
+}
 
-            _InterlockedIncrement64(&numberOfDisseminatedRequests);
-        }
+// Estimated time (in CPU ticks) until the messages buffered for the peer are sent
+static unsigned long long estimatedTransmitTime(const Peer& peer)
+{
+    if (!peer.averageTransmitSize)
+    {
+        return 0;
     }
+    return peer.outboundQueue.size() * peer.averageTransmitTime / peer.averageTransmitSize;
 }
 
-// Add message to sending buffer of random peer, can only called from main thread (not thread-safe).
-static void pushToAny(RequestResponseHeader* requestResponseHeader)
+// Get indices of connected peers that are not congested. If all are congested, all connected peers are returned.
+static unsigned short getSuitablePeers(unsigned short* suitablePeerIndices)
 {
-    unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
     unsigned short numberOfSuitablePeers = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    for (int includeCongested = 0; includeCongested < 2 && !numberOfSuitablePeers; includeCongested++)
     {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
+        for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
         {
-            suitablePeerIndices[numberOfSuitablePeers++] = i;
+            if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing
+                && (includeCongested || !peers[i].outboundQueue.isCongested()))
+            {
+                suitablePeerIndices[numberOfSuitablePeers++] = i;
+            }
         }
     }
+    return numberOfSuitablePeers;
+}
+
+// Choose random suitable peer, preferring the one that will send the message earlier out of two random candidates.
+// Returns index in suitablePeerIndices.
+static unsigned short chooseSuitablePeer(const unsigned short* suitablePeerIndices, unsigned short numberOfSuitablePeers)
+{
+    const unsigned short index = random(numberOfSuitablePeers);
+    const unsigned short otherIndex = random(numberOfSuitablePeers);
+    return (estimatedTransmitTime(peers[suitablePeerIndices[otherIndex]]) < estimatedTransmitTime(peers[suitablePeerIndices[index]])) ? otherIndex : index;
+}
+
+// Add message to sending buffer of random peer, can only called from main thread (not thread-safe).
+static void pushToAny(RequestResponseHeader* requestResponseHeader)
+{
+    unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
+    unsigned short numberOfSuitablePeers = getSuitablePeers(suitablePeerIndices);
     if (numberOfSuitablePeers)
     {
-        push(&peers[suitablePeerIndices[random(numberOfSuitablePeers)]], requestResponseHeader);
+        push(&peers[suitablePeerIndices[chooseSuitablePeer(suitablePeerIndices, numberOfSuitablePeers)]], requestResponseHeader);
     }
 }
 
@@ -203,23 +254,76 @@ static void pushToAny(RequestResponseHeader* requestResponseHeader)
 static void pushToSeveral(RequestResponseHeader* requestResponseHeader)
 {
     unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
-    unsigned short numberOfSuitablePeers = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    unsigned short numberOfSuitablePeers = getSuitablePeers(suitablePeerIndices);
+    unsigned short numberOfRemainingSuitablePeers = DISSEMINATION_MULTIPLIER;
+    while (numberOfRemainingSuitablePeers-- && numberOfSuitablePeers)
     {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
-        {
-            suitablePeerIndices[numberOfSuitablePeers++] = i;
-        }
+        const unsigned short index = chooseSuitablePeer(suitablePeerIndices, numberOfSuitablePeers);
+        push(&peers[suitablePeerIndices[index]], requestResponseHeader);
+        suitablePeerIndices[index] = suitablePeerIndices[--numberOfSuitablePeers];
     }
+}
+
+// Send batch of transaction digests collected for peer as AnnounceTransactions message (main thread only)
+static void flushTransactionAnnouncements(Peer* peer)
+{
+    struct
+    {
+        RequestResponseHeader header;
+        m256i digests[MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS];
+    } announcement;
+    announcement.header.checkAndSetSize(sizeof(RequestResponseHeader) + peer->numberOfPendingAnnouncements * sizeof(m256i));
+    announcement.header.randomizeDejavu();
+    announcement.header.setType(AnnounceTransactions::type);
+    copyMem(announcement.digests, peer->pendingAnnouncements, peer->numberOfPendingAnnouncements * sizeof(m256i));
+    peer->numberOfPendingAnnouncements = 0;
+    push(peer, &announcement.header);
+}
+
+// Disseminate transaction (BroadcastTransaction message) to some random peers. Peers supporting announcements get the
+// digest in the next AnnounceTransactions batch, the others get the transaction. Main thread only.
+static void announceToSeveral(RequestResponseHeader* requestResponseHeader, const m256i& digest)
+{
+    unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
+    unsigned short numberOfSuitablePeers = getSuitablePeers(suitablePeerIndices);
     unsigned short numberOfRemainingSuitablePeers = DISSEMINATION_MULTIPLIER;
     while (numberOfRemainingSuitablePeers-- && numberOfSuitablePeers)
     {
-        const unsigned short index = random(numberOfSuitablePeers);
-        push(&peers[suitablePeerIndices[index]], requestResponseHeader);
+        const unsigned short index = chooseSuitablePeer(suitablePeerIndices, numberOfSuitablePeers);
+        Peer* peer = &peers[suitablePeerIndices[index]];
+        if (peer->supportsTransactionAnnouncements)
+        {
+            if (!peer->numberOfPendingAnnouncements)
+            {
+                peer->firstPendingAnnouncementTick = __rdtsc();
+            }
+            peer->pendingAnnouncements[peer->numberOfPendingAnnouncements++] = digest;
+            if (peer->numberOfPendingAnnouncements == MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS)
+            {
+                flushTransactionAnnouncements(peer);
+            }
+        }
+        else
+        {
+            push(peer, requestResponseHeader);
+        }
         suitablePeerIndices[index] = suitablePeerIndices[--numberOfSuitablePeers];
     }
 }
 
+// Send announcement batches that have been collected for at least maxDelay CPU ticks (main thread only)
+static void flushTransactionAnnouncements(unsigned long long maxDelay)
+{
+    const unsigned long long now = __rdtsc();
+    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    {
+        if (peers[i].numberOfPendingAnnouncements && now - peers[i].firstPendingAnnouncementTick >= maxDelay)
+        {
+            flushTransactionAnnouncements(&peers[i]);
+        }
+    }
+}
+
 // Add message to response queue of specific peer. If peer is NULL, it will be sent to random peers. Can be called from any thread.
 static void enqueueResponse(Peer* peer, RequestResponseHeader* responseHeader)
 {
@@ -513,6 +617,61 @@ static bool peerConnectionNewlyEstablished(unsigned int i)
     return false;
 }
 
+// Pass received message to request processors by adding it to the request queue (or drop it without processing if
+// dejavu filter tells to ignore it). The caller publishes the added messages by setting requestQueueElementHead to
+// elementHead, so several messages can be handed over at once. Main thread only.
+static void enqueueReceivedMessage(Peer* peer, RequestResponseHeader* requestResponseHeader, unsigned int salt, unsigned short& elementHead)
+{
+    unsigned int saltedId;
+
+    const unsigned int header = *((unsigned int*)requestResponseHeader);
+    *((unsigned int*)requestResponseHeader) = salt;
+    KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
+    *((unsigned int*)requestResponseHeader) = header;
+
+    if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
+    {
+        if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
+            && (unsigned short)(elementHead + 1) != requestQueueElementTail)
+        {
+            dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
+
+            ASSERT(elementHead < REQUEST_QUEUE_LENGTH);
+            ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
+            ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
+
+            requestQueueElements[elementHead].offset = requestQueueBufferHead;
+            bs->CopyMem(&requestQueueBuffer[requestQueueBufferHead], requestResponseHeader, requestResponseHeader->size());
+            requestQueueBufferHead += requestResponseHeader->size();
+            requestQueueElements[elementHead].peer = peer;
+            requestQueueElements[elementHead].enqueueTime = __rdtsc();
+            if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+            {
+                requestQueueBufferHead = 0;
+            }
+            elementHead++;
+
+            if (!(--dejavuSwapCounter))
+            {
+                unsigned long long* tmp = dejavu1;
+                dejavu1 = dejavu0;
+                bs->SetMem(dejavu0 = tmp, 536870912, 0);
+                dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
+            }
+        }
+        else
+        {
+            _InterlockedIncrement64(&numberOfDiscardedRequests);
+
+            enqueueResponse(peer, 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
+        }
+    }
+    else
+    {
+        _InterlockedIncrement64(&numberOfDuplicateRequests);
+    }
+}
+
 static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
 {
     EFI_STATUS status;
@@ -546,12 +705,15 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                     numberOfReceivedBytes += peers[i].receiveData.DataLength;
                     *((unsigned long long*) & peers[i].receiveData.FragmentTable[0].FragmentBuffer) += peers[i].receiveData.DataLength;
 
-                iteration:
-                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
-
-                    if (receivedDataSize >= sizeof(RequestResponseHeader))
+                    // process all complete messages in receive buffer in one pass, publish them to the request
+                    // processors at once, and move the remaining data to the beginning of the buffer
+                    const unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
+                    unsigned int processedDataSize = 0;
+                    unsigned short elementHead = requestQueueElementHead;
+                    bool violation = false;
+                    while (receivedDataSize - processedDataSize >= sizeof(RequestResponseHeader))
                     {
-                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)peers[i].receiveBuffer;
+                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)(((char*)peers[i].receiveBuffer) + processedDataSize);
                         if (requestResponseHeader->size() < sizeof(RequestResponseHeader))
                         {
                             // protocol violation -> forget peer
@@ -560,68 +722,46 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                             appendText(message, L"...");
                             forgetPublicPeer(peers[i].address);
                             closePeer(&peers[i]);
+                            violation = true;
+                            break;
                         }
-                        else
+                        if (receivedDataSize - processedDataSize < requestResponseHeader->size())
                         {
-                            if (receivedDataSize >= requestResponseHeader->size())
-                            {
-                                unsigned int saltedId;
-
-                                const unsigned int header = *((unsigned int*)requestResponseHeader);
-                                *((unsigned int*)requestResponseHeader) = salt;
-                                KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
-                                *((unsigned int*)requestResponseHeader) = header;
+                            break;
+                        }
 
-                                // Initiate transfer of already received packet to processing thread
-                                // (or drop it without processing if Dejavu filter tells to ignore it)
-                                if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
-                                {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
-                                    {
-                                        dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
-
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        bs->CopyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                                        {
-                                            requestQueueBufferHead = 0;
-                                        }
-                                        // TODO: Place a fence
-                                        requestQueueElementHead++;
-
-                                        if (!(--dejavuSwapCounter))
-                                        {
-                                            unsigned long long* tmp = dejavu1;
-                                            dejavu1 = dejavu0;
-                                            bs->SetMem(dejavu0 = tmp, 536870912, 0);
-                                            dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        _InterlockedIncrement64(&numberOfDiscardedRequests);
-
-                                        enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
-                                    }
-                                }
-                                else
+                        if (requestResponseHeader->type() == BatchedMessages::type)
+                        {
+                            // unpack container (invalid or nested messages end unpacking)
+                            peers[i].supportsBatchedMessages = TRUE;
+                            const unsigned int payloadSize = requestResponseHeader->getPayloadSize();
+                            unsigned int offset = 0;
+                            while (payloadSize - offset >= sizeof(RequestResponseHeader))
+                            {
+                                RequestResponseHeader* batchedHeader = (RequestResponseHeader*)(requestResponseHeader->getPayload<char>() + offset);
+                                if (batchedHeader->size() < sizeof(RequestResponseHeader) || batchedHeader->size() > payloadSize - offset
+                                    || batchedHeader->type() == BatchedMessages::type)
                                 {
-                                    _InterlockedIncrement64(&numberOfDuplicateRequests);
+                                    break;
                                 }
-
-                                bs->CopyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + requestResponseHeader->size(), receivedDataSize -= requestResponseHeader->size());
-                                peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize;
-
-                                goto iteration;
+                                enqueueReceivedMessage(&peers[i], batchedHeader, salt, elementHead);
+                                offset += batchedHeader->size();
                             }
+                            numberOfReceivedBatches++;
+                        }
+                        else
+                        {
+                            enqueueReceivedMessage(&peers[i], requestResponseHeader, salt, elementHead);
                         }
+                        processedDataSize += requestResponseHeader->size();
+                    }
+                    // TODO: Place a fence
+                    requestQueueElementHead = elementHead;
+
+                    if (!violation && processedDataSize)
+                    {
+                        bs->CopyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + processedDataSize, receivedDataSize - processedDataSize);
+                        peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize - processedDataSize;
                     }
                 }
             }
@@ -689,17 +829,22 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                 {
                     // success
                     numberOfTransmittedBytes += peers[i].transmitData.DataLength;
+
+                    // update moving averages (weight of new transmission is 1/8)
+                    const unsigned long long transmitTime = __rdtsc() - peers[i].transmitStartTick;
+                    peers[i].averageTransmitTime = (peers[i].averageTransmitTime) ? (peers[i].averageTransmitTime * 7 + transmitTime) / 8 : transmitTime;
+                    peers[i].averageTransmitSize = (peers[i].averageTransmitSize) ? (peers[i].averageTransmitSize * 7 + peers[i].transmitData.DataLength) / 8 : peers[i].transmitData.DataLength;
                 }
             }
         }
     }
     if (((unsigned long long)peers[i].tcp4Protocol) > 1)
     {
-        if (peers[i].dataToTransmitSize && !peers[i].isTransmitting && peers[i].isConnectedAccepted && !peers[i].isClosing)
+        if (!peers[i].outboundQueue.isEmpty() && !peers[i].isTransmitting && peers[i].isConnectedAccepted && !peers[i].isClosing)
         {
-            // initiate transmission
-            bs->CopyMem(peers[i].transmitData.FragmentTable[0].FragmentBuffer, peers[i].dataToTransmit, peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].dataToTransmitSize);
-            peers[i].dataToTransmitSize = 0;
+            // initiate transmission of consensus messages and one round of lower priority messages
+            peers[i].transmitStartTick = __rdtsc();
+            peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].outboundQueue.fill((char*)peers[i].transmitData.FragmentTable[0].FragmentBuffer, peers[i].transmitStartTick, peers[i].supportsBatchedMessages);
             if (status = peers[i].tcp4Protocol->Transmit(peers[i].tcp4Protocol, &peers[i].transmitToken))
             {
                 logStatusToConsole(L"EFI_TCP4_PROTOCOL.Transmit() fails", status, __LINE__);
@@ -742,7 +887,11 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
                 if (peers[i].connectAcceptToken.NewChildHandle = getTcp4Protocol(peers[i].address.u8, port, &peers[i].tcp4Protocol))
                 {
                     peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
-                    peers[i].dataToTransmitSize = 0;
+                    peers[i].outboundQueue.reset();
+                    peers[i].averageTransmitTime = peers[i].averageTransmitSize = 0;
+                    peers[i].supportsTransactionAnnouncements = FALSE;
+                    peers[i].numberOfPendingAnnouncements = 0;
+                    peers[i].supportsBatchedMessages = FALSE;
                     peers[i].isReceiving = FALSE;
                     peers[i].isTransmitting = FALSE;
                     peers[i].exchangedPublicPeers = FALSE;
@@ -775,7 +924,11 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
             {
                 peers[i].isIncommingConnection = TRUE;
                 peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
-                peers[i].dataToTransmitSize = 0;
+                peers[i].outboundQueue.reset();
+                peers[i].averageTransmitTime = peers[i].averageTransmitSize = 0;
+                peers[i].supportsTransactionAnnouncements = FALSE;
+                peers[i].numberOfPendingAnnouncements = 0;
+                peers[i].supportsBatchedMessages = FALSE;
                 peers[i].isReceiving = FALSE;
                 peers[i].isTransmitting = FALSE;
                 peers[i].exchangedPublicPeers = FALSE;
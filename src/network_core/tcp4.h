@@ -5,6 +5,10 @@
 
 #include "network_messages/header.h"
 
+#if defined(NO_UEFI) && defined(__linux__)
+#include "tcp4_posix.h"
+#endif
+
 
 // Must be 2 * RequestResponseHeader::max_size (maximum message size) because
 // double buffering is used to avoid waiting
@@ -0,0 +1,515 @@
+// POSIX socket implementation of the EFI TCP4 protocol for running the peer layer on Linux (NO_UEFI builds)
+
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+
+#include "platform/uefi.h"
+
+
+// Implements the subset of EFI_TCP4_PROTOCOL, EFI_SERVICE_BINDING_PROTOCOL, and EFI_BOOT_SERVICES that is used by
+// tcp4.h and peers.h, so the same peer code runs on top of non-blocking sockets. Socket readiness is tracked with
+// edge-triggered epoll. Like in the UEFI TCP driver, pending connect, accept, receive, and transmit tokens are
+// completed in Poll() by setting CompletionToken.Status. Only one thread may use the network.
+//
+// Call initPosixTcp4() with the local IPv4 address before initTcp4(). Different loopback addresses (127.0.0.x) can
+// be used to run several nodes on one machine with the same port.
+
+struct PosixTcp4
+{
+    EFI_TCP4_PROTOCOL protocol; // first member, so handle, protocol, and PosixTcp4 pointers are the same
+    int fd;
+    bool readable, writable;
+    EFI_TCP4_CONNECTION_STATE state;
+    EFI_TCP4_CONFIG_DATA configData;
+    EFI_TCP4_CONNECTION_TOKEN* connectToken;
+    EFI_TCP4_IO_TOKEN* receiveToken;
+    EFI_TCP4_IO_TOKEN* transmitToken;
+    unsigned int transmittedSize;
+    // pending accept tokens of listening instance (FIFO)
+    EFI_TCP4_LISTEN_TOKEN* acceptTokens[128];
+    unsigned int acceptTokenBegin, numberOfAcceptTokens;
+};
+
+static int posixTcp4Epoll = -1;
+static EFI_IPv4_ADDRESS posixTcp4StationAddress;
+static PosixTcp4* posixTcp4Listener = nullptr;
+static EFI_SERVICE_BINDING_PROTOCOL posixTcp4ServiceBinding;
+static EFI_BOOT_SERVICES posixBootServices;
+
+
+static sockaddr_in posixTcp4SocketAddress(const EFI_IPv4_ADDRESS& address, unsigned short port)
+{
+    sockaddr_in socketAddress;
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    socketAddress.sin_family = AF_INET;
+    memcpy(&socketAddress.sin_addr, address.Addr, 4);
+    socketAddress.sin_port = htons(port);
+    return socketAddress;
+}
+
+static bool posixTcp4Register(PosixTcp4* instance)
+{
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = instance;
+    return epoll_ctl(posixTcp4Epoll, EPOLL_CTL_ADD, instance->fd, &event) == 0;
+}
+
+static void posixTcp4Complete(EFI_TCP4_COMPLETION_TOKEN& token, EFI_STATUS status)
+{
+    token.Status = status;
+}
+
+static PosixTcp4* posixTcp4Create();
+
+// Complete pending tokens as far as the socket is ready
+static void posixTcp4Progress(PosixTcp4* instance)
+{
+    while (instance->numberOfAcceptTokens && instance->readable)
+    {
+        sockaddr_in remoteAddress;
+        socklen_t remoteAddressSize = sizeof(remoteAddress);
+        const int fd = accept4(instance->fd, (sockaddr*)&remoteAddress, &remoteAddressSize, SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                instance->readable = false;
+            }
+            break;
+        }
+
+        EFI_TCP4_LISTEN_TOKEN* token = instance->acceptTokens[instance->acceptTokenBegin];
+        instance->acceptTokenBegin = (instance->acceptTokenBegin + 1) % (sizeof(instance->acceptTokens) / sizeof(instance->acceptTokens[0]));
+        instance->numberOfAcceptTokens--;
+
+        PosixTcp4* child = posixTcp4Create();
+        if (!child)
+        {
+            close(fd);
+            posixTcp4Complete(token->CompletionToken, EFI_OUT_OF_RESOURCES);
+            continue;
+        }
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        child->fd = fd;
+        child->state = Tcp4StateEstablished;
+        child->configData = instance->configData;
+        memcpy(child->configData.AccessPoint.RemoteAddress.Addr, &remoteAddress.sin_addr, 4);
+        child->configData.AccessPoint.RemotePort = ntohs(remoteAddress.sin_port);
+        posixTcp4Register(child);
+        token->NewChildHandle = child;
+        posixTcp4Complete(token->CompletionToken, EFI_SUCCESS);
+    }
+
+    if (instance->connectToken && instance->writable)
+    {
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+        getsockopt(instance->fd, SOL_SOCKET, SO_ERROR, &error, &errorSize);
+        instance->state = (error) ? Tcp4StateClosed : Tcp4StateEstablished;
+        posixTcp4Complete(instance->connectToken->CompletionToken, (error) ? EFI_CONNECTION_REFUSED : EFI_SUCCESS);
+        instance->connectToken = nullptr;
+    }
+
+    if (instance->receiveToken && instance->readable)
+    {
+        EFI_TCP4_RECEIVE_DATA* receiveData = instance->receiveToken->Packet.RxData;
+        const ssize_t size = recv(instance->fd, receiveData->FragmentTable[0].FragmentBuffer, receiveData->FragmentTable[0].FragmentLength, 0);
+        if (size > 0)
+        {
+            receiveData->DataLength = (unsigned int)size;
+            posixTcp4Complete(instance->receiveToken->CompletionToken, EFI_SUCCESS);
+            instance->receiveToken = nullptr;
+        }
+        else if (size == 0)
+        {
+            instance->state = Tcp4StateCloseWait;
+            posixTcp4Complete(instance->receiveToken->CompletionToken, EFI_CONNECTION_FIN);
+            instance->receiveToken = nullptr;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            instance->readable = false;
+        }
+        else
+        {
+            instance->state = Tcp4StateClosed;
+            posixTcp4Complete(instance->receiveToken->CompletionToken, EFI_CONNECTION_RESET);
+            instance->receiveToken = nullptr;
+        }
+    }
+
+    while (instance->transmitToken && instance->writable)
+    {
+        EFI_TCP4_TRANSMIT_DATA* transmitData = instance->transmitToken->Packet.TxData;
+        const ssize_t size = send(instance->fd, (const char*)transmitData->FragmentTable[0].FragmentBuffer + instance->transmittedSize,
+            transmitData->DataLength - instance->transmittedSize, MSG_NOSIGNAL);
+        if (size >= 0)
+        {
+            instance->transmittedSize += (unsigned int)size;
+            if (instance->transmittedSize == transmitData->DataLength)
+            {
+                posixTcp4Complete(instance->transmitToken->CompletionToken, EFI_SUCCESS);
+                instance->transmitToken = nullptr;
+            }
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            instance->writable = false;
+        }
+        else
+        {
+            instance->state = Tcp4StateClosed;
+            posixTcp4Complete(instance->transmitToken->CompletionToken, EFI_CONNECTION_RESET);
+            instance->transmitToken = nullptr;
+        }
+    }
+}
+
+// Close socket and abort pending tokens
+static void posixTcp4Reset(PosixTcp4* instance)
+{
+    if (instance->fd >= 0)
+    {
+        close(instance->fd);
+        instance->fd = -1;
+    }
+    instance->state = Tcp4StateClosed;
+    instance->readable = instance->writable = false;
+    if (instance->connectToken)
+    {
+        posixTcp4Complete(instance->connectToken->CompletionToken, EFI_ABORTED);
+        instance->connectToken = nullptr;
+    }
+    if (instance->receiveToken)
+    {
+        posixTcp4Complete(instance->receiveToken->CompletionToken, EFI_ABORTED);
+        instance->receiveToken = nullptr;
+    }
+    if (instance->transmitToken)
+    {
+        posixTcp4Complete(instance->transmitToken->CompletionToken, EFI_ABORTED);
+        instance->transmitToken = nullptr;
+    }
+    while (instance->numberOfAcceptTokens)
+    {
+        posixTcp4Complete(instance->acceptTokens[instance->acceptTokenBegin]->CompletionToken, EFI_ABORTED);
+        instance->acceptTokenBegin = (instance->acceptTokenBegin + 1) % (sizeof(instance->acceptTokens) / sizeof(instance->acceptTokens[0]));
+        instance->numberOfAcceptTokens--;
+    }
+    if (posixTcp4Listener == instance)
+    {
+        posixTcp4Listener = nullptr;
+    }
+}
+
+static EFI_STATUS __cdecl posixTcp4GetModeData(IN void* This, OUT EFI_TCP4_CONNECTION_STATE* Tcp4State OPTIONAL, OUT EFI_TCP4_CONFIG_DATA* Tcp4ConfigData OPTIONAL,
+    OUT EFI_IP4_MODE_DATA* Ip4ModeData OPTIONAL, OUT EFI_MANAGED_NETWORK_CONFIG_DATA* MnpConfigData OPTIONAL, OUT EFI_SIMPLE_NETWORK_MODE* SnpModeData OPTIONAL)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    if (Tcp4State)
+    {
+        *Tcp4State = instance->state;
+    }
+    if (Tcp4ConfigData)
+    {
+        *Tcp4ConfigData = instance->configData;
+        Tcp4ConfigData->AccessPoint.StationAddress = posixTcp4StationAddress;
+        Tcp4ConfigData->ControlOption = NULL;
+    }
+    if (Ip4ModeData)
+    {
+        memset(Ip4ModeData, 0, sizeof(*Ip4ModeData));
+        Ip4ModeData->IsStarted = TRUE;
+        Ip4ModeData->IsConfigured = TRUE;
+    }
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Configure(IN void* This, IN EFI_TCP4_CONFIG_DATA* TcpConfigData OPTIONAL)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    if (!TcpConfigData)
+    {
+        posixTcp4Reset(instance);
+        return EFI_SUCCESS;
+    }
+
+    instance->configData = *TcpConfigData;
+    if (!TcpConfigData->AccessPoint.ActiveFlag)
+    {
+        // passive instance listening for incoming connections
+        const sockaddr_in socketAddress = posixTcp4SocketAddress(posixTcp4StationAddress, TcpConfigData->AccessPoint.StationPort);
+        const int reuseAddress = 1;
+        if ((instance->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0
+            || setsockopt(instance->fd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress))
+            || bind(instance->fd, (const sockaddr*)&socketAddress, sizeof(socketAddress))
+            || listen(instance->fd, 128)
+            || !posixTcp4Register(instance))
+        {
+            posixTcp4Reset(instance);
+            return EFI_ACCESS_DENIED;
+        }
+        instance->state = Tcp4StateListen;
+        posixTcp4Listener = instance;
+    }
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Routes(IN void* This, IN BOOLEAN DeleteRoute, IN EFI_IPv4_ADDRESS* SubnetAddress, IN EFI_IPv4_ADDRESS* SubnetMask, IN EFI_IPv4_ADDRESS* GatewayAddress)
+{
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Connect(IN void* This, IN EFI_TCP4_CONNECTION_TOKEN* ConnectionToken)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    if (instance->fd >= 0 || !instance->configData.AccessPoint.ActiveFlag)
+    {
+        return EFI_ACCESS_DENIED;
+    }
+
+    // bind to station address, so the remote node sees the address of this node
+    const sockaddr_in localAddress = posixTcp4SocketAddress(posixTcp4StationAddress, 0);
+    const sockaddr_in remoteAddress = posixTcp4SocketAddress(instance->configData.AccessPoint.RemoteAddress, instance->configData.AccessPoint.RemotePort);
+    const int noDelay = 1;
+    if ((instance->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0
+        || bind(instance->fd, (const sockaddr*)&localAddress, sizeof(localAddress))
+        || setsockopt(instance->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay))
+        || (connect(instance->fd, (const sockaddr*)&remoteAddress, sizeof(remoteAddress)) && errno != EINPROGRESS)
+        || !posixTcp4Register(instance))
+    {
+        posixTcp4Reset(instance);
+        return EFI_NETWORK_UNREACHABLE;
+    }
+    instance->state = Tcp4StateSynSent;
+    instance->connectToken = ConnectionToken;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Accept(IN void* This, IN EFI_TCP4_LISTEN_TOKEN* ListenToken)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    constexpr unsigned int capacity = sizeof(instance->acceptTokens) / sizeof(instance->acceptTokens[0]);
+    if (instance->state != Tcp4StateListen)
+    {
+        return EFI_NOT_STARTED;
+    }
+    if (instance->numberOfAcceptTokens == capacity)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    instance->acceptTokens[(instance->acceptTokenBegin + instance->numberOfAcceptTokens++) % capacity] = ListenToken;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Transmit(IN void* This, IN EFI_TCP4_IO_TOKEN* Token)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    if (instance->state != Tcp4StateEstablished && instance->state != Tcp4StateCloseWait)
+    {
+        return EFI_NOT_STARTED;
+    }
+    if (instance->transmitToken)
+    {
+        return EFI_ACCESS_DENIED;
+    }
+    instance->transmitToken = Token;
+    instance->transmittedSize = 0;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Receive(IN void* This, IN EFI_TCP4_IO_TOKEN* Token)
+{
+    PosixTcp4* instance = (PosixTcp4*)This;
+    if (instance->state == Tcp4StateCloseWait)
+    {
+        return EFI_CONNECTION_FIN;
+    }
+    if (instance->state != Tcp4StateEstablished)
+    {
+        return EFI_NOT_STARTED;
+    }
+    if (instance->receiveToken)
+    {
+        return EFI_ACCESS_DENIED;
+    }
+    instance->receiveToken = Token;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Close(IN void* This, IN EFI_TCP4_CLOSE_TOKEN* CloseToken)
+{
+    posixTcp4Reset((PosixTcp4*)This);
+    posixTcp4Complete(CloseToken->CompletionToken, EFI_SUCCESS);
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4Cancel(IN void* This, IN EFI_TCP4_COMPLETION_TOKEN* Token OPTIONAL)
+{
+    return EFI_SUCCESS;
+}
+
+// Update readiness of all sockets with epoll and complete pending tokens (UEFI polls the whole stack as well)
+static EFI_STATUS __cdecl posixTcp4Poll(IN void* This)
+{
+    epoll_event events[64];
+    int numberOfEvents;
+    do
+    {
+        numberOfEvents = epoll_wait(posixTcp4Epoll, events, sizeof(events) / sizeof(events[0]), 0);
+        for (int i = 0; i < numberOfEvents; i++)
+        {
+            PosixTcp4* instance = (PosixTcp4*)events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                instance->readable = true;
+            }
+            if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            {
+                instance->writable = true;
+            }
+            posixTcp4Progress(instance);
+        }
+    } while (numberOfEvents == sizeof(events) / sizeof(events[0]));
+
+    posixTcp4Progress((PosixTcp4*)This);
+    if (posixTcp4Listener)
+    {
+        posixTcp4Progress(posixTcp4Listener);
+    }
+    return EFI_SUCCESS;
+}
+
+static PosixTcp4* posixTcp4Create()
+{
+    PosixTcp4* instance = (PosixTcp4*)calloc(1, sizeof(PosixTcp4));
+    if (instance)
+    {
+        instance->protocol.GetModeData = posixTcp4GetModeData;
+        instance->protocol.Configure = posixTcp4Configure;
+        instance->protocol.Routes = posixTcp4Routes;
+        instance->protocol.Connect = posixTcp4Connect;
+        instance->protocol.Accept = posixTcp4Accept;
+        instance->protocol.Transmit = posixTcp4Transmit;
+        instance->protocol.Receive = posixTcp4Receive;
+        instance->protocol.Close = posixTcp4Close;
+        instance->protocol.Cancel = posixTcp4Cancel;
+        instance->protocol.Poll = posixTcp4Poll;
+        instance->fd = -1;
+        instance->state = Tcp4StateClosed;
+    }
+    return instance;
+}
+
+static EFI_STATUS __cdecl posixTcp4CreateChild(IN void* This, IN OUT EFI_HANDLE* ChildHandle)
+{
+    PosixTcp4* instance = posixTcp4Create();
+    if (!instance)
+    {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    *ChildHandle = instance;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixTcp4DestroyChild(IN void* This, IN EFI_HANDLE ChildHandle)
+{
+    if (!ChildHandle)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+    posixTcp4Reset((PosixTcp4*)ChildHandle);
+    free(ChildHandle);
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixOpenProtocol(IN EFI_HANDLE Handle, IN EFI_GUID* Protocol, OUT void** Interface OPTIONAL, IN EFI_HANDLE AgentHandle, IN EFI_HANDLE ControllerHandle, IN unsigned int Attributes)
+{
+    if (!Handle)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+    if (Interface)
+    {
+        *Interface = Handle;
+    }
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixCloseProtocol(IN EFI_HANDLE Handle, IN EFI_GUID* Protocol, IN EFI_HANDLE AgentHandle, IN EFI_HANDLE ControllerHandle)
+{
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS __cdecl posixLocateProtocol(IN EFI_GUID* Protocol, IN void* Registration OPTIONAL, OUT void** Interface)
+{
+    *Interface = &posixTcp4ServiceBinding;
+    return EFI_SUCCESS;
+}
+
+static void __cdecl posixCopyMem(IN void* Destination, IN void* Source, IN unsigned long long Length)
+{
+    memmove(Destination, Source, Length);
+}
+
+static void __cdecl posixSetMem(IN void* Buffer, IN unsigned long long Size, IN unsigned char Value)
+{
+    memset(Buffer, Value, Size);
+}
+
+static EFI_STATUS __cdecl posixAllocatePool(IN EFI_MEMORY_TYPE PoolType, IN unsigned long long Size, OUT void** Buffer)
+{
+    // calloc() maps zeroed pages lazily, so large buffers that are mostly unused only take address space
+    *Buffer = calloc(1, Size);
+    return (*Buffer) ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS __cdecl posixFreePool(IN void* Buffer)
+{
+    free(Buffer);
+    return EFI_SUCCESS;
+}
+
+// Set up socket backend with local address and install the boot services used by the peer layer
+static bool initPosixTcp4(const unsigned char stationAddress[4])
+{
+    if ((posixTcp4Epoll = epoll_create1(0)) < 0)
+    {
+        return false;
+    }
+    memcpy(posixTcp4StationAddress.Addr, stationAddress, 4);
+
+    posixTcp4ServiceBinding.CreateChild = posixTcp4CreateChild;
+    posixTcp4ServiceBinding.DestroyChild = posixTcp4DestroyChild;
+
+    memset(&posixBootServices, 0, sizeof(posixBootServices));
+    posixBootServices.OpenProtocol = posixOpenProtocol;
+    posixBootServices.CloseProtocol = posixCloseProtocol;
+    posixBootServices.LocateProtocol = posixLocateProtocol;
+    posixBootServices.CopyMem = posixCopyMem;
+    posixBootServices.SetMem = posixSetMem;
+    posixBootServices.AllocatePool = posixAllocatePool;
+    posixBootServices.FreePool = posixFreePool;
+    bs = &posixBootServices;
+
+    return true;
+}
+
+static void deinitPosixTcp4()
+{
+    if (posixTcp4Epoll >= 0)
+    {
+        close(posixTcp4Epoll);
+        posixTcp4Epoll = -1;
+    }
+}
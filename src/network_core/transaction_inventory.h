@@ -0,0 +1,173 @@
+// recently disseminated transactions by digest, for announce-then-fetch transaction gossip
+
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/debugging.h"
+
+#include "network_messages/transactions.h"
+
+#include "public_settings.h"
+
+
+// Inventory of transactions that have been disseminated (announced) recently, and of digests of announced transactions
+// that have been requested from a peer. Transactions are stored in a ring buffer, so old transactions are overwritten.
+// The digest index is a lossy hash map: if all slots of a probe sequence are used, the oldest entry is replaced.
+// All functions can be called from any thread.
+class TransactionInventory
+{
+public:
+    static constexpr unsigned int maxNumberOfProbes = 16;
+
+    // Allocate ring buffer of bufferSize bytes and index with numberOfSlots entries (power of 2)
+    bool init(unsigned long long bufferSize, unsigned long long numberOfSlots)
+    {
+        ASSERT((numberOfSlots & (numberOfSlots - 1)) == 0 && bufferSize >= MAX_TRANSACTION_SIZE + sizeof(m256i));
+        if (!allocatePool(bufferSize, (void**)&buffer) || !allocatePool(numberOfSlots * sizeof(Entry), (void**)&entries))
+        {
+            deinit();
+            return false;
+        }
+        this->bufferSize = bufferSize;
+        slotMask = numberOfSlots - 1;
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (buffer)
+        {
+            freePool(buffer);
+            buffer = nullptr;
+        }
+        if (entries)
+        {
+            freePool(entries);
+            entries = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        ACQUIRE(lock);
+        setMem(entries, (slotMask + 1) * sizeof(Entry), 0);
+        head = 0;
+        RELEASE(lock);
+    }
+
+    // Store transaction with given digest. Returns false if it is already stored.
+    bool add(const m256i& digest, const Transaction* transaction, unsigned long long now)
+    {
+        const unsigned int transactionSize = transaction->totalSize();
+        const unsigned long long recordSize = (sizeof(m256i) + transactionSize + 7) & ~7ULL;
+        bool added = false;
+
+        ACQUIRE(lock);
+        Entry& entry = findEntry(digest);
+        if (!(entry.digest == digest && isStored(entry)))
+        {
+            // records do not wrap around at the end of the buffer
+            if (head % bufferSize + recordSize > bufferSize)
+            {
+                head += bufferSize - head % bufferSize;
+            }
+            copyMem(buffer + head % bufferSize, &digest, sizeof(m256i));
+            copyMem(buffer + head % bufferSize + sizeof(m256i), transaction, transactionSize);
+            entry.digest = digest;
+            entry.position = head + 1;
+            entry.time = now;
+            head += recordSize;
+            added = true;
+        }
+        RELEASE(lock);
+
+        return added;
+    }
+
+    // Copy transaction with digest to output buffer (of MAX_TRANSACTION_SIZE). Returns false if it is not stored.
+    bool get(const m256i& digest, Transaction* transaction)
+    {
+        bool found = false;
+
+        ACQUIRE(lock);
+        Entry& entry = findEntry(digest);
+        if (entry.digest == digest && isStored(entry))
+        {
+            const Transaction* storedTransaction = (const Transaction*)(buffer + (entry.position - 1) % bufferSize + sizeof(m256i));
+            copyMem(transaction, storedTransaction, storedTransaction->totalSize());
+            found = true;
+        }
+        RELEASE(lock);
+
+        return found;
+    }
+
+    // Check if announced transaction needs to be requested. Returns false if it is stored or has been requested less
+    // than requestTimeout ago (in units of now). Otherwise the request is recorded and true is returned.
+    bool request(const m256i& digest, unsigned long long now, unsigned long long requestTimeout)
+    {
+        bool mustBeRequested = false;
+
+        ACQUIRE(lock);
+        Entry& entry = findEntry(digest);
+        if (entry.digest != digest || (!isStored(entry) && now - entry.time >= requestTimeout))
+        {
+            entry.digest = digest;
+            entry.position = 0;
+            entry.time = now;
+            mustBeRequested = true;
+        }
+        RELEASE(lock);
+
+        return mustBeRequested;
+    }
+
+private:
+    struct Entry
+    {
+        m256i digest;
+        unsigned long long position;    // position of record in ring buffer + 1 (0 if only requested)
+        unsigned long long time;        // time of adding or requesting
+    };
+
+    unsigned char* buffer = nullptr;
+    unsigned long long bufferSize = 0;
+    unsigned long long head = 0;        // total number of bytes written to ring buffer (position of next record)
+    Entry* entries = nullptr;
+    unsigned long long slotMask = 0;
+    volatile char lock = 0;
+
+    // Record of entry is stored if not overwritten by newer records yet
+    bool isStored(const Entry& entry) const
+    {
+        return entry.position && head + 1 - entry.position <= bufferSize
+            && *(const m256i*)(buffer + (entry.position - 1) % bufferSize) == entry.digest;
+    }
+
+    // Return entry of digest or the entry to be replaced by it (empty or oldest entry of probe sequence)
+    Entry& findEntry(const m256i& digest)
+    {
+        unsigned long long slot = digest.m256i_u64[0] & slotMask;
+        Entry* replacedEntry = &entries[slot];
+        for (unsigned int i = 0; i < maxNumberOfProbes; i++)
+        {
+            Entry& entry = entries[(slot + i) & slotMask];
+            if (entry.digest == digest)
+            {
+                return entry;
+            }
+            if (isZero(entry.digest))
+            {
+                return entry;
+            }
+            if (entry.time < replacedEntry->time)
+            {
+                replacedEntry = &entry;
+            }
+        }
+        return *replacedEntry;
+    }
+};
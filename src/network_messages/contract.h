@@ -50,3 +50,56 @@ struct RespondContractFunction // Returns result of contract function invocation
         type = 43,
     };
 };
+
+
+// Request of the execution profile of the contract entry points called by the core since the beginning of the epoch.
+// If contractIndex is not 0, only the entry points of this contract and the call edges from or to it are sent.
+struct RequestContractProfile
+{
+    unsigned int contractIndex;
+
+    enum {
+        type = 59,
+    };
+};
+
+
+struct ContractEntryPointProfile
+{
+    unsigned int contractIndex;
+    unsigned short inputType; // system procedure ID if kind is 0
+    unsigned char kind; // 0: system procedure, 1: user procedure, 2: user function
+    unsigned char padding;
+    unsigned long long maxStackSize; // peak usage of contract locals stack in bytes (including input and output)
+    unsigned long long numberOfCalls;
+    unsigned long long totalCycles; // CPU cycles including calls of other contracts
+    unsigned long long p50Cycles, p90Cycles, p99Cycles, maxCycles; // percentiles are estimated with up to 25% error
+};
+
+static_assert(sizeof(ContractEntryPointProfile) == 64, "Something is wrong with the struct size.");
+
+
+struct ContractCallEdge
+{
+    unsigned int callerContractIndex;
+    unsigned int calleeContractIndex;
+    unsigned long long numberOfCalls;
+};
+
+
+// Response to RequestContractProfile, followed by numberOfEntryPoints ContractEntryPointProfile and numberOfCallEdges
+// ContractCallEdge
+struct RespondContractProfile
+{
+    unsigned long long cyclesPerSecond; // for converting cycles to time
+    unsigned long long numberOfDroppedCalls; // calls not profiled because the profiler is full
+    unsigned short epoch;
+    unsigned short padding;
+    unsigned int numberOfEntryPoints;
+    unsigned int numberOfCallEdges;
+    unsigned int padding2;
+
+    enum {
+        type = 60,
+    };
+};
@@ -101,3 +101,14 @@ public:
         return this->size() - sizeof(RequestResponseHeader);
     }
 };
+
+// Container packing several complete messages (each with its own RequestResponseHeader) into one frame, to reduce the
+// per-message overhead of small messages. The receiver handles the contained messages as if they had been received
+// one by one. The dejavu of the container is ignored and containers are not nested. Containers are only sent to peers
+// that have sent a BatchedMessages message before (an empty one is sent after connecting to signal support).
+struct BatchedMessages
+{
+    enum {
+        type = 54,
+    };
+};
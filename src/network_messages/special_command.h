@@ -75,3 +75,40 @@ struct SpecialCommandGetMiningScoreRanking
 };
 
 #pragma pack(pop)
+
+#define SPECIAL_COMMAND_GET_TELEMETRY 15ULL // query latency statistics of tick processing and request handling
+
+// Phases of processing a tick measured by the node
+enum TelemetryTickPhase
+{
+    TELEMETRY_TICK_PHASE_QUORUM_WAIT = 0, // from the end of processing the tick until the next tick begins
+    TELEMETRY_TICK_PHASE_BEGIN_TICK, // BEGIN_TICK of contracts
+    TELEMETRY_TICK_PHASE_SOLUTIONS, // scoring of mining solutions
+    TELEMETRY_TICK_PHASE_TRANSACTIONS, // pre-pass and execution of transactions (without scoring of solutions)
+    TELEMETRY_TICK_PHASE_END_TICK, // END_TICK of contracts
+    TELEMETRY_TICK_PHASE_DIGESTS, // spectrum, universe and computer digests
+    TELEMETRY_TICK_PHASE_VOTE_BROADCAST, // creating and signing own votes
+    NUMBER_OF_TELEMETRY_TICK_PHASES
+};
+
+struct SpecialCommandGetTelemetryRequest
+{
+    unsigned long long everIncreasingNonceAndCommandType;
+    unsigned char resetAfterReading; // start new measurement period after responding
+    unsigned char padding[7];
+};
+
+struct TelemetryLatencySummary
+{
+    unsigned long long count;
+    unsigned long long p50, p90, p99, max; // microseconds (percentiles are estimated with up to 25% error)
+};
+
+struct SpecialCommandGetTelemetryResponse
+{
+    unsigned long long everIncreasingNonceAndCommandType;
+    unsigned long long measurementPeriod; // milliseconds since start of measurement period
+    TelemetryLatencySummary tickPhases[NUMBER_OF_TELEMETRY_TICK_PHASES];
+    TelemetryLatencySummary requestQueueWait; // time from receiving a message until a request processor takes it
+    TelemetryLatencySummary requestProcessing[256]; // time of handling a message by request processor, per type
+};
@@ -98,6 +98,51 @@ struct RequestQuorumTick
 };
 
 
+#define MAX_NUMBER_OF_COMPACT_QUORUM_TICKS 16
+
+// Request of the votes of a range of ticks by a node that is catching up. The votes are sent in compact form, one
+// CompactQuorumTick per tick (ticks without votes are skipped). Votes that do not agree with the shared vote of their
+// tick are sent as BroadcastTick. The response ends with EndResponse. Votes of the first tick that are flagged in
+// voteFlags are known by the requester and not sent.
+struct RequestCompactQuorumTicks
+{
+    unsigned int tick;
+    unsigned int numberOfTicks; // 1 to MAX_NUMBER_OF_COMPACT_QUORUM_TICKS
+    unsigned char voteFlags[(NUMBER_OF_COMPUTORS + 7) / 8];
+
+    enum {
+        type = 55,
+    };
+};
+
+
+// Fields of a vote that differ between the computors agreeing on a tick
+struct CompactVote
+{
+    unsigned long long saltedResourceTestingDigest;
+    unsigned char saltedSpectrumDigest[32];
+    unsigned char saltedUniverseDigest[32];
+    unsigned char saltedComputerDigest[32];
+    unsigned char signature[SIGNATURE_SIZE];
+};
+
+static_assert(sizeof(CompactVote) == 8 + 3 * 32 + SIGNATURE_SIZE, "Something is wrong with the struct size.");
+
+
+// Votes of one tick that agree on all fields except the ones in CompactVote. The shared fields are sent once in
+// sharedVote (its computor-specific fields are ignored). The struct is followed by one CompactVote per computor flagged
+// in voteFlags, in the order of the computor indices.
+struct CompactQuorumTick
+{
+    Tick sharedVote;
+    unsigned char voteFlags[(NUMBER_OF_COMPUTORS + 7) / 8];
+
+    enum {
+        type = 56,
+    };
+};
+
+
 struct RequestedTickData
 {
     unsigned int tick;
@@ -114,6 +159,45 @@ struct RequestTickData
 };
 
 
+#define MAX_NUMBER_OF_TICKS_IN_RANGE 1024
+
+#define TICK_RANGE_TICK_DATA 1
+#define TICK_RANGE_TRANSACTIONS 2
+#define TICK_RANGE_QUORUM_VOTES 4
+
+// Request of the data of a range of ticks for syncing archives and explorers. One TickRangeEntry is sent per tick, in
+// the order of the ticks starting with tick. The response ends with EndResponse. It may end before numberOfTicks
+// entries have been sent, if a tick is not processed yet or the requester cannot receive more data without congestion.
+// In this case, the requester continues with the tick following the last entry received.
+struct RequestTickRange
+{
+    unsigned int tick;
+    unsigned int numberOfTicks; // 1 to MAX_NUMBER_OF_TICKS_IN_RANGE
+    unsigned int flags; // TICK_RANGE_* flags of the data to send
+
+    enum {
+        type = 57,
+    };
+};
+
+
+// Data of one tick of a RequestTickRange response. The struct is followed by the data flagged in flags, in this order:
+// TickData, numberOfTransactions transactions in the order of the transaction digests in the tick data (each of
+// Transaction::totalSize() bytes), CompactQuorumTick with the votes agreeing on the most common shared fields. Flags of
+// requested data that is not available are cleared. If epoch is 0, the tick is not stored by the responding node.
+struct TickRangeEntry
+{
+    unsigned int tick;
+    unsigned short epoch;
+    unsigned short numberOfTransactions;
+    unsigned int flags;
+
+    enum {
+        type = 58,
+    };
+};
+
+
 #define REQUEST_CURRENT_TICK_INFO 27
 
 #define RESPOND_CURRENT_TICK_INFO 28
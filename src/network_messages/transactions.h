@@ -69,3 +69,27 @@ struct RequestedTransactionInfo
     m256i txDigest;
 };
 
+
+#define MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS 256
+
+// Announcement of transactions to peers by digest (K12 of whole transaction including signature) instead of sending
+// the full transactions. The payload is an array of up to MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS digests. The receiver
+// requests the transactions it does not know with RequestAnnouncedTransactions. An announcement without digests is
+// sent after connecting to tell the peer that announcements are supported (peers that do not support them receive
+// BroadcastTransaction as before).
+struct AnnounceTransactions
+{
+    enum {
+        type = 52,
+    };
+};
+
+// Request of announced transactions, with an array of up to MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS digests as payload.
+// Each transaction that is known is sent as BroadcastTransaction with zero dejavu, so the requester disseminates it.
+struct RequestAnnouncedTransactions
+{
+    enum {
+        type = 53,
+    };
+};
+
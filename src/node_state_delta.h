@@ -0,0 +1,228 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+// Support for incremental (delta) snapshots of the node state (used by saveAllNodeStates() in qubic.cpp).
+//
+// A full (base) snapshot writes all large state buffers. Afterwards, the pages of these buffers that are changed are
+// marked in a DirtyPageBitmap, and the following snapshots only write a delta file containing the dirty pages. When
+// loading, the base snapshot is loaded first and the deltas are applied in the order they were saved.
+//
+// Delta file format: NodeStateDeltaHeader followed by numberOfRecords records. Each record is a NodeStateDeltaRecord
+// followed by the data (size bytes, padded to a multiple of 8 bytes).
+
+// Bitmap with one bit per page of a memory region, marking pages changed since the last snapshot
+template <unsigned long long numberOfPages>
+class DirtyPageBitmap
+{
+    static_assert(numberOfPages % 64 == 0, "numberOfPages must be multiple of 64");
+
+public:
+    void clearAll()
+    {
+        setMem(bits, sizeof(bits), 0);
+    }
+
+    void markAll()
+    {
+        setMem(bits, sizeof(bits), 0xff);
+    }
+
+    void markPage(unsigned long long page)
+    {
+        ASSERT(page < numberOfPages);
+        bits[page >> 6] |= (1ULL << (page & 63));
+    }
+
+    // Mark all pages that are marked in pageFlags (one bit per page, same layout as this bitmap)
+    void markPages(const unsigned long long* pageFlags)
+    {
+        for (unsigned long long i = 0; i < numberOfPages / 64; ++i)
+            bits[i] |= pageFlags[i];
+    }
+
+    bool isPageDirty(unsigned long long page) const
+    {
+        ASSERT(page < numberOfPages);
+        return (bits[page >> 6] >> (page & 63)) & 1;
+    }
+
+    unsigned long long countDirtyPages() const
+    {
+        unsigned long long count = 0;
+        for (unsigned long long i = 0; i < numberOfPages / 64; ++i)
+            count += __popcnt64(bits[i]);
+        return count;
+    }
+
+    static constexpr unsigned long long pages()
+    {
+        return numberOfPages;
+    }
+
+private:
+    unsigned long long bits[numberOfPages / 64];
+};
+
+static constexpr unsigned int nodeStateDeltaMagic = 0x544c4451; // "QDLT"
+
+struct NodeStateDeltaHeader
+{
+    unsigned int magic;
+    unsigned short epoch;
+    unsigned short sequenceNumber;  // 1 for first delta after base snapshot
+    unsigned int tick;              // tick at the time the delta was saved
+    unsigned int numberOfRecords;
+    unsigned long long size;        // total size including this header
+};
+
+struct NodeStateDeltaRecord
+{
+    unsigned int type;              // region the data belongs to (defined by user of NodeStateDeltaWriter)
+    unsigned int size;              // number of bytes of data following this record
+    unsigned long long offset;      // byte offset of data in region
+};
+
+static_assert(sizeof(NodeStateDeltaHeader) % 8 == 0 && sizeof(NodeStateDeltaRecord) % 8 == 0, "Unexpected struct size");
+
+// Serialize changes into a memory buffer
+class NodeStateDeltaWriter
+{
+public:
+    void init(unsigned char* buffer, unsigned long long capacity, unsigned short epoch, unsigned short sequenceNumber, unsigned int tick)
+    {
+        ASSERT(capacity >= sizeof(NodeStateDeltaHeader));
+        this->buffer = buffer;
+        this->capacity = capacity;
+        header = reinterpret_cast<NodeStateDeltaHeader*>(buffer);
+        header->magic = nodeStateDeltaMagic;
+        header->epoch = epoch;
+        header->sequenceNumber = sequenceNumber;
+        header->tick = tick;
+        header->numberOfRecords = 0;
+        header->size = sizeof(NodeStateDeltaHeader);
+    }
+
+    // Add record with data. Returns false if buffer capacity is exceeded.
+    bool addRecord(unsigned int type, unsigned long long offset, const void* data, unsigned int size)
+    {
+        const unsigned long long paddedSize = (size + 7ULL) & ~7ULL;
+        if (header->size + sizeof(NodeStateDeltaRecord) + paddedSize > capacity)
+            return false;
+
+        NodeStateDeltaRecord* record = reinterpret_cast<NodeStateDeltaRecord*>(buffer + header->size);
+        record->type = type;
+        record->size = size;
+        record->offset = offset;
+        unsigned char* recordData = reinterpret_cast<unsigned char*>(record + 1);
+        copyMem(recordData, data, size);
+        if (paddedSize > size)
+            setMem(recordData + size, paddedSize - size, 0);
+
+        header->size += sizeof(NodeStateDeltaRecord) + paddedSize;
+        header->numberOfRecords++;
+        return true;
+    }
+
+    // Add records for all dirty pages of region, merging consecutive dirty pages into one record.
+    // Returns false if buffer capacity is exceeded.
+    template <unsigned long long numberOfPages>
+    bool addDirtyPages(unsigned int type, const DirtyPageBitmap<numberOfPages>& dirtyPages, const unsigned char* region, unsigned int pageSize)
+    {
+        const unsigned long long maxPagesPerRecord = maxRecordSize / pageSize;
+        ASSERT(maxPagesPerRecord > 0);
+        unsigned long long page = 0;
+        while (page < numberOfPages)
+        {
+            if (!dirtyPages.isPageDirty(page))
+            {
+                ++page;
+                continue;
+            }
+            unsigned long long endPage = page + 1;
+            while (endPage < numberOfPages && endPage - page < maxPagesPerRecord && dirtyPages.isPageDirty(endPage))
+                ++endPage;
+            const unsigned long long offset = page * pageSize;
+            if (!addRecord(type, offset, region + offset, (unsigned int)((endPage - page) * pageSize)))
+                return false;
+            page = endPage;
+        }
+        return true;
+    }
+
+    unsigned long long size() const
+    {
+        return header->size;
+    }
+
+    unsigned int numberOfRecords() const
+    {
+        return header->numberOfRecords;
+    }
+
+private:
+    static constexpr unsigned long long maxRecordSize = 16 * 1024 * 1024;
+
+    unsigned char* buffer;
+    unsigned long long capacity;
+    NodeStateDeltaHeader* header;
+};
+
+// Iterate records of serialized delta
+class NodeStateDeltaReader
+{
+public:
+    // Init reader and check header. Returns false if data is invalid or does not match epoch and sequence number.
+    bool init(const unsigned char* buffer, unsigned long long size, unsigned short epoch, unsigned short sequenceNumber)
+    {
+        this->buffer = buffer;
+        this->bufferSize = size;
+        position = sizeof(NodeStateDeltaHeader);
+        recordsRead = 0;
+        if (size < sizeof(NodeStateDeltaHeader))
+            return false;
+        header = reinterpret_cast<const NodeStateDeltaHeader*>(buffer);
+        return header->magic == nodeStateDeltaMagic && header->epoch == epoch
+            && header->sequenceNumber == sequenceNumber && header->size == size;
+    }
+
+    // Return next record (data follows record) or nullptr if all records have been read or data is corrupted
+    const NodeStateDeltaRecord* nextRecord()
+    {
+        if (recordsRead >= header->numberOfRecords || position + sizeof(NodeStateDeltaRecord) > bufferSize)
+            return nullptr;
+        const NodeStateDeltaRecord* record = reinterpret_cast<const NodeStateDeltaRecord*>(buffer + position);
+        const unsigned long long paddedSize = (record->size + 7ULL) & ~7ULL;
+        if (position + sizeof(NodeStateDeltaRecord) + paddedSize > bufferSize)
+            return nullptr;
+        position += sizeof(NodeStateDeltaRecord) + paddedSize;
+        ++recordsRead;
+        return record;
+    }
+
+    // Return true if all records have been read successfully
+    bool isComplete() const
+    {
+        return recordsRead == header->numberOfRecords && position == bufferSize;
+    }
+
+    const NodeStateDeltaHeader& getHeader() const
+    {
+        return *header;
+    }
+
+    static const unsigned char* recordData(const NodeStateDeltaRecord* record)
+    {
+        return reinterpret_cast<const unsigned char*>(record + 1);
+    }
+
+private:
+    const unsigned char* buffer;
+    unsigned long long bufferSize;
+    unsigned long long position;
+    unsigned int recordsRead;
+    const NodeStateDeltaHeader* header;
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 struct OracleReplyCommitTransaction : public Transaction
 {
 	static constexpr unsigned char transactionType()
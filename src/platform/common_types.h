@@ -1,3 +1,8 @@
 #pragma once
 
+#ifdef __GNUC__
+// GCC and Clang need -fshort-wchar, so wide string literals have 16-bit characters as with MSVC
+typedef wchar_t CHAR16;
+#else
 typedef unsigned short CHAR16;
+#endif
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "memory.h"
+
+// Compressed file format for large, sparse state buffers (spectrum, universe, contract states) saved in snapshots.
+//
+// The raw buffer is split into blocks that are compressed independently, so they can be decompressed in parallel.
+// If a slot size is given (size of the elements of a hash map, such as ::Entity or Asset), all-zero slots of a block
+// are removed first, storing a bitmap of the non-empty slots followed by the packed non-empty slots. The result is
+// compressed with a byte-oriented LZ77 codec in the style of LZ4 (no entropy coding, fast decompression).
+//
+// File layout: CompressedFileHeader, numberOfBlocks x CompressedFileBlock, block data.
+
+static constexpr unsigned int compressedFileMagic = 0x504d4351; // "QCMP"
+
+struct CompressedFileHeader
+{
+    unsigned int magic;
+    unsigned int slotSize;          // 0 if zero slots are not removed
+    unsigned long long rawSize;
+    unsigned int blockSize;         // raw size of each block except the last one
+    unsigned int numberOfBlocks;
+};
+
+struct CompressedFileBlock
+{
+    unsigned long long offset;      // byte offset of block data from beginning of file
+    unsigned int size;              // size of block data in file, LZ compressed if less than decodedSize
+    unsigned int decodedSize;       // size after LZ decompression, zero slots are removed if less than raw block size
+};
+
+static_assert(sizeof(CompressedFileHeader) == 24 && sizeof(CompressedFileBlock) == 16, "Unexpected struct size");
+
+namespace compression
+{
+    // Slots per block if zero slots are removed, limits size of slot bitmap to 4 KB (kept on stack when decoding)
+    static constexpr unsigned int slotsPerBlock = 32768;
+    static constexpr unsigned int maxSlotSize = 2048;
+    static constexpr unsigned int defaultBlockSize = 4 * 1024 * 1024;
+
+    static constexpr unsigned int minMatch = 4;
+    static constexpr unsigned int maxOffset = 65535;
+
+    static inline unsigned int load32(const unsigned char* p)
+    {
+        return *(const unsigned int*)p;
+    }
+
+    static inline unsigned long long load64(const unsigned char* p)
+    {
+        return *(const unsigned long long*)p;
+    }
+
+    // Copy forward byte order, which is required for overlapping matches (offset < length)
+    static inline void copyForward(unsigned char* dst, const unsigned char* src, unsigned int length, unsigned int offset)
+    {
+        if (offset >= 8)
+        {
+            while (length >= 8)
+            {
+                *(unsigned long long*)dst = load64(src);
+                dst += 8;
+                src += 8;
+                length -= 8;
+            }
+        }
+        while (length--)
+            *dst++ = *src++;
+    }
+
+    static inline bool writeLength(unsigned char*& op, const unsigned char* opEnd, unsigned int length)
+    {
+        while (length >= 255)
+        {
+            if (op >= opEnd)
+                return false;
+            *op++ = 255;
+            length -= 255;
+        }
+        if (op >= opEnd)
+            return false;
+        *op++ = (unsigned char)length;
+        return true;
+    }
+
+    static inline bool readLength(const unsigned char*& ip, const unsigned char* ipEnd, unsigned int& length)
+    {
+        unsigned char b;
+        do
+        {
+            if (ip >= ipEnd)
+                return false;
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // Emit sequence of literals followed by match (matchLength == 0 for last sequence without match)
+    static inline bool writeSequence(unsigned char*& op, const unsigned char* opEnd, const unsigned char* literals,
+        unsigned int literalLength, unsigned int offset, unsigned int matchLength)
+    {
+        if (op >= opEnd)
+            return false;
+        unsigned char* token = op++;
+        const unsigned int matchCode = matchLength ? matchLength - minMatch : 0;
+        *token = (unsigned char)(((literalLength < 15) ? literalLength : 15) << 4 | ((matchCode < 15) ? matchCode : 15));
+        if (literalLength >= 15 && !writeLength(op, opEnd, literalLength - 15))
+            return false;
+        if (literalLength > (unsigned long long)(opEnd - op))
+            return false;
+        copyMem(op, literals, literalLength);
+        op += literalLength;
+        if (matchLength)
+        {
+            if (opEnd - op < 2)
+                return false;
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            if (matchCode >= 15 && !writeLength(op, opEnd, matchCode - 15))
+                return false;
+        }
+        return true;
+    }
+
+    // Decompress LZ data to dst, which needs to have exactly dstSize bytes after decompression. Returns false if
+    // data is corrupted.
+    static bool lzDecompress(const unsigned char* src, unsigned int srcSize, unsigned char* dst, unsigned int dstSize)
+    {
+        const unsigned char* ip = src;
+        const unsigned char* const ipEnd = src + srcSize;
+        unsigned char* op = dst;
+        unsigned char* const opEnd = dst + dstSize;
+        while (ip < ipEnd)
+        {
+            const unsigned char token = *ip++;
+            unsigned int literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(ip, ipEnd, literalLength))
+                return false;
+            if (literalLength > (unsigned long long)(ipEnd - ip) || literalLength > (unsigned long long)(opEnd - op))
+                return false;
+            copyForward(op, ip, literalLength, 8);
+            op += literalLength;
+            ip += literalLength;
+            if (ip == ipEnd)
+                break; // last sequence has no match
+
+            if (ipEnd - ip < 2)
+                return false;
+            const unsigned int offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            unsigned int matchLength = token & 15;
+            if (matchLength == 15 && !readLength(ip, ipEnd, matchLength))
+                return false;
+            matchLength += minMatch;
+            if (offset == 0 || offset > (unsigned long long)(op - dst) || matchLength > (unsigned long long)(opEnd - op))
+                return false;
+            copyForward(op, op - offset, matchLength, offset);
+            op += matchLength;
+        }
+        return op == opEnd;
+    }
+
+    static inline unsigned int blockSizeForSlotSize(unsigned int slotSize)
+    {
+        return slotSize ? slotSize * slotsPerBlock : defaultBlockSize;
+    }
+
+    // Return slotSize if zero slots can be removed with it, otherwise 0
+    static inline unsigned int validSlotSize(unsigned long long rawSize, unsigned int slotSize)
+    {
+        return (slotSize > maxSlotSize || (slotSize && rawSize % slotSize)) ? 0 : slotSize;
+    }
+}
+
+// Compress buffers to the format described above. Uses about 64 KB for the hash table, so it should be allocated with
+// allocatePool() or as global/static variable instead of on the stack.
+class SnapshotCompressor
+{
+public:
+    // Maximum size of compressed data (if data cannot be compressed, blocks are stored uncompressed)
+    static unsigned long long compressBound(unsigned long long rawSize, unsigned int slotSize)
+    {
+        const unsigned int blockSize = compression::blockSizeForSlotSize(compression::validSlotSize(rawSize, slotSize));
+        const unsigned long long numberOfBlocks = (rawSize + blockSize - 1) / blockSize;
+        return sizeof(CompressedFileHeader) + numberOfBlocks * sizeof(CompressedFileBlock) + rawSize;
+    }
+
+    // Size of scratch buffer needed by compress()
+    static unsigned long long scratchSize(unsigned int slotSize)
+    {
+        return compression::blockSizeForSlotSize(slotSize) + compression::slotsPerBlock / 8;
+    }
+
+    // Compress raw data to out. If slotSize is not 0, rawSize must be a multiple of slotSize and all-zero slots are
+    // removed before LZ compression. Returns size of compressed data or 0 on error (for example if capacity of out is
+    // less than compressBound()).
+    unsigned long long compress(const unsigned char* raw, unsigned long long rawSize, unsigned int slotSize,
+        unsigned char* out, unsigned long long outCapacity, unsigned char* scratch)
+    {
+        slotSize = compression::validSlotSize(rawSize, slotSize);
+        const unsigned int blockSize = compression::blockSizeForSlotSize(slotSize);
+        const unsigned long long numberOfBlocks = (rawSize + blockSize - 1) / blockSize;
+        if (numberOfBlocks > 0xffffffff || outCapacity < sizeof(CompressedFileHeader) + numberOfBlocks * sizeof(CompressedFileBlock))
+            return 0;
+
+        CompressedFileHeader* header = (CompressedFileHeader*)out;
+        header->magic = compressedFileMagic;
+        header->slotSize = slotSize;
+        header->rawSize = rawSize;
+        header->blockSize = blockSize;
+        header->numberOfBlocks = (unsigned int)numberOfBlocks;
+        CompressedFileBlock* blocks = (CompressedFileBlock*)(header + 1);
+        unsigned long long outSize = sizeof(CompressedFileHeader) + numberOfBlocks * sizeof(CompressedFileBlock);
+
+        for (unsigned long long blockIndex = 0; blockIndex < numberOfBlocks; ++blockIndex)
+        {
+            const unsigned long long rawOffset = blockIndex * blockSize;
+            const unsigned int rawBlockSize = (unsigned int)((rawSize - rawOffset < blockSize) ? rawSize - rawOffset : blockSize);
+            const unsigned char* input = raw + rawOffset;
+            unsigned int inputSize = rawBlockSize;
+
+            if (slotSize)
+            {
+                const unsigned int elidedSize = removeZeroSlots(input, rawBlockSize, slotSize, scratch);
+                if (elidedSize < rawBlockSize)
+                {
+                    input = scratch;
+                    inputSize = elidedSize;
+                }
+            }
+
+            const unsigned long long remaining = outCapacity - outSize;
+            unsigned int blockDataSize = 0;
+            if (inputSize > 16)
+            {
+                // only accept LZ result if it is smaller than its input
+                const unsigned int capacity = (unsigned int)((remaining < inputSize - 1) ? remaining : inputSize - 1);
+                blockDataSize = lzCompress(input, inputSize, out + outSize, capacity);
+            }
+            if (!blockDataSize)
+            {
+                if (remaining < inputSize)
+                    return 0;
+                copyMem(out + outSize, input, inputSize);
+                blockDataSize = inputSize;
+            }
+
+            blocks[blockIndex].offset = outSize;
+            blocks[blockIndex].size = blockDataSize;
+            blocks[blockIndex].decodedSize = inputSize;
+            outSize += blockDataSize;
+        }
+        return outSize;
+    }
+
+    // Compress src with LZ codec. Returns compressed size or 0 if dstCapacity is exceeded.
+    unsigned int lzCompress(const unsigned char* src, unsigned int srcSize, unsigned char* dst, unsigned int dstCapacity)
+    {
+        using namespace compression;
+
+        setMem(hashTable, sizeof(hashTable), 0xff);
+        unsigned char* op = dst;
+        const unsigned char* const opEnd = dst + dstCapacity;
+        unsigned int anchor = 0;
+        unsigned int ip = 0;
+        unsigned int misses = 0;
+        const unsigned int matchLimit = (srcSize >= 8) ? srcSize - 8 : 0;
+        while (ip < matchLimit)
+        {
+            const unsigned int sequence = load32(src + ip);
+            const unsigned int hash = (sequence * 2654435761U) >> (32 - hashLog);
+            const unsigned int ref = hashTable[hash];
+            hashTable[hash] = ip;
+            if (ref == 0xffffffff || ip - ref > maxOffset || load32(src + ref) != sequence)
+            {
+                // skip faster through data that cannot be compressed
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            unsigned int matchLength = minMatch;
+            while (ip + matchLength + 8 <= srcSize)
+            {
+                const unsigned long long diff = load64(src + ip + matchLength) ^ load64(src + ref + matchLength);
+                if (diff)
+                {
+                    matchLength += (unsigned int)(_tzcnt_u64(diff) >> 3);
+                    goto matchEnd;
+                }
+                matchLength += 8;
+            }
+            while (ip + matchLength < srcSize && src[ip + matchLength] == src[ref + matchLength])
+                ++matchLength;
+        matchEnd:
+            if (!writeSequence(op, opEnd, src + anchor, ip - anchor, ip - ref, matchLength))
+                return 0;
+            ip += matchLength;
+            anchor = ip;
+        }
+
+        if (!writeSequence(op, opEnd, src + anchor, srcSize - anchor, 0, 0))
+            return 0;
+        return (unsigned int)(op - dst);
+    }
+
+private:
+    static constexpr unsigned int hashLog = 14;
+
+    // Write bitmap of non-zero slots followed by the non-zero slots to dst, return size written
+    static unsigned int removeZeroSlots(const unsigned char* src, unsigned int size, unsigned int slotSize, unsigned char* dst)
+    {
+        const unsigned int numberOfSlots = size / slotSize;
+        const unsigned int bitmapSize = (numberOfSlots + 7) / 8;
+        setMem(dst, bitmapSize, 0);
+        unsigned int dstSize = bitmapSize;
+        for (unsigned int slot = 0; slot < numberOfSlots; ++slot)
+        {
+            const unsigned char* slotData = src + (unsigned long long)slot * slotSize;
+            bool isZero = true;
+            unsigned int i = 0;
+            for (; isZero && i + 8 <= slotSize; i += 8)
+                isZero = (compression::load64(slotData + i) == 0);
+            for (; isZero && i < slotSize; ++i)
+                isZero = (slotData[i] == 0);
+            if (!isZero)
+            {
+                dst[slot >> 3] |= (1 << (slot & 7));
+                copyMem(dst + dstSize, slotData, slotSize);
+                dstSize += slotSize;
+            }
+        }
+        return dstSize;
+    }
+
+    unsigned int hashTable[1 << hashLog];
+};
+
+// Decompress data of the format described above. Blocks can be decoded by multiple processors in parallel by calling
+// decodeNextBlock() on each of them until it returns false.
+class SnapshotDecompressor
+{
+public:
+    // Check header and block table of compressed data and prepare decoding to raw buffer. Returns false if data is
+    // invalid or the raw size does not match.
+    bool init(const unsigned char* data, unsigned long long size, unsigned char* raw, unsigned long long rawSize)
+    {
+        this->data = data;
+        this->raw = raw;
+        nextBlock = 0;
+        decodedBlocks = 0;
+        failed = false;
+        if (size < sizeof(CompressedFileHeader))
+            return false;
+        header = (const CompressedFileHeader*)data;
+        if (header->magic != compressedFileMagic || header->rawSize != rawSize
+            || header->slotSize > compression::maxSlotSize || (header->slotSize && rawSize % header->slotSize)
+            || header->blockSize != compression::blockSizeForSlotSize(header->slotSize)
+            || header->numberOfBlocks != (rawSize + header->blockSize - 1) / header->blockSize
+            || size < sizeof(CompressedFileHeader) + (unsigned long long)header->numberOfBlocks * sizeof(CompressedFileBlock))
+            return false;
+        blocks = (const CompressedFileBlock*)(header + 1);
+        for (unsigned int i = 0; i < header->numberOfBlocks; ++i)
+        {
+            if (blocks[i].offset > size || blocks[i].size > size - blocks[i].offset || blocks[i].size > blocks[i].decodedSize)
+                return false;
+        }
+        return true;
+    }
+
+    // Decode the next block that has not been taken by another processor. Returns false if there is no block left.
+    bool decodeNextBlock()
+    {
+        const long blockIndex = _InterlockedIncrement(&nextBlock) - 1;
+        if ((unsigned long)blockIndex >= header->numberOfBlocks)
+            return false;
+        if (!decodeBlock(blockIndex))
+            failed = true;
+        _InterlockedIncrement(&decodedBlocks);
+        return true;
+    }
+
+    // Return true if all blocks have been decoded successfully
+    bool isComplete() const
+    {
+        return !failed && (unsigned long)decodedBlocks == header->numberOfBlocks;
+    }
+
+private:
+    bool decodeBlock(unsigned int blockIndex) const
+    {
+        const CompressedFileBlock& block = blocks[blockIndex];
+        const unsigned long long rawOffset = (unsigned long long)blockIndex * header->blockSize;
+        const unsigned int rawBlockSize = (unsigned int)((header->rawSize - rawOffset < header->blockSize) ? header->rawSize - rawOffset : header->blockSize);
+        unsigned char* dst = raw + rawOffset;
+        const unsigned char* src = data + block.offset;
+
+        if (block.decodedSize > rawBlockSize)
+            return false;
+        const bool zeroSlotsRemoved = block.decodedSize < rawBlockSize;
+
+        // If zero slots are removed, decode bitmap and packed slots to the end of the block and expand forward in place.
+        // Packed slot data is never overwritten before it is read, because its position is always >= the position of
+        // its final slot.
+        unsigned char* decoded = dst + rawBlockSize - block.decodedSize;
+        if (block.size < block.decodedSize)
+        {
+            if (!compression::lzDecompress(src, block.size, decoded, block.decodedSize))
+                return false;
+        }
+        else
+        {
+            copyMem(decoded, src, block.size);
+        }
+        if (!zeroSlotsRemoved)
+            return true;
+
+        const unsigned int slotSize = header->slotSize;
+        if (!slotSize)
+            return false;
+        const unsigned int numberOfSlots = rawBlockSize / slotSize;
+        const unsigned int bitmapSize = (numberOfSlots + 7) / 8;
+        if (block.decodedSize < bitmapSize)
+            return false;
+        unsigned char bitmap[compression::slotsPerBlock / 8];
+        copyMem(bitmap, decoded, bitmapSize);
+        if (bitmapSize + countBits(bitmap, bitmapSize) * slotSize != block.decodedSize)
+            return false;
+        const unsigned char* packed = decoded + bitmapSize;
+        for (unsigned int slot = 0; slot < numberOfSlots; ++slot)
+        {
+            unsigned char* slotData = dst + (unsigned long long)slot * slotSize;
+            if (bitmap[slot >> 3] & (1 << (slot & 7)))
+            {
+                if (packed != slotData)
+                    copyForward(slotData, packed, slotSize);
+                packed += slotSize;
+            }
+            else
+            {
+                setMem(slotData, slotSize, 0);
+            }
+        }
+        return true;
+    }
+
+    static void copyForward(unsigned char* dst, const unsigned char* src, unsigned int size)
+    {
+        compression::copyForward(dst, src, size, (unsigned int)(src - dst));
+    }
+
+    static unsigned int countBits(const unsigned char* bitmap, unsigned int size)
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < size; ++i)
+            count += __popcnt(bitmap[i]);
+        return count;
+    }
+
+    const unsigned char* data;
+    unsigned char* raw;
+    const CompressedFileHeader* header;
+    const CompressedFileBlock* blocks;
+    volatile long nextBlock;
+    volatile long decodedBlocks;
+    volatile bool failed;
+};
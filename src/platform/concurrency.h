@@ -10,3 +10,8 @@
 
 // Release lock
 #define RELEASE(lock) lock = 0
+
+// Run procedure(argument) on all idle processors in parallel and return when all have finished. Only available while
+// the processors are not busy with their main loops (during initialization), nullptr otherwise. Callers need to split
+// the work into tasks that are taken by the processors, so the calling processor can do all of them if it is nullptr.
+static void (*runOnIdleProcessors)(void (*procedure)(void* argument), void* argument) = nullptr;
@@ -14,6 +14,7 @@ static CHAR16 message[16384], timestampedMessage[16384];
 #ifdef NO_UEFI
 
 #include <cstdio>
+#include <cwchar>
 
 // Output to console on no-UEFI platform
 static inline void outputStringToConsole(const CHAR16* str)
@@ -4,17 +4,126 @@
 
 #ifdef NO_UEFI
 #include <cstdio>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #endif
 
 #include "uefi.h"
 #include "console_logging.h"
-
+#include "concurrency.h"
+#include "compression.h"
+#include "time_stamp_counter.h"
+
+// Files are read and written in blocks of adaptive size. Each call to load() / save() starts with readingBlockSize /
+// writingBlockSize (MAX_IO_BLOCK_SIZE by default) and halves the block size each time the firmware fails to read or
+// write a block, down to READING_CHUNK_SIZE / WRITING_CHUNK_SIZE. The reduced size is only used for the rest of this
+// call, so a transient failure does not slow down the following calls.
 // If you get an error reading and writing files, set the chunk sizes below to
 // the cluster size set for formatting you disk. If you have no idea about the
 // cluster size, try 16384.
 #define READING_CHUNK_SIZE 32768
 #define WRITING_CHUNK_SIZE 32768
+#define MAX_IO_BLOCK_SIZE (16ULL * 1024 * 1024)
 #define FILE_CHUNK_SIZE (209715200ULL) // for large file saving
+
+// Loading and saving files of at least this size is reported with progress and throughput
+#define FILE_IO_REPORT_MIN_SIZE (64ULL * 1024 * 1024)
+
+// Initial block sizes of each call
+static unsigned long long readingBlockSize = MAX_IO_BLOCK_SIZE;
+static unsigned long long writingBlockSize = MAX_IO_BLOCK_SIZE;
+
+// Report progress (every second) and throughput of loading or saving a large file
+class FileIOProgress
+{
+public:
+    FileIOProgress(const CHAR16* fileName, unsigned long long totalSize, bool saving)
+        : fileName(fileName), totalSize(totalSize), saving(saving)
+    {
+        beginningTick = lastReportTick = __rdtsc();
+    }
+
+    void update(unsigned long long doneSize)
+    {
+        const unsigned long long now = __rdtsc();
+        if (isReported() && now - lastReportTick >= frequency)
+        {
+            lastReportTick = now;
+            report(doneSize, now, false);
+        }
+    }
+
+    void finish(unsigned long long doneSize)
+    {
+        if (isReported())
+            report(doneSize, __rdtsc(), true);
+    }
+
+private:
+    bool isReported() const
+    {
+        return totalSize >= FILE_IO_REPORT_MIN_SIZE && frequency;
+    }
+
+    void report(unsigned long long doneSize, unsigned long long now, bool finished) const
+    {
+        const unsigned long long elapsedTicks = (now > beginningTick) ? now - beginningTick : 1;
+        CHAR16 text[256];
+        setText(text, (saving) ? L"Saving " : L"Loading ");
+        appendText(text, fileName);
+        appendText(text, L": ");
+        appendNumber(text, doneSize / (1024 * 1024), TRUE);
+        appendText(text, L" / ");
+        appendNumber(text, totalSize / (1024 * 1024), TRUE);
+        appendText(text, L" MB, ");
+        if (finished)
+        {
+            appendNumber(text, elapsedTicks * 1000 / frequency, TRUE);
+            appendText(text, L" ms, ");
+        }
+        appendNumber(text, doneSize * 1000 / (1024 * 1024) * frequency / elapsedTicks / 1000, TRUE);
+        appendText(text, L" MB/s");
+        logToConsole(text);
+    }
+
+    const CHAR16* fileName;
+    unsigned long long totalSize;
+    unsigned long long beginningTick;
+    unsigned long long lastReportTick;
+    bool saving;
+};
+
+#ifdef NO_UEFI
+// Get path usable with the C library from file name and optional directory. Returns false if a name contains
+// non-ASCII characters (which cannot be passed through as char) or the path does not fit into pathCapacity.
+static bool getFilePath(char* path, unsigned int pathCapacity, const CHAR16* fileName, const CHAR16* directory)
+{
+    unsigned int i = 0;
+    if (directory)
+    {
+        for (; *directory; ++directory)
+        {
+            if (*directory >= 0x80 || i + 2 >= pathCapacity)
+                return false;
+            path[i++] = (char)*directory;
+        }
+        path[i++] = '/';
+    }
+    for (; *fileName; ++fileName)
+    {
+        if (*fileName >= 0x80 || i + 1 >= pathCapacity)
+            return false;
+        path[i++] = (char)*fileName;
+    }
+    path[i] = 0;
+    return true;
+}
+#endif
 #define VOLUME_LABEL L"Qubic"
 
 static EFI_FILE_PROTOCOL* root = NULL;
@@ -22,8 +131,11 @@ static EFI_FILE_PROTOCOL* root = NULL;
 static long long getFileSize(CHAR16* fileName, CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of getFileSize() is missing! No valid file size returned!");
-    return -1;
+    char path[1024];
+    struct stat fileStatus;
+    if (!getFilePath(path, sizeof(path), fileName, directory) || stat(path, &fileStatus) != 0 || !(fileStatus.st_mode & S_IFREG))
+        return -1;
+    return fileStatus.st_size;
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file;
@@ -71,8 +183,9 @@ static long long getFileSize(CHAR16* fileName, CHAR16* directory = NULL)
 static bool checkDir(const CHAR16* dirName)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of checkDir() is missing! No directory checked!");
-    return false;
+    char path[1024];
+    struct stat fileStatus;
+    return getFilePath(path, sizeof(path), dirName, NULL) && stat(path, &fileStatus) == 0 && (fileStatus.st_mode & S_IFDIR);
 #else
     EFI_FILE_PROTOCOL* file;
 
@@ -90,8 +203,19 @@ static bool checkDir(const CHAR16* dirName)
 static bool createDir(const CHAR16* dirName)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of createDir() is missing! No directory created!");
-    return false;
+    if (checkDir(dirName))
+        return true;
+    char path[1024];
+    if (!getFilePath(path, sizeof(path), dirName, NULL))
+    {
+        logToConsole(L"Directory name not supported in NO_UEFI createDir(), only ASCII names are supported!");
+        return false;
+    }
+#ifdef _MSC_VER
+    return _mkdir(path) == 0;
+#else
+    return mkdir(path, 0755) == 0;
+#endif
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file;
@@ -117,27 +241,50 @@ static bool createDir(const CHAR16* dirName)
 #endif
 }
 
-static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+// Load totalSize bytes starting at fileOffset from file to buffer. Returns number of bytes read or -1 on error.
+static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL, unsigned long long fileOffset = 0)
 {
 #ifdef NO_UEFI
-    if (directory)
+    char path[1024];
+    if (!getFilePath(path, sizeof(path), fileName, directory))
     {
-        logToConsole(L"Argument directory not implemented for NO_UEFI load()! Pass full path as fileName!");
+        logToConsole(L"File name not supported in NO_UEFI file I/O, only ASCII names are supported!");
         return -1;
     }
-    FILE* file = nullptr;
-    if (_wfopen_s(&file, fileName, L"rb") != 0 || !file)
+    FILE* file = fopen(path, "rb");
+    if (!file)
     {
-        wprintf(L"Error opening file %s!\n", fileName);
+        printf("Error opening file %s!\n", path);
         return -1;
     }
-    if (fread(buffer, 1, totalSize, file) != totalSize)
+#ifdef _MSC_VER
+    if (fileOffset && _fseeki64(file, fileOffset, SEEK_SET) != 0)
+#else
+    if (fileOffset && fseeko(file, fileOffset, SEEK_SET) != 0)
+#endif
     {
-        wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+        printf("Error seeking in file %s!\n", path);
+        fclose(file);
         return -1;
     }
+    FileIOProgress progress(fileName, totalSize, false);
+    const unsigned long long blockSize = readingBlockSize;
+    unsigned long long readSize = 0;
+    while (readSize < totalSize)
+    {
+        const unsigned long long size = (blockSize <= totalSize - readSize) ? blockSize : totalSize - readSize;
+        if (fread(buffer + readSize, 1, size, file) != size)
+        {
+            printf("Error reading %llu bytes from %s!\n", totalSize, path);
+            fclose(file);
+            return -1;
+        }
+        readSize += size;
+        progress.update(readSize);
+    }
     fclose(file);
-    return totalSize;
+    progress.finish(readSize);
+    return readSize;
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file;
@@ -173,17 +320,41 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
         }
     }
 
-    
+    if (EFI_SUCCESS == status && fileOffset)
+    {
+        if (status = file->SetPosition(file, fileOffset))
+        {
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+            file->Close(file);
+            return -1;
+        }
+    }
+
     if (EFI_SUCCESS == status)
     {
+        FileIOProgress progress(fileName, totalSize, false);
+        unsigned long long blockSize = readingBlockSize;
         unsigned long long readSize = 0;
         while (readSize < totalSize)
         {
-            unsigned long long size = (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize));
+            const unsigned long long requestedSize = (blockSize <= (totalSize - readSize) ? blockSize : (totalSize - readSize));
+            unsigned long long size = requestedSize;
             status = file->Read(file, &size, &buffer[readSize]);
-            if (status
-                || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
+            if (status || size != requestedSize)
             {
+                if (requestedSize > READING_CHUNK_SIZE)
+                {
+                    // Some firmware fails reading large blocks -> retry from same position with smaller blocks
+                    blockSize = (requestedSize / 2 > READING_CHUNK_SIZE) ? requestedSize / 2 : READING_CHUNK_SIZE;
+                    if (status = file->SetPosition(file, fileOffset + readSize))
+                    {
+                        logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+                        file->Close(file);
+                        return -1;
+                    }
+                    continue;
+                }
+
                 // If this error occurs, see the definition of READING_CHUNK_SIZE above.
                 logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
 
@@ -192,8 +363,10 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
                 return -1;
             }
             readSize += size;
+            progress.update(readSize);
         }
         file->Close(file);
+        progress.finish(readSize);
 
         return readSize;
     }
@@ -204,8 +377,43 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
 static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of save() is missing! No file saved!");
-    return 0;
+    if (directory)
+    {
+        createDir(directory);
+    }
+    char path[1024];
+    if (!getFilePath(path, sizeof(path), fileName, directory))
+    {
+        logToConsole(L"File name not supported in NO_UEFI file I/O, only ASCII names are supported!");
+        return -1;
+    }
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Error creating file %s!\n", path);
+        return -1;
+    }
+    FileIOProgress progress(fileName, totalSize, true);
+    const unsigned long long blockSize = writingBlockSize;
+    unsigned long long writtenSize = 0;
+    while (writtenSize < totalSize)
+    {
+        const unsigned long long size = (blockSize <= totalSize - writtenSize) ? blockSize : totalSize - writtenSize;
+        if (fwrite(buffer + writtenSize, 1, size, file) != size)
+        {
+            printf("Error writing %llu bytes to %s!\n", totalSize, path);
+            fclose(file);
+            return -1;
+        }
+        writtenSize += size;
+        progress.update(writtenSize);
+    }
+    if (fclose(file) != 0)
+    {
+        return -1;
+    }
+    progress.finish(writtenSize);
+    return writtenSize;
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file = NULL;
@@ -250,14 +458,29 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
     
     if (EFI_SUCCESS == status)
     {
+        FileIOProgress progress(fileName, totalSize, true);
+        unsigned long long blockSize = writingBlockSize;
         unsigned long long writtenSize = 0;
         while (writtenSize < totalSize)
         {
-            unsigned long long size = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
+            const unsigned long long requestedSize = (blockSize <= (totalSize - writtenSize) ? blockSize : (totalSize - writtenSize));
+            unsigned long long size = requestedSize;
             status = file->Write(file, &size, (void*)&buffer[writtenSize]);
-            if (status
-                || size != (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize)))
+            if (status || size != requestedSize)
             {
+                if (requestedSize > WRITING_CHUNK_SIZE)
+                {
+                    // Some firmware fails writing large blocks -> retry from same position with smaller blocks
+                    blockSize = (requestedSize / 2 > WRITING_CHUNK_SIZE) ? requestedSize / 2 : WRITING_CHUNK_SIZE;
+                    if (status = file->SetPosition(file, writtenSize))
+                    {
+                        logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+                        file->Close(file);
+                        return -1;
+                    }
+                    continue;
+                }
+
                 // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
                 logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
 
@@ -266,8 +489,10 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
                 return -1;
             }
             writtenSize += size;
+            progress.update(writtenSize);
         }
         file->Close(file);
+        progress.finish(writtenSize);
 
         return writtenSize;
     }
@@ -275,6 +500,169 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
 #endif
 }
 
+// Append buffer to end of file, creating the file if it does not exist. If truncate is true, an existing file is deleted
+// first. Returns number of bytes written or -1 on error.
+static long long append(const CHAR16* fileName, unsigned long long size, const unsigned char* buffer, const CHAR16* directory = NULL, bool truncate = false)
+{
+#ifdef NO_UEFI
+    if (directory)
+    {
+        createDir(directory);
+    }
+    char path[1024];
+    if (!getFilePath(path, sizeof(path), fileName, directory))
+    {
+        logToConsole(L"File name not supported in NO_UEFI file I/O, only ASCII names are supported!");
+        return -1;
+    }
+    FILE* file = fopen(path, (truncate) ? "wb" : "ab");
+    if (!file)
+    {
+        printf("Error opening file %s!\n", path);
+        return -1;
+    }
+    if (fwrite(buffer, 1, size, file) != size)
+    {
+        printf("Error appending %llu bytes to %s!\n", size, path);
+        fclose(file);
+        return -1;
+    }
+    if (fclose(file) != 0)
+    {
+        return -1;
+    }
+    return size;
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file = NULL;
+    EFI_FILE_PROTOCOL* directoryProtocol = root;
+
+    // Check if there is a directory provided
+    if (NULL != directory)
+    {
+        createDir(directory);
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOAppend:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return -1;
+        }
+    }
+
+    if (truncate && !directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0))
+    {
+        // Delete() also closes the file
+        file->Delete(file);
+    }
+
+    status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+    if (directoryProtocol != root)
+    {
+        directoryProtocol->Close(directoryProtocol);
+    }
+    if (status)
+    {
+        logStatusToConsole(L"FileIOAppend:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+        return -1;
+    }
+
+    // Position 0xFFFFFFFFFFFFFFFF is end of file
+    if (status = file->SetPosition(file, 0xFFFFFFFFFFFFFFFFULL))
+    {
+        logStatusToConsole(L"FileIOAppend:SetPosition EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+        file->Close(file);
+        return -1;
+    }
+
+    unsigned long long writtenSize = 0;
+    while (writtenSize < size)
+    {
+        const unsigned long long requestedSize = (writingBlockSize <= (size - writtenSize) ? writingBlockSize : (size - writtenSize));
+        unsigned long long writeSize = requestedSize;
+        status = file->Write(file, &writeSize, (void*)&buffer[writtenSize]);
+        if (status || writeSize != requestedSize)
+        {
+            logStatusToConsole(L"FileIOAppend:Write EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
+            file->Close(file);
+            return -1;
+        }
+        writtenSize += writeSize;
+    }
+    file->Close(file);
+    return writtenSize;
+#endif
+}
+
+// Truncate existing file to size bytes. Returns false on error.
+static bool setFileSize(const CHAR16* fileName, unsigned long long size, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    char path[1024];
+    if (!getFilePath(path, sizeof(path), fileName, directory))
+    {
+        logToConsole(L"File name not supported in NO_UEFI file I/O, only ASCII names are supported!");
+        return false;
+    }
+#ifdef _MSC_VER
+    FILE* file = fopen(path, "r+b");
+    if (!file)
+    {
+        printf("Error opening file %s!\n", path);
+        return false;
+    }
+    const bool ok = _chsize_s(_fileno(file), size) == 0;
+    fclose(file);
+    return ok;
+#else
+    return truncate(path, size) == 0;
+#endif
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file = NULL;
+    EFI_FILE_PROTOCOL* directoryProtocol = root;
+
+    // Check if there is a directory provided
+    if (NULL != directory)
+    {
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOSetSize:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return false;
+        }
+    }
+
+    status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+    if (directoryProtocol != root)
+    {
+        directoryProtocol->Close(directoryProtocol);
+    }
+    if (status)
+    {
+        logStatusToConsole(L"FileIOSetSize:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+        return false;
+    }
+
+    // FileSize is the second field of EFI_FILE_INFO
+    EFI_GUID fileInfoId = EFI_FILE_INFO_ID;
+    unsigned long long bufferSize = 1024;
+    unsigned char buffer[1024];
+    if (status = file->GetInfo(file, &fileInfoId, &bufferSize, buffer))
+    {
+        logStatusToConsole(L"FileIOSetSize:GetInfo EFI_FILE_PROTOCOL.GetInfo() fails", status, __LINE__);
+        file->Close(file);
+        return false;
+    }
+    copyMem(buffer + 8, &size, 8);
+    if (status = file->SetInfo(file, &fileInfoId, bufferSize, buffer))
+    {
+        logStatusToConsole(L"FileIOSetSize:SetInfo EFI_FILE_PROTOCOL.SetInfo() fails", status, __LINE__);
+        file->Close(file);
+        return false;
+    }
+    file->Close(file);
+    return true;
+#endif
+}
+
 
 static bool initFilesystem()
 {
@@ -434,6 +822,26 @@ static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     return totalWriteSize;
 }
 
+// Save one chunk of a large file in the format of saveLargeFile(). Allows to split saving a large file into multiple steps.
+// Returns number of bytes written (0 if chunkId is beyond the end) or -1 on error.
+static long long saveLargeFileChunk(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, unsigned int chunkId, CHAR16* directory = NULL)
+{
+    const unsigned long long maxWriteSizePerChunk = FILE_CHUNK_SIZE;
+    if (totalSize < maxWriteSizePerChunk) {
+        return (chunkId == 0) ? save(fileName, totalSize, buffer, directory) : 0;
+    }
+    const unsigned long long offset = chunkId * maxWriteSizePerChunk;
+    if (offset >= totalSize) {
+        return 0;
+    }
+    CHAR16 fileNameWithChunkId[64];
+    setText(fileNameWithChunkId, fileName);
+    appendText(fileNameWithChunkId, L".XXX");
+    addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+    const unsigned long long writeSize = maxWriteSizePerChunk < totalSize - offset ? maxWriteSizePerChunk : totalSize - offset;
+    return save(fileNameWithChunkId, writeSize, buffer + offset, directory);
+}
+
 static long long loadLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL)
 {
     const unsigned long long maxReadSizePerChunk = FILE_CHUNK_SIZE;
@@ -458,4 +866,134 @@ static long long loadLargeFile(CHAR16* fileName, unsigned long long totalSize, u
         chunkId++;
     }
     return totalReadSize;
+}
+
+// Load byte range [offset, offset + size) of a file saved with saveLargeFile() with totalSize bytes to buffer + offset.
+// Allows to load parts of a large file on demand. Returns true on success.
+static bool loadLargeFileRange(CHAR16* fileName, unsigned long long totalSize, unsigned long long offset, unsigned long long size, unsigned char* buffer, CHAR16* directory = NULL)
+{
+    const unsigned long long maxReadSizePerChunk = FILE_CHUNK_SIZE;
+    if (offset + size > totalSize) {
+        return false;
+    }
+    if (totalSize < maxReadSizePerChunk) {
+        return load(fileName, size, buffer + offset, directory, offset) == size;
+    }
+    while (size) {
+        const unsigned int chunkId = (unsigned int)(offset / maxReadSizePerChunk);
+        const unsigned long long offsetInChunk = offset % maxReadSizePerChunk;
+        const unsigned long long readSize = maxReadSizePerChunk - offsetInChunk < size ? maxReadSizePerChunk - offsetInChunk : size;
+        CHAR16 fileNameWithChunkId[64];
+        setText(fileNameWithChunkId, fileName);
+        appendText(fileNameWithChunkId, L".XXX");
+        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+        if (load(fileNameWithChunkId, readSize, buffer + offset, directory, offsetInChunk) != readSize) {
+            return false;
+        }
+        offset += readSize;
+        size -= readSize;
+    }
+    return true;
+}
+
+// Save buffer in compressed format (see compression.h). slotSize is the size of the elements of the buffer, used for
+// removing empty slots (0 to disable). Saves raw data if compression does not reduce size or memory for compression
+// cannot be allocated. Returns totalSize if the file has been saved successfully, otherwise a different value.
+static long long saveCompressed(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, unsigned int slotSize, const CHAR16* directory = NULL)
+{
+    const unsigned long long beginningTick = __rdtsc();
+    const unsigned long long capacity = SnapshotCompressor::compressBound(totalSize, slotSize);
+    unsigned char* compressed = NULL;
+    unsigned char* scratch = NULL;
+    SnapshotCompressor* compressor = NULL;
+    if (!allocatePool(capacity, (void**)&compressed)
+        || !allocatePool(SnapshotCompressor::scratchSize(slotSize), (void**)&scratch)
+        || !allocatePool(sizeof(SnapshotCompressor), (void**)&compressor))
+    {
+        logToConsole(L"Failed to allocate memory for compression, saving uncompressed file");
+        if (compressed)
+            freePool(compressed);
+        if (scratch)
+            freePool(scratch);
+        return save(fileName, totalSize, buffer, directory);
+    }
+
+    long long result;
+    const unsigned long long compressedSize = compressor->compress(buffer, totalSize, slotSize, compressed, capacity, scratch);
+    if (compressedSize == 0 || compressedSize >= totalSize)
+    {
+        result = save(fileName, totalSize, buffer, directory);
+    }
+    else
+    {
+        result = (save(fileName, compressedSize, compressed, directory) == compressedSize) ? totalSize : -1;
+
+        CHAR16 message[256];
+        setText(message, fileName);
+        appendText(message, L": ");
+        appendNumber(message, totalSize, TRUE);
+        appendText(message, L" bytes compressed to ");
+        appendNumber(message, compressedSize, TRUE);
+        appendText(message, L" bytes (");
+        appendNumber(message, (frequency) ? (__rdtsc() - beginningTick) * 1000000 / frequency : 0, TRUE);
+        appendText(message, L" microseconds).");
+        logToConsole(message);
+    }
+
+    freePool(compressor);
+    freePool(scratch);
+    freePool(compressed);
+    return result;
+}
+
+static void decompressBlocks(void* decompressor)
+{
+    while (((SnapshotDecompressor*)decompressor)->decodeNextBlock())
+    {
+    }
+}
+
+// Load file saved with saveCompressed() or save() to buffer. Files that have exactly totalSize bytes are loaded as raw
+// data. Decompression is distributed to idle processors if runOnIdleProcessors is available. Returns totalSize if the
+// file has been loaded successfully, otherwise a different value.
+static long long loadCompressed(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+{
+    const long long fileSize = getFileSize((CHAR16*)fileName, (CHAR16*)directory);
+    if (fileSize < 0 || (unsigned long long)fileSize == totalSize)
+    {
+        return load(fileName, totalSize, buffer, directory);
+    }
+
+    unsigned char* compressed = NULL;
+    if (!allocatePool(fileSize, (void**)&compressed))
+    {
+        logToConsole(L"Failed to allocate memory for loading compressed file");
+        return -1;
+    }
+
+    long long result = -1;
+    SnapshotDecompressor decompressor;
+    if (load(fileName, fileSize, compressed, directory) == fileSize
+        && decompressor.init(compressed, fileSize, buffer, totalSize))
+    {
+        if (runOnIdleProcessors)
+        {
+            runOnIdleProcessors(decompressBlocks, &decompressor);
+        }
+        decompressBlocks(&decompressor);
+        if (decompressor.isComplete())
+        {
+            result = totalSize;
+        }
+    }
+    if (result < 0)
+    {
+        CHAR16 message[256];
+        setText(message, L"Invalid compressed file ");
+        appendText(message, fileName);
+        logToConsole(message);
+    }
+
+    freePool(compressed);
+    return result;
 }
\ No newline at end of file
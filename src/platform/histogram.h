@@ -0,0 +1,106 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "memory.h"
+
+// Histogram of durations (such as CPU ticks) for estimating percentiles with constant memory and time. Each power of 2
+// is split into 4 buckets, so the estimates are at most 25% above the true value (and never above the maximum).
+// add() may be called by several processors concurrently. reset() and the getters are not synchronized with add(),
+// which is fine for monitoring.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned int subBucketBits = 2;
+    static constexpr unsigned int numberOfSubBuckets = 1 << subBucketBits;
+    static constexpr unsigned int numberOfBuckets = numberOfSubBuckets + (64 - subBucketBits) * numberOfSubBuckets;
+
+    void reset()
+    {
+        setMem((void*)counts, sizeof(counts), 0);
+        maxValue = 0;
+    }
+
+    void add(unsigned long long value)
+    {
+        _InterlockedIncrement64(&counts[bucketOf(value)]);
+        long long currentMax = maxValue;
+        while ((unsigned long long)currentMax < value)
+        {
+            const long long previousMax = _InterlockedCompareExchange64(&maxValue, (long long)value, currentMax);
+            if (previousMax == currentMax)
+            {
+                break;
+            }
+            currentMax = previousMax;
+        }
+    }
+
+    unsigned long long count() const
+    {
+        unsigned long long totalCount = 0;
+        for (unsigned int i = 0; i < numberOfBuckets; i++)
+        {
+            totalCount += counts[i];
+        }
+        return totalCount;
+    }
+
+    unsigned long long max() const
+    {
+        return maxValue;
+    }
+
+    // Return estimate of value that is not exceeded by permille / 1000 of the values, 0 if there is no value
+    unsigned long long percentile(unsigned int permille) const
+    {
+        const unsigned long long totalCount = count();
+        if (!totalCount)
+        {
+            return 0;
+        }
+        unsigned long long targetCount = (totalCount * permille + 999) / 1000;
+        if (!targetCount)
+        {
+            targetCount = 1;
+        }
+        unsigned long long accumulatedCount = 0;
+        for (unsigned int i = 0; i < numberOfBuckets; i++)
+        {
+            accumulatedCount += counts[i];
+            if (accumulatedCount >= targetCount)
+            {
+                const unsigned long long bound = upperBoundOf(i);
+                return (bound < (unsigned long long)maxValue) ? bound : maxValue;
+            }
+        }
+        return maxValue;
+    }
+
+    static unsigned int bucketOf(unsigned long long value)
+    {
+        if (value < numberOfSubBuckets)
+        {
+            return (unsigned int)value;
+        }
+        const unsigned int exponent = 63 - (unsigned int)_lzcnt_u64(value);
+        const unsigned int mantissa = (value >> (exponent - subBucketBits)) & (numberOfSubBuckets - 1);
+        return numberOfSubBuckets + (exponent - subBucketBits) * numberOfSubBuckets + mantissa;
+    }
+
+    // Largest value in bucket
+    static unsigned long long upperBoundOf(unsigned int bucket)
+    {
+        if (bucket < numberOfSubBuckets)
+        {
+            return bucket;
+        }
+        const unsigned int shift = (bucket - numberOfSubBuckets) / numberOfSubBuckets;
+        const unsigned long long mantissa = (bucket - numberOfSubBuckets) % numberOfSubBuckets;
+        return ((numberOfSubBuckets + mantissa) << shift) + (1ULL << shift) - 1;
+    }
+
+private:
+    volatile long long counts[numberOfBuckets];
+    volatile long long maxValue;
+};
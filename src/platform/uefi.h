@@ -96,7 +96,12 @@
 #define TPL_NOTIFY 16
 
 typedef unsigned char BOOLEAN;
+#ifdef __GNUC__
+// GCC and Clang need -fshort-wchar, so wide string literals have 16-bit characters as with MSVC
+typedef wchar_t CHAR16;
+#else
 typedef unsigned short CHAR16;
+#endif
 typedef void* EFI_EVENT;
 typedef void* EFI_HANDLE;
 typedef unsigned long long EFI_PHYSICAL_ADDRESS;
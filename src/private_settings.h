@@ -47,4 +47,33 @@ static unsigned long long logReaderPasscodes[4] = {
 // Perform state persisting when your node is misaligned will also make your node misaligned after resuming.
 // Thus, picking various TICK_STORAGE_AUTOSAVE_TICK_PERIOD numbers across AUX nodes is recommended.
 // some suggested prime numbers you can try: 971 977 983 991 997
-#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
\ No newline at end of file
+#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
+// When loading a tick storage snapshot at startup, only the most recent TICK_STORAGE_EAGER_LOAD_TICKS ticks are loaded
+// before the node starts processing ticks. Older ticks are loaded by the main loop afterwards, one segment of
+// TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS ticks per iteration, prioritizing ticks requested by peers.
+// Set TICK_STORAGE_EAGER_LOAD_TICKS to 0 to load all ticks at startup.
+#define TICK_STORAGE_EAGER_LOAD_TICKS 1000
+#define TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS 64
+// Number of recent ticks of the current epoch for which the votes of all computors are kept in full (0 = all ticks).
+// The votes of older ticks are compacted: only the votes agreeing with the majority are kept, without the fields that are
+// shared by all of them, which reduces tick vote memory by about half. Cannot be combined with TICK_STORAGE_AUTOSAVE_MODE.
+// Minority votes of compacted ticks are lost: peers requesting older ticks with RequestCompactQuorumTicks or
+// RequestTickRange only get the majority votes, without any indication that other votes existed.
+#define TICK_STORAGE_RETENTION_TICKS 0
+
+// Write the finalized ticks (tick data, digests agreed by the quorum, and transactions) to one archive file per epoch
+// in the directory "archive" for external indexers (see epoch_archive.h and tools/epoch_archive_reader).
+// EPOCH_ARCHIVE_BUFFER_SIZE is the size of each of the two buffers passing the ticks from tick processor to main loop.
+#define EPOCH_ARCHIVE 0
+#define EPOCH_ARCHIVE_BUFFER_SIZE (64ULL * 1024 * 1024)
+
+// Node state snapshots are saved as delta of the previous snapshot if possible, containing only the changed parts of
+// spectrum, universe, contract states, and miner solution flags. After NODE_STATE_DELTAS_PER_BASE deltas or if the
+// changes exceed NODE_STATE_DELTA_BUFFER_SIZE, a full snapshot is saved. Deltas are captured in memory at a tick boundary
+// and written by the main loop while the tick processor continues. Full snapshots pause the tick processor until saved.
+// Set NODE_STATE_DELTAS_PER_BASE to 0 to always save full snapshots.
+#define NODE_STATE_DELTAS_PER_BASE 20
+#define NODE_STATE_DELTA_BUFFER_SIZE (2ULL * 1024 * 1024 * 1024)
+// Save spectrum, universe, and contract states of full node state snapshots in compressed format (empty slots removed,
+// LZ compression). Loading supports compressed and uncompressed files.
+#define NODE_STATE_SNAPSHOT_COMPRESSION 1
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "platform/common_types.h"
+
 ////////// Public Settings \\\\\\\\\\
 
 //////////////////////////////////////////////////////////////////////////
@@ -16,6 +18,25 @@
 // is MAX_NUMBER_OF_PROCESSORS - 1.
 #define NUMBER_OF_CONTRACT_EXECUTION_BUFFERS 10
 
+// Let contract function calls requested via network run on a snapshot of the contract state of the last completed tick
+// instead of locking the current state, so heavy query load does not delay procedures executed by the tick processor.
+// Doubles the RAM used for contract states (sum of stateSize of all contracts). After each tick, the state of each
+// contract changed in the tick is compared with its snapshot and the changed 4 KB pages are copied, so the cost per
+// tick is reading the full changed states plus copying what changed. Calls by the core itself always use the current state.
+#define USE_CONTRACT_STATE_SNAPSHOTS 0
+
+// Cache for outputs of contract functions requested via network. Identical requests in the same tick are served from
+// the cache as long as the contract state is unchanged. Outputs of functions reading spectrum, universe, or the state
+// of other contracts are not cached. Requires about ENTRIES * MAX_OUTPUT_SIZE bytes of RAM, larger
+// outputs are not cached. Set CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES to 0 to disable the cache.
+#define CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES 1024 // must be 8 * 2^N
+#define CONTRACT_FUNCTION_RESULT_CACHE_MAX_OUTPUT_SIZE 16384
+
+// Profiler of contract procedures and functions called by the core, queried with RequestContractProfile and reset at
+// the beginning of each epoch. Requires about ENTRIES * 2 KB of RAM. If more different entry points are called, the
+// additional ones are not profiled. Set CONTRACT_PROFILER_ENTRIES to 0 to disable the profiler.
+#define CONTRACT_PROFILER_ENTRIES 1024 // must be 2^N
+
 #define USE_SCORE_CACHE 1
 #define SCORE_CACHE_SIZE 2000000 // the larger the better
 #define SCORE_CACHE_COLLISION_RETRIES 20 // number of retries to find entry in cache in case of hash collision
@@ -58,14 +79,14 @@
 
 #define ARBITRATOR "AFZPUAIYVPNUYGJRQVLUKOPPVLHAZQTGLYAAUUNBXFTVTAMSBKQBLEIEPCVJ"
 
-static unsigned short SYSTEM_FILE_NAME[] = L"system";
-static unsigned short SYSTEM_END_OF_EPOCH_FILE_NAME[] = L"system.eoe";
-static unsigned short SPECTRUM_FILE_NAME[] = L"spectrum.???";
-static unsigned short UNIVERSE_FILE_NAME[] = L"universe.???";
-static unsigned short SCORE_CACHE_FILE_NAME[] = L"score.???";
-static unsigned short CONTRACT_FILE_NAME[] = L"contract????.???";
+static CHAR16 SYSTEM_FILE_NAME[] = L"system";
+static CHAR16 SYSTEM_END_OF_EPOCH_FILE_NAME[] = L"system.eoe";
+static CHAR16 SPECTRUM_FILE_NAME[] = L"spectrum.???";
+static CHAR16 UNIVERSE_FILE_NAME[] = L"universe.???";
+static CHAR16 SCORE_CACHE_FILE_NAME[] = L"score.???";
+static CHAR16 CONTRACT_FILE_NAME[] = L"contract????.???";
 
-static unsigned short REVENUE_FILE_NAME[] = L"revenueScore"; // TODO: for testing purpose, will delete at epoch 111
+static CHAR16 REVENUE_FILE_NAME[] = L"revenueScore"; // TODO: for testing purpose, will delete at epoch 111
 
 #define DATA_LENGTH 256
 #define NUMBER_OF_HIDDEN_NEURONS 10000
@@ -3,6 +3,7 @@
 // contract_def.h needs to be included first to make sure that contracts have minimal access
 #include "contract_core/contract_def.h"
 #include "contract_core/contract_exec.h"
+#include "contract_core/contract_function_result_cache.h"
 
 #include <intrin.h>
 
@@ -24,6 +25,7 @@
 #include "platform/time.h"
 #include "platform/file_io.h"
 #include "platform/time_stamp_counter.h"
+#include "platform/histogram.h"
 
 #include "platform/custom_stack.h"
 
@@ -35,6 +37,8 @@
 
 #include "network_core/tcp4.h"
 #include "network_core/peers.h"
+#include "network_core/transaction_inventory.h"
+#include "network_core/compact_quorum_tick.h"
 
 #include "system.h"
 #include "contract_core/qpi_system_impl.h"
@@ -51,6 +55,10 @@
 
 #include "tick_storage.h"
 #include "vote_counter.h"
+#include "tick_transaction_lookup_cache.h"
+#include "node_state_delta.h"
+#include "epoch_archive.h"
+#include "digest_tree.h"
 
 #include "addons/tx_status_request.h"
 
@@ -62,10 +70,10 @@
 
 #define CONTRACT_STATES_DEPTH 10 // Is derived from MAX_NUMBER_OF_CONTRACTS (=N)
 #define TICK_REQUESTING_PERIOD 500ULL
+#define COMPACT_QUORUM_TICKS_REQUESTING_RANGE 64 // number of ticks for which missing votes are requested when catching up
+#define TICK_RANGE_RESPONSE_SIZE_LIMIT (BUFFER_SIZE / 8) // with 2 pending requests, a peer that is not congested does not become congested by the responses
 #define MAX_NUMBER_EPOCH 1000ULL
 #define INVALIDATED_TICK_DATA (MAX_NUMBER_EPOCH+1)
-#define MAX_NUMBER_OF_MINERS 8192
-#define NUMBER_OF_MINER_SOLUTION_FLAGS 0x100000000
 #define MAX_MESSAGE_PAYLOAD_SIZE MAX_TRANSACTION_SIZE
 #define MAX_UNIVERSE_SIZE 1073741824
 #define MESSAGE_DISSEMINATION_THRESHOLD 1000000000
@@ -76,6 +84,10 @@
 #define TICK_VOTE_COUNTER_PUBLICATION_OFFSET 4 // Must be at least 3+: 1+ for tx propagration + 1 for tickData propagration + 1 for vote propagration
 #define MIN_MINING_SOLUTIONS_PUBLICATION_OFFSET 3 // Must be 3+
 #define TIME_ACCURACY 5000
+#define TRANSACTION_ANNOUNCEMENT_DELAY 50ULL // ms to collect digests for one AnnounceTransactions message
+#define ANNOUNCED_TRANSACTION_REQUEST_TIMEOUT 2000ULL // ms until an announced transaction is requested from another peer
+#define TRANSACTION_INVENTORY_BUFFER_SIZE 67108864
+#define TRANSACTION_INVENTORY_SLOTS 262144
 
 
 struct Processor : public CustomStack
@@ -126,15 +138,22 @@ static unsigned short ownComputorIndices[sizeof(computorSeeds) / sizeof(computor
 static unsigned short ownComputorIndicesMapping[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
 
 static TickStorage ts;
+static TransactionInventory transactionInventory;
+static volatile long long numberOfRequestedAnnouncedTransactions = 0, numberOfServedAnnouncedTransactions = 0;
+static volatile long long numberOfReceivedCompactVotes = 0, numberOfServedCompactQuorumTicks = 0;
+static volatile long long numberOfServedTickRangeEntries = 0;
+static unsigned long long numberOfUnindexedTransactions = 0; // transactions not found by digest, because digest index is full
+static volatile unsigned int latestVotedTick = 0; // latest tick with a vote received
 static VoteCounter voteCounter;
+#if EPOCH_ARCHIVE
+static EpochArchiveWriter epochArchive;
+#endif
 static Tick etalonTick;
 static TickData nextTickData;
 
 static m256i uniqueNextTickTransactionDigests[NUMBER_OF_COMPUTORS];
 static unsigned int uniqueNextTickTransactionDigestCounters[NUMBER_OF_COMPUTORS];
 
-static unsigned long long resourceTestingDigest = 0;
-
 static unsigned int numberOfTransactions = 0;
 static volatile char entityPendingTransactionsLock = 0;
 static unsigned char* entityPendingTransactions = NULL;
@@ -160,10 +179,6 @@ static bool targetNextTickDataDigestIsKnown = false;
 static m256i targetNextTickDataDigest;
 static unsigned long long tickTicks[11];
 
-static m256i releasedPublicKeys[NUMBER_OF_COMPUTORS];
-static long long releasedAmounts[NUMBER_OF_COMPUTORS];
-static unsigned int numberOfReleasedEntities;
-
 static EFI_MP_SERVICES_PROTOCOL* mpServicesProtocol;
 static unsigned int numberOfProcessors = 0;
 static Processor processors[MAX_NUMBER_OF_PROCESSORS];
@@ -191,7 +206,6 @@ static ScoreFunction<
     NUMBER_OF_SOLUTION_PROCESSORS
 > * score = nullptr;
 static volatile char solutionsLock = 0;
-static unsigned long long* minerSolutionFlags = NULL;
 static volatile m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
 static volatile unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
 static volatile unsigned int numberOfMiners = NUMBER_OF_COMPUTORS;
@@ -201,40 +215,68 @@ static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
 static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
 static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
 static unsigned long long solutionTotalExecutionTicks = 0;
-static unsigned long long K12MeasurementsCount = 0;
-static unsigned long long K12MeasurementsSum = 0;
 static volatile char minerScoreArrayLock = 0;
 static SpecialCommandGetMiningScoreRanking<MAX_NUMBER_OF_MINERS> requestMiningScoreRanking;
 
+#if CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES
+static ContractFunctionResultCache<CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES, CONTRACT_FUNCTION_RESULT_CACHE_MAX_OUTPUT_SIZE> contractFunctionResultCache;
+static unsigned char contractFunctionResultCacheOutput[MAX_NUMBER_OF_PROCESSORS][CONTRACT_FUNCTION_RESULT_CACHE_MAX_OUTPUT_SIZE];
+#endif
+
+static TickTransactionLookupCache tickTransactionLookupCache;
+static unsigned long long tickTransactionLookupTotalExecutionTicks = 0;
+static unsigned long long tickTransactionLookupTransactions = 0;
+
+// Latency statistics (in CPU ticks) of the current measurement period, queried with SPECIAL_COMMAND_GET_TELEMETRY
+static LatencyHistogram tickPhaseLatencies[NUMBER_OF_TELEMETRY_TICK_PHASES];
+static LatencyHistogram requestQueueWaitLatency;
+static LatencyHistogram requestProcessingLatencies[256];
+static unsigned long long telemetryPeriodBeginningTick = 0;
+static unsigned long long tickProcessingEndTick = 0; // for measuring quorum wait, only accessed by tick processor
+
 
 // variables and declare for persisting state
 static volatile int requestPersistingNodeState = 0;
 static volatile int persistingNodeStateTickProcWaiting = 0;
+static volatile bool persistingNodeStateInBackground = false;
 static m256i initialRandomSeedFromPersistingState;
 static bool loadMiningSeedFromFile = false;
 static bool loadAllNodeStateFromFile = false;
 #if TICK_STORAGE_AUTOSAVE_MODE
 static unsigned int nextPersistingNodeStateTick = 0;
-struct
+static NodeMiningState nodeStateBuffer;
+#if NODE_STATE_DELTAS_PER_BASE
+// Describes the delta snapshots saved after the last full node state snapshot
+static struct
 {
-    Tick etalonTick;
-    m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
-    unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
-    m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    m256i currentRandomSeed;    
-    int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS];
-    unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
-    unsigned char voteCounterData[VoteCounter::VoteCounterDataSize];
-    BroadcastComputors broadcastedComputors;
-    unsigned long long resourceTestingDigest;
-    unsigned int numberOfMiners;
-    unsigned int numberOfTransactions;
-    unsigned long long lastLogId;
-} nodeStateBuffer;
+    unsigned short epoch;           // epoch of full (base) snapshot, 0 if there is no valid base snapshot
+    unsigned short numberOfDeltas;
+    unsigned int baseTick;
+    unsigned long long deltaSizes[NODE_STATE_DELTAS_PER_BASE];
+} nodeStateDeltaInfo;
+static unsigned char* nodeStateDeltaBuffer = nullptr;
+
+// Node state captured at a tick boundary, which is saved by the main loop while the tick processor continues
+static struct
+{
+    System system;                  // copy of system at the time of capturing
+    unsigned long long deltaSize;   // size of delta serialized in nodeStateDeltaBuffer
+    unsigned long long beginningTick;
+    unsigned int nextDeltaChunk;
+    unsigned short deltaSequenceNumber;
+    unsigned char step;
+} backgroundNodeStateSave;
+
+enum NodeStateDeltaRegion
+{
+    NodeStateDeltaSpectrum = 1,
+    NodeStateDeltaUniverse = 2,
+    NodeStateDeltaMinerSolutionFlags = 3,
+    NodeStateDeltaContractStates = 0x1000, // + contract index
+};
 #endif
-static bool saveComputer(CHAR16* directory = NULL);
+#endif
+static bool saveComputer(CHAR16* directory = NULL, bool compressed = false);
 static bool saveSystem(CHAR16* directory = NULL);
 static bool loadComputer(CHAR16* directory = NULL, bool forceLoadFromFile = false);
 
@@ -258,6 +300,12 @@ static struct
     RequestQuorumTick requestQuorumTick;
 } requestedQuorumTick;
 
+static struct
+{
+    RequestResponseHeader header;
+    RequestCompactQuorumTicks requestCompactQuorumTicks;
+} requestedCompactQuorumTicks;
+
 static struct
 {
     RequestResponseHeader header;
@@ -283,6 +331,8 @@ static struct {
     unsigned long long lastTryClock; // last time it rolling the dice
 } emptyTickResolver;
 
+#include "tick_processing.h"
+
 static void logToConsole(const CHAR16* message)
 {
     if (disableConsoleLogging)
@@ -341,19 +391,6 @@ static void logToConsole(const CHAR16* message)
 }
 
 
-static int computorIndex(m256i computor)
-{
-    for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
-    {
-        if (broadcastedComputors.computors.publicKeys[computorIndex] == computor)
-        {
-            return computorIndex;
-        }
-    }
-
-    return -1;
-}
-
 // NOTE: this function doesn't work well on a few CPUs, some bits will be flipped after calling this. It's probably microcode bug.
 static void enableAVX()
 {
@@ -365,66 +402,63 @@ static void enableAVX()
         ));
 }
 
-// Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
-static void getComputerDigest(m256i& digest)
-{
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
-    {
-        if (contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
-        {
-            const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
-            if (!size)
-            {
-                contractStateDigests[digestIndex] = m256i::zero();
-            }
-            else
-            {
-                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
-                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
-                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
-                // digest.
-                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
-                contractStateLock[digestIndex].acquireRead();
+// Number of leafs of the spectrum and universe digest trees computed by one processor at a time during startup
+static constexpr unsigned long long digestTreeLeafsPerTask = 65536;
 
-                const unsigned long long startTick = __rdtsc();
-                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
-                const unsigned long long executionTicks = __rdtsc() - startTick;
+static void getSpectrumLeafDigest(unsigned long long spectrumIndex, m256i& digest)
+{
+    KangarooTwelve64To32(&spectrum[spectrumIndex], &digest);
+}
 
-                contractStateLock[digestIndex].releaseRead();
+static void getAssetLeafDigest(unsigned long long assetIndex, m256i& digest)
+{
+    KangarooTwelve(&assets[assetIndex], sizeof(Asset), &digest, 32);
+}
 
-                // K12 of state is included in contract execution time
-                _interlockedadd64(&contractTotalExecutionTicks[digestIndex], executionTicks);
+static void computeChangedContractStateDigest(unsigned long long contractIndex, void*)
+{
+    if ((contractStateChangeFlags[contractIndex >> 6] & (1ULL << (contractIndex & 63)))
+        && contractIndex < contractCount && contractDescriptions[contractIndex].stateSize)
+    {
+        KangarooTwelve(contractStates[contractIndex], (unsigned int)contractDescriptions[contractIndex].stateSize, &contractStateDigests[contractIndex], 32);
+    }
+}
 
-                // Gather data for comparing different versions of K12
-                if (K12MeasurementsCount < 500)
-                {
-                    K12MeasurementsSum += executionTicks;
-                    K12MeasurementsCount++;
-                }
-            }
-        }
+// Set spectrumDigests after loading the spectrum at startup: load the trusted digest tree saved with a snapshot if
+// trustedDigestsFileName is given and it matches the spectrum, otherwise compute it using all processors.
+static void initSpectrumDigests(const CHAR16* trustedDigestsFileName = NULL, const CHAR16* directory = NULL)
+{
+    const unsigned long long beginningTick = __rdtsc();
+    const bool loaded = trustedDigestsFileName
+        && loadDigestTree(trustedDigestsFileName, directory, spectrum, spectrumSizeInBytes, spectrumDigests, spectrumDigestsSizeInByte);
+    if (!loaded)
+    {
+        computeDigestTree(spectrumDigests, SPECTRUM_CAPACITY, getSpectrumLeafDigest, digestTreeLeafsPerTask);
     }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
-    while (numberOfLeafs > 1)
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+
+    setText(message, (loaded) ? L"Trusted spectrum digests are loaded (" : L"Spectrum digests are computed (");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
+}
+
+// Set assetDigests after loading the universe at startup, see initSpectrumDigests()
+static void initUniverseDigests(const CHAR16* trustedDigestsFileName = NULL, const CHAR16* directory = NULL)
+{
+    const unsigned long long beginningTick = __rdtsc();
+    const bool loaded = trustedDigestsFileName
+        && loadDigestTree(trustedDigestsFileName, directory, assets, ASSETS_CAPACITY * sizeof(Asset), assetDigests, assetDigestsSizeInBytes);
+    if (!loaded)
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
-                contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
+        computeDigestTree(assetDigests, ASSETS_CAPACITY, getAssetLeafDigest, digestTreeLeafsPerTask);
     }
-    contractStateChangeFlags[0] = 0;
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
 
-    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
+    setText(message, (loaded) ? L"Trusted universe digests are loaded (" : L"Universe digests are computed (");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
 }
 
 
@@ -640,60 +674,104 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
     }
 }
 
+// Check fields and signature of received vote (tick struct is modified temporarily)
+static bool verifyTick(Tick& tick)
+{
+    if (tick.computorIndex < NUMBER_OF_COMPUTORS
+        && tick.epoch == system.epoch
+        && tick.tick >= system.tick
+        && ts.ticks.isStoredInFull(tick.tick)
+        && tick.month >= 1 && tick.month <= 12
+        && tick.day >= 1 && tick.day <= ((tick.month == 1 || tick.month == 3 || tick.month == 5 || tick.month == 7 || tick.month == 8 || tick.month == 10 || tick.month == 12) ? 31 : ((tick.month == 4 || tick.month == 6 || tick.month == 9 || tick.month == 11) ? 30 : ((tick.year & 3) ? 28 : 29)))
+        && tick.hour <= 23
+        && tick.minute <= 59
+        && tick.second <= 59
+        && tick.millisecond <= 999)
+    {
+        unsigned char digest[32];
+        tick.computorIndex ^= BroadcastTick::type;
+        KangarooTwelve(&tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
+        tick.computorIndex ^= BroadcastTick::type;
+        return verify(broadcastedComputors.computors.publicKeys[tick.computorIndex].m256i_u8, digest, tick.signature);
+    }
+    return false;
+}
+
+// Store verified vote in tick storage or mark computor as faulty if it differs from the stored vote
+static void storeTick(const Tick& tick)
+{
+    ts.ticks.acquireLock(tick.computorIndex);
+
+    // Find element in tick storage and check if contains data (epoch is set to 0 on init)
+    Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(tick.tick) + tick.computorIndex;
+    if (tsTick->epoch == system.epoch)
+    {
+        // Check if the sent tick matches the tick in tick storage
+        if (*((unsigned long long*)&tick.millisecond) != *((unsigned long long*)&tsTick->millisecond)
+            || tick.prevSpectrumDigest != tsTick->prevSpectrumDigest
+            || tick.prevUniverseDigest != tsTick->prevUniverseDigest
+            || tick.prevComputerDigest != tsTick->prevComputerDigest
+            || tick.saltedSpectrumDigest != tsTick->saltedSpectrumDigest
+            || tick.saltedUniverseDigest != tsTick->saltedUniverseDigest
+            || tick.saltedComputerDigest != tsTick->saltedComputerDigest
+            || tick.transactionDigest != tsTick->transactionDigest
+            || tick.expectedNextTickTransactionDigest != tsTick->expectedNextTickTransactionDigest)
+        {
+            faultyComputorFlags[tick.computorIndex >> 6] |= (1ULL << (tick.computorIndex & 63));
+        }
+    }
+    else
+    {
+        // Copy the sent tick to the tick storage
+        bs->CopyMem(tsTick, &tick, sizeof(Tick));
+    }
+
+    ts.ticks.releaseLock(tick.computorIndex);
+
+    // Votes of later ticks than the next one indicate that this node is behind (see requesting of compact votes)
+    if (tick.tick > latestVotedTick)
+    {
+        latestVotedTick = tick.tick;
+    }
+}
+
 static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
 {
     BroadcastTick* request = header->getPayload<BroadcastTick>();
-    if (request->tick.computorIndex < NUMBER_OF_COMPUTORS
-        && request->tick.epoch == system.epoch
-        && request->tick.tick >= system.tick
-        && ts.tickInCurrentEpochStorage(request->tick.tick)
-        && request->tick.month >= 1 && request->tick.month <= 12
-        && request->tick.day >= 1 && request->tick.day <= ((request->tick.month == 1 || request->tick.month == 3 || request->tick.month == 5 || request->tick.month == 7 || request->tick.month == 8 || request->tick.month == 10 || request->tick.month == 12) ? 31 : ((request->tick.month == 4 || request->tick.month == 6 || request->tick.month == 9 || request->tick.month == 11) ? 30 : ((request->tick.year & 3) ? 28 : 29)))
-        && request->tick.hour <= 23
-        && request->tick.minute <= 59
-        && request->tick.second <= 59
-        && request->tick.millisecond <= 999)
+    if (verifyTick(request->tick))
     {
-        unsigned char digest[32];
-        request->tick.computorIndex ^= BroadcastTick::type;
-        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
-        request->tick.computorIndex ^= BroadcastTick::type;
-        if (verify(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature))
+        if (header->isDejavuZero())
         {
-            if (header->isDejavuZero())
-            {
-                enqueueResponse(NULL, header);
-            }
+            enqueueResponse(NULL, header);
+        }
 
-            ts.ticks.acquireLock(request->tick.computorIndex);
+        storeTick(request->tick);
+    }
+}
 
-            // Find element in tick storage and check if contains data (epoch is set to 0 on init)
-            Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
-            if (tsTick->epoch == system.epoch)
-            {
-                // Check if the sent tick matches the tick in tick storage
-                if (*((unsigned long long*)&request->tick.millisecond) != *((unsigned long long*)&tsTick->millisecond)
-                    || request->tick.prevSpectrumDigest != tsTick->prevSpectrumDigest
-                    || request->tick.prevUniverseDigest != tsTick->prevUniverseDigest
-                    || request->tick.prevComputerDigest != tsTick->prevComputerDigest
-                    || request->tick.saltedSpectrumDigest != tsTick->saltedSpectrumDigest
-                    || request->tick.saltedUniverseDigest != tsTick->saltedUniverseDigest
-                    || request->tick.saltedComputerDigest != tsTick->saltedComputerDigest
-                    || request->tick.transactionDigest != tsTick->transactionDigest
-                    || request->tick.expectedNextTickTransactionDigest != tsTick->expectedNextTickTransactionDigest)
-                {
-                    faultyComputorFlags[request->tick.computorIndex >> 6] |= (1ULL << (request->tick.computorIndex & 63));
-                }
-            }
-            else
+// Votes of a tick requested with RequestCompactQuorumTicks, they are not disseminated
+static void processCompactQuorumTick(Peer* peer, RequestResponseHeader* header)
+{
+    const CompactQuorumTick* request = header->getPayload<CompactQuorumTick>();
+    if (getNumberOfCompactVotes(request, header->getPayloadSize()) < 0)
+    {
+        return;
+    }
+
+    const CompactVote* compactVotes = (const CompactVote*)(request + 1);
+    Tick tick;
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (request->voteFlags[computorIndex >> 3] & (1 << (computorIndex & 7)))
+        {
+            expandCompactVote(*request, computorIndex, *compactVotes++, tick);
+            if (verifyTick(tick))
             {
-                // Copy the sent tick to the tick storage
-                bs->CopyMem(tsTick, &request->tick, sizeof(Tick));
+                storeTick(tick);
             }
-
-            ts.ticks.releaseLock(request->tick.computorIndex);
         }
     }
+    _InterlockedExchangeAdd64(&numberOfReceivedCompactVotes, compactVotes - (const CompactVote*)(request + 1));
 }
 
 static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
@@ -790,6 +868,87 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
     }
 }
 
+// Request announced transactions that are neither in the inventory, nor in the tick storage, nor requested recently
+static void processAnnounceTransactions(Peer* peer, RequestResponseHeader* header)
+{
+    peer->supportsTransactionAnnouncements = TRUE;
+
+    const unsigned int payloadSize = header->getPayloadSize();
+    if (payloadSize % sizeof(m256i) || payloadSize > MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS * sizeof(m256i))
+    {
+        return;
+    }
+    const unsigned int numberOfDigests = payloadSize / sizeof(m256i);
+    const m256i* digests = header->getPayload<m256i>();
+
+    struct
+    {
+        RequestResponseHeader header;
+        m256i digests[MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS];
+    } request;
+    unsigned int numberOfRequestedDigests = 0;
+    const unsigned long long now = __rdtsc();
+    for (unsigned int i = 0; i < numberOfDigests; i++)
+    {
+        if (!isZero(digests[i]) && !ts.transactionsDigestAccess.findTransaction(digests[i])
+            && transactionInventory.request(digests[i], now, ANNOUNCED_TRANSACTION_REQUEST_TIMEOUT * frequency / 1000))
+        {
+            request.digests[numberOfRequestedDigests++] = digests[i];
+        }
+    }
+    if (numberOfRequestedDigests)
+    {
+        _InterlockedExchangeAdd64(&numberOfRequestedAnnouncedTransactions, numberOfRequestedDigests);
+        request.header.checkAndSetSize(sizeof(RequestResponseHeader) + numberOfRequestedDigests * sizeof(m256i));
+        request.header.randomizeDejavu();
+        request.header.setType(RequestAnnouncedTransactions::type);
+        enqueueResponse(peer, &request.header);
+    }
+}
+
+// Send requested transactions with zero dejavu, so the requester disseminates them further
+static void processRequestAnnouncedTransactions(Peer* peer, RequestResponseHeader* header)
+{
+    const unsigned int payloadSize = header->getPayloadSize();
+    if (payloadSize % sizeof(m256i) || payloadSize > MAX_NUMBER_OF_ANNOUNCED_TRANSACTIONS * sizeof(m256i))
+    {
+        return;
+    }
+    const unsigned int numberOfDigests = payloadSize / sizeof(m256i);
+    const m256i* digests = header->getPayload<m256i>();
+
+    unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
+    Transaction* transaction = (Transaction*)transactionBuffer;
+    for (unsigned int i = 0; i < numberOfDigests; i++)
+    {
+        if (transactionInventory.get(digests[i], transaction))
+        {
+            enqueueResponse(peer, transaction->totalSize(), BROADCAST_TRANSACTION, 0, transaction);
+            _InterlockedIncrement64(&numberOfServedAnnouncedTransactions);
+        }
+        else
+        {
+            const Transaction* tickTransaction = ts.transactionsDigestAccess.findTransaction(digests[i]);
+            if (tickTransaction && ts.checkTickLoaded(tickTransaction->tick))
+            {
+                enqueueResponse(peer, tickTransaction->totalSize(), BROADCAST_TRANSACTION, 0, (void*)tickTransaction);
+                _InterlockedIncrement64(&numberOfServedAnnouncedTransactions);
+            }
+        }
+    }
+}
+
+// Disseminate transaction from response queue, keeping it in the inventory for answering RequestAnnouncedTransactions
+// (main thread only)
+static void disseminateTransaction(RequestResponseHeader* header)
+{
+    const Transaction* transaction = header->getPayload<Transaction>();
+    m256i digest;
+    KangarooTwelve(transaction, transaction->totalSize(), &digest, sizeof(digest));
+    transactionInventory.add(digest, transaction, __rdtsc());
+    announceToSeveral(header, digest);
+}
+
 static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* header)
 {
     Transaction* request = header->getPayload<Transaction>();
@@ -885,23 +1044,58 @@ static void processRequestComputors(Peer* peer, RequestResponseHeader* header)
     }
 }
 
-static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
+// Find votes of tick in tick storage for responding to requests. Returns epoch of the tick or 0 if the tick is not
+// available. tsCompTicks is set to the votes stored in full or to nullptr if votes need to be reconstructed from
+// compacted tick storage (see getStoredVote()).
+static unsigned short findStoredVotes(unsigned int tick, const Tick*& tsCompTicks)
 {
-    RequestQuorumTick* request = header->getPayload<RequestQuorumTick>();
+    tsCompTicks = nullptr;
+    if (!ts.checkTickLoaded(tick))
+    {
+        // tick of snapshot not loaded yet -> respond as if tick is not available
+        return 0;
+    }
+    else if (ts.ticks.isCompacted(tick))
+    {
+        return system.epoch;
+    }
+    else if (ts.ticks.isStoredInFull(tick))
+    {
+        tsCompTicks = ts.ticks.getByTickInCurrentEpoch(tick);
+        return system.epoch;
+    }
+    else if (ts.tickInPreviousEpochStorage(tick))
+    {
+        tsCompTicks = ts.ticks.getByTickInPreviousEpoch(tick);
+        return system.epoch - 1;
+    }
+    return 0;
+}
 
-    unsigned short tickEpoch = 0;
-    const Tick* tsCompTicks;
-    if (ts.tickInCurrentEpochStorage(request->quorumTick.tick))
+// Get vote of computor for tick found with findStoredVotes(). Returns nullptr if there is no vote. compactedVote is
+// used as buffer for reconstructing compacted votes.
+static const Tick* getStoredVote(unsigned int tick, unsigned short tickEpoch, const Tick* tsCompTicks, unsigned int computorIndex, Tick& compactedVote)
+{
+    // Todo: We should acquire ts.ticks lock here if tick >= system.tick
+    const Tick* tsTick = nullptr;
+    if (tsCompTicks)
     {
-        tickEpoch = system.epoch;
-        tsCompTicks = ts.ticks.getByTickInCurrentEpoch(request->quorumTick.tick);
+        tsTick = tsCompTicks + computorIndex;
     }
-    else if (ts.tickInPreviousEpochStorage(request->quorumTick.tick))
+    else if (ts.ticks.getCompacted(tick, computorIndex, compactedVote))
     {
-        tickEpoch = system.epoch - 1;
-        tsCompTicks = ts.ticks.getByTickInPreviousEpoch(request->quorumTick.tick);
+        tsTick = &compactedVote;
     }
+    return (tsTick && tsTick->epoch == tickEpoch) ? tsTick : nullptr;
+}
+
+static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
+{
+    RequestQuorumTick* request = header->getPayload<RequestQuorumTick>();
 
+    const Tick* tsCompTicks;
+    Tick compactedVote;
+    const unsigned short tickEpoch = findStoredVotes(request->quorumTick.tick, tsCompTicks);
     if (tickEpoch != 0)
     {
         // Send Tick struct data from tick storage as requested by tick and voteFlags in request->quorumTick.
@@ -919,9 +1113,8 @@ static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
 
             if (!(request->quorumTick.voteFlags[computorIndices[index] >> 3] & (1 << (computorIndices[index] & 7))))
             {
-                // Todo: We should acquire ts.ticks lock here if tick >= system.tick
-                const Tick* tsTick = tsCompTicks + computorIndices[index];
-                if (tsTick->epoch == tickEpoch)
+                const Tick* tsTick = getStoredVote(request->quorumTick.tick, tickEpoch, tsCompTicks, computorIndices[index], compactedVote);
+                if (tsTick)
                 {
                     enqueueResponse(peer, sizeof(Tick), BroadcastTick::type, header->dejavu(), tsTick);
                 }
@@ -933,10 +1126,117 @@ static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
     enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
+// Select the most common shared fields of the stored votes of tick that are not flagged in knownVoteFlags (may be
+// nullptr). Returns the number of votes agreeing with sharedVote, which is 0 if there is no vote.
+static unsigned int selectSharedVote(unsigned int tick, unsigned short tickEpoch, const Tick* tsCompTicks, const unsigned char* knownVoteFlags, Tick& sharedVote)
+{
+    SharedVoteSelector sharedVoteSelector;
+    Tick compactedVote;
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        const Tick* tsTick = getStoredVote(tick, tickEpoch, tsCompTicks, computorIndex, compactedVote);
+        if (tsTick && !(knownVoteFlags && (knownVoteFlags[computorIndex >> 3] & (1 << (computorIndex & 7)))))
+        {
+            sharedVoteSelector.add(*tsTick);
+        }
+    }
+    if (!sharedVoteSelector.get())
+    {
+        return 0;
+    }
+    bs->CopyMem(&sharedVote, sharedVoteSelector.get(), sizeof(Tick));
+
+    unsigned int numberOfVotes = 0;
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        const Tick* tsTick = getStoredVote(tick, tickEpoch, tsCompTicks, computorIndex, compactedVote);
+        if (tsTick && !(knownVoteFlags && (knownVoteFlags[computorIndex >> 3] & (1 << (computorIndex & 7))))
+            && haveSameSharedVoteFields(sharedVote, *tsTick))
+        {
+            numberOfVotes++;
+        }
+    }
+    return numberOfVotes;
+}
+
+// Write up to maxNumberOfVotes stored votes of tick that agree with sharedVote and are not flagged in knownVoteFlags
+// to message (of compactQuorumTickSize(maxNumberOfVotes) bytes). Returns the number of votes written.
+static unsigned int writeCompactQuorumTick(unsigned int tick, unsigned short tickEpoch, const Tick* tsCompTicks, const unsigned char* knownVoteFlags,
+    const Tick& sharedVote, unsigned int maxNumberOfVotes, CompactQuorumTick* message)
+{
+    CompactVote* compactVotes = (CompactVote*)(message + 1);
+    bs->CopyMem(&message->sharedVote, &sharedVote, sizeof(Tick));
+    bs->SetMem(message->voteFlags, sizeof(message->voteFlags), 0);
+    Tick compactedVote;
+    unsigned int numberOfVotes = 0;
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS && numberOfVotes < maxNumberOfVotes; computorIndex++)
+    {
+        const Tick* tsTick = getStoredVote(tick, tickEpoch, tsCompTicks, computorIndex, compactedVote);
+        if (tsTick && !(knownVoteFlags && (knownVoteFlags[computorIndex >> 3] & (1 << (computorIndex & 7))))
+            && haveSameSharedVoteFields(sharedVote, *tsTick))
+        {
+            compactVote(*tsTick, compactVotes[numberOfVotes++]);
+            message->voteFlags[computorIndex >> 3] |= (1 << (computorIndex & 7));
+        }
+    }
+    return numberOfVotes;
+}
+
+// The buffer of a request processor has room for a message of maximum size behind the request being processed. Large
+// responses are built there and copied into the response queue afterwards, so the queue is not locked while computing.
+static void* getResponseBuildingBuffer(RequestResponseHeader* request)
+{
+    static_assert(BUFFER_SIZE >= 2 * RequestResponseHeader::max_size, "Request processor buffer too small");
+    return (unsigned char*)request + ((request->size() + 7) & ~7);
+}
+
+// Send votes of range of ticks in compact form: per tick, the votes agreeing with the most common shared fields are
+// sent as CompactQuorumTick and the other votes are sent as BroadcastTick.
+static void processRequestCompactQuorumTicks(Peer* peer, RequestResponseHeader* header)
+{
+    RequestCompactQuorumTicks* request = header->getPayload<RequestCompactQuorumTicks>();
+    const unsigned int numberOfTicks = (request->numberOfTicks < MAX_NUMBER_OF_COMPACT_QUORUM_TICKS) ? request->numberOfTicks : MAX_NUMBER_OF_COMPACT_QUORUM_TICKS;
+
+    CompactQuorumTick* compactQuorumTick = (CompactQuorumTick*)getResponseBuildingBuffer(header);
+    Tick sharedVote, compactedVote;
+    for (unsigned int tick = request->tick; tick - request->tick < numberOfTicks; tick++)
+    {
+        const Tick* tsCompTicks;
+        const unsigned short tickEpoch = findStoredVotes(tick, tsCompTicks);
+        if (tickEpoch == 0)
+        {
+            continue;
+        }
+
+        // Votes of the first tick that the requester knows are skipped
+        const unsigned char* knownVoteFlags = (tick == request->tick) ? request->voteFlags : nullptr;
+        const unsigned int numberOfVotes = selectSharedVote(tick, tickEpoch, tsCompTicks, knownVoteFlags, sharedVote);
+        if (!numberOfVotes)
+        {
+            continue;
+        }
+
+        for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+        {
+            const Tick* tsTick = getStoredVote(tick, tickEpoch, tsCompTicks, computorIndex, compactedVote);
+            if (tsTick && !(knownVoteFlags && (knownVoteFlags[computorIndex >> 3] & (1 << (computorIndex & 7))))
+                && !haveSameSharedVoteFields(sharedVote, *tsTick))
+            {
+                enqueueResponse(peer, sizeof(Tick), BroadcastTick::type, header->dejavu(), tsTick);
+            }
+        }
+
+        const unsigned int numberOfCompactVotes = writeCompactQuorumTick(tick, tickEpoch, tsCompTicks, knownVoteFlags, sharedVote, numberOfVotes, compactQuorumTick);
+        enqueueResponse(peer, compactQuorumTickSize(numberOfCompactVotes), CompactQuorumTick::type, header->dejavu(), compactQuorumTick);
+        _InterlockedIncrement64(&numberOfServedCompactQuorumTicks);
+    }
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
+}
+
 static void processRequestTickData(Peer* peer, RequestResponseHeader* header)
 {
     RequestTickData* request = header->getPayload<RequestTickData>();
-    TickData* td = ts.tickData.getByTickIfNotEmpty(request->requestedTickData.tick);
+    TickData* td = (ts.checkTickLoaded(request->requestedTickData.tick)) ? ts.tickData.getByTickIfNotEmpty(request->requestedTickData.tick) : nullptr;
     if (td)
     {
         enqueueResponse(peer, sizeof(TickData), BroadcastFutureTickData::type, header->dejavu(), td);
@@ -947,13 +1247,110 @@ static void processRequestTickData(Peer* peer, RequestResponseHeader* header)
     }
 }
 
+// Get transaction with index in tick from tick storage (with the transaction offsets of the tick). Returns nullptr if
+// there is no valid transaction.
+static const Transaction* getStoredTickTransaction(unsigned int tick, const unsigned long long* tsTickTransactionOffsets, unsigned int index)
+{
+    const unsigned long long tickTransactionOffset = tsTickTransactionOffsets[index];
+    if (!tickTransactionOffset)
+    {
+        return nullptr;
+    }
+    const Transaction* transaction = ts.tickTransactions(tickTransactionOffset);
+    return (transaction->tick == tick && transaction->checkValidity()) ? transaction : nullptr;
+}
+
+// Send data of range of ticks for syncing archives and explorers. One TickRangeEntry per tick is built from tick
+// storage in the response building buffer and then enqueued. For flow control, the response is ended early if the peer is congested or
+// TICK_RANGE_RESPONSE_SIZE_LIMIT is reached, so the requester continues with the next tick in a new request.
+static void processRequestTickRange(Peer* peer, RequestResponseHeader* header)
+{
+    RequestTickRange* request = header->getPayload<RequestTickRange>();
+    const unsigned int numberOfTicks = (request->numberOfTicks < MAX_NUMBER_OF_TICKS_IN_RANGE) ? request->numberOfTicks : MAX_NUMBER_OF_TICKS_IN_RANGE;
+
+    TickRangeEntry* entry = (TickRangeEntry*)getResponseBuildingBuffer(header);
+    Tick sharedVote;
+    unsigned int responseSize = 0;
+    for (unsigned int tick = request->tick; tick - request->tick < numberOfTicks && tick < system.tick; tick++)
+    {
+        if (responseSize >= TICK_RANGE_RESPONSE_SIZE_LIMIT || peer->outboundQueue.isCongested() || !ts.checkTickLoaded(tick))
+        {
+            break;
+        }
+
+        unsigned short tickEpoch = 0;
+        const unsigned long long* tsTickTransactionOffsets = nullptr;
+        if (ts.tickInCurrentEpochStorage(tick))
+        {
+            tickEpoch = system.epoch;
+            tsTickTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+        }
+        else if (ts.tickInPreviousEpochStorage(tick))
+        {
+            tickEpoch = system.epoch - 1;
+            tsTickTransactionOffsets = ts.tickTransactionOffsets.getByTickInPreviousEpoch(tick);
+        }
+
+        entry->tick = tick;
+        entry->epoch = tickEpoch;
+        entry->flags = 0;
+        entry->numberOfTransactions = 0;
+        unsigned char* data = (unsigned char*)(entry + 1);
+        if (tickEpoch && (request->flags & TICK_RANGE_TICK_DATA))
+        {
+            const TickData* td = ts.tickData.getByTickIfNotEmpty(tick);
+            if (td)
+            {
+                bs->CopyMem(data, td, sizeof(TickData));
+                data += sizeof(TickData);
+                entry->flags |= TICK_RANGE_TICK_DATA;
+            }
+        }
+        if (tickEpoch && (request->flags & TICK_RANGE_TRANSACTIONS))
+        {
+            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+            {
+                const Transaction* transaction = getStoredTickTransaction(tick, tsTickTransactionOffsets, i);
+                if (transaction)
+                {
+                    bs->CopyMem(data, transaction, transaction->totalSize());
+                    data += transaction->totalSize();
+                    entry->numberOfTransactions++;
+                }
+            }
+            entry->flags |= TICK_RANGE_TRANSACTIONS;
+        }
+        if (tickEpoch && (request->flags & TICK_RANGE_QUORUM_VOTES))
+        {
+            const Tick* tsCompTicks;
+            const unsigned short voteEpoch = findStoredVotes(tick, tsCompTicks);
+            const unsigned int numberOfVotes = (voteEpoch == tickEpoch) ? selectSharedVote(tick, voteEpoch, tsCompTicks, nullptr, sharedVote) : 0;
+            if (numberOfVotes)
+            {
+                data += compactQuorumTickSize(writeCompactQuorumTick(tick, voteEpoch, tsCompTicks, nullptr, sharedVote, numberOfVotes, (CompactQuorumTick*)data));
+                entry->flags |= TICK_RANGE_QUORUM_VOTES;
+            }
+        }
+        const unsigned int entrySize = (unsigned int)(data - (unsigned char*)entry);
+        enqueueResponse(peer, entrySize, TickRangeEntry::type, header->dejavu(), entry);
+        _InterlockedIncrement64(&numberOfServedTickRangeEntries);
+
+        responseSize += sizeof(RequestResponseHeader) + entrySize;
+    }
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
+}
+
 static void processRequestTickTransactions(Peer* peer, RequestResponseHeader* header)
 {
     RequestedTickTransactions* request = header->getPayload<RequestedTickTransactions>();
 
     unsigned short tickEpoch = 0;
     const unsigned long long* tsReqTickTransactionOffsets;
-    if (ts.tickInCurrentEpochStorage(request->tick))
+    if (!ts.checkTickLoaded(request->tick))
+    {
+        // tick of snapshot not loaded yet -> respond as if tick is not available
+    }
+    else if (ts.tickInCurrentEpochStorage(request->tick))
     {
         tickEpoch = system.epoch;
         tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(request->tick);
@@ -1010,7 +1407,7 @@ static void processRequestTransactionInfo(Peer* peer, RequestResponseHeader* hea
 {
     RequestedTransactionInfo* request = header->getPayload<RequestedTransactionInfo>();
     const Transaction* transaction = ts.transactionsDigestAccess.findTransaction(request->txDigest);
-    if (transaction)
+    if (transaction && ts.checkTickLoaded(transaction->tick))
     {
         enqueueResponse(peer, transaction->totalSize(), BROADCAST_TRANSACTION, header->dejavu(), (void*)transaction);
     }
@@ -1118,21 +1515,109 @@ static void processRequestContractFunction(Peer* peer, const unsigned long long
     }
     else
     {
-        QpiContextUserFunctionCall qpiContext(request->contractIndex);
-        qpiContext.call(request->inputType, (((unsigned char*)request) + sizeof(RequestContractFunction)), request->inputSize);
+        const unsigned char* input = ((unsigned char*)request) + sizeof(RequestContractFunction);
+#if CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES
+        // Serve identical request from cache if contract state version (of state function would run on) and tick match
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        const long long stateVersion = (contractStateSnapshots[request->contractIndex].isValid()) ? contractStateSnapshots[request->contractIndex].getVersion() : contractStateVersions[request->contractIndex];
+#else
+        const long long stateVersion = contractStateVersions[request->contractIndex];
+#endif
+        const unsigned int tick = system.tick;
+        ContractFunctionResultCacheKey cacheKey;
+        cacheKey.set(request->contractIndex, request->inputType, input, request->inputSize, stateVersion, tick);
+        unsigned short cachedOutputSize;
+        if (contractFunctionResultCache.tryFetching(cacheKey, contractFunctionResultCacheOutput[processorNumber], cachedOutputSize))
+        {
+            enqueueResponse(peer, cachedOutputSize, RespondContractFunction::type, header->dejavu(), contractFunctionResultCacheOutput[processorNumber]);
+            return;
+        }
+#endif
+
+        const bool allowStateSnapshot = true;
+        QpiContextUserFunctionCall qpiContext(request->contractIndex, allowStateSnapshot);
+        qpiContext.call(request->inputType, input, request->inputSize);
         enqueueResponse(peer, qpiContext.outputSize, RespondContractFunction::type, header->dejavu(), qpiContext.outputBuffer);
+
+#if CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES
+        if (qpiContext.outputCacheable && tick == system.tick)
+        {
+            cacheKey.stateVersion = qpiContext.stateVersion;
+            contractFunctionResultCache.add(cacheKey, qpiContext.outputBuffer, qpiContext.outputSize);
+        }
+#endif
     }
 }
 
-static void processRequestSystemInfo(Peer* peer, RequestResponseHeader* header)
+#if CONTRACT_PROFILER_ENTRIES
+// Build profile of contract entry points and call edges and enqueue it as response
+static void processRequestContractProfile(Peer* peer, RequestResponseHeader* header)
 {
-    RespondSystemInfo respondedSystemInfo;
-
-    respondedSystemInfo.version = system.version;
-    respondedSystemInfo.epoch = system.epoch;
-    respondedSystemInfo.tick = system.tick;
-    respondedSystemInfo.initialTick = system.initialTick;
-    respondedSystemInfo.latestCreatedTick = system.latestCreatedTick;
+    RequestContractProfile* request = header->getPayload<RequestContractProfile>();
+    static_assert(sizeof(RespondContractProfile) + CONTRACT_PROFILER_ENTRIES * sizeof(ContractEntryPointProfile)
+        + contractCount * contractCount * sizeof(ContractCallEdge) <= RequestResponseHeader::max_size - sizeof(RequestResponseHeader), "Contract profile too large");
+    RespondContractProfile* response = (RespondContractProfile*)getResponseBuildingBuffer(header);
+
+    ContractEntryPointProfile* entryPointProfiles = (ContractEntryPointProfile*)(response + 1);
+    unsigned int numberOfEntryPoints = 0;
+    for (unsigned int slot = 0; slot < contractProfiler.capacity(); slot++)
+    {
+        const auto* entryPoint = contractProfiler.entryPoint(slot);
+        if (entryPoint && (!request->contractIndex || entryPoint->contractIndex() == request->contractIndex))
+        {
+            ContractEntryPointProfile& profile = entryPointProfiles[numberOfEntryPoints++];
+            profile.contractIndex = entryPoint->contractIndex();
+            profile.inputType = entryPoint->inputType();
+            profile.kind = entryPoint->kind();
+            profile.padding = 0;
+            profile.maxStackSize = entryPoint->maxStackSize;
+            profile.numberOfCalls = entryPoint->numberOfCalls;
+            profile.totalCycles = entryPoint->totalCycles;
+            profile.p50Cycles = entryPoint->cycles.percentile(500);
+            profile.p90Cycles = entryPoint->cycles.percentile(900);
+            profile.p99Cycles = entryPoint->cycles.percentile(990);
+            profile.maxCycles = entryPoint->cycles.max();
+        }
+    }
+
+    ContractCallEdge* callEdges = (ContractCallEdge*)(entryPointProfiles + numberOfEntryPoints);
+    unsigned int numberOfCallEdges = 0;
+    for (unsigned int callerIndex = 0; callerIndex < contractCount; callerIndex++)
+    {
+        for (unsigned int calleeIndex = 0; calleeIndex < contractCount; calleeIndex++)
+        {
+            const long long numberOfCalls = contractProfiler.numberOfCallEdgeCalls(callerIndex, calleeIndex);
+            if (numberOfCalls && (!request->contractIndex || callerIndex == request->contractIndex || calleeIndex == request->contractIndex))
+            {
+                callEdges[numberOfCallEdges].callerContractIndex = callerIndex;
+                callEdges[numberOfCallEdges].calleeContractIndex = calleeIndex;
+                callEdges[numberOfCallEdges].numberOfCalls = numberOfCalls;
+                numberOfCallEdges++;
+            }
+        }
+    }
+
+    response->cyclesPerSecond = frequency;
+    response->numberOfDroppedCalls = contractProfiler.numberOfDroppedCalls();
+    response->epoch = system.epoch;
+    response->padding = 0;
+    response->numberOfEntryPoints = numberOfEntryPoints;
+    response->numberOfCallEdges = numberOfCallEdges;
+    response->padding2 = 0;
+    enqueueResponse(peer, sizeof(RespondContractProfile) + numberOfEntryPoints * sizeof(ContractEntryPointProfile) + numberOfCallEdges * sizeof(ContractCallEdge),
+        RespondContractProfile::type, header->dejavu(), response);
+}
+#endif
+
+static void processRequestSystemInfo(Peer* peer, RequestResponseHeader* header)
+{
+    RespondSystemInfo respondedSystemInfo;
+
+    respondedSystemInfo.version = system.version;
+    respondedSystemInfo.epoch = system.epoch;
+    respondedSystemInfo.tick = system.tick;
+    respondedSystemInfo.initialTick = system.initialTick;
+    respondedSystemInfo.latestCreatedTick = system.latestCreatedTick;
 
     respondedSystemInfo.initialMillisecond = system.initialMillisecond;
     respondedSystemInfo.initialSecond = system.initialSecond;
@@ -1154,6 +1639,49 @@ static void processRequestSystemInfo(Peer* peer, RequestResponseHeader* header)
     enqueueResponse(peer, sizeof(respondedSystemInfo), RESPOND_SYSTEM_INFO, header->dejavu(), &respondedSystemInfo);
 }
 
+static void getLatencySummary(const LatencyHistogram& histogram, TelemetryLatencySummary& summary)
+{
+    const unsigned long long ticksPerMicrosecond = frequency / 1000000;
+    summary.count = histogram.count();
+    summary.p50 = histogram.percentile(500) / ticksPerMicrosecond;
+    summary.p90 = histogram.percentile(900) / ticksPerMicrosecond;
+    summary.p99 = histogram.percentile(990) / ticksPerMicrosecond;
+    summary.max = histogram.max() / ticksPerMicrosecond;
+}
+
+// Respond latency statistics and optionally start new measurement period
+static void respondTelemetry(Peer* peer, RequestResponseHeader* header)
+{
+    SpecialCommandGetTelemetryRequest* request = header->getPayload<SpecialCommandGetTelemetryRequest>();
+    SpecialCommandGetTelemetryResponse* response = (SpecialCommandGetTelemetryResponse*)getResponseBuildingBuffer(header);
+    response->everIncreasingNonceAndCommandType = request->everIncreasingNonceAndCommandType;
+    response->measurementPeriod = (__rdtsc() - telemetryPeriodBeginningTick) * 1000 / frequency;
+    for (unsigned int i = 0; i < NUMBER_OF_TELEMETRY_TICK_PHASES; i++)
+    {
+        getLatencySummary(tickPhaseLatencies[i], response->tickPhases[i]);
+    }
+    getLatencySummary(requestQueueWaitLatency, response->requestQueueWait);
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        getLatencySummary(requestProcessingLatencies[i], response->requestProcessing[i]);
+    }
+    enqueueResponse(peer, sizeof(SpecialCommandGetTelemetryResponse), SpecialCommand::type, header->dejavu(), response);
+
+    if (request->resetAfterReading)
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_TELEMETRY_TICK_PHASES; i++)
+        {
+            tickPhaseLatencies[i].reset();
+        }
+        requestQueueWaitLatency.reset();
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            requestProcessingLatencies[i].reset();
+        }
+        telemetryPeriodBeginningTick = __rdtsc();
+    }
+}
+
 static void processSpecialCommand(Peer* peer, RequestResponseHeader* header)
 {
     SpecialCommand* request = header->getPayload<SpecialCommand>();
@@ -1192,7 +1720,7 @@ static void processSpecialCommand(Peer* peer, RequestResponseHeader* header)
             case SPECIAL_COMMAND_TOGGLE_MAIN_MODE_REQUEST:
             {
                 SpecialCommandToggleMainModeRequestAndResponse* _request = header->getPayload<SpecialCommandToggleMainModeRequestAndResponse>();
-                if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1)
+                if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1 || persistingNodeStateInBackground)
                 {
                     //logToConsole(L"Unable to switch mode because node is saving states.");
                 }
@@ -1268,6 +1796,11 @@ static void processSpecialCommand(Peer* peer, RequestResponseHeader* header)
                     &requestMiningScoreRanking);
             }
             break;
+            case SPECIAL_COMMAND_GET_TELEMETRY:
+            {
+                respondTelemetry(peer, header);
+            }
+            break;
             }
         }
     }
@@ -1282,32 +1815,6 @@ static void checkinTime(unsigned long long processorNumber)
     threadTimeCheckin[processorNumber].day = utcTime.Day;
 }
 
-static void setNewMiningSeed()
-{
-    score->initMiningData(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
-}
-
-static unsigned int getTickInMiningPhaseCycle()
-{
-    return (system.tick - system.initialTick) % (INTERNAL_COMPUTATIONS_INTERVAL + EXTERNAL_COMPUTATIONS_INTERVAL);
-}
-
-static void checkAndSwitchMiningPhase()
-{
-    const unsigned int r = getTickInMiningPhaseCycle();
-    if (!r)
-    {
-        setNewMiningSeed();
-    }
-    else
-    {
-        if (r == INTERNAL_COMPUTATIONS_INTERVAL + 3) // 3 is added because of 3-tick shift for transaction confirmation
-        {
-            score->initMiningData(m256i::zero());
-        }
-    }
-}
-
 static void requestProcessor(void* ProcedureArgument)
 {
     enableAVX();
@@ -1336,6 +1843,9 @@ static void requestProcessor(void* ProcedureArgument)
         {
             score->tryProcessSolution(processorNumber);
         }
+
+        // help tick processor with lookups for transactions if the tick processor is waiting for it
+        tickTransactionLookupCache.tryProcessTask();
         
         if (requestQueueElementTail == requestQueueElementHead)
         {
@@ -1360,6 +1870,7 @@ static void requestProcessor(void* ProcedureArgument)
                 }
 
                 Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+                const unsigned long long enqueueTime = requestQueueElements[requestQueueElementTail].enqueueTime;
 
                 if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
                 {
@@ -1368,7 +1879,9 @@ static void requestProcessor(void* ProcedureArgument)
                 requestQueueElementTail++;
 
                 RELEASE(requestQueueTailLock);
-                switch (header->type())
+                requestQueueWaitLatency.add(beginningTick - enqueueTime);
+                const unsigned char messageType = header->type();
+                switch (messageType)
                 {
                 case ExchangePublicPeers::type:
                 {
@@ -1406,6 +1919,18 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case AnnounceTransactions::type:
+                {
+                    processAnnounceTransactions(peer, header);
+                }
+                break;
+
+                case RequestAnnouncedTransactions::type:
+                {
+                    processRequestAnnouncedTransactions(peer, header);
+                }
+                break;
+
                 case RequestComputors::type:
                 {
                     processRequestComputors(peer, header);
@@ -1418,6 +1943,18 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case RequestCompactQuorumTicks::type:
+                {
+                    processRequestCompactQuorumTicks(peer, header);
+                }
+                break;
+
+                case CompactQuorumTick::type:
+                {
+                    processCompactQuorumTick(peer, header);
+                }
+                break;
+
                 case RequestTickData::type:
                 {
                     processRequestTickData(peer, header);
@@ -1430,6 +1967,12 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case RequestTickRange::type:
+                {
+                    processRequestTickRange(peer, header);
+                }
+                break;
+
                 case REQUEST_TRANSACTION_INFO:
                 {
                     processRequestTransactionInfo(peer, header);
@@ -1478,6 +2021,14 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+#if CONTRACT_PROFILER_ENTRIES
+                case RequestContractProfile::type:
+                {
+                    processRequestContractProfile(peer, header);
+                }
+                break;
+#endif
+
                 case RequestLog::type:
                 {
                     logger.processRequestLog(peer, header);
@@ -1512,15 +2063,21 @@ static void requestProcessor(void* ProcedureArgument)
                 /* qli: process RequestTxStatus message */
                 case REQUEST_TX_STATUS:
                 {
-                    processRequestConfirmedTx(processorNumber, peer, header);
+                    // tick of snapshot not loaded yet -> don't respond, as if tick is not available
+                    if (ts.checkTickLoaded(header->getPayload<RequestTxStatus>()->tick))
+                    {
+                        processRequestConfirmedTx(processorNumber, peer, header);
+                    }
                 }
                 break;
 #endif
 
                 }
 
-                queueProcessingNumerator += __rdtsc() - beginningTick;
+                const unsigned long long processingTime = __rdtsc() - beginningTick;
+                queueProcessingNumerator += processingTime;
                 queueProcessingDenominator++;
+                requestProcessingLatencies[messageType].add(processingTime);
 
                 _InterlockedIncrement64(&numberOfProcessedRequests);
             }
@@ -1529,133 +2086,7 @@ static void requestProcessor(void* ProcedureArgument)
 }
 
 
-QPI::id QPI::QpiContextFunctionCall::arbitrator() const
-{
-    return arbitratorPublicKey;
-}
-
-bool QPI::QpiContextProcedureCall::acquireShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 sourceOwnershipManagingContractIndex, uint16 sourcePossessionManagingContractIndex) const
-{
-    // Just examples, to make it compile, move these to parameter list
-    unsigned int contractIndex = QX_CONTRACT_INDEX;
-    QPI::sint64 invocationReward = 10;
-
-    if (contractIndex >= contractCount)
-        return false;
-    if (invocationReward < 0)
-        return false;
-    // ...
-
-    // TODO: Init input
-    QPI::PreManagementRightsTransfer_input pre_input;
-    // output is zeroed in __qpiCallSystemProcOfOtherContract
-    QPI::PreManagementRightsTransfer_output pre_output;
-
-    // Call PRE_ACQUIRE_SHARES in other contract after transferring invocationReward
-    __qpiCallSystemProcOfOtherContract<PRE_ACQUIRE_SHARES>(contractIndex, pre_input, pre_output, invocationReward);
-
-    if (pre_output.ok)
-    {
-        // TODO: transfer
-
-        // TODO: init input
-        QPI::PostManagementRightsTransfer_input post_input;
-        // Output is unused, but needed for generalized interface
-        QPI::NoData post_output;
-
-        // Call POST_ACQUIRE_SHARES in other contract without transferring an invocationReward
-        __qpiCallSystemProcOfOtherContract<POST_ACQUIRE_SHARES>(contractIndex, post_input, post_output, 0);
-    }
-
-    return pre_output.ok;
-}
-
-QPI::id QPI::QpiContextFunctionCall::computor(unsigned short computorIndex) const
-{
-    return broadcastedComputors.computors.publicKeys[computorIndex % NUMBER_OF_COMPUTORS];
-}
-
-unsigned char QPI::QpiContextFunctionCall::day() const
-{
-    return etalonTick.day;
-}
-
-unsigned char QPI::QpiContextFunctionCall::dayOfWeek(unsigned char year, unsigned char month, unsigned char day) const
-{
-    return dayIndex(year, month, day) % 7;
-}
-
-unsigned char QPI::QpiContextFunctionCall::hour() const
-{
-    return etalonTick.hour;
-}
-
-unsigned short QPI::QpiContextFunctionCall::millisecond() const
-{
-    return etalonTick.millisecond;
-}
-
-unsigned char QPI::QpiContextFunctionCall::minute() const
-{
-    return etalonTick.minute;
-}
-
-unsigned char QPI::QpiContextFunctionCall::month() const
-{
-    return etalonTick.month;
-}
-
-m256i QPI::QpiContextFunctionCall::nextId(const m256i& currentId) const
-{
-    int index = spectrumIndex(currentId);
-    while (++index < SPECTRUM_CAPACITY)
-    {
-        const m256i& nextId = spectrum[index].publicKey;
-        if (!isZero(nextId))
-        {
-            return nextId;
-        }
-    }
-
-    return m256i::zero();
-}
-
-int QPI::QpiContextFunctionCall::numberOfTickTransactions() const
-{
-    return -1; // TODO: Return -1 if the current tick is empty, return the number of the transactions in the tick otherwise, including 0
-}
-
-bool QPI::QpiContextProcedureCall::releaseShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 destinationOwnershipManagingContractIndex, uint16 destinationPossessionManagingContractIndex) const
-{
-    // TODO
-
-    return false;
-}
-
-unsigned char QPI::QpiContextFunctionCall::second() const
-{
-    return etalonTick.second;
-}
-
-bool QPI::QpiContextFunctionCall::signatureValidity(const m256i& entity, const m256i& digest, const array<signed char, 64>& signature) const
-{
-    return verify(entity.m256i_u8, digest.m256i_u8, reinterpret_cast<const unsigned char*>(&signature));
-}
-
-unsigned char QPI::QpiContextFunctionCall::year() const
-{
-    return etalonTick.year;
-}
-
-template <typename T>
-m256i QPI::QpiContextFunctionCall::K12(const T& data) const
-{
-    m256i digest;
-
-    KangarooTwelve(&data, sizeof(data), &digest, sizeof(digest));
-
-    return digest;
-}
+#include "contract_core/qpi_ticking_impl.h"
 
 static void contractProcessor(void*)
 {
@@ -1664,596 +2095,225 @@ static void contractProcessor(void*)
     unsigned long long processorNumber;
     mpServicesProtocol->WhoAmI(mpServicesProtocol, &processorNumber);
 
-    unsigned int executedContractIndex;
     switch (contractProcessorPhase)
     {
     case INITIALIZE:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch == contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(INITIALIZE);
-            }
-        }
-    }
-    break;
-
     case BEGIN_EPOCH:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(BEGIN_EPOCH);
-            }
-        }
-    }
-    break;
-
     case BEGIN_TICK:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(BEGIN_TICK);
-            }
-        }
-    }
-    break;
-
     case END_TICK:
-    {
-        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(END_TICK);
-            }
-        }
-    }
-    break;
-
     case END_EPOCH:
     {
-        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(END_EPOCH);
-            }
-        }
+        callContractSystemProcedures(contractProcessorPhase);
     }
     break;
 
     case USER_PROCEDURE_CALL:
     {
-        const Transaction* transaction = contractProcessorTransaction;
-        ASSERT(transaction && transaction->checkValidity());
-
-        unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
-        ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
-        ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
-        ASSERT(contractUserProcedures[contractIndex][transaction->inputType]);
-
-        QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount);
-        qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
-
-        if (contractActionTracker.getOverallQuTransferBalance(transaction->sourcePublicKey) == 0)
-            contractProcessorTransactionMoneyflew = 0;
-        else
-            contractProcessorTransactionMoneyflew = 1;
+        contractProcessorTransactionMoneyflew = callContractUserProcedure(contractProcessorTransaction);
         contractProcessorTransaction = 0;
     }
     break;
     }
 }
 
-static void processTickTransactionContractIPO(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+// Hook of tick_processing.h: run user procedure call of transaction in contract processor and wait for completion
+static bool runContractUserProcedure(const Transaction* transaction)
 {
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(!transaction->amount && transaction->inputSize == sizeof(ContractIPOBid));
-    ASSERT(spectrumIndex >= 0);
-    ASSERT(contractIndex < contractCount);
-    ASSERT(system.epoch < contractDescriptions[contractIndex].constructionEpoch);
+    contractProcessorTransaction = transaction;
+    contractProcessorPhase = USER_PROCEDURE_CALL;
+    contractProcessorState = 1;
+    while (contractProcessorState)
+    {
+        _mm_pause();
+    }
+
+    return contractProcessorTransactionMoneyflew;
+}
+
+// Hook of tick_processing.h
+static int getSolutionThreshold()
+{
+    return (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
+}
 
-    ContractIPOBid* contractIPOBid = (ContractIPOBid*)transaction->inputPtr();
-    if (contractIPOBid->price > 0 && contractIPOBid->price <= MAX_AMOUNT / NUMBER_OF_COMPUTORS
-        && contractIPOBid->quantity > 0 && contractIPOBid->quantity <= NUMBER_OF_COMPUTORS)
+// Record solution of own computor in system.solutions, so it is not published again
+static void recordOwnComputorSolution(const MiningSolutionTransaction* transaction)
+{
+    for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
     {
-        const long long amount = contractIPOBid->price * contractIPOBid->quantity;
-        if (decreaseEnergy(spectrumIndex, amount))
+        if (transaction->sourcePublicKey == computorPublicKeys[i])
         {
-            const QuTransfer quTransfer = { transaction->sourcePublicKey, m256i::zero(), amount };
-            logger.logQuTransfer(quTransfer);
+            ACQUIRE(solutionsLock);
 
-            numberOfReleasedEntities = 0;
-            contractStateLock[contractIndex].acquireWrite();
-            IPO* ipo = (IPO*)contractStates[contractIndex];
-            for (unsigned int i = 0; i < contractIPOBid->quantity; i++)
+            unsigned int j;
+            for (j = 0; j < system.numberOfSolutions; j++)
             {
-                if (contractIPOBid->price <= ipo->prices[NUMBER_OF_COMPUTORS - 1])
+                if (transaction->nonce == system.solutions[j].nonce
+                    && transaction->miningSeed == system.solutions[j].miningSeed
+                    && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
                 {
-                    unsigned int j;
-                    for (j = 0; j < numberOfReleasedEntities; j++)
-                    {
-                        if (transaction->sourcePublicKey == releasedPublicKeys[j])
-                        {
-                            break;
-                        }
-                    }
-                    if (j == numberOfReleasedEntities)
-                    {
-                        releasedPublicKeys[numberOfReleasedEntities] = transaction->sourcePublicKey;
-                        releasedAmounts[numberOfReleasedEntities++] = contractIPOBid->price;
-                    }
-                    else
-                    {
-                        releasedAmounts[j] += contractIPOBid->price;
-                    }
-                }
-                else
-                {
-                    unsigned int j;
-                    for (j = 0; j < numberOfReleasedEntities; j++)
-                    {
-                        if (ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] == releasedPublicKeys[j])
-                        {
-                            break;
-                        }
-                    }
-                    if (j == numberOfReleasedEntities)
-                    {
-                        releasedPublicKeys[numberOfReleasedEntities] = ipo->publicKeys[NUMBER_OF_COMPUTORS - 1];
-                        releasedAmounts[numberOfReleasedEntities++] = ipo->prices[NUMBER_OF_COMPUTORS - 1];
-                    }
-                    else
-                    {
-                        releasedAmounts[j] += ipo->prices[NUMBER_OF_COMPUTORS - 1];
-                    }
-
-                    ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] = transaction->sourcePublicKey;
-                    ipo->prices[NUMBER_OF_COMPUTORS - 1] = contractIPOBid->price;
-                    j = NUMBER_OF_COMPUTORS - 1;
-                    while (j
-                        && ipo->prices[j - 1] < ipo->prices[j])
-                    {
-                        const m256i tmpPublicKey = ipo->publicKeys[j - 1];
-                        const long long tmpPrice = ipo->prices[j - 1];
-                        ipo->publicKeys[j - 1] = ipo->publicKeys[j];
-                        ipo->prices[j - 1] = ipo->prices[j];
-                        ipo->publicKeys[j] = tmpPublicKey;
-                        ipo->prices[j--] = tmpPrice;
-                    }
+                    solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
 
-                    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+                    break;
                 }
             }
-            contractStateLock[contractIndex].releaseWrite();
-
-            for (unsigned int i = 0; i < numberOfReleasedEntities; i++)
+            if (j == system.numberOfSolutions
+                && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
             {
-                increaseEnergy(releasedPublicKeys[i], releasedAmounts[i]);
-                const QuTransfer quTransfer = { m256i::zero(), releasedPublicKeys[i], releasedAmounts[i] };
-                logger.logQuTransfer(quTransfer);
+                system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
+                system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
+                system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
+                solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
             }
+
+            RELEASE(solutionsLock);
+
+            break;
         }
     }
 }
 
-// Return if money flew
-static bool processTickTransactionContractProcedure(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+// Count good solution of miner and update the future computors of the next epoch
+static void updateMinerScores(const MiningSolutionTransaction* transaction)
 {
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(spectrumIndex >= 0);
-    ASSERT(contractIndex < contractCount);
-    ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
-    ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
-
-    if (contractUserProcedures[contractIndex][transaction->inputType])
+    ACQUIRE(minerScoreArrayLock);
+    unsigned int minerIndex;
+    for (minerIndex = 0; minerIndex < numberOfMiners; minerIndex++)
     {
-        // Run user procedure call of transaction in contract processor
-        // and wait for completion
-        contractProcessorTransaction = transaction;
-        contractProcessorPhase = USER_PROCEDURE_CALL;
-        contractProcessorState = 1;
-        while (contractProcessorState)
+        if (transaction->sourcePublicKey == minerPublicKeys[minerIndex])
         {
-            _mm_pause();
-        }
+            minerScores[minerIndex]++;
 
-        return contractProcessorTransactionMoneyflew;
+            break;
+        }
+    }
+    if (minerIndex == numberOfMiners
+        && numberOfMiners < MAX_NUMBER_OF_MINERS)
+    {
+        minerPublicKeys[numberOfMiners] = transaction->sourcePublicKey;
+        minerScores[numberOfMiners++] = 1;
     }
 
-    // if transaction tries to invoke non-registered procedure, transaction amount is not reimbursed
-    return transaction->amount > 0;
-}
-
-static void processTickTransactionSolution(const MiningSolutionTransaction* transaction, const unsigned long long processorNumber)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->amount >=MiningSolutionTransaction::minAmount()
-            && transaction->inputSize == 64
-            && transaction->inputType == MiningSolutionTransaction::transactionType());
+    const m256i tmpPublicKey = minerPublicKeys[minerIndex];
+    const unsigned int tmpScore = minerScores[minerIndex];
+    while (minerIndex > (unsigned int)(minerIndex < NUMBER_OF_COMPUTORS ? 0 : NUMBER_OF_COMPUTORS)
+        && minerScores[minerIndex - 1] < minerScores[minerIndex])
+    {
+        minerPublicKeys[minerIndex] = minerPublicKeys[minerIndex - 1];
+        minerScores[minerIndex] = minerScores[minerIndex - 1];
+        minerPublicKeys[--minerIndex] = tmpPublicKey;
+        minerScores[minerIndex] = tmpScore;
+    }
 
-    m256i data[3] = { transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce };
-    static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-    unsigned int flagIndex;
-    KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
-    if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
+    // combine 225 worst current computors with 225 best candidates
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS - QUORUM; i++)
     {
-        minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
+        competitorPublicKeys[i] = minerPublicKeys[QUORUM + i];
+        competitorScores[i] = minerScores[QUORUM + i];
+        competitorComputorStatuses[i] = true;
 
-        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
-        if (score->isValidScore(solutionScore))
+        if (NUMBER_OF_COMPUTORS + i < numberOfMiners)
         {
-            resourceTestingDigest ^= (unsigned long long)(solutionScore);
-            KangarooTwelve(&resourceTestingDigest, sizeof(resourceTestingDigest), &resourceTestingDigest, sizeof(resourceTestingDigest));
-
-            const int threshold = (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
-            if (score->isGoodScore(solutionScore, threshold))
-            {
-                // Solution deposit return
-                {
-                    increaseEnergy(transaction->sourcePublicKey, transaction->amount);
-
-                    const QuTransfer quTransfer = { m256i::zero(), transaction->sourcePublicKey, transaction->amount };
-                    logger.logQuTransfer(quTransfer);
-                }
-
-                for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
-                {
-                    if (transaction->sourcePublicKey == computorPublicKeys[i])
-                    {
-                        ACQUIRE(solutionsLock);
-
-                        unsigned int j;
-                        for (j = 0; j < system.numberOfSolutions; j++)
-                        {
-                            if (transaction->nonce == system.solutions[j].nonce
-                                && transaction->miningSeed == system.solutions[j].miningSeed
-                                && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                            {
-                                solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
-
-                                break;
-                            }
-                        }
-                        if (j == system.numberOfSolutions
-                            && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                        {
-                            system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                            system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                            system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                            solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
-                        }
-
-                        RELEASE(solutionsLock);
-
-                        break;
-                    }
-                }
-
-                ACQUIRE(minerScoreArrayLock);
-                unsigned int minerIndex;
-                for (minerIndex = 0; minerIndex < numberOfMiners; minerIndex++)
-                {
-                    if (transaction->sourcePublicKey == minerPublicKeys[minerIndex])
-                    {
-                        minerScores[minerIndex]++;
-
-                        break;
-                    }
-                }
-                if (minerIndex == numberOfMiners
-                    && numberOfMiners < MAX_NUMBER_OF_MINERS)
-                {
-                    minerPublicKeys[numberOfMiners] = transaction->sourcePublicKey;
-                    minerScores[numberOfMiners++] = 1;
-                }
-
-                const m256i tmpPublicKey = minerPublicKeys[minerIndex];
-                const unsigned int tmpScore = minerScores[minerIndex];
-                while (minerIndex > (unsigned int)(minerIndex < NUMBER_OF_COMPUTORS ? 0 : NUMBER_OF_COMPUTORS)
-                    && minerScores[minerIndex - 1] < minerScores[minerIndex])
-                {
-                    minerPublicKeys[minerIndex] = minerPublicKeys[minerIndex - 1];
-                    minerScores[minerIndex] = minerScores[minerIndex - 1];
-                    minerPublicKeys[--minerIndex] = tmpPublicKey;
-                    minerScores[minerIndex] = tmpScore;
-                }
-
-                // combine 225 worst current computors with 225 best candidates
-                for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS - QUORUM; i++)
-                {
-                    competitorPublicKeys[i] = minerPublicKeys[QUORUM + i];
-                    competitorScores[i] = minerScores[QUORUM + i];
-                    competitorComputorStatuses[i] = true;
-
-                    if (NUMBER_OF_COMPUTORS + i < numberOfMiners)
-                    {
-                        competitorPublicKeys[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerPublicKeys[NUMBER_OF_COMPUTORS + i];
-                        competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerScores[NUMBER_OF_COMPUTORS + i];
-                    }
-                    else
-                    {
-                        competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = 0;
-                    }
-                    competitorComputorStatuses[i + (NUMBER_OF_COMPUTORS - QUORUM)] = false;
-                }
-                RELEASE(minerScoreArrayLock);
-
-                // bubble sorting -> top 225 from competitorPublicKeys have computors and candidates which are the best from that subset
-                for (unsigned int i = NUMBER_OF_COMPUTORS - QUORUM; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
-                {
-                    int j = i;
-                    const m256i tmpPublicKey = competitorPublicKeys[j];
-                    const unsigned int tmpScore = competitorScores[j];
-                    const bool tmpComputorStatus = false;
-                    while (j
-                        && competitorScores[j - 1] < competitorScores[j])
-                    {
-                        competitorPublicKeys[j] = competitorPublicKeys[j - 1];
-                        competitorScores[j] = competitorScores[j - 1];
-                        competitorComputorStatuses[j] = competitorComputorStatuses[j - 1];
-                        competitorPublicKeys[--j] = tmpPublicKey;
-                        competitorScores[j] = tmpScore;
-                        competitorComputorStatuses[j] = tmpComputorStatus;
-                    }
-                }
-
-                minimumComputorScore = competitorScores[NUMBER_OF_COMPUTORS - QUORUM - 1];
-
-                unsigned char candidateCounter = 0;
-                for (unsigned int i = 0; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
-                {
-                    if (!competitorComputorStatuses[i])
-                    {
-                        minimumCandidateScore = competitorScores[i];
-                        candidateCounter++;
-                    }
-                }
-                if (candidateCounter < NUMBER_OF_COMPUTORS - QUORUM)
-                {
-                    minimumCandidateScore = minimumComputorScore;
-                }
-
-                ACQUIRE(minerScoreArrayLock);
-                for (unsigned int i = 0; i < QUORUM; i++)
-                {
-                    system.futureComputors[i] = minerPublicKeys[i];
-                }
-                RELEASE(minerScoreArrayLock);
-
-                for (unsigned int i = QUORUM; i < NUMBER_OF_COMPUTORS; i++)
-                {
-                    system.futureComputors[i] = competitorPublicKeys[i - QUORUM];
-                }
-            }
-        }        
+            competitorPublicKeys[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerPublicKeys[NUMBER_OF_COMPUTORS + i];
+            competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerScores[NUMBER_OF_COMPUTORS + i];
+        }
+        else
+        {
+            competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = 0;
+        }
+        competitorComputorStatuses[i + (NUMBER_OF_COMPUTORS - QUORUM)] = false;
     }
-    else
+    RELEASE(minerScoreArrayLock);
+
+    // bubble sorting -> top 225 from competitorPublicKeys have computors and candidates which are the best from that subset
+    for (unsigned int i = NUMBER_OF_COMPUTORS - QUORUM; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
     {
-        for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+        int j = i;
+        const m256i tmpPublicKey = competitorPublicKeys[j];
+        const unsigned int tmpScore = competitorScores[j];
+        const bool tmpComputorStatus = false;
+        while (j
+            && competitorScores[j - 1] < competitorScores[j])
         {
-            if (transaction->sourcePublicKey == computorPublicKeys[i])
-            {
-                ACQUIRE(solutionsLock);
-
-                unsigned int j;
-                for (j = 0; j < system.numberOfSolutions; j++)
-                {
-                    if (transaction->nonce == system.solutions[j].nonce
-                        && transaction->miningSeed == system.solutions[j].miningSeed
-                        && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                    {
-                        solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
-
-                        break;
-                    }
-                }
-                if (j == system.numberOfSolutions
-                    && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                {
-                    system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                    system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                    system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                    solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
-                }
-
-                RELEASE(solutionsLock);
-
-                break;
-            }
+            competitorPublicKeys[j] = competitorPublicKeys[j - 1];
+            competitorScores[j] = competitorScores[j - 1];
+            competitorComputorStatuses[j] = competitorComputorStatuses[j - 1];
+            competitorPublicKeys[--j] = tmpPublicKey;
+            competitorScores[j] = tmpScore;
+            competitorComputorStatuses[j] = tmpComputorStatus;
         }
     }
-}
 
-static void processTickTransactionOracleReplyCommit(const OracleReplyCommitTransaction* transaction)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->tick == system.tick);
+    minimumComputorScore = competitorScores[NUMBER_OF_COMPUTORS - QUORUM - 1];
 
-    // TODO
-}
-
-static void processTickTransactionOracleReplyReveal(const OracleReplyRevealTransactionPrefix* transaction)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->tick == system.tick);
-
-    // TODO
-}
-
-static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, unsigned long long processorNumber)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-
-    // Record the tx with digest
-    ts.transactionsDigestAccess.acquireLock();
-    ts.transactionsDigestAccess.insertTransaction(transactionDigest, transaction);
-    ts.transactionsDigestAccess.releaseLock();
-
-    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
-    if (spectrumIndex >= 0)
+    unsigned char candidateCounter = 0;
+    for (unsigned int i = 0; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
     {
-        numberOfTransactions++;
-        bool moneyFlew = false;
-#if ADDON_TX_STATUS_REQUEST
-        txStatusData.tickTxIndexStart[system.tick - system.initialTick + 1] = numberOfTransactions; // qli: part of tx_status_request add-on
-#endif
-        if (decreaseEnergy(spectrumIndex, transaction->amount))
+        if (!competitorComputorStatuses[i])
         {
-            increaseEnergy(transaction->destinationPublicKey, transaction->amount);
-
-            if (transaction->amount)
-            {
-                moneyFlew = true;
-                const QuTransfer quTransfer = { transaction->sourcePublicKey , transaction->destinationPublicKey , transaction->amount };
-                logger.logQuTransfer(quTransfer);
-            }
-
-            if (isZero(transaction->destinationPublicKey))
-            {
-                switch (transaction->inputType)
-                {
-                case VOTE_COUNTER_INPUT_TYPE:
-                {
-                    int computorIndex = transaction->tick % NUMBER_OF_COMPUTORS;
-                    if (transaction->sourcePublicKey == broadcastedComputors.computors.publicKeys[computorIndex]) // this tx was sent by the tick leader of this tick
-                    {
-                        if (!transaction->amount
-                            && transaction->inputSize == VOTE_COUNTER_DATA_SIZE_IN_BYTES)
-                        {
-                            voteCounter.addVotes(transaction->inputPtr(), computorIndex);
-                        }
-                    }
-                }
-                break;
-
-                case FileHeaderTransaction::transactionType():
-                {
-                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
-                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
-                    {
-                        // Do nothing
-                    }
-                }
-                break;
-
-                case FileFragmentTransactionPrefix::transactionType():
-                {
-                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
-                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
-                    {
-                        // Do nothing
-                    }
-                }
-                break;
-
-                case FileTrailerTransaction::transactionType():
-                {
-                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
-                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
-                    {
-                        // Do nothing
-                    }
-                }
-                break;
+            minimumCandidateScore = competitorScores[i];
+            candidateCounter++;
+        }
+    }
+    if (candidateCounter < NUMBER_OF_COMPUTORS - QUORUM)
+    {
+        minimumCandidateScore = minimumComputorScore;
+    }
 
-                case MiningSolutionTransaction::transactionType():
-                {
-                    if (transaction->amount >= MiningSolutionTransaction::minAmount()
-                        && transaction->inputSize >= MiningSolutionTransaction::minInputSize())
-                    {
-                        processTickTransactionSolution((MiningSolutionTransaction*)transaction, processorNumber);
-                    }
-                }
-                break;
+    ACQUIRE(minerScoreArrayLock);
+    for (unsigned int i = 0; i < QUORUM; i++)
+    {
+        system.futureComputors[i] = minerPublicKeys[i];
+    }
+    RELEASE(minerScoreArrayLock);
 
-                case OracleReplyCommitTransaction::transactionType():
-                {
-                    if (computorIndex(transaction->sourcePublicKey) >= 0
-                        && transaction->inputSize == sizeof(OracleReplyCommitTransaction))
-                    {
-                        processTickTransactionOracleReplyCommit((OracleReplyCommitTransaction*)transaction);
-                    }
-                }
-                break;
+    for (unsigned int i = QUORUM; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        system.futureComputors[i] = competitorPublicKeys[i - QUORUM];
+    }
+}
 
-                case OracleReplyRevealTransactionPrefix::transactionType():
-                {
-                    if (computorIndex(transaction->sourcePublicKey) >= 0
-                        && transaction->inputSize >= sizeof(OracleReplyRevealTransactionPrefix) + sizeof(OracleReplyRevealTransactionPostfix))
-                    {
-                        processTickTransactionOracleReplyReveal((OracleReplyRevealTransactionPrefix*)transaction);
-                    }
-                }
-                break;
-                }
-            }
-            else
-            {
-                // Contracts are identified by their index stored in the first 64 bits of the id, all
-                // other bits are zeroed. However, the max number of contracts is limited to 2^32 - 1,
-                // only 32 bits are used for the contract index.
-                m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
-                maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
-                unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
-                if (isZero(maskedDestinationPublicKey)
-                    && contractIndex < contractCount)
-                {
-                    // Contract transactions
-                    if (system.epoch < contractDescriptions[contractIndex].constructionEpoch)
-                    {
-                        // IPO
-                        if (!transaction->amount
-                            && transaction->inputSize == sizeof(ContractIPOBid))
-                        {
-                            processTickTransactionContractIPO(transaction, spectrumIndex, contractIndex);
-                        }
-                    }
-                    else if (system.epoch < contractDescriptions[contractIndex].destructionEpoch)
-                    {
-                        // Regular contract procedure invocation
-                        moneyFlew = processTickTransactionContractProcedure(transaction, spectrumIndex, contractIndex);
-                    }
-                }
-            }
-        }
+// Hook of tick_processing.h
+static void recordMiningSolution(const MiningSolutionTransaction* transaction, MiningSolutionStatus status)
+{
+    if (status == MINING_SOLUTION_GOOD_SCORE)
+    {
+        recordOwnComputorSolution(transaction);
+        updateMinerScores(transaction);
+    }
+    else if (status == MINING_SOLUTION_ALREADY_SCORED)
+    {
+        recordOwnComputorSolution(transaction);
+    }
+}
+
+// Process transaction of current tick. The spectrum index of the source entity (-1 if the source entity does not
+// exist) and the miner solution flag index (only used for solution transactions) are taken from the lookup cache.
+static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, unsigned long long processorNumber, const int spectrumIndex,
+    const unsigned int solutionFlagIndex)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+
+    // Record the tx with digest (if the digest index is full, the tx can only be requested by tick)
+    ts.transactionsDigestAccess.acquireLock();
+    if (!ts.transactionsDigestAccess.insertTransaction(transactionDigest, transaction))
+    {
+        numberOfUnindexedTransactions++;
+    }
+    ts.transactionsDigestAccess.releaseLock();
 
+    if (spectrumIndex >= 0)
+    {
+        numberOfTransactions++;
 #if ADDON_TX_STATUS_REQUEST
+        txStatusData.tickTxIndexStart[system.tick - system.initialTick + 1] = numberOfTransactions; // qli: part of tx_status_request add-on
+        const bool moneyFlew = executeTickTransaction(transaction, processorNumber, spectrumIndex, &solutionFlagIndex);
         saveConfirmedTx(numberOfTransactions - 1, moneyFlew, system.tick, transactionDigest); // qli: save tx
+#else
+        executeTickTransaction(transaction, processorNumber, spectrumIndex, &solutionFlagIndex);
 #endif
     }
 }
@@ -2312,6 +2372,7 @@ static void processTick(unsigned long long processorNumber)
         }
     }
 
+    unsigned long long phaseBeginningTick = __rdtsc();
     logger.registerNewTx(system.tick, logger.SC_BEGIN_TICK_TX);
     contractProcessorPhase = BEGIN_TICK;
     contractProcessorState = 1;
@@ -2319,6 +2380,7 @@ static void processTick(unsigned long long processorNumber)
     {
         _mm_pause();
     }
+    tickPhaseLatencies[TELEMETRY_TICK_PHASE_BEGIN_TICK].add(__rdtsc() - phaseBeginningTick);
 
     unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick);
     ts.tickData.acquireLock();
@@ -2333,7 +2395,9 @@ static void processTick(unsigned long long processorNumber)
 #endif
         // reset solution task queue
         score->resetTaskQueue();
-        // pre-scan any solution tx and add them to solution task queue
+
+        // Queue transactions of the tick for the parallel lookups (spectrum index, solution digest)
+        tickTransactionLookupCache.reset();
         for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
         {
             if (!isZero(nextTickData.transactionDigests[transactionIndex]))
@@ -2343,27 +2407,49 @@ static void processTick(unsigned long long processorNumber)
                     Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
                     ASSERT(transaction->checkValidity());
                     ASSERT(transaction->tick == system.tick);
-                    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
-                    if (spectrumIndex >= 0)
+                    tickTransactionLookupCache.addTransaction(transaction, transactionIndex);
+                }
+                else
+                {
+                    while (true)
+                    {
+                        criticalSituation = 1;
+                    }
+                }
+            }
+        }
+
+        // Fill lookup cache. In parallel, tickTransactionLookupCache.tryProcessTask() is called by request processors.
+        unsigned long long lookupStartTick = __rdtsc();
+        tickTransactionLookupCache.start();
+        while (!tickTransactionLookupCache.isFinished())
+        {
+            tickTransactionLookupCache.tryProcessTask();
+        }
+        tickTransactionLookupCache.stop();
+        const unsigned long long lookupEndTick = __rdtsc();
+        tickTransactionLookupTotalExecutionTicks += lookupEndTick - lookupStartTick;
+
+        // pre-scan any solution tx and add them to solution task queue
+        for (unsigned int i = 0; i < tickTransactionLookupCache.size(); i++)
+        {
+            const TickTransactionLookupCache::Entry& entry = tickTransactionLookupCache.entry(i);
+            const Transaction* transaction = entry.transaction;
+            if (entry.sourceSpectrumIndex >= 0)
+            {
+                // Solution transactions
+                if (isZero(transaction->destinationPublicKey)
+                    && transaction->amount >= MiningSolutionTransaction::minAmount()
+                    && transaction->inputType == MiningSolutionTransaction::transactionType())
+                {
+                    if (transaction->inputSize == 32 + 32)
                     {
-                        // Solution transactions
-                        if (isZero(transaction->destinationPublicKey)
-                            && transaction->amount >= MiningSolutionTransaction::minAmount()
-                            && transaction->inputType == MiningSolutionTransaction::transactionType())
+                        const m256i& solution_miningSeed = *(m256i*)transaction->inputPtr();
+                        const m256i& solution_nonce = *(m256i*)(transaction->inputPtr() + 32);
+                        const unsigned int flagIndex = entry.solutionFlagIndex;
+                        if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
                         {
-                            if (transaction->inputSize == 32 + 32)
-                            {
-                                const m256i& solution_miningSeed = *(m256i*)transaction->inputPtr();
-                                const m256i& solution_nonce = *(m256i*)(transaction->inputPtr() + 32);
-                                m256i data[3] = { transaction->sourcePublicKey, solution_miningSeed, solution_nonce };
-                                static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-                                unsigned int flagIndex;
-                                KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
-                                if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
-                                {
-                                    score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce);
-                                }
-                            }
+                            score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce);
                         }
                     }
                 }
@@ -2380,30 +2466,24 @@ static void processTick(unsigned long long processorNumber)
             }
             score->stopProcessTaskQueue();
         }
-        solutionTotalExecutionTicks = __rdtsc() - solutionProcessStartTick; // for tracking the time processing solutions
+        const unsigned long long solutionProcessEndTick = __rdtsc();
+        solutionTotalExecutionTicks = solutionProcessEndTick - solutionProcessStartTick; // for tracking the time processing solutions
+        tickPhaseLatencies[TELEMETRY_TICK_PHASE_SOLUTIONS].add(solutionProcessEndTick - lookupEndTick);
 
-        // Process all transaction of the tick
-        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        // Process all transaction of the tick (sequentially in canonical order, using the lookup cache)
+        for (unsigned int i = 0; i < tickTransactionLookupCache.size(); i++)
         {
-            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
-            {
-                if (tsCurrentTickTransactionOffsets[transactionIndex])
-                {
-                    Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
-                    logger.registerNewTx(transaction->tick, transactionIndex);
-                    processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], processorNumber);
-                }
-                else
-                {
-                    while (true)
-                    {
-                        criticalSituation = 1;
-                    }
-                }
-            }
+            const TickTransactionLookupCache::Entry& entry = tickTransactionLookupCache.entry(i);
+            const Transaction* transaction = entry.transaction;
+            logger.registerNewTx(transaction->tick, entry.transactionIndex);
+            processTickTransaction(transaction, nextTickData.transactionDigests[entry.transactionIndex], processorNumber,
+                tickTransactionLookupCache.validatedSourceSpectrumIndex(i), entry.solutionFlagIndex);
         }
+        tickTransactionLookupTransactions += tickTransactionLookupCache.size();
+        tickPhaseLatencies[TELEMETRY_TICK_PHASE_TRANSACTIONS].add((lookupEndTick - lookupStartTick) + (__rdtsc() - solutionProcessEndTick));
     }
 
+    phaseBeginningTick = __rdtsc();
     logger.registerNewTx(system.tick, logger.SC_END_TICK_TX);
     contractProcessorPhase = END_TICK;
     contractProcessorState = 1;
@@ -2411,41 +2491,13 @@ static void processTick(unsigned long long processorNumber)
     {
         _mm_pause();
     }
+    tickPhaseLatencies[TELEMETRY_TICK_PHASE_END_TICK].add(__rdtsc() - phaseBeginningTick);
+    phaseBeginningTick = __rdtsc();
 
-    unsigned int digestIndex;
-    ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
-
-    etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
-    RELEASE(spectrumLock);
-
+    getSpectrumDigest(etalonTick.saltedSpectrumDigest);
     getUniverseDigest(etalonTick.saltedUniverseDigest);
     getComputerDigest(etalonTick.saltedComputerDigest);
+    tickPhaseLatencies[TELEMETRY_TICK_PHASE_DIGESTS].add(__rdtsc() - phaseBeginningTick);
 
     for (unsigned int i = 0; i < numberOfOwnComputorIndices; i++)
     {
@@ -2705,6 +2757,9 @@ static void beginEpoch()
 #endif
     ts.beginEpoch(system.initialTick);
     voteCounter.init();
+#if EPOCH_ARCHIVE
+    epochArchive.beginEpoch(system.epoch, system.initialTick);
+#endif
 #ifndef NDEBUG
     ts.checkStateConsistencyWithAssert();
 #endif
@@ -2762,6 +2817,9 @@ static void beginEpoch()
     resourceTestingDigest = 0;
 
     numberOfTransactions = 0;
+#if CONTRACT_PROFILER_ENTRIES
+    contractProfiler.reset();
+#endif
 #if TICK_STORAGE_AUTOSAVE_MODE
     ts.initMetaData(system.epoch); // for save/load state
 #endif
@@ -2841,7 +2899,7 @@ static void endEpoch()
             contractStateLock[contractIndex].releaseRead();
 
             contractStateLock[0].acquireWrite();
-            contractFeeReserve(contractIndex) = finalPrice * NUMBER_OF_COMPUTORS;
+            setContractFeeReserve(contractIndex, finalPrice * NUMBER_OF_COMPUTORS);
             contractStateLock[0].releaseWrite();
         }
     }
@@ -3128,24 +3186,171 @@ static bool invalidateNodeStates(CHAR16* directory)
     return ts.saveInvalidateData(system.epoch, directory);
 }
 
-// can only called from main thread
-static bool saveAllNodeStates()
+#if NODE_STATE_DELTAS_PER_BASE
+static void setNodeStateDeltaFileName(CHAR16* fileName, unsigned int fileNameSize, unsigned short sequenceNumber)
 {
-    CHAR16 directory[16];
-    setText(directory, L"ep");
-    appendNumber(directory, system.epoch, false);
+    setText(fileName, L"snapshotDelta.???");
+    addEpochToFileName(fileName, getTextSize(fileName, fileNameSize) + 1, sequenceNumber);
+}
 
-    logToConsole(L"Start saving node states from main thread");
+// Serialize parts of node state that changed since the last snapshot into nodeStateDeltaBuffer. Returns false if a
+// full snapshot needs to be saved instead (no valid base snapshot of current epoch, too many deltas, or too many
+// changes). Only call while the tick processor is paused, because the delta must be a consistent image of the state.
+static bool captureNodeStateDelta(unsigned short& sequenceNumber, unsigned long long& deltaSize)
+{
+    if (nodeStateDeltaInfo.epoch != system.epoch || nodeStateDeltaInfo.numberOfDeltas >= NODE_STATE_DELTAS_PER_BASE)
+        return false;
+    if (!nodeStateDeltaBuffer && !allocatePool(NODE_STATE_DELTA_BUFFER_SIZE, (void**)&nodeStateDeltaBuffer))
+    {
+        nodeStateDeltaBuffer = nullptr;
+        logToConsole(L"Failed to allocate buffer for node state delta");
+        return false;
+    }
 
-    // Mark current snapshot metadata as invalid at the beginning.
-    // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
-    // and make the loadAllNodeStates see this saving as an invalid save.
-    if (!invalidateNodeStates(directory))
+    const unsigned long long beginningTick = __rdtsc();
+    sequenceNumber = nodeStateDeltaInfo.numberOfDeltas + 1;
+    NodeStateDeltaWriter writer;
+    writer.init(nodeStateDeltaBuffer, NODE_STATE_DELTA_BUFFER_SIZE, system.epoch, sequenceNumber, system.tick);
+
+    ACQUIRE(spectrumLock);
+    bool ok = writer.addDirtyPages(NodeStateDeltaSpectrum, spectrumDirtyPagesSinceSnapshot, (unsigned char*)spectrum, 64 * sizeof(::Entity));
+    RELEASE(spectrumLock);
+
+    ACQUIRE(universeLock);
+    ok = ok && writer.addDirtyPages(NodeStateDeltaUniverse, assetDirtyPagesSinceSnapshot, (unsigned char*)assets, 64 * sizeof(Asset));
+    RELEASE(universeLock);
+
+    ok = ok && writer.addDirtyPages(NodeStateDeltaMinerSolutionFlags, minerSolutionFlagsDirtyPagesSinceSnapshot, (unsigned char*)minerSolutionFlags, minerSolutionFlagsSnapshotPageSize);
+
+    // include contract states changed after the last digest computation
+    contractStatesDirtySinceSnapshot.markPages(contractStateChangeFlags);
+    for (unsigned int contractIndex = 0; ok && contractIndex < contractCount; contractIndex++)
     {
-        logToConsole(L"Failed to init snapshot metadata");
+        if (contractStatesDirtySinceSnapshot.isPageDirty(contractIndex))
+        {
+            contractStateLock[contractIndex].acquireRead();
+            ok = writer.addRecord(NodeStateDeltaContractStates + contractIndex, 0, contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
+            contractStateLock[contractIndex].releaseRead();
+        }
+    }
+
+    if (!ok)
+    {
+        logToConsole(L"Node state changes exceed delta buffer, saving full snapshot");
+        return false;
+    }
+    deltaSize = writer.size();
+
+    setNumber(message, writer.size(), TRUE);
+    appendText(message, L" bytes of node state delta are captured (");
+    appendNumber(message, writer.numberOfRecords(), TRUE);
+    appendText(message, L" records, ");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
+    return true;
+}
+
+// Apply delta snapshots saved after the full snapshot that has been loaded before
+static bool loadNodeStateDeltas(CHAR16* directory)
+{
+    CHAR16 DELTA_INFO_FILE_NAME[] = L"snapshotDeltaInfo";
+    if (load(DELTA_INFO_FILE_NAME, sizeof(nodeStateDeltaInfo), (unsigned char*)&nodeStateDeltaInfo, directory) != sizeof(nodeStateDeltaInfo))
+    {
+        // no delta info (for example if snapshot has been saved without delta support) -> next snapshot will be full
+        setMem(&nodeStateDeltaInfo, sizeof(nodeStateDeltaInfo), 0);
+        return true;
+    }
+    if (nodeStateDeltaInfo.epoch != system.epoch || nodeStateDeltaInfo.numberOfDeltas > NODE_STATE_DELTAS_PER_BASE)
+    {
+        logToConsole(L"Invalid node state delta info");
+        setMem(&nodeStateDeltaInfo, sizeof(nodeStateDeltaInfo), 0);
         return false;
     }
+    if (nodeStateDeltaInfo.numberOfDeltas && !nodeStateDeltaBuffer && !allocatePool(NODE_STATE_DELTA_BUFFER_SIZE, (void**)&nodeStateDeltaBuffer))
+    {
+        nodeStateDeltaBuffer = nullptr;
+        logToConsole(L"Failed to allocate buffer for node state delta");
+        return false;
+    }
+
+    for (unsigned short sequenceNumber = 1; sequenceNumber <= nodeStateDeltaInfo.numberOfDeltas; ++sequenceNumber)
+    {
+        const unsigned long long size = nodeStateDeltaInfo.deltaSizes[sequenceNumber - 1];
+        CHAR16 fileName[32];
+        setNodeStateDeltaFileName(fileName, 32, sequenceNumber);
+        setText(message, L"Loading node state delta ");
+        appendText(message, fileName);
+        logToConsole(message);
+        NodeStateDeltaReader reader;
+        if (size > NODE_STATE_DELTA_BUFFER_SIZE
+            || loadLargeFile(fileName, size, nodeStateDeltaBuffer, directory) != size
+            || !reader.init(nodeStateDeltaBuffer, size, system.epoch, sequenceNumber))
+        {
+            logToConsole(L"Failed to load node state delta");
+            return false;
+        }
+
+        // Apply records and set change flags, so the digests are updated when they are computed the next time
+        while (const NodeStateDeltaRecord* record = reader.nextRecord())
+        {
+            const unsigned char* data = NodeStateDeltaReader::recordData(record);
+            if (record->type == NodeStateDeltaSpectrum && record->offset + record->size <= SPECTRUM_CAPACITY * sizeof(::Entity)
+                && record->offset % sizeof(::Entity) == 0 && record->size % sizeof(::Entity) == 0)
+            {
+                copyMem((unsigned char*)spectrum + record->offset, data, record->size);
+                const unsigned long long begin = record->offset / sizeof(::Entity), end = begin + record->size / sizeof(::Entity);
+                for (unsigned long long i = begin; i < end; ++i)
+                {
+                    KangarooTwelve64To32(&spectrum[i], &spectrumDigests[i]);
+                    spectrumChangeFlags[i >> 6] |= (1ULL << (i & 63));
+                }
+            }
+            else if (record->type == NodeStateDeltaUniverse && record->offset + record->size <= ASSETS_CAPACITY * sizeof(Asset)
+                && record->offset % sizeof(Asset) == 0 && record->size % sizeof(Asset) == 0)
+            {
+                copyMem((unsigned char*)assets + record->offset, data, record->size);
+                const unsigned long long begin = record->offset / sizeof(Asset), end = begin + record->size / sizeof(Asset);
+                for (unsigned long long i = begin; i < end; ++i)
+                    assetChangeFlags[i >> 6] |= (1ULL << (i & 63));
+            }
+            else if (record->type == NodeStateDeltaMinerSolutionFlags && record->offset + record->size <= NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+            {
+                copyMem((unsigned char*)minerSolutionFlags + record->offset, data, record->size);
+            }
+            else if (record->type >= NodeStateDeltaContractStates && record->type - NodeStateDeltaContractStates < contractCount
+                && record->offset == 0 && record->size == contractDescriptions[record->type - NodeStateDeltaContractStates].stateSize)
+            {
+                const unsigned int contractIndex = record->type - NodeStateDeltaContractStates;
+                copyMem(contractStates[contractIndex], data, record->size);
+                contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+            }
+            else
+            {
+                logToConsole(L"Invalid record in node state delta");
+                return false;
+            }
+        }
+        if (!reader.isComplete())
+        {
+            logToConsole(L"Node state delta is incomplete");
+            return false;
+        }
+    }
+    updateSpectrumInfo();
+
+    spectrumDirtyPagesSinceSnapshot.clearAll();
+    assetDirtyPagesSinceSnapshot.clearAll();
+    minerSolutionFlagsDirtyPagesSinceSnapshot.clearAll();
+    contractStatesDirtySinceSnapshot.clearAll();
+    return true;
+}
+#endif
 
+// Save full copy of the large node state buffers (spectrum, universe, contract states, digests, miner solution flags,
+// score cache), which are the base for following delta snapshots
+static bool saveNodeStateBase(CHAR16* directory)
+{
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
@@ -3153,7 +3358,7 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, SPECTRUM_FILE_NAME);
     logToConsole(message);
-    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory))
+    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory, NODE_STATE_SNAPSHOT_COMPRESSION))
     {
         logToConsole(L"Failed to save spectrum");
         return false;
@@ -3166,7 +3371,7 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, UNIVERSE_FILE_NAME);
     logToConsole(message);
-    if (!saveUniverse(directory))
+    if (!saveUniverse(directory, NODE_STATE_SNAPSHOT_COMPRESSION))
     {
         logToConsole(L"Failed to save universe");
         return false;
@@ -3177,24 +3382,55 @@ static bool saveAllNodeStates()
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
     setText(message, L"Saving computer files");
     logToConsole(message);
-    if (!saveComputer(directory))
+    if (!saveComputer(directory, NODE_STATE_SNAPSHOT_COMPRESSION))
     {
         logToConsole(L"Failed to save computer");
         return false;
     }
-    setText(message, L"Saving system to system.snp");
-    logToConsole(message);
 
-    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
-    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
-    if (savedSize != sizeof(system))
+    score->saveScoreCache(system.epoch, directory);
+
+    // spectrum and universe digests are saved with checksum of the data, so they can be trusted when loading
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    logToConsole(L"Saving spectrum digests");
+    if (!saveDigestTree(SPECTRUM_DIGEST_FILE_NAME, directory, spectrum, spectrumSizeInBytes, spectrumDigests, spectrumDigestsSizeInByte))
     {
-        logToConsole(L"Failed to save system");
+        logToConsole(L"Failed to save spectrum digest");
         return false;
     }
-    
-    score->saveScoreCache(system.epoch, directory);
-    
+
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    logToConsole(L"Saving universe digests");
+    if (!saveDigestTree(UNIVERSE_DIGEST_FILE_NAME, directory, assets, ASSETS_CAPACITY * sizeof(Asset), assetDigests, assetDigestsSizeInBytes))
+    {
+        logToConsole(L"Failed to save universe digest");
+        return false;
+    }
+
+    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
+    long long savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
+    logToConsole(L"Saving computer digests");
+    if (savedSize != contractStateDigestsSizeInBytes)
+    {
+        logToConsole(L"Failed to save computer digest");
+        return false;
+    }
+
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+    logToConsole(L"Saving miner solution flags");
+    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
+    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    {
+        logToConsole(L"Failed to save miner solution flag");
+        return false;
+    }
+
+    return true;
+}
+
+// Copy mining state and other small parts of the node state into nodeStateBuffer
+static void captureNodeMiningState()
+{
     copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
     copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
     copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
@@ -3210,70 +3446,235 @@ static bool saveAllNodeStates()
     nodeStateBuffer.numberOfTransactions = numberOfTransactions;
     nodeStateBuffer.lastLogId = logger.logId;
     voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
+}
+
+// Save data of tick storage and tx status. Can only called from main thread while the tick processor is waiting
+// (persistingNodeStateTickProcWaiting), because both are changed by the tick processor. Saving is incremental (only
+// chunks that have changed in size are written), so this takes much less time than saving the full tick storage.
+// The snapshot stays invalid until saveNodeStateFinalFiles() writes the metadata of tick storage.
+static bool saveNodeStateTickStorage(CHAR16* directory)
+{
+    setText(message, L"Saving tick storage ");
+    logToConsole(message);
+    if (ts.trySaveDataToFile(system.epoch, system.tick, directory) != 0)
+    {
+        logToConsole(L"Failed to save tick storage");
+        return false;
+    }
+
+#if ADDON_TX_STATUS_REQUEST
+    if (!saveStateTxStatus(numberOfTransactions, directory))
+    {
+        logToConsole(L"Failed to save tx status");
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+// Save system (copy passed as systemSnapshot), mining state captured in nodeStateBuffer, and delta info. Writing the
+// metadata of the tick storage saved by saveNodeStateTickStorage() finalizes the snapshot.
+static bool saveNodeStateFinalFiles(CHAR16* directory, const System& systemSnapshot)
+{
+    setText(message, L"Saving system to system.snp");
+    logToConsole(message);
+
+    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(systemSnapshot), (unsigned char*)&systemSnapshot, directory);
+    if (savedSize != sizeof(systemSnapshot))
+    {
+        logToConsole(L"Failed to save system");
+        return false;
+    }
 
     CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
     savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
     logToConsole(L"Saving mining states");
     if (savedSize != sizeof(nodeStateBuffer))
     {
-        logToConsole(L"Failed to save etalon tick and other states");
+        logToConsole(L"Failed to save etalon tick and other states");
+        return false;
+    }
+
+#if NODE_STATE_DELTAS_PER_BASE
+    CHAR16 DELTA_INFO_FILE_NAME[] = L"snapshotDeltaInfo";
+    savedSize = save(DELTA_INFO_FILE_NAME, sizeof(nodeStateDeltaInfo), (unsigned char*)&nodeStateDeltaInfo, directory);
+    if (savedSize != sizeof(nodeStateDeltaInfo))
+    {
+        logToConsole(L"Failed to save node state delta info");
+        return false;
+    }
+#endif
+
+    if (!ts.trySaveMetaDataToFile(directory))
+    {
+        logToConsole(L"Failed to save tick storage metadata");
+        return false;
+    }
+
+    return true;
+}
+
+static void clearNodeStateDirtyPages()
+{
+    spectrumDirtyPagesSinceSnapshot.clearAll();
+    assetDirtyPagesSinceSnapshot.clearAll();
+    minerSolutionFlagsDirtyPagesSinceSnapshot.clearAll();
+    contractStatesDirtySinceSnapshot.clearAll();
+}
+
+// Save full node state snapshot.
+// Can only called from main thread while the tick processor is waiting (persistingNodeStateTickProcWaiting).
+static bool saveAllNodeStates()
+{
+    CHAR16 directory[16];
+    setText(directory, L"ep");
+    appendNumber(directory, system.epoch, false);
+
+    logToConsole(L"Start saving node states from main thread");
+
+    // Mark current snapshot metadata as invalid at the beginning.
+    // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
+    // and make the loadAllNodeStates see this saving as an invalid save.
+    if (!invalidateNodeStates(directory))
+    {
+        logToConsole(L"Failed to init snapshot metadata");
         return false;
     }
-    
-    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    savedSize = save(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
-    logToConsole(L"Saving spectrum digests");
-    if (savedSize != spectrumDigestsSizeInByte)
-    {
-        logToConsole(L"Failed to save spectrum digest");
+
+#if NODE_STATE_DELTAS_PER_BASE
+    // Base snapshot is invalid until all files have been saved successfully
+    nodeStateDeltaInfo.epoch = 0;
+    nodeStateDeltaInfo.numberOfDeltas = 0;
+#endif
+
+    if (!saveNodeStateBase(directory))
         return false;
-    }
 
-    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    savedSize = save(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
-    logToConsole(L"Saving universe digests");
-    if (savedSize != assetDigestsSizeInBytes)
+    captureNodeMiningState();
+
+#if NODE_STATE_DELTAS_PER_BASE
+    nodeStateDeltaInfo.epoch = system.epoch;
+    nodeStateDeltaInfo.baseTick = system.tick;
+#endif
+
+    if (!saveNodeStateTickStorage(directory) || !saveNodeStateFinalFiles(directory, system))
     {
-        logToConsole(L"Failed to save universe digest");
+#if NODE_STATE_DELTAS_PER_BASE
+        nodeStateDeltaInfo.epoch = 0;
+#endif
         return false;
     }
 
-    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
-    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
-    logToConsole(L"Saving computer digests");
-    if (savedSize != contractStateDigestsSizeInBytes)
-    {
-        logToConsole(L"Failed to save computer digest");
+    // Start tracking changes for next delta
+    clearNodeStateDirtyPages();
+
+    return true;
+}
+
+#if NODE_STATE_DELTAS_PER_BASE
+// Capture a consistent image of the node state changes for saving them in the background while the tick processor
+// continues. Tick storage and tx status are saved here, because they are too large for capturing and the tick
+// processor keeps changing them. Can only called from main thread while the tick processor is waiting
+// (persistingNodeStateTickProcWaiting). Returns false if a full snapshot needs to be saved with saveAllNodeStates()
+// instead.
+static bool startSavingNodeStateInBackground()
+{
+    if (!captureNodeStateDelta(backgroundNodeStateSave.deltaSequenceNumber, backgroundNodeStateSave.deltaSize))
         return false;
-    }
 
-    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
-    logToConsole(L"Saving miner solution flags");
-    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
-    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    // As in saveAllNodeStates(), the snapshot metadata is invalidated first and finalized last
+    CHAR16 directory[16];
+    setText(directory, L"ep");
+    appendNumber(directory, system.epoch, false);
+    if (!ts.saveInvalidateData(system.epoch, directory))
     {
-        logToConsole(L"Failed to save miner solution flag");
+        logToConsole(L"Failed to init snapshot metadata");
+        nodeStateDeltaInfo.epoch = 0;
         return false;
     }
-
-    setText(message, L"Saving tick storage ");
-    logToConsole(message);
-    if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
+    if (!saveNodeStateTickStorage(directory))
     {
-        logToConsole(L"Failed to save tick storage");
+        nodeStateDeltaInfo.epoch = 0;
         return false;
     }
 
-#if ADDON_TX_STATUS_REQUEST
-    if (!saveStateTxStatus(numberOfTransactions, directory))
+    copyMem(&backgroundNodeStateSave.system, &system, sizeof(system));
+    captureNodeMiningState();
+    backgroundNodeStateSave.nextDeltaChunk = 0;
+    backgroundNodeStateSave.step = 0;
+    backgroundNodeStateSave.beginningTick = __rdtsc();
+
+    // Changes from now on go into the next delta
+    clearNodeStateDirtyPages();
+
+    persistingNodeStateInBackground = true;
+    return true;
+}
+
+// Perform the next step of saving the node state captured by startSavingNodeStateInBackground(). Called by the main
+// loop while the tick processor continues. Each step only writes a limited amount of data, so the main loop keeps
+// serving the peers.
+static void continueSavingNodeStateInBackground()
+{
+    CHAR16 directory[16];
+    setText(directory, L"ep");
+    appendNumber(directory, backgroundNodeStateSave.system.epoch, false);
+
+    const unsigned short sequenceNumber = backgroundNodeStateSave.deltaSequenceNumber;
+    bool ok = true;
+    switch (backgroundNodeStateSave.step)
     {
-        logToConsole(L"Failed to save tx status");
-        return false;
+    case 0:
+    {
+        CHAR16 fileName[32];
+        setNodeStateDeltaFileName(fileName, 32, sequenceNumber);
+        if (!backgroundNodeStateSave.nextDeltaChunk)
+        {
+            setText(message, L"Saving node state delta to ");
+            appendText(message, directory); appendText(message, L"/");
+            appendText(message, fileName);
+            logToConsole(message);
+        }
+        if (saveLargeFileChunk(fileName, backgroundNodeStateSave.deltaSize, nodeStateDeltaBuffer, backgroundNodeStateSave.nextDeltaChunk, directory) < 0)
+        {
+            logToConsole(L"Failed to save node state delta");
+            ok = false;
+        }
+        else if (++backgroundNodeStateSave.nextDeltaChunk * FILE_CHUNK_SIZE >= backgroundNodeStateSave.deltaSize)
+        {
+            backgroundNodeStateSave.step = 1;
+        }
+        break;
     }
-#endif
 
-    return true;
+    case 1:
+        nodeStateDeltaInfo.deltaSizes[sequenceNumber - 1] = backgroundNodeStateSave.deltaSize;
+        nodeStateDeltaInfo.numberOfDeltas = sequenceNumber;
+        ok = saveNodeStateFinalFiles(directory, backgroundNodeStateSave.system);
+        if (ok)
+        {
+            setText(message, L"Complete saving node state of tick ");
+            appendNumber(message, backgroundNodeStateSave.system.tick, TRUE);
+            appendText(message, L" in background (");
+            appendNumber(message, (__rdtsc() - backgroundNodeStateSave.beginningTick) * 1000 / frequency, TRUE);
+            appendText(message, L" ms).");
+            logToConsole(message);
+            persistingNodeStateInBackground = false;
+        }
+        break;
+    }
+
+    if (!ok)
+    {
+        // The snapshot on disk stays invalid and the captured changes are lost -> next snapshot has to be a full one
+        nodeStateDeltaInfo.epoch = 0;
+        logToConsole(L"Failed to save node state in background");
+        persistingNodeStateInBackground = false;
+    }
 }
+#endif
 
 static bool loadAllNodeStates()
 {
@@ -3372,25 +3773,14 @@ static bool loadAllNodeStates()
         return false;
     }
 
-    setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
-    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    // digests are recomputed if the snapshot digests do not match the loaded spectrum and universe
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
     logToConsole(L"Loading spectrum digests");
-    if (loadedSize != spectrumDigestsSizeInByte)
-    {
-        logToConsole(L"Failed to load spectrum digest");
-        return false;
-    }
+    initSpectrumDigests(SPECTRUM_DIGEST_FILE_NAME, directory);
 
     CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    loadedSize = load(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
     logToConsole(L"Loading universe digests");
-    if (loadedSize != assetDigestsSizeInBytes)
-    {
-        logToConsole(L"Failed to load universe digest");
-        return false;
-    }
+    initUniverseDigests(UNIVERSE_DIGEST_FILE_NAME, directory);
 
     CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
     loadedSize = load(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
@@ -3410,6 +3800,14 @@ static bool loadAllNodeStates()
         return false;
     }
 
+#if NODE_STATE_DELTAS_PER_BASE
+    if (!loadNodeStateDeltas(directory))
+    {
+        logToConsole(L"Failed to load node state deltas");
+        return false;
+    }
+#endif
+
 #if ADDON_TX_STATUS_REQUEST
     if (!loadStateTxStatus(numberOfTransactions, directory))
     {
@@ -3427,6 +3825,29 @@ static bool loadAllNodeStates()
 
 #endif
 
+#if EPOCH_ARCHIVE
+// Add tick system.tick that the quorum agreed on to the epoch archive. Called by tick processor.
+static void archiveCurrentTick(unsigned int tickIndex, unsigned short numberOfQuorumVotes)
+{
+    static const Transaction* transactions[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    unsigned int numberOfTransactions = 0;
+    const TickData& tickData = ts.tickData[tickIndex];
+    const bool tickIsEmpty = (tickData.epoch != system.epoch);
+    if (!tickIsEmpty)
+    {
+        const unsigned long long* tickOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            if (!isZero(tickData.transactionDigests[i]) && tickOffsets[i])
+            {
+                transactions[numberOfTransactions++] = ts.tickTransactions(tickOffsets[i]);
+            }
+        }
+    }
+    epochArchive.addTick(system.tick, (tickIsEmpty) ? nullptr : &tickData, etalonTick, numberOfQuorumVotes, transactions, numberOfTransactions);
+}
+#endif
+
 static void tickProcessor(void*)
 {
     enableAVX();
@@ -3482,6 +3903,7 @@ static void tickProcessor(void*)
                     }
                     processTick(processorNumber);
                     latestProcessedTick = system.tick;
+                    tickProcessingEndTick = __rdtsc();
                 }
 
                 if (futureTickTotalNumberOfComputors > NUMBER_OF_COMPUTORS - QUORUM)
@@ -3892,6 +4314,7 @@ static void tickProcessor(void*)
                         {
                             if (mainAuxStatus & 1)
                             {
+                                const unsigned long long voteBroadcastBeginningTick = __rdtsc();
                                 BroadcastTick broadcastTick;
                                 bs->CopyMem(&broadcastTick.tick, &etalonTick, sizeof(Tick));
                                 for (unsigned int i = 0; i < numberOfOwnComputorIndices; i++)
@@ -3920,6 +4343,10 @@ static void tickProcessor(void*)
                                     // - all votes need to be processed in a single place of code (for further handling)
                                     // - all votes are treated equally (own votes and their votes)
                                 }
+                                if (numberOfOwnComputorIndices)
+                                {
+                                    tickPhaseLatencies[TELEMETRY_TICK_PHASE_VOTE_BROADCAST].add(__rdtsc() - voteBroadcastBeginningTick);
+                                }
                             }
 
                             if (system.tick != system.initialTick)
@@ -4052,6 +4479,10 @@ static void tickProcessor(void*)
                                 }
                                 if (tickDataSuits)
                                 {
+#if EPOCH_ARCHIVE
+                                    archiveCurrentTick(currentTickIndex, tickNumberOfComputors);
+#endif
+
                                     const int dayIndex = ::dayIndex(etalonTick.year, etalonTick.month, etalonTick.day);
                                     if ((dayIndex == 738570 + system.epoch * 7 && etalonTick.hour >= 12)
                                         || dayIndex > 738570 + system.epoch * 7)
@@ -4063,60 +4494,8 @@ static void tickProcessor(void*)
                                     else
                                     {
                                         // update etalonTick
-                                        etalonTick.tick++;
                                         ts.tickData.acquireLock();
-                                        const TickData& td = ts.tickData[currentTickIndex];
-                                        if (td.epoch == system.epoch
-                                            && (td.year > etalonTick.year
-                                                || (td.year == etalonTick.year && (td.month > etalonTick.month
-                                                    || (td.month == etalonTick.month && (td.day > etalonTick.day
-                                                        || (td.day == etalonTick.day && (td.hour > etalonTick.hour
-                                                            || (td.hour == etalonTick.hour && (td.minute > etalonTick.minute
-                                                                || (td.minute == etalonTick.minute && (td.second > etalonTick.second
-                                                                    || (td.second == etalonTick.second && td.millisecond > etalonTick.millisecond)))))))))))))
-                                        {
-                                            etalonTick.millisecond = td.millisecond;
-                                            etalonTick.second = td.second;
-                                            etalonTick.minute = td.minute;
-                                            etalonTick.hour = td.hour;
-                                            etalonTick.day = td.day;
-                                            etalonTick.month = td.month;
-                                            etalonTick.year = td.year;
-                                        }
-                                        else
-                                        {
-                                            if (++etalonTick.millisecond > 999)
-                                            {
-                                                etalonTick.millisecond = 0;
-
-                                                if (++etalonTick.second > 59)
-                                                {
-                                                    etalonTick.second = 0;
-
-                                                    if (++etalonTick.minute > 59)
-                                                    {
-                                                        etalonTick.minute = 0;
-
-                                                        if (++etalonTick.hour > 23)
-                                                        {
-                                                            etalonTick.hour = 0;
-
-                                                            if (++etalonTick.day > ((etalonTick.month == 1 || etalonTick.month == 3 || etalonTick.month == 5 || etalonTick.month == 7 || etalonTick.month == 8 || etalonTick.month == 10 || etalonTick.month == 12) ? 31 : ((etalonTick.month == 4 || etalonTick.month == 6 || etalonTick.month == 9 || etalonTick.month == 11) ? 30 : ((etalonTick.year & 3) ? 28 : 29))))
-                                                            {
-                                                                etalonTick.day = 1;
-
-                                                                if (++etalonTick.month > 12)
-                                                                {
-                                                                    etalonTick.month = 1;
-
-                                                                    ++etalonTick.year;
-                                                                }
-                                                            }
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                        }
+                                        advanceEtalonTick(ts.tickData[currentTickIndex]);
                                         ts.tickData.releaseLock();
                                     }
 
@@ -4145,6 +4524,27 @@ static void tickProcessor(void*)
                                             _mm_pause();
                                         }
 
+                                        // wait until saving node state of the ending epoch in background is complete
+                                        while (persistingNodeStateInBackground)
+                                        {
+                                            _mm_pause();
+                                        }
+
+                                        // wait until main loop has loaded all ticks of tick storage snapshot
+                                        while (ts.isLazyLoading())
+                                        {
+                                            _mm_pause();
+                                        }
+
+#if EPOCH_ARCHIVE
+                                        // wait until main loop has written the archive of the ending epoch completely
+                                        epochArchive.endEpoch();
+                                        while (epochArchive.isEnding())
+                                        {
+                                            _mm_pause();
+                                        }
+#endif
+
                                         // end current epoch
                                         endEpoch();
 
@@ -4216,6 +4616,12 @@ static void tickProcessor(void*)
                                     numberOfNextTickTransactions = 0;
                                     numberOfKnownNextTickTransactions = 0;
 
+                                    if (tickProcessingEndTick)
+                                    {
+                                        tickPhaseLatencies[TELEMETRY_TICK_PHASE_QUORUM_WAIT].add(__rdtsc() - tickProcessingEndTick);
+                                        tickProcessingEndTick = 0;
+                                    }
+
                                     for (unsigned int i = 0; i < sizeof(tickTicks) / sizeof(tickTicks[0]) - 1; i++)
                                     {
                                         tickTicks[i] = tickTicks[i + 1];
@@ -4267,7 +4673,7 @@ static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
-            long long loadedSize = load(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
+            long long loadedSize = loadCompressed(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
             if (loadedSize != contractDescriptions[contractIndex].stateSize)
             {
                 logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -4284,7 +4690,7 @@ static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
     return true;
 }
 
-static bool saveComputer(CHAR16* directory)
+static bool saveComputer(CHAR16* directory, bool compressed)
 {
     logToConsole(L"Saving contract files...");
 
@@ -4300,7 +4706,9 @@ static bool saveComputer(CHAR16* directory)
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
         contractStateLock[contractIndex].acquireRead();
-        long long savedSize = save(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
+        long long savedSize = (compressed)
+            ? saveCompressed(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], 0, directory)
+            : save(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
         contractStateLock[contractIndex].releaseRead();
         totalSize += savedSize;
         if (savedSize != contractDescriptions[contractIndex].stateSize)
@@ -4342,10 +4750,34 @@ static bool saveSystem(CHAR16* directory)
     return false;
 }
 
+// Used for runOnIdleProcessors during initialization (see concurrency.h)
+static void (*idleProcessorProcedure)(void* argument) = nullptr;
+static void* idleProcessorArgument = nullptr;
+
+static void __cdecl idleProcessorFunction(void*)
+{
+    enableAVX();
+    idleProcessorProcedure(idleProcessorArgument);
+}
+
+static void runOnIdleProcessorsDuringInitialization(void (*procedure)(void* argument), void* argument)
+{
+    idleProcessorProcedure = procedure;
+    idleProcessorArgument = argument;
+    mpServicesProtocol->StartupAllAPs(mpServicesProtocol, idleProcessorFunction, FALSE, NULL, 0, NULL, NULL);
+}
+
 static bool initialize()
 {
     enableAVX();
 
+    // Let all processors help with expensive tasks like decompressing snapshot files while loading
+    EFI_GUID mpServiceProtocolGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    if (bs->LocateProtocol(&mpServiceProtocolGuid, NULL, (void**)&mpServicesProtocol) == EFI_SUCCESS && mpServicesProtocol)
+    {
+        runOnIdleProcessors = runOnIdleProcessorsDuringInitialization;
+    }
+
 #if defined (__AVX512F__) && !GENERIC_K12
     initAVX512KangarooTwelveConstants();
 #endif
@@ -4374,6 +4806,7 @@ static bool initialize()
     initTimeStampCounter();
 
     bs->SetMem(&tickTicks, sizeof(tickTicks), 0);
+    telemetryPeriodBeginningTick = __rdtsc();
 
     bs->SetMem(processors, sizeof(processors), 0);
     bs->SetMem(peers, sizeof(peers), 0);
@@ -4383,6 +4816,8 @@ static bool initialize()
     requestedComputors.header.setType(RequestComputors::type);
     requestedQuorumTick.header.setSize<sizeof(requestedQuorumTick)>();
     requestedQuorumTick.header.setType(RequestQuorumTick::type);
+    requestedCompactQuorumTicks.header.setSize<sizeof(requestedCompactQuorumTicks)>();
+    requestedCompactQuorumTicks.header.setType(RequestCompactQuorumTicks::type);
     requestedTickData.header.setSize<sizeof(requestedTickData)>();
     requestedTickData.header.setType(RequestTickData::type);
     requestedTickTransactions.header.setSize<sizeof(requestedTickTransactions)>();
@@ -4396,6 +4831,15 @@ static bool initialize()
     {
         if (!ts.init())
             return false;
+        if (!transactionInventory.init(TRANSACTION_INVENTORY_BUFFER_SIZE, TRANSACTION_INVENTORY_SLOTS))
+        {
+            logToConsole(L"Failed to allocate transaction inventory!");
+            return false;
+        }
+#if EPOCH_ARCHIVE
+        if (!epochArchive.init(L"archive", MAX_NUMBER_OF_TICKS_PER_EPOCH, EPOCH_ARCHIVE_BUFFER_SIZE))
+            return false;
+#endif
         if (status = bs->AllocatePool(EfiRuntimeServicesData, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE, (void**)&entityPendingTransactions))
         {
             logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE);
@@ -4430,6 +4874,9 @@ static bool initialize()
             return false;
 
         initContractExec();
+#if CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES
+        contractFunctionResultCache.reset();
+#endif
         for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
         {
             unsigned long long size = contractDescriptions[contractIndex].stateSize;
@@ -4439,6 +4886,16 @@ static bool initialize()
 
                 return false;
             }
+#if USE_CONTRACT_STATE_SNAPSHOTS
+            unsigned char* snapshotBuffer;
+            if (status = bs->AllocatePool(EfiRuntimeServicesData, size, (void**)&snapshotBuffer))
+            {
+                logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, size);
+
+                return false;
+            }
+            contractStateSnapshots[contractIndex].init(snapshotBuffer);
+#endif
         }
 
         if (status = bs->AllocatePool(EfiRuntimeServicesData, sizeof(*score), (void**)&score))
@@ -4507,31 +4964,7 @@ static bool initialize()
 
             loadSpectrum();
             {
-                const unsigned long long beginningTick = __rdtsc();
-
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
-                {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
-
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
-
-                setNumber(message, SPECTRUM_CAPACITY * sizeof(::Entity), TRUE);
-                appendText(message, L" bytes of the spectrum data are hashed (");
-                appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
-                appendText(message, L" microseconds).");
-                logToConsole(message);
+                initSpectrumDigests();
 
                 CHAR16 digestChars[60 + 1];
                 getIdentity((unsigned char*)&spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], digestChars, true);
@@ -4548,6 +4981,7 @@ static bool initialize()
             logToConsole(L"Loading universe file ...");
             if (!loadUniverse())
                 return false;
+            initUniverseDigests();
             m256i universeDigest;
             {
                 setText(message, L"Universe digest = ");
@@ -4561,8 +4995,9 @@ static bool initialize()
             loadComputer();
             m256i computerDigest;
             {
+                runTasksInParallel(contractCount, computeChangedContractStateDigest, nullptr);
                 setText(message, L"Computer digest = ");
-                getComputerDigest(computerDigest);
+                getComputerDigest(computerDigest, true);
                 CHAR16 digestChars[60 + 1];
                 getIdentity(computerDigest.m256i_u8, digestChars, true);
                 appendText(message, digestChars);
@@ -4583,6 +5018,11 @@ static bool initialize()
         }
     }
 
+#if EPOCH_ARCHIVE
+    // continue archive file of the epoch written before the node has been restarted instead of overwriting it
+    epochArchive.reopen(system.tick);
+#endif
+
     initializeContracts();
 
     if (loadMiningSeedFromFile)
@@ -4619,6 +5059,7 @@ static bool initialize()
         return false;
     }
 
+    initOutboundPriorities();
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
         peers[i].receiveData.FragmentCount = 1;
@@ -4641,6 +5082,7 @@ static bool initialize()
 
             return false;
         }
+        peers[i].outboundQueue.init(peers[i].dataToTransmit, BUFFER_SIZE);
         if ((status = bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, emptyCallback, NULL, &peers[i].connectAcceptToken.CompletionToken.Event))
             || (status = bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, emptyCallback, NULL, &peers[i].receiveToken.CompletionToken.Event))
             || (status = bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, emptyCallback, NULL, &peers[i].transmitToken.CompletionToken.Event)))
@@ -4721,6 +5163,12 @@ static void deinitialize()
         {
             bs->FreePool(contractStates[contractIndex]);
         }
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        if (contractStateSnapshots[contractIndex].buffer())
+        {
+            bs->FreePool(contractStateSnapshots[contractIndex].buffer());
+        }
+#endif
     }
 
     if (computorPendingTransactionDigests)
@@ -4740,6 +5188,10 @@ static void deinitialize()
         bs->FreePool(entityPendingTransactions);
     }
     ts.deinit();
+    transactionInventory.deinit();
+#if EPOCH_ARCHIVE
+    epochArchive.deinit();
+#endif
 
     if (score)
     {
@@ -4750,6 +5202,14 @@ static void deinitialize()
         bs->FreePool(minerSolutionFlags);
     }
 
+#if TICK_STORAGE_AUTOSAVE_MODE && NODE_STATE_DELTAS_PER_BASE
+    if (nodeStateDeltaBuffer)
+    {
+        freePool(nodeStateDeltaBuffer);
+        nodeStateDeltaBuffer = nullptr;
+    }
+#endif
+
     if (dejavu0)
     {
         bs->FreePool((void*)dejavu0);
@@ -4805,7 +5265,7 @@ static void logInfo()
     {
         if (peers[i].tcp4Protocol)
         {
-            numberOfWaitingBytes += peers[i].dataToTransmitSize;
+            numberOfWaitingBytes += peers[i].outboundQueue.size();
         }
     }
 
@@ -4999,6 +5459,69 @@ static void logInfo()
     appendText(message, L" ms.");
     logToConsole(message);
 
+    // average since start and maximum since last output of time messages wait in sending buffers of peers
+    setText(message, L"Outbound queueing time (average/max) =");
+    const CHAR16* outboundPriorityNames[NUMBER_OF_OUTBOUND_PRIORITIES] = { L" consensus ", L" | transactions ", L" | queries " };
+    for (unsigned int i = 0; i < NUMBER_OF_OUTBOUND_PRIORITIES; i++)
+    {
+        appendText(message, outboundPriorityNames[i]);
+        if (outboundQueueingTimeDenominator[i])
+        {
+            appendNumber(message, (outboundQueueingTimeNumerator[i] / outboundQueueingTimeDenominator[i]) * 1000000 / frequency, TRUE);
+        }
+        else
+        {
+            appendText(message, L"?");
+        }
+        appendText(message, L"/");
+        appendNumber(message, outboundQueueingTimeMax[i] * 1000000 / frequency, TRUE);
+        outboundQueueingTimeMax[i] = 0;
+    }
+    unsigned int numberOfCongestedPeers = 0;
+    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    {
+        if (peers[i].tcp4Protocol && peers[i].outboundQueue.isCongested())
+        {
+            numberOfCongestedPeers++;
+        }
+    }
+    appendText(message, L" mcs | ");
+    appendNumber(message, numberOfCongestedPeers, TRUE);
+    appendText(message, L" congested peers | ");
+    appendNumber(message, numberOfDroppedOutboundMessages - prevNumberOfDroppedOutboundMessages, TRUE);
+    appendText(message, L" dropped messages | ");
+    appendNumber(message, numberOfRequestedAnnouncedTransactions, TRUE);
+    appendText(message, L" requested/");
+    appendNumber(message, numberOfServedAnnouncedTransactions, TRUE);
+    appendText(message, L" served announced transactions | ");
+    appendNumber(message, numberOfReceivedCompactVotes, TRUE);
+    appendText(message, L" received compact votes/");
+    appendNumber(message, numberOfServedCompactQuorumTicks, TRUE);
+    appendText(message, L" served compact ticks | ");
+    appendNumber(message, numberOfServedTickRangeEntries, TRUE);
+    appendText(message, L" served tick range entries | ");
+    if (numberOfUnindexedTransactions)
+    {
+        appendNumber(message, numberOfUnindexedTransactions, TRUE);
+        appendText(message, L" transactions not in digest index | ");
+    }
+    appendNumber(message, numberOfReceivedBatches - prevNumberOfReceivedBatches, TRUE);
+    appendText(message, L" received batches.");
+    logToConsole(message);
+    prevNumberOfDroppedOutboundMessages = numberOfDroppedOutboundMessages;
+    prevNumberOfReceivedBatches = numberOfReceivedBatches;
+
+    setText(message, L"Tx lookup cache time = ");
+    appendNumber(message, tickTransactionLookupTotalExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms for ");
+    appendNumber(message, tickTransactionLookupTransactions, TRUE);
+    appendText(message, L" txs | Spectrum index hints valid/invalid = ");
+    appendNumber(message, tickTransactionLookupCache.hintHits, TRUE);
+    appendText(message, L"/");
+    appendNumber(message, tickTransactionLookupCache.hintMisses, TRUE);
+    appendText(message, L".");
+    logToConsole(message);
+
     setText(message, L"Entity balance dust threshold: ");
     appendNumber(message, (dustThresholdBurnAll > dustThresholdBurnHalf) ? dustThresholdBurnAll : dustThresholdBurnHalf, TRUE);
     logToConsole(message);
@@ -5144,6 +5667,68 @@ static void logHealthStatus()
     appendText(message, L" | max processors waiting ");
     appendNumber(message, contractLocalsStackLockWaitingCountMax, TRUE);
     logToConsole(message);
+
+    // Print histogram of peak stack usage per contract call and how much zeroing of locals was avoided
+    unsigned long long zeroedBytes = 0, zeroedOnFreeBytes = 0, zeroingSkippedBytes = 0;
+    for (int i = 0; i < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS; ++i)
+    {
+        zeroedBytes += contractLocalsStack[i].zeroedBytes();
+        zeroedOnFreeBytes += contractLocalsStack[i].zeroedOnFreeBytes();
+        zeroingSkippedBytes += contractLocalsStack[i].zeroingSkippedBytes();
+    }
+    setText(message, L"Contract stack usage per call (count by size < 2^n):");
+    for (unsigned int i = 0; i < contractLocalsStackUsageHistogramSize; ++i)
+    {
+        if (contractLocalsStackUsageHistogram[i])
+        {
+            appendText(message, L" 2^");
+            appendNumber(message, i, FALSE);
+            appendText(message, L": ");
+            appendNumber(message, contractLocalsStackUsageHistogram[i], TRUE);
+        }
+    }
+    appendText(message, L" | zeroed ");
+    appendNumber(message, zeroedBytes, TRUE);
+    appendText(message, L" bytes on alloc (");
+    appendNumber(message, zeroingSkippedBytes, TRUE);
+    appendText(message, L" skipped) and ");
+    appendNumber(message, zeroedOnFreeBytes, TRUE);
+    appendText(message, L" bytes on free");
+    logToConsole(message);
+
+#if USE_CONTRACT_STATE_SNAPSHOTS
+    unsigned int validSnapshots = 0;
+    for (unsigned int i = 0; i < contractCount; ++i)
+    {
+        if (contractStateSnapshots[i].isValid())
+            ++validSnapshots;
+    }
+    setText(message, L"Contract state snapshots: ");
+    appendNumber(message, validSnapshots, TRUE);
+    appendText(message, L"/");
+    appendNumber(message, contractCount, TRUE);
+    appendText(message, L" valid | ");
+    appendNumber(message, contractStateSnapshotUpdates, TRUE);
+    appendText(message, L" updates, ");
+    appendNumber(message, contractStateSnapshotInvalidations, TRUE);
+    appendText(message, L" invalidations, ");
+    appendNumber(message, contractStateSnapshotCopiedBytes / 1048576, TRUE);
+    appendText(message, L" MB copied");
+    logToConsole(message);
+#endif
+
+#if CONTRACT_FUNCTION_RESULT_CACHE_ENTRIES
+    setText(message, L"Contract function result cache: ");
+    appendNumber(message, contractFunctionResultCache.hitCount(), TRUE);
+    appendText(message, L" hits, ");
+    appendNumber(message, contractFunctionResultCache.missCount(), TRUE);
+    appendText(message, L" misses, ");
+    appendNumber(message, contractFunctionResultCache.insertionCount(), TRUE);
+    appendText(message, L" insertions (capacity ");
+    appendNumber(message, contractFunctionResultCache.capacity(), TRUE);
+    appendText(message, L")");
+    logToConsole(message);
+#endif
 }
 
 static void processKeyPresses()
@@ -5432,7 +6017,7 @@ static void processKeyPresses()
         */
         case 0x16:
         {
-            if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1)
+            if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1 || persistingNodeStateInBackground)
             {
                 logToConsole(L"Unable to switch mode because node is saving states.");
             }
@@ -5487,7 +6072,9 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
     appendText(message, L" is launched.");
     logToConsole(message);
 
-    if (initialize())
+    const bool initialized = initialize();
+    runOnIdleProcessors = nullptr;
+    if (initialized)
     {
         logToConsole(L"Setting up multiprocessing ...");
 
@@ -5695,7 +6282,12 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     {
                         // new connection established:
                         // prepare and send ExchangePublicPeers message
-                        ExchangePublicPeers* request = (ExchangePublicPeers*)&peers[i].dataToTransmit[sizeof(RequestResponseHeader)];
+                        struct
+                        {
+                            RequestResponseHeader header;
+                            ExchangePublicPeers payload;
+                        } exchangePublicPeers;
+                        ExchangePublicPeers* request = &exchangePublicPeers.payload;
                         bool noVerifiedPublicPeers = true;
                         for (unsigned int k = 0; k < numberOfPublicPeers; k++)
                         {
@@ -5728,21 +6320,31 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                             }
                         }
 
-                        RequestResponseHeader* requestHeader = (RequestResponseHeader*)peers[i].dataToTransmit;
-                        requestHeader->setSize<sizeof(RequestResponseHeader) + sizeof(ExchangePublicPeers)>();
-                        requestHeader->randomizeDejavu();
-                        requestHeader->setType(ExchangePublicPeers::type);
-                        peers[i].dataToTransmitSize = requestHeader->size();
-                        _InterlockedIncrement64(&numberOfDisseminatedRequests);
+                        exchangePublicPeers.header.setSize<sizeof(exchangePublicPeers)>();
+                        exchangePublicPeers.header.randomizeDejavu();
+                        exchangePublicPeers.header.setType(ExchangePublicPeers::type);
+                        push(&peers[i], &exchangePublicPeers.header);
+
+                        // tell peer that transaction announcements are supported
+                        RequestResponseHeader announceTransactions;
+                        announceTransactions.setSize<sizeof(announceTransactions)>();
+                        announceTransactions.randomizeDejavu();
+                        announceTransactions.setType(AnnounceTransactions::type);
+                        push(&peers[i], &announceTransactions);
+
+                        // tell peer that BatchedMessages containers are supported
+                        RequestResponseHeader batchedMessages;
+                        batchedMessages.setSize<sizeof(batchedMessages)>();
+                        batchedMessages.setDejavu(0);
+                        batchedMessages.setType(BatchedMessages::type);
+                        push(&peers[i], &batchedMessages);
 
                         // send RequestComputors message at beginning of epoch
                         if (!broadcastedComputors.computors.epoch
                             || broadcastedComputors.computors.epoch != system.epoch)
                         {
                             requestedComputors.header.randomizeDejavu();
-                            bs->CopyMem(&peers[i].dataToTransmit[peers[i].dataToTransmitSize], &requestedComputors, requestedComputors.header.size());
-                            peers[i].dataToTransmitSize += requestedComputors.header.size();
-                            _InterlockedIncrement64(&numberOfDisseminatedRequests);
+                            push(&peers[i], &requestedComputors.header);
                         }
                     }
 
@@ -5821,6 +6423,41 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     }
                     futureTickRequestingIndicator = futureTickTotalNumberOfComputors;
 
+                    if (latestVotedTick > system.tick + 1 && isNewTick)
+                    {
+                        // Votes of later ticks have been received, so this node is behind. Request the votes of the
+                        // following ticks without quorum in compact form, in ranges from different peers.
+                        RequestCompactQuorumTicks& request = requestedCompactQuorumTicks.requestCompactQuorumTicks;
+                        const unsigned int endTick = (latestVotedTick < system.tick + COMPACT_QUORUM_TICKS_REQUESTING_RANGE) ? latestVotedTick + 1 : system.tick + COMPACT_QUORUM_TICKS_REQUESTING_RANGE;
+                        unsigned int tick = system.tick;
+                        while (tick < endTick && ts.ticks.isStoredInFull(tick))
+                        {
+                            unsigned int numberOfVotes = 0;
+                            bs->SetMem(request.voteFlags, sizeof(request.voteFlags), 0);
+                            const Tick* tsCompTicks = ts.ticks.getByTickInCurrentEpoch(tick);
+                            for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+                            {
+                                if (tsCompTicks[i].epoch == system.epoch)
+                                {
+                                    request.voteFlags[i >> 3] |= (1 << (i & 7));
+                                    numberOfVotes++;
+                                }
+                            }
+                            if (numberOfVotes >= QUORUM)
+                            {
+                                tick++;
+                            }
+                            else
+                            {
+                                requestedCompactQuorumTicks.header.randomizeDejavu();
+                                request.tick = tick;
+                                request.numberOfTicks = (endTick - tick < MAX_NUMBER_OF_COMPACT_QUORUM_TICKS) ? endTick - tick : MAX_NUMBER_OF_COMPACT_QUORUM_TICKS;
+                                pushToAny(&requestedCompactQuorumTicks.header);
+                                tick += request.numberOfTicks;
+                            }
+                        }
+                    }
+
                     if ((ts.tickData[system.tick + 1 - system.initialTick].epoch != system.epoch
                         || targetNextTickDataDigestIsKnown)
                         && isNewTickPlus1)
@@ -5858,7 +6495,11 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         RequestResponseHeader* responseHeader = (RequestResponseHeader*)&responseQueueBuffer[responseQueueElements[responseQueueElementTail].offset];
                         if (responseQueueElements[responseQueueElementTail].peer)
                         {
-                            push(responseQueueElements[responseQueueElementTail].peer, responseHeader);
+                            push(responseQueueElements[responseQueueElementTail].peer, responseHeader, true);
+                        }
+                        else if (responseHeader->type() == BROADCAST_TRANSACTION)
+                        {
+                            disseminateTransaction(responseHeader);
                         }
                         else
                         {
@@ -5873,6 +6514,7 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         responseQueueElementTail++;
                     }
                 }
+                flushTransactionAnnouncements(TRANSACTION_ANNOUNCEMENT_DELAY * frequency / 1000);
 
                 if (systemMustBeSaved)
                 {
@@ -5907,6 +6549,22 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
 
                 processKeyPresses();
 
+                if (ts.isClearing())
+                {
+                    // clear tick storage of new epoch step by step
+                    ts.continueClearing();
+                }
+
+#if TICK_STORAGE_RETENTION_TICKS
+                // compact votes of ticks that are not needed in full anymore
+                ts.continueCompaction(system.tick);
+#endif
+
+#if EPOCH_ARCHIVE
+                // write ticks archived by tick processor to disk
+                epochArchive.flush();
+#endif
+
 #if TICK_STORAGE_AUTOSAVE_MODE
                 bool nextAutoSaveTickUpdated = false;
                 if (mainAuxStatus & 1)
@@ -5935,19 +6593,43 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         }
                     }
                 }
-                if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1)
+                if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1 && !persistingNodeStateInBackground)
                 {
-                    // Saving node state takes a lot of time -> Close peer connections before to signal that
-                    // the peers should connect to another node.
-                    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+                    bool savingInBackground = false;
+#if NODE_STATE_DELTAS_PER_BASE
+                    // Capture changes since last snapshot in memory and write them while the tick processor continues
+                    savingInBackground = startSavingNodeStateInBackground();
+#endif
+                    if (savingInBackground)
                     {
-                        closePeer(&peers[i]);
+                        requestPersistingNodeState = 0;
+                        logToConsole(L"Saving node state in background...");
                     }
+                    else
+                    {
+                        // Saving full node state takes a lot of time -> Close peer connections before to signal that
+                        // the peers should connect to another node.
+                        for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+                        {
+                            closePeer(&peers[i]);
+                        }
 
-                    logToConsole(L"Saving node state...");
-                    saveAllNodeStates();
-                    requestPersistingNodeState = 0;
-                    logToConsole(L"Complete saving all node states");
+                        logToConsole(L"Saving node state...");
+                        saveAllNodeStates();
+                        requestPersistingNodeState = 0;
+                        logToConsole(L"Complete saving all node states");
+                    }
+                }
+#if NODE_STATE_DELTAS_PER_BASE
+                else if (persistingNodeStateInBackground)
+                {
+                    continueSavingNodeStateInBackground();
+                }
+#endif
+                else if (ts.isLazyLoading())
+                {
+                    // load older ticks of tick storage snapshot step by step
+                    ts.continueLazyLoading();
                 }
                 if (nextAutoSaveTickUpdated)
                 {
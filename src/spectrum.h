@@ -15,6 +15,7 @@
 #include "system.h"
 #include "kangaroo_twelve.h"
 #include "common_buffers.h"
+#include "node_state_delta.h"
 
 GLOBAL_VAR_DECL volatile char spectrumLock GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL ::Entity* spectrum GLOBAL_VAR_INIT(nullptr);
@@ -32,6 +33,9 @@ static constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACI
 
 GLOBAL_VAR_DECL unsigned long long spectrumReorgTotalExecutionTicks GLOBAL_VAR_INIT(0);
 
+// Pages of 64 entities changed since the last node state snapshot (marked when computing the spectrum digest)
+GLOBAL_VAR_DECL DirtyPageBitmap<SPECTRUM_CAPACITY / 64> spectrumDirtyPagesSinceSnapshot;
+
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
@@ -167,6 +171,9 @@ static void reorganizeSpectrum()
     }
     copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
 
+    // entities have been moved to other slots, so the next delta snapshot needs to contain the whole spectrum
+    spectrumDirtyPagesSinceSnapshot.markAll();
+
     unsigned int digestIndex;
     for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
     {
@@ -375,7 +382,7 @@ static bool decreaseEnergy(const int index, long long amount)
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
     logToConsole(L"Loading spectrum file ...");
-    long long loadedSize = load(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
+    long long loadedSize = loadCompressed(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
     if (loadedSize != SPECTRUM_CAPACITY * sizeof(::Entity))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -386,14 +393,17 @@ static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
     return true;
 }
 
-static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
+// Save spectrum to file, optionally in compressed format (supported by loadSpectrum())
+static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr, bool compressed = false)
 {
     logToConsole(L"Saving spectrum file...");
 
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(spectrumLock);
-    long long savedSize = save(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
+    long long savedSize = (compressed)
+        ? saveCompressed(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, sizeof(::Entity), directory)
+        : save(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
     RELEASE(spectrumLock);
 
     if (savedSize == SPECTRUM_CAPACITY * sizeof(::Entity))
@@ -416,6 +426,7 @@ static bool initSpectrum()
         logToConsole(L"Failed to allocate spectrum memory!");
         return false;
     }
+    spectrumDirtyPagesSinceSnapshot.markAll();
 
     return true;
 }
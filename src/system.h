@@ -4,8 +4,13 @@
 #include "platform/m256.h"
 
 #include "network_messages/special_command.h"
+#include "network_messages/computors.h"
+#include "network_messages/tick.h"
+#include "vote_counter.h"
 
 #define MAX_NUMBER_OF_SOLUTIONS 65536 // Must be 2^N
+#define MAX_NUMBER_OF_MINERS 8192
+#define NUMBER_OF_MINER_SOLUTION_FLAGS 0x100000000
 
 
 
@@ -40,3 +45,23 @@ struct System
 static_assert(sizeof(System) == 20 + 8 + 8 + 8 + 4 + 96 * MAX_NUMBER_OF_SOLUTIONS + 32 * NUMBER_OF_COMPUTORS, "Unexpected size");
 
 GLOBAL_VAR_DECL System system;
+
+// Mining state and other small parts of the node state, saved to snapshotNodeMiningState with the snapshots
+struct NodeMiningState
+{
+    Tick etalonTick;
+    m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
+    unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
+    m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    m256i currentRandomSeed;
+    int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS];
+    unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
+    unsigned char voteCounterData[VoteCounter::VoteCounterDataSize];
+    BroadcastComputors broadcastedComputors;
+    unsigned long long resourceTestingDigest;
+    unsigned int numberOfMiners;
+    unsigned int numberOfTransactions;
+    unsigned long long lastLogId;
+};
@@ -0,0 +1,676 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/assert.h"
+#include "platform/concurrency.h"
+
+#include "network_messages/transactions.h"
+
+#include "contract_core/contract_def.h"
+#include "contract_core/contract_exec.h"
+#include "kangaroo_twelve.h"
+#include "spectrum.h"
+#include "system.h"
+#include "vote_counter.h"
+#include "logging/logging.h"
+#include "files/files.h"
+#include "mining/mining.h"
+#include "oracles/oracle_machines.h"
+
+// Processing of ticks shared by the node (qubic.cpp) and tools replaying ticks (tools/tick_replay), so that tools
+// measure and check the same code that runs in the node.
+//
+// The following need to be defined before including this file: etalonTick, nextTickData, broadcastedComputors, score,
+// voteCounter, spectrumChangeFlags, and contractStateDigests. State that is only changed by tick processing is defined
+// here. The hooks declared below need to be defined by the includer, they cover the parts that differ between node and
+// tools (contract processor, bookkeeping of own solutions and miner scores, solution threshold set by operator).
+
+// Status of mining solution passed to recordMiningSolution()
+enum MiningSolutionStatus
+{
+    MINING_SOLUTION_ALREADY_SCORED = 0, // solution has been processed before (flag was set)
+    MINING_SOLUTION_SCORED,             // solution was scored, but its score is not good
+    MINING_SOLUTION_GOOD_SCORE,         // solution was scored and the deposit has been returned
+};
+
+// Run user procedure of contract invoked by the transaction, return if money flew
+static bool runContractUserProcedure(const Transaction* transaction);
+
+// Called after processing each mining solution transaction
+static void recordMiningSolution(const MiningSolutionTransaction* transaction, MiningSolutionStatus status);
+
+// Solution threshold of the current epoch
+static int getSolutionThreshold();
+
+
+static unsigned long long resourceTestingDigest = 0;
+
+// Parts of node state changed since the last node state snapshot (pages of miner solution flags and contract states),
+// used to save delta snapshots (see also spectrumDirtyPagesSinceSnapshot and assetDirtyPagesSinceSnapshot)
+static DirtyPageBitmap<MAX_NUMBER_OF_CONTRACTS> contractStatesDirtySinceSnapshot;
+static constexpr unsigned long long minerSolutionFlagsSnapshotPageSize = 64 * 1024;
+
+static unsigned long long* minerSolutionFlags = NULL;
+static DirtyPageBitmap<NUMBER_OF_MINER_SOLUTION_FLAGS / 8 / minerSolutionFlagsSnapshotPageSize> minerSolutionFlagsDirtyPagesSinceSnapshot;
+
+static unsigned long long K12MeasurementsCount = 0;
+static unsigned long long K12MeasurementsSum = 0;
+
+static m256i releasedPublicKeys[NUMBER_OF_COMPUTORS];
+static long long releasedAmounts[NUMBER_OF_COMPUTORS];
+static unsigned int numberOfReleasedEntities;
+
+
+// Call system procedure of all active contracts (in the contract processor of the node)
+static void callContractSystemProcedures(unsigned int systemProcedureId)
+{
+    unsigned int executedContractIndex;
+    switch (systemProcedureId)
+    {
+    case INITIALIZE:
+    {
+        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
+        {
+            if (system.epoch == contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(INITIALIZE);
+            }
+        }
+    }
+    break;
+
+    case BEGIN_EPOCH:
+    case BEGIN_TICK:
+    {
+        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call((SystemProcedureID)systemProcedureId);
+            }
+        }
+    }
+    break;
+
+    case END_TICK:
+    case END_EPOCH:
+    {
+        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call((SystemProcedureID)systemProcedureId);
+            }
+        }
+    }
+    break;
+    }
+}
+
+// Call user procedure of contract invoked by the transaction (in the contract processor of the node), return if money flew
+static bool callContractUserProcedure(const Transaction* transaction)
+{
+    ASSERT(transaction && transaction->checkValidity());
+
+    unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+    ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
+    ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
+    ASSERT(contractUserProcedures[contractIndex][transaction->inputType]);
+
+    QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount);
+    qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
+
+    return contractActionTracker.getOverallQuTransferBalance(transaction->sourcePublicKey) != 0;
+}
+
+static void processTickTransactionContractIPO(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(!transaction->amount && transaction->inputSize == sizeof(ContractIPOBid));
+    ASSERT(spectrumIndex >= 0);
+    ASSERT(contractIndex < contractCount);
+    ASSERT(system.epoch < contractDescriptions[contractIndex].constructionEpoch);
+
+    ContractIPOBid* contractIPOBid = (ContractIPOBid*)transaction->inputPtr();
+    if (contractIPOBid->price > 0 && contractIPOBid->price <= MAX_AMOUNT / NUMBER_OF_COMPUTORS
+        && contractIPOBid->quantity > 0 && contractIPOBid->quantity <= NUMBER_OF_COMPUTORS)
+    {
+        const long long amount = contractIPOBid->price * contractIPOBid->quantity;
+        if (decreaseEnergy(spectrumIndex, amount))
+        {
+            const QuTransfer quTransfer = { transaction->sourcePublicKey, m256i::zero(), amount };
+            logger.logQuTransfer(quTransfer);
+
+            numberOfReleasedEntities = 0;
+            contractStateLock[contractIndex].acquireWrite();
+            IPO* ipo = (IPO*)contractStates[contractIndex];
+            for (unsigned int i = 0; i < contractIPOBid->quantity; i++)
+            {
+                if (contractIPOBid->price <= ipo->prices[NUMBER_OF_COMPUTORS - 1])
+                {
+                    unsigned int j;
+                    for (j = 0; j < numberOfReleasedEntities; j++)
+                    {
+                        if (transaction->sourcePublicKey == releasedPublicKeys[j])
+                        {
+                            break;
+                        }
+                    }
+                    if (j == numberOfReleasedEntities)
+                    {
+                        releasedPublicKeys[numberOfReleasedEntities] = transaction->sourcePublicKey;
+                        releasedAmounts[numberOfReleasedEntities++] = contractIPOBid->price;
+                    }
+                    else
+                    {
+                        releasedAmounts[j] += contractIPOBid->price;
+                    }
+                }
+                else
+                {
+                    unsigned int j;
+                    for (j = 0; j < numberOfReleasedEntities; j++)
+                    {
+                        if (ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] == releasedPublicKeys[j])
+                        {
+                            break;
+                        }
+                    }
+                    if (j == numberOfReleasedEntities)
+                    {
+                        releasedPublicKeys[numberOfReleasedEntities] = ipo->publicKeys[NUMBER_OF_COMPUTORS - 1];
+                        releasedAmounts[numberOfReleasedEntities++] = ipo->prices[NUMBER_OF_COMPUTORS - 1];
+                    }
+                    else
+                    {
+                        releasedAmounts[j] += ipo->prices[NUMBER_OF_COMPUTORS - 1];
+                    }
+
+                    ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] = transaction->sourcePublicKey;
+                    ipo->prices[NUMBER_OF_COMPUTORS - 1] = contractIPOBid->price;
+                    j = NUMBER_OF_COMPUTORS - 1;
+                    while (j
+                        && ipo->prices[j - 1] < ipo->prices[j])
+                    {
+                        const m256i tmpPublicKey = ipo->publicKeys[j - 1];
+                        const long long tmpPrice = ipo->prices[j - 1];
+                        ipo->publicKeys[j - 1] = ipo->publicKeys[j];
+                        ipo->prices[j - 1] = ipo->prices[j];
+                        ipo->publicKeys[j] = tmpPublicKey;
+                        ipo->prices[j--] = tmpPrice;
+                    }
+
+                    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+                    _InterlockedIncrement64(&contractStateVersions[contractIndex]);
+                }
+            }
+            contractStateLock[contractIndex].releaseWrite();
+
+            for (unsigned int i = 0; i < numberOfReleasedEntities; i++)
+            {
+                increaseEnergy(releasedPublicKeys[i], releasedAmounts[i]);
+                const QuTransfer quTransfer = { m256i::zero(), releasedPublicKeys[i], releasedAmounts[i] };
+                logger.logQuTransfer(quTransfer);
+            }
+        }
+    }
+}
+
+// Return if money flew
+static bool processTickTransactionContractProcedure(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(spectrumIndex >= 0);
+    ASSERT(contractIndex < contractCount);
+    ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
+    ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
+
+    if (contractUserProcedures[contractIndex][transaction->inputType])
+    {
+        return runContractUserProcedure(transaction);
+    }
+
+    // if transaction tries to invoke non-registered procedure, transaction amount is not reimbursed
+    return transaction->amount > 0;
+}
+
+// Score solution if it has not been scored before. The index of the miner solution flag is computed from the solution
+// if it is not passed as precomputedFlagIndex.
+static void processTickTransactionSolution(const MiningSolutionTransaction* transaction, const unsigned long long processorNumber,
+    const unsigned int* precomputedFlagIndex = nullptr)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->amount >=MiningSolutionTransaction::minAmount()
+            && transaction->inputSize == 64
+            && transaction->inputType == MiningSolutionTransaction::transactionType());
+
+    unsigned int flagIndex;
+    if (precomputedFlagIndex)
+    {
+        flagIndex = *precomputedFlagIndex;
+    }
+    else
+    {
+        m256i data[3] = { transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce };
+        static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
+        KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+    }
+    MiningSolutionStatus status = MINING_SOLUTION_ALREADY_SCORED;
+    if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
+    {
+        minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
+        minerSolutionFlagsDirtyPagesSinceSnapshot.markPage((flagIndex >> 3) / minerSolutionFlagsSnapshotPageSize);
+
+        status = MINING_SOLUTION_SCORED;
+        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
+        if (score->isValidScore(solutionScore))
+        {
+            resourceTestingDigest ^= (unsigned long long)(solutionScore);
+            KangarooTwelve(&resourceTestingDigest, sizeof(resourceTestingDigest), &resourceTestingDigest, sizeof(resourceTestingDigest));
+
+            if (score->isGoodScore(solutionScore, getSolutionThreshold()))
+            {
+                // Solution deposit return
+                {
+                    increaseEnergy(transaction->sourcePublicKey, transaction->amount);
+
+                    const QuTransfer quTransfer = { m256i::zero(), transaction->sourcePublicKey, transaction->amount };
+                    logger.logQuTransfer(quTransfer);
+                }
+
+                status = MINING_SOLUTION_GOOD_SCORE;
+            }
+        }
+    }
+
+    recordMiningSolution(transaction, status);
+}
+
+static void processTickTransactionOracleReplyCommit(const OracleReplyCommitTransaction* transaction)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->tick == system.tick);
+
+    // TODO
+}
+
+static void processTickTransactionOracleReplyReveal(const OracleReplyRevealTransactionPrefix* transaction)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->tick == system.tick);
+
+    // TODO
+}
+
+static int computorIndex(m256i computor)
+{
+    for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (broadcastedComputors.computors.publicKeys[computorIndex] == computor)
+        {
+            return computorIndex;
+        }
+    }
+
+    return -1;
+}
+
+// Execute transaction of current tick whose source entity has the given spectrum index: transfer amount and process
+// the input (vote counter, mining solution, oracle reply, contract IPO bid or procedure). The miner solution flag index
+// of a solution transaction may be passed if it has been computed before. Return if money flew.
+static bool executeTickTransaction(const Transaction* transaction, unsigned long long processorNumber, const int spectrumIndex,
+    const unsigned int* solutionFlagIndex = nullptr)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(spectrumIndex >= 0);
+
+    bool moneyFlew = false;
+    if (decreaseEnergy(spectrumIndex, transaction->amount))
+    {
+        increaseEnergy(transaction->destinationPublicKey, transaction->amount);
+
+        if (transaction->amount)
+        {
+            moneyFlew = true;
+            const QuTransfer quTransfer = { transaction->sourcePublicKey , transaction->destinationPublicKey , transaction->amount };
+            logger.logQuTransfer(quTransfer);
+        }
+
+        if (isZero(transaction->destinationPublicKey))
+        {
+            switch (transaction->inputType)
+            {
+            case VOTE_COUNTER_INPUT_TYPE:
+            {
+                int computorIndex = transaction->tick % NUMBER_OF_COMPUTORS;
+                if (transaction->sourcePublicKey == broadcastedComputors.computors.publicKeys[computorIndex]) // this tx was sent by the tick leader of this tick
+                {
+                    if (!transaction->amount
+                        && transaction->inputSize == VOTE_COUNTER_DATA_SIZE_IN_BYTES)
+                    {
+                        voteCounter.addVotes(transaction->inputPtr(), computorIndex);
+                    }
+                }
+            }
+            break;
+
+            case FileHeaderTransaction::transactionType():
+            {
+                if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
+                    && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
+                {
+                    // Do nothing
+                }
+            }
+            break;
+
+            case FileFragmentTransactionPrefix::transactionType():
+            {
+                if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
+                    && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
+                {
+                    // Do nothing
+                }
+            }
+            break;
+
+            case FileTrailerTransaction::transactionType():
+            {
+                if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
+                    && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
+                {
+                    // Do nothing
+                }
+            }
+            break;
+
+            case MiningSolutionTransaction::transactionType():
+            {
+                if (transaction->amount >= MiningSolutionTransaction::minAmount()
+                    && transaction->inputSize >= MiningSolutionTransaction::minInputSize())
+                {
+                    processTickTransactionSolution((MiningSolutionTransaction*)transaction, processorNumber, solutionFlagIndex);
+                }
+            }
+            break;
+
+            case OracleReplyCommitTransaction::transactionType():
+            {
+                if (computorIndex(transaction->sourcePublicKey) >= 0
+                    && transaction->inputSize == sizeof(OracleReplyCommitTransaction))
+                {
+                    processTickTransactionOracleReplyCommit((OracleReplyCommitTransaction*)transaction);
+                }
+            }
+            break;
+
+            case OracleReplyRevealTransactionPrefix::transactionType():
+            {
+                if (computorIndex(transaction->sourcePublicKey) >= 0
+                    && transaction->inputSize >= sizeof(OracleReplyRevealTransactionPrefix) + sizeof(OracleReplyRevealTransactionPostfix))
+                {
+                    processTickTransactionOracleReplyReveal((OracleReplyRevealTransactionPrefix*)transaction);
+                }
+            }
+            break;
+            }
+        }
+        else
+        {
+            // Contracts are identified by their index stored in the first 64 bits of the id, all
+            // other bits are zeroed. However, the max number of contracts is limited to 2^32 - 1,
+            // only 32 bits are used for the contract index.
+            m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
+            maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
+            unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+            if (isZero(maskedDestinationPublicKey)
+                && contractIndex < contractCount)
+            {
+                // Contract transactions
+                if (system.epoch < contractDescriptions[contractIndex].constructionEpoch)
+                {
+                    // IPO
+                    if (!transaction->amount
+                        && transaction->inputSize == sizeof(ContractIPOBid))
+                    {
+                        processTickTransactionContractIPO(transaction, spectrumIndex, contractIndex);
+                    }
+                }
+                else if (system.epoch < contractDescriptions[contractIndex].destructionEpoch)
+                {
+                    // Regular contract procedure invocation
+                    moneyFlew = processTickTransactionContractProcedure(transaction, spectrumIndex, contractIndex);
+                }
+            }
+        }
+    }
+
+    return moneyFlew;
+}
+
+// Update spectrum digest tree after the transfers of system.tick and return the digest of the spectrum
+static void getSpectrumDigest(m256i& digest)
+{
+    unsigned int digestIndex;
+    ACQUIRE(spectrumLock);
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+        {
+            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+            spectrumDirtyPagesSinceSnapshot.markPage(digestIndex >> 6);
+        }
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            {
+                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+            digestIndex++;
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    spectrumChangeFlags[0] = 0;
+
+    digest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    RELEASE(spectrumLock);
+}
+
+// Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
+// If stateDigestsComputed is true, the digests of the changed contract states have already been computed (at startup).
+static void getComputerDigest(m256i& digest, bool stateDigestsComputed = false)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
+    {
+        if (contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
+        {
+            contractStatesDirtySinceSnapshot.markPage(digestIndex);
+            const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
+            if (!size)
+            {
+                contractStateDigests[digestIndex] = m256i::zero();
+            }
+            else
+            {
+                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
+                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
+                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
+                // digest.
+                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
+                contractStateLock[digestIndex].acquireRead();
+
+                const unsigned long long startTick = __rdtsc();
+                if (!stateDigestsComputed)
+                {
+                    KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
+                }
+                const unsigned long long executionTicks = __rdtsc() - startTick;
+
+#if USE_CONTRACT_STATE_SNAPSHOTS
+                // Publish state for contract function calls requested via network
+                updateContractStateSnapshot(digestIndex);
+#endif
+
+                contractStateLock[digestIndex].releaseRead();
+
+                if (!stateDigestsComputed)
+                {
+                    // K12 of state is included in contract execution time
+                    _interlockedadd64(&contractTotalExecutionTicks[digestIndex], executionTicks);
+
+                    // Gather data for comparing different versions of K12
+                    if (K12MeasurementsCount < 500)
+                    {
+                        K12MeasurementsSum += executionTicks;
+                        K12MeasurementsCount++;
+                    }
+                }
+            }
+        }
+#if USE_CONTRACT_STATE_SNAPSHOTS
+        else if (digestIndex < contractCount)
+        {
+            // Snapshots updated above in this tick are not retried, because they are likely still in use
+            retryInvalidContractStateSnapshot(digestIndex);
+        }
+#endif
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            {
+                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
+                contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+            digestIndex++;
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    contractStateChangeFlags[0] = 0;
+
+    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
+}
+
+// Advance etalonTick to the next tick: take time of tick data if it is later, otherwise add 1 millisecond
+static void advanceEtalonTick(const TickData& td)
+{
+    etalonTick.tick++;
+    if (td.epoch == system.epoch
+        && (td.year > etalonTick.year
+            || (td.year == etalonTick.year && (td.month > etalonTick.month
+                || (td.month == etalonTick.month && (td.day > etalonTick.day
+                    || (td.day == etalonTick.day && (td.hour > etalonTick.hour
+                        || (td.hour == etalonTick.hour && (td.minute > etalonTick.minute
+                            || (td.minute == etalonTick.minute && (td.second > etalonTick.second
+                                || (td.second == etalonTick.second && td.millisecond > etalonTick.millisecond)))))))))))))
+    {
+        etalonTick.millisecond = td.millisecond;
+        etalonTick.second = td.second;
+        etalonTick.minute = td.minute;
+        etalonTick.hour = td.hour;
+        etalonTick.day = td.day;
+        etalonTick.month = td.month;
+        etalonTick.year = td.year;
+    }
+    else
+    {
+        if (++etalonTick.millisecond > 999)
+        {
+            etalonTick.millisecond = 0;
+
+            if (++etalonTick.second > 59)
+            {
+                etalonTick.second = 0;
+
+                if (++etalonTick.minute > 59)
+                {
+                    etalonTick.minute = 0;
+
+                    if (++etalonTick.hour > 23)
+                    {
+                        etalonTick.hour = 0;
+
+                        if (++etalonTick.day > ((etalonTick.month == 1 || etalonTick.month == 3 || etalonTick.month == 5 || etalonTick.month == 7 || etalonTick.month == 8 || etalonTick.month == 10 || etalonTick.month == 12) ? 31 : ((etalonTick.month == 4 || etalonTick.month == 6 || etalonTick.month == 9 || etalonTick.month == 11) ? 30 : ((etalonTick.year & 3) ? 28 : 29))))
+                        {
+                            etalonTick.day = 1;
+
+                            if (++etalonTick.month > 12)
+                            {
+                                etalonTick.month = 1;
+
+                                ++etalonTick.year;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void setNewMiningSeed()
+{
+    score->initMiningData(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+}
+
+static unsigned int getTickInMiningPhaseCycle()
+{
+    return (system.tick - system.initialTick) % (INTERNAL_COMPUTATIONS_INTERVAL + EXTERNAL_COMPUTATIONS_INTERVAL);
+}
+
+static void checkAndSwitchMiningPhase()
+{
+    const unsigned int r = getTickInMiningPhaseCycle();
+    if (!r)
+    {
+        setNewMiningSeed();
+    }
+    else
+    {
+        if (r == INTERNAL_COMPUTATIONS_INTERVAL + 3) // 3 is added because of 3-tick shift for transaction confirmation
+        {
+            score->initMiningData(m256i::zero());
+        }
+    }
+}
@@ -17,6 +17,18 @@ static unsigned short SNAPSHOT_TICKS_FILE_NAME[] = L"snapshotTicks.???";
 static unsigned short SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME[] = L"snapshotTickTransactionOffsets.???";
 static unsigned short SNAPSHOT_TRANSACTIONS_FILE_NAME[] = L"snapshotTickTransaction.???";
 #endif
+
+#ifndef TICK_STORAGE_RETENTION_TICKS
+#define TICK_STORAGE_RETENTION_TICKS 0
+#endif
+#if TICK_STORAGE_RETENTION_TICKS
+#if TICK_STORAGE_AUTOSAVE_MODE
+#error "TICK_STORAGE_RETENTION_TICKS cannot be combined with TICK_STORAGE_AUTOSAVE_MODE"
+#endif
+static_assert(TICK_STORAGE_RETENTION_TICKS >= 2 * TICKS_TO_KEEP_FROM_PRIOR_EPOCH, "TICK_STORAGE_RETENTION_TICKS too small for keeping ticks of prior epoch");
+static_assert(TICK_STORAGE_RETENTION_TICKS <= MAX_NUMBER_OF_TICKS_PER_EPOCH, "TICK_STORAGE_RETENTION_TICKS too large");
+#endif
+
 // Encapsulated tick storage of current epoch that can additionally keep the last ticks of the previous epoch.
 // The number of ticks to keep from the previous epoch is TICKS_TO_KEEP_FROM_PRIOR_EPOCH (defined in public_settings.h).
 //
@@ -28,13 +40,26 @@ static unsigned short SNAPSHOT_TRANSACTIONS_FILE_NAME[] = L"snapshotTickTransact
 // - tickTransactions (continuous buffer efficiently storing the variable-size transactions)
 // - tickTransactionOffsets (offsets of transactions in buffer, order in tickTransactions may differ)
 // - nextTickTransactionOffset (offset of next transition to be added)
+//
+// Clearing the storage of the new epoch in beginEpoch() would take a long time with large storage. So beginEpoch() only
+// clears the first ticks and continueClearing() clears the rest step by step. Ticks are only accessible after they have
+// been cleared. The transactions buffer is never cleared, because transactions are only accessed through offsets.
+//
+// If TICK_STORAGE_RETENTION_TICKS is set, the ticks (computor votes) of the current epoch are only stored in full for a
+// window of TICK_STORAGE_RETENTION_TICKS ticks (ring buffer). Older ticks are compacted by continueCompaction(): only
+// the votes agreeing with the majority are kept, reduced to the fields that differ between computors (CompactedVote).
+// Compacted votes can be reconstructed with ticks.getCompacted().
 class TickStorage
 {
 private:
     static constexpr unsigned long long tickDataLength = MAX_NUMBER_OF_TICKS_PER_EPOCH + TICKS_TO_KEEP_FROM_PRIOR_EPOCH;
     static constexpr unsigned long long tickDataSize = tickDataLength * sizeof(TickData);
     
+#if TICK_STORAGE_RETENTION_TICKS
+    static constexpr unsigned long long ticksLengthCurrentEpoch = ((unsigned long long)TICK_STORAGE_RETENTION_TICKS) * NUMBER_OF_COMPUTORS;
+#else
     static constexpr unsigned long long ticksLengthCurrentEpoch = ((unsigned long long)MAX_NUMBER_OF_TICKS_PER_EPOCH) * NUMBER_OF_COMPUTORS;
+#endif
     static constexpr unsigned long long ticksLengthPreviousEpoch = ((unsigned long long)TICKS_TO_KEEP_FROM_PRIOR_EPOCH) * NUMBER_OF_COMPUTORS;
     static constexpr unsigned long long ticksLength = ticksLengthCurrentEpoch + ticksLengthPreviousEpoch;
     static constexpr unsigned long long ticksSize = ticksLength * sizeof(Tick);
@@ -55,6 +80,25 @@ private:
     inline static unsigned int tickBegin = 0;
     inline static unsigned int tickEnd = 0;
 
+    // Ticks in [tickBegin, clearedTickEnd) have been cleared after beginEpoch() and can be accessed
+    inline static volatile unsigned int clearedTickEnd = 0;
+
+    // Maximum number of bytes cleared by one call of continueClearing(), which holds clearingLock and runs in the main loop
+    static constexpr unsigned long long clearingStepBytes = 4 * 1024 * 1024;
+
+    // Bytes cleared per tick without and with the votes of the computors
+    static constexpr unsigned long long clearingBytesPerTick = sizeof(TickData) + NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned long long);
+    static constexpr unsigned long long clearingBytesPerTickWithVotes = clearingBytesPerTick + NUMBER_OF_COMPUTORS * sizeof(Tick);
+
+    // Lock for securing clearing and compaction of current epoch storage
+    inline static volatile char clearingLock = 0;
+
+    // Entries of transaction digest hash map with other generation are empty (incremented by beginEpoch())
+    inline static unsigned int transactionDigestsGeneration = 1;
+
+    // Number of used overflow entries of transaction digest hash map (reset by beginEpoch())
+    inline static volatile unsigned int transactionDigestsOverflowCount = 0;
+
     // Tick number range of previous epoch storage
     inline static unsigned int oldTickBegin = 0;
     inline static unsigned int oldTickEnd = 0;
@@ -83,7 +127,8 @@ private:
     // Tick transaction offsets of previous epoch. Points to tickTransactionOffsetsPtr + tickTransactionOffsetsLengthCurrentEpoch.
     inline static unsigned long long* oldTickTransactionOffsetsPtr = nullptr;
 
-    // Allocated transaction access digest buffer with current epoch transactions.
+    // Allocated buffer of transaction digest index of current epoch (tags of all slots followed by entries of all slots,
+    // see TransactionsDigestAccess).
     inline static unsigned char* tickTransactionsDigestPtr = nullptr;
 
     // Lock for securing tickData
@@ -95,9 +140,119 @@ private:
     // Lock for securing tickTransactions and tickTransactionOffsets
     inline static volatile char tickTransactionsLock = 0;
 
-    // Lock for securing tickTransactions and tickTransactionsDigestPtr
+    // Lock for serializing insertions into tickTransactionsDigestPtr (lookups don't need lock)
     inline static volatile char tickTransactionsDigestAccessLock = 0;
 
+#if TICK_STORAGE_RETENTION_TICKS
+public:
+    // Vote of computor reduced to the fields that differ between the votes agreeing on a tick
+    struct CompactedVote
+    {
+        unsigned long long saltedResourceTestingDigest;
+        unsigned char saltedSpectrumDigest[32];
+        unsigned char saltedUniverseDigest[32];
+        unsigned char saltedComputerDigest[32];
+        unsigned char signature[SIGNATURE_SIZE];
+    };
+    static_assert(sizeof(CompactedVote) == 8 + 3 * 32 + SIGNATURE_SIZE, "Unexpected struct size");
+
+private:
+    // Compacted votes of one tick: vote with the fields shared by all kept votes and flags of computors with kept vote
+    struct CompactedTick
+    {
+        Tick sharedVote;
+        unsigned char voteFlags[(NUMBER_OF_COMPUTORS + 7) / 8];
+    };
+
+    // Number of ticks compacted by one call of continueCompaction()
+    static constexpr unsigned int compactionStepTicks = 16;
+
+    // Votes of ticks in [tickBegin, compactedTickEnd) have been compacted
+    inline static volatile unsigned int compactedTickEnd = 0;
+
+    // Votes of ticks in [compactedTickEnd, fullVotesTickEnd) are stored in full in the ring buffer ticksPtr
+    inline static volatile unsigned int fullVotesTickEnd = 0;
+
+    // Allocated buffers with one CompactedTick per tick and one CompactedVote per tick and computor of current epoch
+    inline static CompactedTick* compactedTicksPtr = nullptr;
+    inline static CompactedVote* compactedVotesPtr = nullptr;
+
+    // Return true if the votes share all fields that are not computor-specific
+    static bool haveSameSharedFields(const Tick& a, const Tick& b)
+    {
+        return *((unsigned long long*)&a.millisecond) == *((unsigned long long*)&b.millisecond)
+            && a.prevResourceTestingDigest == b.prevResourceTestingDigest
+            && a.prevSpectrumDigest == b.prevSpectrumDigest
+            && a.prevUniverseDigest == b.prevUniverseDigest
+            && a.prevComputerDigest == b.prevComputerDigest
+            && a.transactionDigest == b.transactionDigest
+            && a.expectedNextTickTransactionDigest == b.expectedNextTickTransactionDigest;
+    }
+
+    // Compact votes of tick stored in the ring buffer, keeping the largest group of votes that agree on the shared fields.
+    // Returns false if there were no votes at all.
+    static bool compactTick(unsigned int tick)
+    {
+        const unsigned int tickIndex = tickToIndexCurrentEpoch(tick);
+        const Tick* votes = ticksPtr + (unsigned long long)(tickIndex % TICK_STORAGE_RETENTION_TICKS) * NUMBER_OF_COMPUTORS;
+        CompactedTick& compactedTick = compactedTicksPtr[tickIndex];
+        CompactedVote* compactedVotes = compactedVotesPtr + (unsigned long long)tickIndex * NUMBER_OF_COMPUTORS;
+
+        unsigned short uniqueVoteIndex[NUMBER_OF_COMPUTORS];
+        unsigned short uniqueVoteCount[NUMBER_OF_COMPUTORS];
+        unsigned int numberOfUniqueVotes = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (votes[i].epoch == 0 || votes[i].tick != tick)
+                continue;
+            unsigned int j;
+            for (j = 0; j < numberOfUniqueVotes; j++)
+            {
+                if (haveSameSharedFields(votes[uniqueVoteIndex[j]], votes[i]))
+                {
+                    uniqueVoteCount[j]++;
+                    break;
+                }
+            }
+            if (j == numberOfUniqueVotes)
+            {
+                uniqueVoteIndex[numberOfUniqueVotes] = i;
+                uniqueVoteCount[numberOfUniqueVotes++] = 1;
+            }
+        }
+
+        setMem(compactedTick.voteFlags, sizeof(compactedTick.voteFlags), 0);
+        if (!numberOfUniqueVotes)
+        {
+            compactedTick.sharedVote.epoch = 0;
+            return false;
+        }
+
+        unsigned int maxUniqueVoteCountIndex = 0;
+        for (unsigned int j = 1; j < numberOfUniqueVotes; j++)
+        {
+            if (uniqueVoteCount[j] > uniqueVoteCount[maxUniqueVoteCountIndex])
+                maxUniqueVoteCountIndex = j;
+        }
+        const Tick& sharedVote = votes[uniqueVoteIndex[maxUniqueVoteCountIndex]];
+        copyMem(&compactedTick.sharedVote, &sharedVote, sizeof(Tick));
+        for (unsigned int i = uniqueVoteIndex[maxUniqueVoteCountIndex]; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (votes[i].epoch == sharedVote.epoch && votes[i].tick == tick && haveSameSharedFields(sharedVote, votes[i]))
+            {
+                CompactedVote& compactedVote = compactedVotes[i];
+                compactedVote.saltedResourceTestingDigest = votes[i].saltedResourceTestingDigest;
+                copyMem(compactedVote.saltedSpectrumDigest, &votes[i].saltedSpectrumDigest, 32);
+                copyMem(compactedVote.saltedUniverseDigest, &votes[i].saltedUniverseDigest, 32);
+                copyMem(compactedVote.saltedComputerDigest, &votes[i].saltedComputerDigest, 32);
+                copyMem(compactedVote.signature, votes[i].signature, SIGNATURE_SIZE);
+                compactedTick.voteFlags[i >> 3] |= (1 << (i & 7));
+            }
+        }
+        return true;
+    }
+#endif
+
 #if TICK_STORAGE_AUTOSAVE_MODE
     struct MetaData {
         unsigned int epoch;
@@ -108,6 +263,10 @@ private:
         // may need to store more meta data here to verify consistency when loading (ie: some nodes have different configs and can't use the saved files)
     } metaData;
     inline static unsigned long long lastCheckTransactionOffset = 0; // use for save/load transaction state
+    // describes data saved by trySaveDataToFile() for writing the metadata afterwards
+    inline static unsigned int savedDataEpoch = 0, savedDataTickEnd = 0;
+    inline static long long savedDataTotalTransactionSize = 0;
+    inline static unsigned long long savedDataNextTickTransactionOffset = 0;
     void prepareMetaDataFilename(short epoch)
     {
         addEpochToFileName(SNAPSHOT_METADATA_FILE_NAME, sizeof(SNAPSHOT_METADATA_FILE_NAME) / sizeof(SNAPSHOT_METADATA_FILE_NAME[0]), epoch);
@@ -274,8 +433,150 @@ private:
         }
         return true;
     }
+
+    // Lazy loading of the snapshot (see tryLoadFromFile()). The ticks are split in segments of
+    // TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS ticks, which are marked in lazyLoadedSegmentFlags after they have been loaded.
+    // Segments that fail to load stay unmarked and are retried in the next pass over the segments. After
+    // lazyLoadMaxPasses passes with failures, loading is given up and the ticks of these segments stay unavailable.
+    static constexpr unsigned int lazyLoadSegmentCount = (MAX_NUMBER_OF_TICKS_PER_EPOCH + TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS - 1) / TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS;
+    static constexpr unsigned int lazyLoadMaxPasses = 10;
+    inline static volatile long long lazyLoadedSegmentFlags[(lazyLoadSegmentCount + 63) / 64];
+    inline static volatile bool lazyLoading = false;            // true until all segments of snapshot are loaded
+    inline static volatile long lazyLoadRequestedSegment = -1; // segment requested by checkTickLoaded(), loaded first
+    inline static unsigned int lazyLoadNextSegment = 0;      // segments are loaded from the most recent to the oldest
+    inline static unsigned int lazyLoadFirstEagerSegment = 0;
+    inline static unsigned int lazyLoadFailuresInPass = 0;
+    inline static volatile unsigned int lazyLoadFailedPasses = 0;
+    inline static unsigned long long lazyLoadNumberOfTicks = 0;
+    inline static unsigned long long lazyLoadTransactionsSize = 0;
+    inline static unsigned short lazyLoadEpoch = 0;
+    inline static CHAR16 lazyLoadDirectory[32];
+
+    inline static bool isSegmentLoaded(unsigned int segment)
+    {
+        return (lazyLoadedSegmentFlags[segment >> 6] >> (segment & 63)) & 1;
+    }
+
+    inline static void markSegmentLoaded(unsigned int segment)
+    {
+        _InterlockedOr64(&lazyLoadedSegmentFlags[segment >> 6], 1LL << (segment & 63));
+    }
+
+    // Load tick data, ticks, transaction offsets, and transactions of tick index range [firstTickIndex, firstTickIndex + numberOfTicks)
+    // from snapshot files. Requires lazyLoadNumberOfTicks and lazyLoadTransactionsSize to be set.
+    bool loadTickRange(unsigned int firstTickIndex, unsigned int numberOfTicks, CHAR16* directory = NULL)
+    {
+        const unsigned long long nTick = lazyLoadNumberOfTicks;
+        ASSERT(firstTickIndex + numberOfTicks <= nTick);
+        if (!loadLargeFileRange(SNAPSHOT_TICK_DATA_FILE_NAME, nTick * sizeof(TickData),
+                firstTickIndex * sizeof(TickData), numberOfTicks * sizeof(TickData), (unsigned char*)tickDataPtr, directory)
+            || !loadLargeFileRange(SNAPSHOT_TICKS_FILE_NAME, nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS,
+                firstTickIndex * sizeof(Tick) * NUMBER_OF_COMPUTORS, numberOfTicks * sizeof(Tick) * NUMBER_OF_COMPUTORS, (unsigned char*)ticksPtr, directory)
+            || !loadLargeFileRange(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK,
+                firstTickIndex * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK, numberOfTicks * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK,
+                (unsigned char*)tickTransactionOffsetsPtr, directory))
+        {
+            return false;
+        }
+
+        // Transactions are stored roughly in the order of ticks, so the transactions of the range are found in
+        // [lowest offset, highest offset + size of last transaction). Loading some bytes of other ticks again is harmless,
+        // because the part of the buffer covered by the snapshot is not changed after loading.
+        const unsigned long long* offsets = tickTransactionOffsetsPtr + firstTickIndex * NUMBER_OF_TRANSACTIONS_PER_TICK;
+        unsigned long long beginOffset = lazyLoadTransactionsSize;
+        unsigned long long endOffset = 0;
+        for (unsigned long long i = 0; i < numberOfTicks * NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            if (offsets[i] && offsets[i] < lazyLoadTransactionsSize)
+            {
+                if (offsets[i] < beginOffset)
+                    beginOffset = offsets[i];
+                if (offsets[i] > endOffset)
+                    endOffset = offsets[i];
+            }
+        }
+        if (!endOffset)
+        {
+            return true;
+        }
+        endOffset = (endOffset + MAX_TRANSACTION_SIZE < lazyLoadTransactionsSize) ? endOffset + MAX_TRANSACTION_SIZE : lazyLoadTransactionsSize;
+        return loadLargeFileRange(SNAPSHOT_TRANSACTIONS_FILE_NAME, lazyLoadTransactionsSize, beginOffset, endOffset - beginOffset, tickTransactionsPtr, directory);
+    }
+
+    // Load most recent ticks of the snapshot and prepare loading the older ticks with continueLazyLoading()
+    bool startLazyLoading(unsigned short epoch, unsigned long long nTick, CHAR16* directory)
+    {
+        lazyLoadEpoch = epoch;
+        lazyLoadNumberOfTicks = nTick;
+        lazyLoadTransactionsSize = metaData.outTotalTransactionSize;
+        if (directory)
+            setText(lazyLoadDirectory, directory);
+        else
+            lazyLoadDirectory[0] = 0;
+        setMem((void*)lazyLoadedSegmentFlags, sizeof(lazyLoadedSegmentFlags), 0);
+
+        const unsigned int firstEagerSegment = (unsigned int)((nTick - TICK_STORAGE_EAGER_LOAD_TICKS) / TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS);
+        const unsigned int firstEagerTickIndex = firstEagerSegment * TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS;
+        logToConsole(L"Loading most recent ticks...");
+        if (!loadTickRange(firstEagerTickIndex, (unsigned int)(nTick - firstEagerTickIndex), directory))
+        {
+            return false;
+        }
+        for (unsigned int segment = firstEagerSegment; segment < lazyLoadSegmentCount; segment++)
+        {
+            markSegmentLoaded(segment);
+        }
+        lazyLoadNextSegment = firstEagerSegment;
+        lazyLoadFirstEagerSegment = firstEagerSegment;
+        lazyLoadFailuresInPass = 0;
+        lazyLoadFailedPasses = 0;
+        lazyLoadRequestedSegment = -1;
+        lazyLoading = true;
+
+        setText(message, L"Loaded ticks ");
+        appendNumber(message, tickBegin + firstEagerTickIndex, FALSE);
+        appendText(message, L" - ");
+        appendNumber(message, metaData.tickEnd, FALSE);
+        appendText(message, L", older ticks are loaded in background.");
+        logToConsole(message);
+        return true;
+    }
 #endif
-    
+
+    // Clear next ticks of current epoch storage (up to about clearingStepBytes, at least one tick) and make them
+    // accessible. Returns true if there is more to clear. Requires clearingLock.
+    static bool clearNextTicks()
+    {
+        const unsigned int clearedLength = clearedTickEnd - tickBegin;
+        if (clearedLength >= MAX_NUMBER_OF_TICKS_PER_EPOCH)
+        {
+            return false;
+        }
+#if TICK_STORAGE_RETENTION_TICKS
+        const unsigned long long bytesPerTick = (clearedLength < TICK_STORAGE_RETENTION_TICKS) ? clearingBytesPerTickWithVotes : clearingBytesPerTick;
+#else
+        const unsigned long long bytesPerTick = clearingBytesPerTickWithVotes;
+#endif
+        const unsigned int stepTicks = (clearingStepBytes > bytesPerTick) ? (unsigned int)(clearingStepBytes / bytesPerTick) : 1;
+        const unsigned int count = (MAX_NUMBER_OF_TICKS_PER_EPOCH - clearedLength < stepTicks) ? MAX_NUMBER_OF_TICKS_PER_EPOCH - clearedLength : stepTicks;
+        setMem(tickDataPtr + clearedLength, count * sizeof(TickData), 0);
+#if TICK_STORAGE_RETENTION_TICKS
+        // ring buffer slots of later ticks are cleared by continueCompaction()
+        if (clearedLength < TICK_STORAGE_RETENTION_TICKS)
+        {
+            const unsigned int ringCount = (TICK_STORAGE_RETENTION_TICKS - clearedLength < count) ? TICK_STORAGE_RETENTION_TICKS - clearedLength : count;
+            setMem(ticksPtr + (unsigned long long)clearedLength * NUMBER_OF_COMPUTORS, (unsigned long long)ringCount * NUMBER_OF_COMPUTORS * sizeof(Tick), 0);
+        }
+#else
+        setMem(ticksPtr + (unsigned long long)clearedLength * NUMBER_OF_COMPUTORS, (unsigned long long)count * NUMBER_OF_COMPUTORS * sizeof(Tick), 0);
+#endif
+        setMem(tickTransactionOffsetsPtr + (unsigned long long)clearedLength * NUMBER_OF_TRANSACTIONS_PER_TICK, (unsigned long long)count * NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(tickTransactionOffsetsPtr[0]), 0);
+
+        // make sure zeros are visible to other processors before ticks become accessible
+        _mm_sfence();
+        clearedTickEnd = tickBegin + clearedLength + count;
+        return clearedLength + count < MAX_NUMBER_OF_TICKS_PER_EPOCH;
+    }
 
 public:
 #if TICK_STORAGE_AUTOSAVE_MODE
@@ -295,10 +596,29 @@ public:
     // (2) write all missing chunks to disk
     // (3) update metadata state
     int trySaveToFile(unsigned int epoch, unsigned int tick, CHAR16* directory = NULL)
+    {
+        const int result = trySaveDataToFile(epoch, tick, directory);
+        if (result != 0)
+        {
+            return result;
+        }
+        return trySaveMetaDataToFile(directory) ? 0 : 1;
+    }
+
+    // Steps (1) and (2) of trySaveToFile(). The snapshot only becomes valid with trySaveMetaDataToFile(), so the
+    // metadata can be saved after other parts of the node state that are written later.
+    int trySaveDataToFile(unsigned int epoch, unsigned int tick, CHAR16* directory = NULL)
     {   
         if (tick <= tickBegin) {
             return 6;
         }
+        // all ticks of the previous snapshot need to be in memory (don't overwrite it with a snapshot missing ticks)
+        if (!completeLazyLoading())
+        {
+            logToConsole(L"Cannot save tick storage, because not all ticks of the loaded snapshot are available");
+            return 7;
+        }
+
         unsigned long long nTick = tick - tickBegin + 1; // inclusive [tickBegin, tick]
         prepareFilenames(epoch);
 
@@ -342,20 +662,31 @@ public:
         }
         tickTransactions.releaseLock();
 
+        savedDataEpoch = epoch;
+        savedDataTickEnd = tick;
+        savedDataTotalTransactionSize = outTotalTransactionSize;
+        savedDataNextTickTransactionOffset = outNextTickTransactionOffset;
+        return 0;
+    }
+
+    // Step (3) of trySaveToFile() for the data saved by the last successful call of trySaveDataToFile()
+    bool trySaveMetaDataToFile(CHAR16* directory = NULL)
+    {
         logToConsole(L"Saving meta data");
-        if (!saveMetaData(epoch, tick, outTotalTransactionSize, outNextTickTransactionOffset, directory))
+        if (!saveMetaData(savedDataEpoch, savedDataTickEnd, savedDataTotalTransactionSize, savedDataNextTickTransactionOffset, directory))
         {
             logToConsole(L"Failed to save metaData");
-            return 1;
+            return false;
         }
-
-        return 0;
+        return true;
     }
 
     // Load procedure:
     // (1) try to load metadata file
     // (2) sanity check meta data file
     // (3) load these in order: tickData -> Ticks -> tx offset -> tx 
+    //     If the snapshot has more than TICK_STORAGE_EAGER_LOAD_TICKS ticks, only the most recent ticks are loaded here.
+    //     The older ticks are loaded later by continueLazyLoading().
     // only load once at start up
     int tryLoadFromFile(unsigned short epoch, CHAR16* directory)
     {
@@ -376,6 +707,24 @@ public:
         unsigned long long nTick = metaData.tickEnd - metaData.tickBegin + 1;
         prepareFilenames(epoch);
 
+        // storage of loaded ticks needs to be cleared before (ticks of snapshot may be incomplete)
+        while (clearedTickEnd - tickBegin < nTick && continueClearing())
+        {
+        }
+
+#if TICK_STORAGE_EAGER_LOAD_TICKS
+        if (nTick > TICK_STORAGE_EAGER_LOAD_TICKS)
+        {
+            if (!startLazyLoading(epoch, nTick, directory))
+            {
+                logToConsole(L"Failed to load most recent ticks");
+                initMetaData(epoch);
+                return 7;
+            }
+            return 0;
+        }
+#endif
+
         logToConsole(L"Loading tick data...");
         if (!loadTickData(nTick, directory))
         {
@@ -410,6 +759,84 @@ public:
         return 0;
     }
 
+    // Load one segment of ticks that has not been loaded by tryLoadFromFile(). Segments requested by checkTickLoaded()
+    // are loaded first, the others from the most recent to the oldest. Returns true if there are more segments to load.
+    // Only call from main processor (file access).
+    bool continueLazyLoading()
+    {
+        if (!isLazyLoading())
+        {
+            return false;
+        }
+
+        long segment = lazyLoadRequestedSegment;
+        lazyLoadRequestedSegment = -1;
+        if (segment < 0 || isSegmentLoaded(segment))
+        {
+            while (lazyLoadNextSegment > 0 && isSegmentLoaded(lazyLoadNextSegment - 1))
+            {
+                lazyLoadNextSegment--;
+            }
+            if (lazyLoadNextSegment == 0)
+            {
+                if (!lazyLoadFailuresInPass)
+                {
+                    lazyLoading = false;
+                    logToConsole(L"Finished loading tick storage snapshot");
+                    return false;
+                }
+
+                // retry segments that failed to load in another pass
+                setNumber(message, lazyLoadFailuresInPass, TRUE);
+                lazyLoadFailuresInPass = 0;
+                if (++lazyLoadFailedPasses >= lazyLoadMaxPasses)
+                {
+                    appendText(message, L" segments of tick storage snapshot failed to load again, giving up (ticks stay unavailable)");
+                    logToConsole(message);
+                    return false;
+                }
+                appendText(message, L" segments of tick storage snapshot failed to load, retrying");
+                logToConsole(message);
+                lazyLoadNextSegment = lazyLoadFirstEagerSegment;
+                return true;
+            }
+            segment = lazyLoadNextSegment - 1;
+        }
+
+        const unsigned int firstTickIndex = segment * TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS;
+        const unsigned int numberOfTicks = (firstTickIndex + TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS <= lazyLoadNumberOfTicks) ? TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS : (unsigned int)(lazyLoadNumberOfTicks - firstTickIndex);
+        prepareFilenames(lazyLoadEpoch);
+        if (!loadTickRange(firstTickIndex, numberOfTicks, (lazyLoadDirectory[0]) ? lazyLoadDirectory : NULL))
+        {
+            // Keep segment unloaded (checkTickLoaded() returns false for its ticks) and retry it in the next pass
+            if (segment == lazyLoadNextSegment - 1)
+            {
+                lazyLoadNextSegment--;
+            }
+            lazyLoadFailuresInPass++;
+
+            setText(message, L"Failed to load ticks ");
+            appendNumber(message, tickBegin + firstTickIndex, FALSE);
+            appendText(message, L" - ");
+            appendNumber(message, tickBegin + firstTickIndex + numberOfTicks - 1, FALSE);
+            appendText(message, L" of tick storage snapshot");
+            logToConsole(message);
+            return true;
+        }
+        markSegmentLoaded(segment);
+        return true;
+    }
+
+    // Load all ticks that have not been loaded yet. Returns false if some ticks could not be loaded. Only call from
+    // main processor (file access).
+    bool completeLazyLoading()
+    {
+        while (continueLazyLoading())
+        {
+        }
+        return !lazyLoading;
+    }
+
     // Save a dummy metadata that invalidate the current snapshot
     bool saveInvalidateData(unsigned int epoch, CHAR16* directory = NULL)
     {
@@ -446,7 +873,12 @@ public:
             || !allocatePool(ticksSize, (void**)&ticksPtr)
             || !allocatePool(tickTransactionsSize, (void**)&tickTransactionsPtr)
             || !allocatePool(tickTransactionOffsetsSize, (void**)&tickTransactionOffsetsPtr)
-            || !allocatePool(tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry), (void**)&tickTransactionsDigestPtr))
+            || !allocatePool(TransactionsDigestAccess::bufferSize, (void**)&tickTransactionsDigestPtr)
+#if TICK_STORAGE_RETENTION_TICKS
+            || !allocatePool(MAX_NUMBER_OF_TICKS_PER_EPOCH * sizeof(CompactedTick), (void**)&compactedTicksPtr)
+            || !allocatePool((unsigned long long)MAX_NUMBER_OF_TICKS_PER_EPOCH * NUMBER_OF_COMPUTORS * sizeof(CompactedVote), (void**)&compactedVotesPtr)
+#endif
+            )
         {
             logToConsole(L"Failed to allocate tick storage memory!");
             return false;
@@ -464,10 +896,17 @@ public:
 
         tickBegin = 0;
         tickEnd = 0;
+        clearedTickEnd = 0;
+#if TICK_STORAGE_RETENTION_TICKS
+        compactedTickEnd = 0;
+        fullVotesTickEnd = 0;
+#endif
         oldTickBegin = 0;
         oldTickEnd = 0;
 
-        setMem((void*)tickTransactionsDigestPtr, tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry), 0);
+        setMem((void*)tickTransactionsDigestPtr, TransactionsDigestAccess::bufferSize, 0);
+        transactionDigestsGeneration = 1;
+        transactionDigestsOverflowCount = 0;
 
         return true;
     }
@@ -499,6 +938,18 @@ public:
         {
             freePool(tickTransactionsDigestPtr);
         }
+
+#if TICK_STORAGE_RETENTION_TICKS
+        if (compactedTicksPtr)
+        {
+            freePool(compactedTicksPtr);
+        }
+
+        if (compactedVotesPtr)
+        {
+            freePool(compactedVotesPtr);
+        }
+#endif
     }
 
     // Begin new epoch. If not called the first time (seamless transition), assume that the ticks to keep
@@ -509,6 +960,7 @@ public:
         addDebugMessage(L"Begin ts.beginEpoch()");
         CHAR16 dbgMsgBuf[300];
 #endif
+        ACQUIRE(clearingLock);
         if (tickBegin && tickInCurrentEpochStorage(newInitialTick) && tickBegin < newInitialTick)
         {
             // seamless epoch transition: keep some ticks of prior epoch
@@ -530,7 +982,14 @@ public:
 
             // copy ticks and tick data from recently ended epoch into storage of previous epoch
             copyMem(oldTickDataPtr, tickDataPtr + tickIndex, tickCount * sizeof(TickData));
+#if TICK_STORAGE_RETENTION_TICKS
+            // votes are stored in ring buffer (ticks to keep are never compacted, see continueCompaction())
+            ASSERT(oldTickBegin >= compactedTickEnd);
+            for (unsigned int i = 0; i < tickCount; ++i)
+                copyMem(oldTicksPtr + i * NUMBER_OF_COMPUTORS, TicksAccess::getByTickIndex(tickIndex + i), NUMBER_OF_COMPUTORS * sizeof(Tick));
+#else
             copyMem(oldTicksPtr, ticksPtr + (tickIndex * NUMBER_OF_COMPUTORS), tickCount * NUMBER_OF_COMPUTORS * sizeof(Tick));
+#endif
 
             // copy transactions and transactionOffsets
             {
@@ -583,27 +1042,38 @@ public:
                 }
             }
 
-            // reset data storage of new epoch
-            setMem(tickDataPtr, MAX_NUMBER_OF_TICKS_PER_EPOCH * sizeof(TickData), 0);
-            setMem(ticksPtr, ticksLengthCurrentEpoch * sizeof(Tick), 0);
-            setMem(tickTransactionOffsetsPtr, tickTransactionOffsetsSizeCurrentEpoch, 0);
-            setMem(tickTransactionsPtr, tickTransactionsSizeCurrentEpoch, 0);
         }
         else
         {
-            // node startup with no data of prior epoch (also use storage for prior epoch for current)
-            setMem(tickDataPtr, tickDataSize, 0);
-            setMem(ticksPtr, ticksSize, 0);
-            setMem(tickTransactionOffsetsPtr, tickTransactionOffsetsSize, 0);
-            setMem(tickTransactionsPtr, tickTransactionsSize, 0);
+            // node startup with no data of prior epoch
+            setMem(oldTickDataPtr, TICKS_TO_KEEP_FROM_PRIOR_EPOCH * sizeof(TickData), 0);
+            setMem(oldTicksPtr, ticksLengthPreviousEpoch * sizeof(Tick), 0);
+            setMem(oldTickTransactionOffsetsPtr, tickTransactionOffsetsSizePreviousEpoch, 0);
             oldTickBegin = 0;
             oldTickEnd = 0;
         }
         // Transaction digest look up need to reset at the begining of epoch for pointing to valid current epoch transaction
-        setMem((void*)tickTransactionsDigestPtr, tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry), 0);
-
+        // (entries of previous generation are treated as empty)
+        // (generation is stored with 16 bits in tags and 0 is reserved for slots that have never been used)
+        transactionDigestsGeneration++;
+        if (!(transactionDigestsGeneration & 0xffff))
+            transactionDigestsGeneration++;
+        transactionDigestsOverflowCount = 0;
+
+        // reset data storage of new epoch: clear first ticks here and the rest in continueClearing()
         tickBegin = newInitialTick;
         tickEnd = newInitialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH;
+        clearedTickEnd = newInitialTick;
+#if TICK_STORAGE_RETENTION_TICKS
+        compactedTickEnd = newInitialTick;
+        fullVotesTickEnd = newInitialTick + TICK_STORAGE_RETENTION_TICKS;
+#endif
+        clearNextTicks();
+#if TICK_STORAGE_AUTOSAVE_MODE
+        // segments of a snapshot that could not be loaded don't refer to the new epoch
+        lazyLoading = false;
+#endif
+        RELEASE(clearingLock);
 
         nextTickTransactionOffset = FIRST_TICK_TRANSACTION_OFFSET;
 #if !defined(NDEBUG) && !defined(NO_UEFI)
@@ -611,6 +1081,55 @@ public:
 #endif
     }
 
+    // Clear next part of current epoch storage that has not been cleared after beginEpoch(). Returns true if there is more
+    // to clear. Called by main loop.
+    static bool continueClearing()
+    {
+        ACQUIRE(clearingLock);
+        const bool moreToClear = clearNextTicks();
+        RELEASE(clearingLock);
+        return moreToClear;
+    }
+
+    // Return true if current epoch storage has not been cleared completely after beginEpoch()
+    inline static bool isClearing()
+    {
+        return clearedTickEnd < tickEnd;
+    }
+
+#if TICK_STORAGE_RETENTION_TICKS
+    // Compact votes of the next ticks older than currentTick - TICK_STORAGE_RETENTION_TICKS / 2 and free their slots in
+    // the ring buffer for later ticks. Returns true if there are more ticks to compact. Called by main loop.
+    static bool continueCompaction(unsigned int currentTick)
+    {
+        ACQUIRE(clearingLock);
+        for (unsigned int i = 0; i < compactionStepTicks; i++)
+        {
+            const unsigned int tick = compactedTickEnd;
+            if (tick + TICK_STORAGE_RETENTION_TICKS / 2 >= currentTick || tick >= clearedTickEnd)
+            {
+                RELEASE(clearingLock);
+                return false;
+            }
+
+            // make compacted votes accessible before the votes in the ring buffer are overwritten
+            const bool hadVotes = compactTick(tick);
+            _mm_sfence();
+            compactedTickEnd = tick + 1;
+
+            // free slot for tick + TICK_STORAGE_RETENTION_TICKS
+            if (hadVotes)
+            {
+                setMem(ticksPtr + (unsigned long long)(tickToIndexCurrentEpoch(tick) % TICK_STORAGE_RETENTION_TICKS) * NUMBER_OF_COMPUTORS, NUMBER_OF_COMPUTORS * sizeof(Tick), 0);
+                _mm_sfence();
+            }
+            fullVotesTickEnd = tick + 1 + TICK_STORAGE_RETENTION_TICKS;
+        }
+        RELEASE(clearingLock);
+        return true;
+    }
+#endif
+
     // Useful for debugging, but expensive: check that everything is as expected.
     static void checkStateConsistencyWithAssert()
     {
@@ -699,16 +1218,19 @@ public:
         test_current_epoch:
 #endif
         unsigned long long lastTransactionEndOffset = FIRST_TICK_TRANSACTION_OFFSET;
-        for (unsigned int tickId = tickBegin; tickId < tickEnd; ++tickId)
+        for (unsigned int tickId = tickBegin; tickId < clearedTickEnd; ++tickId)
         {
             const TickData& tickData = TickDataAccess::getByTickInCurrentEpoch(tickId);
             ASSERT(tickData.epoch == 0 || (tickData.tick == tickId));
 
-            const Tick* computorsTicks = TicksAccess::getByTickInCurrentEpoch(tickId);
-            for (unsigned int computor = 0; computor < NUMBER_OF_COMPUTORS; ++computor)
+            if (TicksAccess::isStoredInFull(tickId))
             {
-                const Tick& computorTick = computorsTicks[computor];
-                ASSERT(computorTick.epoch == 0 || (computorTick.tick == tickId && computorTick.computorIndex == computor));
+                const Tick* computorsTicks = TicksAccess::getByTickInCurrentEpoch(tickId);
+                for (unsigned int computor = 0; computor < NUMBER_OF_COMPUTORS; ++computor)
+                {
+                    const Tick& computorTick = computorsTicks[computor];
+                    ASSERT(computorTick.epoch == 0 || (computorTick.tick == tickId && computorTick.computorIndex == computor));
+                }
             }
 
             const unsigned long long* tickOffsets = TickTransactionOffsetsAccess::getByTickInCurrentEpoch(tickId);
@@ -757,10 +1279,38 @@ public:
 #endif
     }
 
-    // Check whether tick is stored in the current epoch storage.
+    // Check whether tick is stored in the current epoch storage (only ticks that have been cleared after beginEpoch()).
     inline static bool tickInCurrentEpochStorage(unsigned int tick)
     {
-        return tick >= tickBegin && tick < tickEnd;
+        return tick >= tickBegin && tick < clearedTickEnd;
+    }
+
+    // Return true if ticks of the snapshot are still loaded by continueLazyLoading()
+    inline static bool isLazyLoading()
+    {
+#if TICK_STORAGE_AUTOSAVE_MODE
+        return lazyLoading && lazyLoadFailedPasses < lazyLoadMaxPasses;
+#else
+        return false;
+#endif
+    }
+
+    // Check whether data of tick is available. Only returns false if the tick is in the part of the snapshot that is not
+    // loaded yet (see tryLoadFromFile()). In this case, the segment of the tick is requested to be loaded next.
+    inline static bool checkTickLoaded(unsigned int tick)
+    {
+#if TICK_STORAGE_AUTOSAVE_MODE
+        if (lazyLoading && tickInCurrentEpochStorage(tick))
+        {
+            const unsigned int segment = tickToIndexCurrentEpoch(tick) / TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS;
+            if (!isSegmentLoaded(segment))
+            {
+                lazyLoadRequestedSegment = segment;
+                return false;
+            }
+        }
+#endif
+        return true;
     }
 
     // Check whether tick is stored in the previous epoch storage.
@@ -860,21 +1410,72 @@ public:
         inline static Tick* getByTickIndex(unsigned int tickIndex)
         {
             ASSERT(tickIndex < tickDataLength);
+#if TICK_STORAGE_RETENTION_TICKS
+            if (tickIndex < MAX_NUMBER_OF_TICKS_PER_EPOCH)
+                return ticksPtr + (unsigned long long)(tickIndex % TICK_STORAGE_RETENTION_TICKS) * NUMBER_OF_COMPUTORS;
+            return oldTicksPtr + (unsigned long long)(tickIndex - MAX_NUMBER_OF_TICKS_PER_EPOCH) * NUMBER_OF_COMPUTORS;
+#else
             return ticksPtr + tickIndex * NUMBER_OF_COMPUTORS;
+#endif
         }
 
         // Return pointer to array of one Tick per computor in current epoch by tick (checking tick with ASSERT)
         inline static Tick* getByTickInCurrentEpoch(unsigned int tick)
         {
-            ASSERT(tickInCurrentEpochStorage(tick));
-            return ticksPtr + tickToIndexCurrentEpoch(tick) * NUMBER_OF_COMPUTORS;
+            ASSERT(isStoredInFull(tick));
+            return getByTickIndex(tickToIndexCurrentEpoch(tick));
         }
 
         // Return pointer to array of one Tick per computor in previous epoch by tick (checking tick with ASSERT)
         inline static Tick* getByTickInPreviousEpoch(unsigned int tick)
         {
             ASSERT(tickInPreviousEpochStorage(tick));
-            return ticksPtr + tickToIndexPreviousEpoch(tick) * NUMBER_OF_COMPUTORS;
+            return getByTickIndex(tickToIndexPreviousEpoch(tick));
+        }
+
+        // Check whether the votes of tick are stored in full in the current epoch storage and can be accessed with
+        // getByTickInCurrentEpoch() (all ticks of current epoch storage if TICK_STORAGE_RETENTION_TICKS is 0)
+        inline static bool isStoredInFull(unsigned int tick)
+        {
+#if TICK_STORAGE_RETENTION_TICKS
+            return tickInCurrentEpochStorage(tick) && tick >= compactedTickEnd && tick < fullVotesTickEnd;
+#else
+            return tickInCurrentEpochStorage(tick);
+#endif
+        }
+
+        // Check whether the votes of tick of current epoch have been compacted (see getCompacted())
+        inline static bool isCompacted(unsigned int tick)
+        {
+#if TICK_STORAGE_RETENTION_TICKS
+            return tick >= tickBegin && tick < compactedTickEnd;
+#else
+            return false;
+#endif
+        }
+
+        // Reconstruct vote of computor in compacted tick. Returns false if the vote has not been kept.
+        static bool getCompacted(unsigned int tick, unsigned int computorIndex, Tick& vote)
+        {
+#if TICK_STORAGE_RETENTION_TICKS
+            ASSERT(isCompacted(tick));
+            ASSERT(computorIndex < NUMBER_OF_COMPUTORS);
+            const unsigned int tickIndex = tickToIndexCurrentEpoch(tick);
+            const CompactedTick& compactedTick = compactedTicksPtr[tickIndex];
+            if (!(compactedTick.voteFlags[computorIndex >> 3] & (1 << (computorIndex & 7))))
+                return false;
+            const CompactedVote& compactedVote = compactedVotesPtr[(unsigned long long)tickIndex * NUMBER_OF_COMPUTORS + computorIndex];
+            copyMem(&vote, &compactedTick.sharedVote, sizeof(Tick));
+            vote.computorIndex = computorIndex;
+            vote.saltedResourceTestingDigest = compactedVote.saltedResourceTestingDigest;
+            copyMem(&vote.saltedSpectrumDigest, compactedVote.saltedSpectrumDigest, 32);
+            copyMem(&vote.saltedUniverseDigest, compactedVote.saltedUniverseDigest, 32);
+            copyMem(&vote.saltedComputerDigest, compactedVote.saltedComputerDigest, 32);
+            copyMem(vote.signature, compactedVote.signature, SIGNATURE_SIZE);
+            return true;
+#else
+            return false;
+#endif
         }
 
         // Get ticks element at offset (checking offset with ASSERT)
@@ -959,9 +1560,39 @@ public:
         }
     } tickTransactions;
 
-    // Struct for access the transaction using its digest. It contains the offset in tickTransactionsPtr
+    // Struct for access of transactions of current epoch by digest (open addressing hash map with power of two size).
+    // Each slot has a 32-bit tag (generation and fingerprint of digest) and an entry (digest and transaction offset).
+    // The tags of slotsPerBucket slots form a bucket of one cache line. A digest is stored in the first free slot of its
+    // home bucket or the following maxProbeBuckets - 1 buckets, so a lookup usually reads one line of tags and the entry
+    // with matching tag. Lookups don't need a lock, because entries are written before their tag and not changed until
+    // beginEpoch() invalidates all slots by incrementing the generation.
     struct TransactionsDigestAccess
     {
+        static constexpr unsigned int slotsPerBucket = 16;
+        static constexpr unsigned int maxProbeBuckets = 4;
+
+        // Number of slots: power of two >= max number of transactions in current epoch
+        static constexpr unsigned long long capacity = []()
+        {
+            unsigned long long slots = slotsPerBucket * maxProbeBuckets;
+            while (slots < tickTransactionOffsetsLengthCurrentEpoch)
+                slots <<= 1;
+            return slots;
+        }();
+        static constexpr unsigned long long numberOfBuckets = capacity / slotsPerBucket;
+
+        // Digests not fitting in the probed buckets are stored in a small list of overflow entries, which is only
+        // searched if all probed slots are used.
+        static constexpr unsigned int overflowCapacity = 1024;
+
+        struct Entry
+        {
+            unsigned long long digest[4];
+            unsigned long long transactionOffset;
+        };
+
+        static constexpr unsigned long long bufferSize = capacity * (sizeof(unsigned int) + sizeof(Entry)) + overflowCapacity * sizeof(Entry);
+
         inline static void acquireLock()
         {
             ACQUIRE(tickTransactionsDigestAccessLock);
@@ -972,42 +1603,68 @@ public:
             RELEASE(tickTransactionsDigestAccessLock);
         }
 
-        struct HashMapEntry
-        {
-            m256i digest; // isZero mean not occupied
-            const Transaction* transaction;
-        };
-        unsigned long long hashFunc(const m256i& digest)
-        {
-            return digest.m256i_u32[7] % tickTransactionOffsetsLengthCurrentEpoch;
-        }
-
-        void insertTransaction(const m256i& digest, const Transaction* transaction)
+        // Insert digest of transaction in current epoch storage. Returns false if digest is zero or neither a slot in
+        // the probed buckets nor an overflow entry is free. Requires lock.
+        static bool insertTransaction(const m256i& digest, const Transaction* transaction)
         {
             // Zero digest. No further process
             if (isZero(digest))
             {
-                return;
+                return false;
             }
+            ASSERT((const unsigned char*)transaction >= tickTransactionsPtr + FIRST_TICK_TRANSACTION_OFFSET);
+            ASSERT((const unsigned char*)transaction < tickTransactionsPtr + tickTransactionsSizeCurrentEpoch);
 
-            HashMapEntry* pHashMap = (HashMapEntry*)tickTransactionsDigestPtr;
-            unsigned long long index = hashFunc(digest);
-            unsigned long long original_index = index;
-            // TODO: check alraeady added tx ?
-            while (!isZero(pHashMap[index].digest))
+            const unsigned int digestTag = tag(digest);
+            unsigned long long bucket = homeBucket(digest);
+            for (unsigned int probe = 0; probe < maxProbeBuckets; ++probe, bucket = (bucket + 1) & (numberOfBuckets - 1))
             {
-                index = (index + 1) % tickTransactionOffsetsLengthCurrentEpoch;
-                if (index == original_index)
+                volatile unsigned int* bucketTags = tags() + bucket * slotsPerBucket;
+                for (unsigned int i = 0; i < slotsPerBucket; ++i)
                 {
-                    // Don't have enough place in the table
-                    return;
+                    const unsigned int slotTag = bucketTags[i];
+                    Entry& entry = entries()[bucket * slotsPerBucket + i];
+                    if (slotTag == digestTag && hasDigest(entry, digest))
+                    {
+                        // already added
+                        return true;
+                    }
+                    if ((slotTag >> 16) != (digestTag >> 16))
+                    {
+                        copyMem(entry.digest, &digest, sizeof(entry.digest));
+                        entry.transactionOffset = (const unsigned char*)transaction - tickTransactionsPtr;
+
+                        // make entry visible to other processors before tag
+                        _mm_sfence();
+                        bucketTags[i] = digestTag;
+                        return true;
+                    }
                 }
             }
-            pHashMap[index].transaction = transaction;
-            pHashMap[index].digest = digest;
+
+            // all probed slots are used -> store in overflow entries
+            if (findOverflowEntry(digest))
+            {
+                // already added
+                return true;
+            }
+            const unsigned int overflowCount = transactionDigestsOverflowCount;
+            if (overflowCount >= overflowCapacity)
+            {
+                return false;
+            }
+            Entry& entry = overflowEntries()[overflowCount];
+            copyMem(entry.digest, &digest, sizeof(entry.digest));
+            entry.transactionOffset = (const unsigned char*)transaction - tickTransactionsPtr;
+
+            // make entry visible to other processors before count
+            _mm_sfence();
+            transactionDigestsOverflowCount = overflowCount + 1;
+            return true;
         }
 
-        const Transaction* findTransaction(const m256i& digest)
+        // Find transaction of current epoch by digest. Returns NULL if not found. Can be called without lock.
+        static const Transaction* findTransaction(const m256i& digest)
         {
             // Zero digest. No further process
             if (isZero(digest))
@@ -1015,22 +1672,84 @@ public:
                 return NULL;
             }
 
-            HashMapEntry* pHashMap = (HashMapEntry*)tickTransactionsDigestPtr;
-            unsigned long long index = hashFunc(digest);
-            unsigned long long original_index = index;
-            while (!isZero(pHashMap[index].digest))
+            const unsigned int digestTag = tag(digest);
+            unsigned long long bucket = homeBucket(digest);
+            for (unsigned int probe = 0; probe < maxProbeBuckets; ++probe, bucket = (bucket + 1) & (numberOfBuckets - 1))
             {
-                if (pHashMap[index].digest == digest)
+                const volatile unsigned int* bucketTags = tags() + bucket * slotsPerBucket;
+                for (unsigned int i = 0; i < slotsPerBucket; ++i)
                 {
-                    return pHashMap[index].transaction;
+                    const unsigned int slotTag = bucketTags[i];
+                    if (slotTag == digestTag)
+                    {
+                        // read entry after tag
+                        _mm_lfence();
+                        const Entry& entry = entries()[bucket * slotsPerBucket + i];
+                        if (hasDigest(entry, digest))
+                        {
+                            return (const Transaction*)(tickTransactionsPtr + entry.transactionOffset);
+                        }
+                    }
+                    else if ((slotTag >> 16) != (digestTag >> 16))
+                    {
+                        // free slot -> digest would have been inserted here
+                        return NULL;
+                    }
                 }
-                index = (index + 1) % tickTransactionOffsetsLengthCurrentEpoch;
-                if (index == original_index)
+            }
+
+            // all probed slots are used -> digest may be in overflow entries
+            const Entry* entry = findOverflowEntry(digest);
+            return (entry) ? (const Transaction*)(tickTransactionsPtr + entry->transactionOffset) : NULL;
+        }
+
+    private:
+        inline static volatile unsigned int* tags()
+        {
+            return (volatile unsigned int*)tickTransactionsDigestPtr;
+        }
+
+        inline static Entry* entries()
+        {
+            return (Entry*)(tickTransactionsDigestPtr + capacity * sizeof(unsigned int));
+        }
+
+        inline static Entry* overflowEntries()
+        {
+            return entries() + capacity;
+        }
+
+        static const Entry* findOverflowEntry(const m256i& digest)
+        {
+            const unsigned int overflowCount = transactionDigestsOverflowCount;
+
+            // read entries after count
+            _mm_lfence();
+            for (unsigned int i = 0; i < overflowCount; ++i)
+            {
+                if (hasDigest(overflowEntries()[i], digest))
                 {
-                    break;
+                    return &overflowEntries()[i];
                 }
             }
             return NULL;
         }
+
+        // Tag of slot: generation in high 16 bits, fingerprint of digest in low 16 bits
+        inline static unsigned int tag(const m256i& digest)
+        {
+            return ((transactionDigestsGeneration & 0xffff) << 16) | (digest.m256i_u32[7] >> 16);
+        }
+
+        inline static unsigned long long homeBucket(const m256i& digest)
+        {
+            return digest.m256i_u64[0] & (numberOfBuckets - 1);
+        }
+
+        inline static bool hasDigest(const Entry& entry, const m256i& digest)
+        {
+            return entry.digest[0] == digest.m256i_u64[0] && entry.digest[1] == digest.m256i_u64[1]
+                && entry.digest[2] == digest.m256i_u64[2] && entry.digest[3] == digest.m256i_u64[3];
+        }
     } transactionsDigestAccess;
 };
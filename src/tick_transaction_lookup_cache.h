@@ -0,0 +1,161 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/assert.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+
+#include "network_messages/transactions.h"
+
+#include "kangaroo_twelve.h"
+#include "spectrum.h"
+#include "mining/mining.h"
+
+// Cache of read-only lookups for the transactions of the tick that is about to be processed, filled in parallel.
+//
+// Transactions are still executed strictly sequentially to keep spectrum hash map layout, universe, contract states,
+// and logging order identical on all nodes (there is no speculative execution). Only the lookups that do not depend
+// on the execution of earlier transactions of the tick are done in parallel by all processors that are idle while the
+// tick processor waits:
+// - looking up the source entity in the spectrum (the lookup result is used as hint and validated in the sequential
+//   pass, so it is only re-executed if the entity was not there before the tick or was moved by reorganizeSpectrum()),
+// - computing the K12 digest that indexes the miner solution flags for solution transactions, which is used by the
+//   scoring of solutions and by executeTickTransaction().
+//
+// Usage (tick processor): reset() -> addTransaction() for each tx -> start() -> tryProcessTask() until isFinished()
+// -> stop() -> use entry() in sequential pass. Request processors call tryProcessTask() in their main loop.
+class TickTransactionLookupCache
+{
+public:
+    struct Entry
+    {
+        const Transaction* transaction;
+        int sourceSpectrumIndex;       // -1 if source entity not in spectrum before executing the tick
+        unsigned int solutionFlagIndex; // only valid if transaction is a mining solution
+        unsigned short transactionIndex;
+    };
+
+    // Init to empty state, called by tick processor before filling the queue
+    void reset()
+    {
+        ACQUIRE(lock);
+        numberOfEntries = 0;
+        nextEntryToProcess = 0;
+        numberOfProcessedEntries = 0;
+        ready = false;
+        RELEASE(lock);
+    }
+
+    // Add transaction to queue, queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK
+    void addTransaction(const Transaction* transaction, unsigned int transactionIndex)
+    {
+        ASSERT(!ready);
+        if (numberOfEntries < NUMBER_OF_TRANSACTIONS_PER_TICK)
+        {
+            Entry& e = entries[numberOfEntries++];
+            e.transaction = transaction;
+            e.sourceSpectrumIndex = -1;
+            e.solutionFlagIndex = 0;
+            e.transactionIndex = transactionIndex;
+        }
+    }
+
+    // Allow other processors to take tasks from the queue
+    void start()
+    {
+        ACQUIRE(lock);
+        ready = true;
+        RELEASE(lock);
+    }
+
+    // Process one queued entry if there is any, can be called on any thread
+    void tryProcessTask()
+    {
+        if (!ready)
+            return;
+
+        ACQUIRE(lock);
+        if (!ready || nextEntryToProcess >= numberOfEntries)
+        {
+            RELEASE(lock);
+            return;
+        }
+        const unsigned int entryIndex = nextEntryToProcess++;
+        RELEASE(lock);
+
+        processEntry(entries[entryIndex]);
+
+        ACQUIRE(lock);
+        numberOfProcessedEntries++;
+        RELEASE(lock);
+    }
+
+    bool isFinished() const
+    {
+        return numberOfProcessedEntries == numberOfEntries;
+    }
+
+    // Stop distributing tasks. Called by tick processor only after isFinished() returned true.
+    void stop()
+    {
+        ACQUIRE(lock);
+        ready = false;
+        RELEASE(lock);
+    }
+
+    unsigned int size() const
+    {
+        return numberOfEntries;
+    }
+
+    const Entry& entry(unsigned int i) const
+    {
+        ASSERT(i < numberOfEntries);
+        return entries[i];
+    }
+
+    // Return spectrum index of source entity of entry i. Uses hint computed in parallel lookup if it is still valid
+    // and falls back to regular lookup otherwise. Only call from the tick processor while processing the tick.
+    int validatedSourceSpectrumIndex(unsigned int i)
+    {
+        const Entry& e = entry(i);
+        if (e.sourceSpectrumIndex >= 0 && spectrum[e.sourceSpectrumIndex].publicKey == e.transaction->sourcePublicKey)
+        {
+            ++hintHits;
+            return e.sourceSpectrumIndex;
+        }
+        ++hintMisses;
+        return ::spectrumIndex(e.transaction->sourcePublicKey);
+    }
+
+    // Statistics since node start
+    unsigned long long hintHits = 0;
+    unsigned long long hintMisses = 0;
+
+private:
+    void processEntry(Entry& e)
+    {
+        const Transaction* tx = e.transaction;
+        e.sourceSpectrumIndex = ::spectrumIndex(tx->sourcePublicKey);
+
+        if (isZero(tx->destinationPublicKey))
+        {
+            if (tx->amount >= MiningSolutionTransaction::minAmount()
+                && tx->inputType == MiningSolutionTransaction::transactionType()
+                && tx->inputSize >= MiningSolutionTransaction::minInputSize())
+            {
+                const m256i* solution = (const m256i*)tx->inputPtr();
+                m256i data[3] = { tx->sourcePublicKey, solution[0], solution[1] };
+                static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
+                KangarooTwelve(data, sizeof(data), &e.solutionFlagIndex, sizeof(e.solutionFlagIndex));
+            }
+        }
+    }
+
+    Entry entries[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    unsigned int numberOfEntries = 0;
+    unsigned int nextEntryToProcess = 0;
+    volatile unsigned int numberOfProcessedEntries = 0;
+    volatile bool ready = false;
+    volatile char lock = 0;
+};
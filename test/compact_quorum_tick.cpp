@@ -0,0 +1,90 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/compact_quorum_tick.h"
+
+#include <vector>
+
+
+static Tick makeVote(unsigned short computorIndex, unsigned int tick, unsigned long long variant)
+{
+    Tick vote;
+    setMem(&vote, sizeof(vote), 0);
+    vote.computorIndex = computorIndex;
+    vote.epoch = 100;
+    vote.tick = tick;
+    vote.month = 5;
+    vote.day = 17;
+    vote.prevResourceTestingDigest = variant;
+    vote.prevSpectrumDigest = m256i(variant, 1, 2, 3);
+    vote.transactionDigest = m256i(tick, variant, 0, 0);
+    vote.saltedResourceTestingDigest = computorIndex * 7;
+    vote.saltedSpectrumDigest = m256i(computorIndex, tick, 1, 0);
+    vote.saltedUniverseDigest = m256i(computorIndex, tick, 2, 0);
+    vote.saltedComputerDigest = m256i(computorIndex, tick, 3, 0);
+    for (unsigned int i = 0; i < SIGNATURE_SIZE; i++)
+        vote.signature[i] = (unsigned char)(computorIndex + i);
+    return vote;
+}
+
+TEST(TestCoreCompactQuorumTick, EncodeAndDecode)
+{
+    // encode votes of every third computor as a sender would do
+    std::vector<unsigned char> buffer(compactQuorumTickSize(NUMBER_OF_COMPUTORS));
+    CompactQuorumTick* message = (CompactQuorumTick*)buffer.data();
+    CompactVote* compactVotes = (CompactVote*)(message + 1);
+    const Tick sharedVote = makeVote(0, 1234, 42);
+    copyMem(&message->sharedVote, &sharedVote, sizeof(Tick));
+    setMem(message->voteFlags, sizeof(message->voteFlags), 0);
+    unsigned int numberOfVotes = 0;
+    for (unsigned short computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex += 3)
+    {
+        const Tick vote = makeVote(computorIndex, 1234, 42);
+        EXPECT_TRUE(haveSameSharedVoteFields(sharedVote, vote));
+        compactVote(vote, compactVotes[numberOfVotes++]);
+        message->voteFlags[computorIndex >> 3] |= (1 << (computorIndex & 7));
+    }
+    const unsigned int payloadSize = compactQuorumTickSize(numberOfVotes);
+    EXPECT_LT(payloadSize * 2, numberOfVotes * sizeof(BroadcastTick));
+
+    // check size and decode as a receiver would do
+    EXPECT_EQ(getNumberOfCompactVotes(message, payloadSize), (int)numberOfVotes);
+    EXPECT_EQ(getNumberOfCompactVotes(message, payloadSize - 1), -1);
+    EXPECT_EQ(getNumberOfCompactVotes(message, payloadSize + sizeof(CompactVote)), -1);
+    EXPECT_EQ(getNumberOfCompactVotes(message, sizeof(CompactQuorumTick) - 1), -1);
+    unsigned int decodedVotes = 0;
+    for (unsigned short computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (message->voteFlags[computorIndex >> 3] & (1 << (computorIndex & 7)))
+        {
+            Tick decoded;
+            expandCompactVote(*message, computorIndex, compactVotes[decodedVotes++], decoded);
+            const Tick expected = makeVote(computorIndex, 1234, 42);
+            EXPECT_EQ(memcmp(&decoded, &expected, sizeof(Tick)), 0);
+        }
+    }
+    EXPECT_EQ(decodedVotes, numberOfVotes);
+}
+
+TEST(TestCoreCompactQuorumTick, SharedVoteSelector)
+{
+    SharedVoteSelector selector;
+    EXPECT_EQ(selector.get(), nullptr);
+
+    // majority of votes agree on variant 2, a few differ
+    for (unsigned short computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        const unsigned long long variant = (computorIndex < 10) ? 1 : ((computorIndex % 100 == 0) ? computorIndex : 2);
+        selector.add(makeVote(computorIndex, 77, variant));
+    }
+    ASSERT_NE(selector.get(), nullptr);
+    EXPECT_TRUE(haveSameSharedVoteFields(*selector.get(), makeVote(500, 77, 2)));
+    EXPECT_FALSE(haveSameSharedVoteFields(*selector.get(), makeVote(500, 77, 1)));
+    EXPECT_FALSE(haveSameSharedVoteFields(*selector.get(), makeVote(500, 78, 2)));
+
+    selector.reset();
+    EXPECT_EQ(selector.get(), nullptr);
+    selector.add(makeVote(3, 77, 1));
+    EXPECT_TRUE(haveSameSharedVoteFields(*selector.get(), makeVote(4, 77, 1)));
+}
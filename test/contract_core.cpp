@@ -54,6 +54,108 @@ TEST(TestCoreContractCore, StackBuffer)
     s1.free();
 }
 
+static bool isZeroed(const char* p, unsigned int size)
+{
+    for (unsigned int i = 0; i < size; ++i)
+        if (p[i])
+            return false;
+    return true;
+}
+
+TEST(TestCoreContractCore, ZeroedStackBuffer)
+{
+    ZeroedStackBuffer<unsigned int, 1024, 128> s;
+    s.init();
+    EXPECT_EQ(s.highWaterMark(), 0);
+    EXPECT_EQ(s.peakSize(), 0);
+
+    // fresh memory does not need to be zeroed
+    char* p = s.allocateZeroed(100);
+    EXPECT_NE(p, nullptr);
+    EXPECT_TRUE(isZeroed(p, 100));
+    EXPECT_EQ(s.zeroedBytes(), 0);
+    EXPECT_EQ(s.zeroingSkippedBytes(), 100);
+    EXPECT_EQ(s.highWaterMark(), 104);
+    for (int i = 0; i < 100; ++i)
+        p[i] = char(i + 1);
+
+    // freeing zeroes the block and lowers the high-water mark, so reusing it does not need zeroing
+    s.free();
+    EXPECT_EQ(s.highWaterMark(), 0);
+    EXPECT_EQ(s.zeroedOnFreeBytes(), 104);
+    p = s.allocateZeroed(200);
+    EXPECT_NE(p, nullptr);
+    EXPECT_TRUE(isZeroed(p, 200));
+    EXPECT_EQ(s.zeroedBytes(), 0);
+    EXPECT_EQ(s.zeroingSkippedBytes(), 300);
+    EXPECT_EQ(s.highWaterMark(), 204);
+
+    // nested allocation without zeroing, large enough for non-temporal stores when freed
+    for (int i = 0; i < 200; ++i)
+        p[i] = char(i + 1);
+    char* q = s.allocate(300);
+    EXPECT_NE(q, nullptr);
+    for (int i = 0; i < 300; ++i)
+        q[i] = 1;
+    s.free();
+    EXPECT_EQ(s.highWaterMark(), 204);
+    q = s.allocateZeroed(400);
+    EXPECT_NE(q, nullptr);
+    EXPECT_TRUE(isZeroed(q, 400));
+    EXPECT_EQ(s.peakSize(), 204 + 404);
+    EXPECT_EQ(s.highWaterMark(), 204 + 404);
+    s.free();
+    s.free();
+    EXPECT_EQ(s.size(), 0);
+    EXPECT_EQ(s.highWaterMark(), 0);
+    EXPECT_EQ(s.zeroedBytes(), 0);
+
+    s.resetPeakSize();
+    EXPECT_EQ(s.peakSize(), 0);
+    EXPECT_EQ(s.allocateZeroed(1021), nullptr);
+    EXPECT_EQ(s.peakSize(), 0);
+    EXPECT_EQ(s.highWaterMark(), 0);
+}
+
+TEST(TestCoreContractCore, ZeroedStackBufferAfterDeepCall)
+{
+    ZeroedStackBuffer<unsigned int, 64 * 1024, 1024> s;
+    s.init();
+
+    // deep call dirties a large part of the buffer
+    for (int depth = 0; depth < 8; ++depth)
+    {
+        char* p = s.allocateZeroed(4000);
+        ASSERT_NE(p, nullptr);
+        setMem(p, 4000, 0xff);
+    }
+    EXPECT_EQ(s.highWaterMark(), 8 * 4004);
+    while (s.size())
+        s.free();
+    EXPECT_EQ(s.highWaterMark(), 0);
+    EXPECT_EQ(s.zeroedOnFreeBytes(), 8 * 4004);
+
+    // later shallow calls do not need to zero anything on the call path
+    for (int call = 0; call < 10; ++call)
+    {
+        const unsigned long long zeroedBefore = s.zeroedBytes();
+        char* p = s.allocateZeroed(3000);
+        ASSERT_NE(p, nullptr);
+        EXPECT_TRUE(isZeroed(p, 3000));
+        EXPECT_EQ(s.zeroedBytes(), zeroedBefore);
+        setMem(p, 3000, 0xff);
+        s.free();
+    }
+
+    // freeAll() of an aborted call zeroes the whole dirty region
+    for (int depth = 0; depth < 4; ++depth)
+        setMem(s.allocate(1000), 1000, 0xff);
+    s.freeAll();
+    EXPECT_EQ(s.highWaterMark(), 0);
+    EXPECT_TRUE(isZeroed(s.allocateZeroed(s.capacity() - 4), s.capacity() - 4));
+    EXPECT_EQ(s.zeroedBytes(), 0);
+}
+
 TEST(TestCoreContractCore, ContractActionTracker)
 {
     m256i id0(0, 1, 2, 3);
@@ -61,6 +163,7 @@ TEST(TestCoreContractCore, ContractActionTracker)
     m256i id2(3, 4, 5, 6);
 
     ContractActionTracker<6> at;
+    EXPECT_EQ(at.getOverallQuTransferBalance(id0), 0); // before init(), must not hang in balance map lookup
     at.init();
     EXPECT_EQ(at.getOverallQuTransferBalance(id0), 0);
 
@@ -101,3 +204,32 @@ TEST(TestCoreContractCore, ContractActionTracker)
     EXPECT_EQ(at.getOverallQuTransferBalance(id1), 200);
     EXPECT_EQ(at.getOverallQuTransferBalance(id2), 300);
 }
+
+TEST(TestCoreContractCore, ContractActionTrackerBalanceMapOverflowAndReset)
+{
+    // Balance map with capacity 8 can hold balances of 6 entities before falling back to scanning the action log
+    ContractActionTracker<20, 8> at;
+    m256i ids[10];
+    for (int i = 0; i < 10; ++i)
+        ids[i] = m256i(i + 1, 0, 0, i);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        at.init();
+        for (int i = 0; i < 10; ++i)
+            EXPECT_EQ(at.getOverallQuTransferBalance(ids[i]), 0);
+
+        // Chain of transfers ids[0] -> ids[1] -> ... -> ids[9], each forwarding less than it received
+        for (int i = 0; i < 9; ++i)
+        {
+            EXPECT_TRUE(at.addQuTransfer(ids[i], ids[i + 1], 1000 - i * 10));
+            EXPECT_EQ(at.getOverallQuTransferBalance(ids[0]), -1000);
+            for (int j = 1; j <= i; ++j)
+                EXPECT_EQ(at.getOverallQuTransferBalance(ids[j]), 10);
+            EXPECT_EQ(at.getOverallQuTransferBalance(ids[i + 1]), 1000 - i * 10);
+        }
+
+        // Entity not involved in any transfer
+        EXPECT_EQ(at.getOverallQuTransferBalance(m256i(1, 2, 3, 4)), 0);
+    }
+}
@@ -0,0 +1,107 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_function_result_cache.h"
+
+#include <random>
+#include <vector>
+
+
+typedef ContractFunctionResultCache<64, 128> SmallCache;
+
+static ContractFunctionResultCacheKey makeKey(unsigned int contractIndex, unsigned short inputType, unsigned long long inputValue, long long stateVersion, unsigned int tick)
+{
+    ContractFunctionResultCacheKey key;
+    key.set(contractIndex, inputType, &inputValue, sizeof(inputValue), stateVersion, tick);
+    return key;
+}
+
+TEST(TestCoreContractFunctionResultCache, HitAndMiss)
+{
+    SmallCache* cache = new SmallCache();
+    cache->reset();
+    EXPECT_EQ(cache->capacity(), 64);
+    EXPECT_EQ(cache->maxOutput(), 128);
+
+    unsigned char output[128];
+    unsigned char buffer[128];
+    unsigned short outputSize = 0;
+    for (int i = 0; i < 128; ++i)
+        output[i] = (unsigned char)(i * 3);
+
+    ContractFunctionResultCacheKey key = makeKey(1, 2, 12345, 7, 1000);
+    EXPECT_FALSE(cache->tryFetching(key, buffer, outputSize));
+    cache->add(key, output, 100);
+    EXPECT_TRUE(cache->tryFetching(key, buffer, outputSize));
+    EXPECT_EQ(outputSize, 100);
+    EXPECT_EQ(memcmp(buffer, output, 100), 0);
+
+    // Any difference in key leads to miss
+    EXPECT_FALSE(cache->tryFetching(makeKey(2, 2, 12345, 7, 1000), buffer, outputSize));
+    EXPECT_FALSE(cache->tryFetching(makeKey(1, 3, 12345, 7, 1000), buffer, outputSize));
+    EXPECT_FALSE(cache->tryFetching(makeKey(1, 2, 12346, 7, 1000), buffer, outputSize));
+    EXPECT_FALSE(cache->tryFetching(makeKey(1, 2, 12345, 8, 1000), buffer, outputSize));
+    EXPECT_FALSE(cache->tryFetching(makeKey(1, 2, 12345, 7, 1001), buffer, outputSize));
+
+    // Empty output is valid
+    ContractFunctionResultCacheKey key2 = makeKey(1, 2, 12345, 8, 1000);
+    cache->add(key2, output, 0);
+    EXPECT_TRUE(cache->tryFetching(key2, buffer, outputSize));
+    EXPECT_EQ(outputSize, 0);
+
+    // Too large output is not cached
+    ContractFunctionResultCacheKey key3 = makeKey(5, 2, 1, 1, 1);
+    cache->add(key3, output, 129);
+    EXPECT_FALSE(cache->tryFetching(key3, buffer, outputSize));
+
+    EXPECT_EQ(cache->hitCount(), 2);
+    EXPECT_EQ(cache->missCount(), 7);
+    EXPECT_EQ(cache->insertionCount(), 2);
+
+    cache->reset();
+    EXPECT_FALSE(cache->tryFetching(key, buffer, outputSize));
+    EXPECT_EQ(cache->hitCount(), 0);
+    EXPECT_EQ(cache->missCount(), 1);
+
+    delete cache;
+}
+
+TEST(TestCoreContractFunctionResultCache, LeastRecentlyUsedReplacement)
+{
+    SmallCache* cache = new SmallCache();
+    cache->reset();
+
+    unsigned char buffer[128];
+    unsigned short outputSize = 0;
+
+    // Add many more entries than capacity; each output stores the input value
+    std::mt19937_64 gen64(42);
+    const unsigned int entryCount = cache->capacity() * 8;
+    std::vector<unsigned long long> values(entryCount);
+    for (unsigned int i = 0; i < entryCount; ++i)
+    {
+        values[i] = gen64();
+        cache->add(makeKey(1, 1, values[i], 0, 0), &values[i], sizeof(values[i]));
+
+        // Keep first entry alive by accessing it regularly
+        EXPECT_TRUE(cache->tryFetching(makeKey(1, 1, values[0], 0, 0), buffer, outputSize));
+        EXPECT_EQ(*(unsigned long long*)buffer, values[0]);
+    }
+
+    // Cache never holds more than capacity, all hits return correct output, most recent entry is available
+    unsigned int hits = 0;
+    for (unsigned int i = 0; i < entryCount; ++i)
+    {
+        if (cache->tryFetching(makeKey(1, 1, values[i], 0, 0), buffer, outputSize))
+        {
+            EXPECT_EQ(outputSize, sizeof(values[i]));
+            EXPECT_EQ(*(unsigned long long*)buffer, values[i]);
+            ++hits;
+        }
+    }
+    EXPECT_LE(hits, cache->capacity());
+    EXPECT_TRUE(cache->tryFetching(makeKey(1, 1, values[entryCount - 1], 0, 0), buffer, outputSize));
+
+    delete cache;
+}
@@ -0,0 +1,100 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_profiler.h"
+
+#include <map>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+typedef ContractProfiler<8, 16> SmallProfiler;
+
+static std::map<std::tuple<unsigned int, unsigned char, unsigned short>, const SmallProfiler::EntryPoint*> getEntryPoints(const SmallProfiler& profiler)
+{
+    std::map<std::tuple<unsigned int, unsigned char, unsigned short>, const SmallProfiler::EntryPoint*> entryPoints;
+    for (unsigned int slot = 0; slot < profiler.capacity(); ++slot)
+    {
+        const SmallProfiler::EntryPoint* entryPoint = profiler.entryPoint(slot);
+        if (entryPoint)
+        {
+            auto key = std::make_tuple(entryPoint->contractIndex(), entryPoint->kind(), entryPoint->inputType());
+            EXPECT_EQ(entryPoints.count(key), 0u);
+            entryPoints[key] = entryPoint;
+        }
+    }
+    return entryPoints;
+}
+
+TEST(TestCoreContractProfiler, RecordAndReset)
+{
+    std::unique_ptr<SmallProfiler> profiler(new SmallProfiler);
+    profiler->reset();
+    EXPECT_TRUE(getEntryPoints(*profiler).empty());
+
+    // same input type of different kinds and contracts are separate entry points
+    profiler->recordCall(1, CONTRACT_ENTRY_POINT_USER_PROCEDURE, 3, 100, 4096);
+    profiler->recordCall(1, CONTRACT_ENTRY_POINT_USER_PROCEDURE, 3, 300, 1024);
+    profiler->recordCall(1, CONTRACT_ENTRY_POINT_USER_FUNCTION, 3, 50, 512);
+    profiler->recordCall(7, CONTRACT_ENTRY_POINT_SYSTEM_PROCEDURE, 3, 1000, 0);
+    profiler->recordCall(2, CONTRACT_ENTRY_POINT_USER_FUNCTION, 0xffff, 10, 64);
+    profiler->recordCallEdge(1, 2);
+    profiler->recordCallEdge(1, 2);
+    profiler->recordCallEdge(2, 1);
+    profiler->recordCallEdge(8, 1); // out of range -> ignored
+
+    auto entryPoints = getEntryPoints(*profiler);
+    ASSERT_EQ(entryPoints.size(), 4u);
+    const SmallProfiler::EntryPoint* procedure = entryPoints[std::make_tuple(1u, (unsigned char)CONTRACT_ENTRY_POINT_USER_PROCEDURE, (unsigned short)3)];
+    ASSERT_NE(procedure, nullptr);
+    EXPECT_EQ(procedure->numberOfCalls, 2);
+    EXPECT_EQ(procedure->totalCycles, 400);
+    EXPECT_EQ(procedure->maxStackSize, 4096);
+    EXPECT_EQ(procedure->cycles.max(), 300ull);
+    EXPECT_EQ(procedure->cycles.count(), 2ull);
+    const SmallProfiler::EntryPoint* function = entryPoints[std::make_tuple(2u, (unsigned char)CONTRACT_ENTRY_POINT_USER_FUNCTION, (unsigned short)0xffff)];
+    ASSERT_NE(function, nullptr);
+    EXPECT_EQ(function->numberOfCalls, 1);
+    EXPECT_EQ(function->maxStackSize, 64);
+    EXPECT_NE(entryPoints[std::make_tuple(7u, (unsigned char)CONTRACT_ENTRY_POINT_SYSTEM_PROCEDURE, (unsigned short)3)], nullptr);
+    EXPECT_EQ(profiler->numberOfCallEdgeCalls(1, 2), 2);
+    EXPECT_EQ(profiler->numberOfCallEdgeCalls(2, 1), 1);
+    EXPECT_EQ(profiler->numberOfCallEdgeCalls(1, 1), 0);
+
+    profiler->reset();
+    EXPECT_TRUE(getEntryPoints(*profiler).empty());
+    EXPECT_EQ(profiler->numberOfCallEdgeCalls(1, 2), 0);
+}
+
+TEST(TestCoreContractProfiler, FullAndConcurrent)
+{
+    std::unique_ptr<SmallProfiler> profiler(new SmallProfiler);
+    profiler->reset();
+
+    // more entry points than capacity, recorded by several threads concurrently
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&profiler]()
+            {
+                for (unsigned int i = 0; i < 1000; ++i)
+                    profiler->recordCall(1 + i % 5, CONTRACT_ENTRY_POINT_USER_PROCEDURE, (unsigned short)(i % 20), i, i);
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    auto entryPoints = getEntryPoints(*profiler);
+    EXPECT_EQ(entryPoints.size(), profiler->capacity());
+    long long numberOfCalls = profiler->numberOfDroppedCalls();
+    for (const auto& entryPoint : entryPoints)
+    {
+        numberOfCalls += entryPoint.second->numberOfCalls;
+        EXPECT_EQ((unsigned long long)entryPoint.second->numberOfCalls, entryPoint.second->cycles.count());
+    }
+    EXPECT_EQ(numberOfCalls, 4000);
+    EXPECT_GT(profiler->numberOfDroppedCalls(), 0);
+}
@@ -0,0 +1,164 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_state_snapshot.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+TEST(TestCoreContractStateSnapshot, CopiesOnlyChangedPages)
+{
+    constexpr unsigned long long size = 10 * ContractStateSnapshot::pageSize + 100;
+    std::vector<unsigned char> state(size), buffer(size);
+    for (unsigned long long i = 0; i < size; ++i)
+        state[i] = (unsigned char)(i * 7 + 1);
+
+    ContractStateSnapshot snapshot;
+    snapshot.init(nullptr);
+    unsigned long long copiedBytes = 1;
+    EXPECT_FALSE(snapshot.tryUpdate(state.data(), size, 1, copiedBytes));
+    EXPECT_EQ(copiedBytes, 0);
+    EXPECT_EQ(snapshot.tryAcquireRead(), nullptr);
+
+    snapshot.init(buffer.data());
+    EXPECT_FALSE(snapshot.isValid());
+    EXPECT_EQ(snapshot.tryAcquireRead(), nullptr);
+
+    // first update copies everything
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 1, copiedBytes));
+    EXPECT_EQ(copiedBytes, size);
+    EXPECT_TRUE(snapshot.isValid());
+    EXPECT_EQ(snapshot.getVersion(), 1);
+    EXPECT_EQ(buffer, state);
+
+    // change one byte in a page in the middle and one in the partial page at the end
+    state[3 * ContractStateSnapshot::pageSize + 17] ^= 0xff;
+    state[size - 1] ^= 0xff;
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 2, copiedBytes));
+    EXPECT_EQ(copiedBytes, ContractStateSnapshot::pageSize + 100);
+    EXPECT_EQ(snapshot.getVersion(), 2);
+    EXPECT_EQ(buffer, state);
+
+    // same version is not compared again
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 2, copiedBytes));
+    EXPECT_EQ(copiedBytes, 0);
+
+    // new version without changes
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 3, copiedBytes));
+    EXPECT_EQ(copiedBytes, 0);
+    EXPECT_EQ(snapshot.getVersion(), 3);
+}
+
+TEST(TestCoreContractStateSnapshot, InvalidatedWhileInUse)
+{
+    constexpr unsigned long long size = 2 * ContractStateSnapshot::pageSize;
+    std::vector<unsigned char> state(size, 1), buffer(size);
+
+    ContractStateSnapshot snapshot;
+    snapshot.init(buffer.data());
+    unsigned long long copiedBytes;
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 1, copiedBytes));
+
+    unsigned char* data = snapshot.tryAcquireRead();
+    EXPECT_EQ(data, buffer.data());
+    EXPECT_EQ(snapshot.tryAcquireRead(), buffer.data());
+    snapshot.releaseRead();
+
+    // update while in use does not wait, but invalidates snapshot without changing it
+    state[0] = 2;
+    EXPECT_FALSE(snapshot.tryUpdate(state.data(), size, 2, copiedBytes));
+    EXPECT_EQ(copiedBytes, 0);
+    EXPECT_FALSE(snapshot.isValid());
+    EXPECT_EQ(snapshot.getVersion(), 1);
+    EXPECT_EQ(data[0], 1);
+    EXPECT_EQ(snapshot.tryAcquireRead(), nullptr);
+    snapshot.releaseRead(); // first reader
+
+    // retry succeeds after reader is done
+    EXPECT_TRUE(snapshot.tryUpdate(state.data(), size, 2, copiedBytes));
+    EXPECT_EQ(copiedBytes, ContractStateSnapshot::pageSize);
+    EXPECT_TRUE(snapshot.isValid());
+    EXPECT_EQ(buffer, state);
+}
+
+TEST(TestCoreContractStateSnapshot, ConsistentWhileWriterRuns)
+{
+    // State of version v: all words of page p are the last version <= v that is a multiple of p + 1, so each version
+    // changes a different set of pages. The last partial page is handled like the others.
+    constexpr unsigned long long pageWords = ContractStateSnapshot::pageSize / 8;
+    constexpr unsigned long long pageCount = 17;
+    constexpr unsigned long long wordCount = (pageCount - 1) * pageWords + 3;
+    constexpr unsigned long long size = wordCount * 8;
+    constexpr long long lastVersion = 20000;
+    std::vector<unsigned long long> state(wordCount, 0), buffer(wordCount, 0);
+
+    ContractStateSnapshot snapshot;
+    snapshot.init((unsigned char*)buffer.data());
+
+    std::atomic<bool> writerDone = false;
+    std::atomic<unsigned long long> successfulReads = 0, inconsistentReads = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t)
+    {
+        readers.emplace_back([&]()
+            {
+                long long previousVersion = 0;
+                while (!writerDone)
+                {
+                    const unsigned long long* data = (const unsigned long long*)snapshot.tryAcquireRead();
+                    if (!data)
+                        continue;
+                    const long long version = snapshot.getVersion();
+                    bool consistent = version >= previousVersion;
+                    for (unsigned long long i = 0; i < wordCount && consistent; ++i)
+                    {
+                        const long long p = i / pageWords;
+                        consistent = ((long long)data[i] == version - version % (p + 1));
+                    }
+                    snapshot.releaseRead();
+                    previousVersion = version;
+                    ++successfulReads;
+                    if (!consistent)
+                        ++inconsistentReads;
+                }
+            });
+    }
+
+    // single writer like the tick processor: change state, then update snapshot without waiting
+    unsigned long long successfulUpdates = 0, copiedBytesSum = 0;
+    for (long long version = 1; version <= lastVersion; ++version)
+    {
+        for (unsigned long long p = 0; p < pageCount; ++p)
+        {
+            if (version % (p + 1) == 0)
+            {
+                for (unsigned long long i = p * pageWords; i < (p + 1) * pageWords && i < wordCount; ++i)
+                    state[i] = version;
+            }
+        }
+        unsigned long long copiedBytes;
+        if (snapshot.tryUpdate((const unsigned char*)state.data(), size, version, copiedBytes))
+        {
+            ++successfulUpdates;
+            copiedBytesSum += copiedBytes;
+        }
+        else
+        {
+            EXPECT_FALSE(snapshot.isValid());
+        }
+    }
+    writerDone = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    unsigned long long copiedBytes;
+    EXPECT_TRUE(snapshot.tryUpdate((const unsigned char*)state.data(), size, lastVersion, copiedBytes));
+    EXPECT_EQ(buffer, state);
+    EXPECT_GT(successfulUpdates, 0);
+    EXPECT_LT(copiedBytesSum, successfulUpdates * size);
+    EXPECT_GT(successfulReads, 0);
+    EXPECT_EQ(inconsistentReads, 0);
+}
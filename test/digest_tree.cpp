@@ -0,0 +1,105 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/digest_tree.h"
+
+#include <thread>
+#include <vector>
+
+
+static void runOnTestThreads(void (*procedure)(void* argument), void* argument)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+        threads.emplace_back(procedure, argument);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+static std::vector<unsigned char> leafData;
+
+static void getTestLeafDigest(unsigned long long leafIndex, m256i& digest)
+{
+    KangarooTwelve(&leafData[leafIndex * 64], 64, &digest, 32);
+}
+
+// Reference implementation as used before for spectrumDigests
+static std::vector<m256i> computeDigestTreeSequentially(unsigned int numberOfLeafs)
+{
+    std::vector<m256i> digests(numberOfLeafs * 2 - 1);
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < numberOfLeafs; digestIndex++)
+    {
+        getTestLeafDigest(digestIndex, digests[digestIndex]);
+    }
+    unsigned int previousLevelBeginning = 0;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    return digests;
+}
+
+TEST(TestCoreDigestTree, ComputeDigestTree)
+{
+    constexpr unsigned int numberOfLeafs = 4096;
+    leafData.resize(numberOfLeafs * 64);
+    for (size_t i = 0; i < leafData.size(); ++i)
+        leafData[i] = (unsigned char)(i * 7 + (i >> 9));
+    const std::vector<m256i> expected = computeDigestTreeSequentially(numberOfLeafs);
+
+    for (int parallel = 0; parallel < 2; ++parallel)
+    {
+        runOnIdleProcessors = (parallel) ? runOnTestThreads : nullptr;
+        for (unsigned long long leafsPerTask : { 1ULL, 2ULL, 64ULL, 4096ULL, 65536ULL })
+        {
+            std::vector<m256i> digests(numberOfLeafs * 2 - 1, m256i::zero());
+            computeDigestTree(digests.data(), numberOfLeafs, getTestLeafDigest, leafsPerTask);
+            EXPECT_TRUE(digests == expected) << "leafsPerTask " << leafsPerTask << ", parallel " << parallel;
+        }
+    }
+    runOnIdleProcessors = nullptr;
+}
+
+TEST(TestCoreDigestTree, ChecksumAndTrustedDigests)
+{
+    std::vector<unsigned char> data(40 * 1024 * 1024 + 123);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (unsigned char)(i ^ (i >> 11));
+
+    // checksum is independent of number of processors
+    m256i checksum, parallelChecksum;
+    EXPECT_TRUE(computeChecksum(data.data(), data.size(), checksum));
+    runOnIdleProcessors = runOnTestThreads;
+    EXPECT_TRUE(computeChecksum(data.data(), data.size(), parallelChecksum));
+    runOnIdleProcessors = nullptr;
+    EXPECT_EQ(checksum, parallelChecksum);
+
+    data[data.size() - 1] ^= 1;
+    EXPECT_TRUE(computeChecksum(data.data(), data.size(), parallelChecksum));
+    EXPECT_NE(checksum, parallelChecksum);
+
+    const CHAR16* directory = L"test_digest_tree";
+    std::vector<m256i> digests(255), loaded(255);
+    for (size_t i = 0; i < digests.size(); ++i)
+        digests[i].m256i_u64[0] = i + 1;
+    EXPECT_FALSE(loadDigestTree(L"digests.dat", directory, data.data(), data.size(), loaded.data(), loaded.size() * sizeof(m256i)));
+    EXPECT_TRUE(saveDigestTree(L"digests.dat", directory, data.data(), data.size(), digests.data(), digests.size() * sizeof(m256i)));
+    EXPECT_TRUE(loadDigestTree(L"digests.dat", directory, data.data(), data.size(), loaded.data(), loaded.size() * sizeof(m256i)));
+    EXPECT_TRUE(loaded == digests);
+
+    // digests saved for different data or with different size are not loaded
+    data[0] ^= 1;
+    EXPECT_FALSE(loadDigestTree(L"digests.dat", directory, data.data(), data.size(), loaded.data(), loaded.size() * sizeof(m256i)));
+    data[0] ^= 1;
+    EXPECT_FALSE(loadDigestTree(L"digests.dat", directory, data.data(), data.size() - 1, loaded.data(), loaded.size() * sizeof(m256i)));
+    EXPECT_FALSE(loadDigestTree(L"digests.dat", directory, data.data(), data.size(), loaded.data(), (loaded.size() - 1) * sizeof(m256i)));
+
+    remove("test_digest_tree/digests.dat");
+}
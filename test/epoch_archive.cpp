@@ -0,0 +1,252 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/epoch_archive.h"
+
+#include <memory>
+#include <vector>
+
+
+static std::vector<unsigned char> makeTransaction(unsigned int tick, unsigned short inputSize, unsigned char seed)
+{
+    std::vector<unsigned char> buffer(sizeof(Transaction) + inputSize + SIGNATURE_SIZE);
+    for (size_t i = 0; i < buffer.size(); ++i)
+        buffer[i] = (unsigned char)(i * 13 + seed);
+    Transaction* transaction = (Transaction*)buffer.data();
+    transaction->amount = seed * 1000;
+    transaction->tick = tick;
+    transaction->inputType = seed;
+    transaction->inputSize = inputSize;
+    return buffer;
+}
+
+static std::vector<unsigned char> loadArchive(const CHAR16* fileName, const CHAR16* directory)
+{
+    const long long size = getFileSize(fileName, directory);
+    std::vector<unsigned char> data((size > 0) ? size : 0);
+    if (size > 0)
+        EXPECT_EQ(load(fileName, data.size(), data.data(), directory), size);
+    return data;
+}
+
+TEST(TestCoreEpochArchive, WriteAndRead)
+{
+    const CHAR16* directory = L"test_epoch_archive";
+    constexpr unsigned int maxTicks = 4;
+    EpochArchiveWriter writer;
+    ASSERT_TRUE(writer.init(directory, maxTicks, EpochArchiveWriter::maxRecordSize()));
+    writer.beginEpoch(123, 1000);
+
+    std::unique_ptr<TickData> tickData(new TickData);
+    setMem(tickData.get(), sizeof(TickData), 0);
+    tickData->epoch = 123;
+    tickData->tick = 1000;
+    Tick quorumTick;
+    setMem(&quorumTick, sizeof(quorumTick), 0);
+    quorumTick.prevSpectrumDigest.m256i_u64[0] = 42;
+    quorumTick.transactionDigest.m256i_u64[0] = 43;
+
+    std::vector<unsigned char> transactions[3] = { makeTransaction(1000, 0, 1), makeTransaction(1000, 5, 2), makeTransaction(1000, 100, 3) };
+    const Transaction* transactionPtrs[3];
+    for (int i = 0; i < 3; ++i)
+        transactionPtrs[i] = (const Transaction*)transactions[i].data();
+
+    // tick with transactions, empty tick, tick data without transactions
+    EXPECT_TRUE(writer.addTick(1000, tickData.get(), quorumTick, 451, transactionPtrs, 3));
+    EXPECT_TRUE(writer.addTick(1001, nullptr, quorumTick, 500, nullptr, 0));
+    writer.flush();
+    tickData->tick = 1003;
+    EXPECT_TRUE(writer.addTick(1003, tickData.get(), quorumTick, 460, nullptr, 0));
+    writer.flush();
+    EXPECT_EQ(writer.recordCount(), 3);
+    EXPECT_FALSE(writer.isIncomplete());
+
+    // before end of epoch, records can be read without index
+    std::vector<unsigned char> data = loadArchive(L"archive.123", directory);
+    EpochArchiveReader reader;
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    EXPECT_FALSE(reader.hasIndex());
+    EXPECT_EQ(reader.getHeader().epoch, 123);
+    EXPECT_EQ(reader.getHeader().initialTick, 1000);
+    EpochArchiveReader::TickView tick;
+    unsigned int ticksRead = 0;
+    while (reader.nextTick(tick))
+        ++ticksRead;
+    EXPECT_EQ(ticksRead, 3);
+    EXPECT_TRUE(reader.isComplete());
+
+    writer.endEpoch();
+    EXPECT_TRUE(writer.isEnding());
+    writer.flush();
+    EXPECT_FALSE(writer.isEnding());
+
+    data = loadArchive(L"archive.123", directory);
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    ASSERT_TRUE(reader.hasIndex());
+    EXPECT_EQ(reader.getFooter().numberOfRecords, 3);
+    EXPECT_EQ(reader.getFooter().incomplete, 0);
+
+    ASSERT_TRUE(reader.nextTick(tick));
+    EXPECT_EQ(tick.record.tick, 1000);
+    EXPECT_EQ(tick.record.numberOfQuorumVotes, 451);
+    EXPECT_EQ(tick.record.numberOfTransactions, 3);
+    EXPECT_EQ(tick.quorumTick.prevSpectrumDigest.m256i_u64[0], 42);
+    EXPECT_EQ(tick.quorumTick.transactionDigest.m256i_u64[0], 43);
+    ASSERT_NE(tick.tickData, nullptr);
+    unsigned int tickOfTickData;
+    copyMem(&tickOfTickData, tick.tickData + offsetof(TickData, tick), sizeof(tickOfTickData));
+    EXPECT_EQ(tickOfTickData, 1000);
+    const unsigned char* ptr = tick.transactions;
+    for (int i = 0; i < 3; ++i)
+    {
+        Transaction transaction;
+        const unsigned char* next = EpochArchiveReader::nextTransaction(ptr, transaction);
+        EXPECT_EQ(transaction.totalSize(), transactions[i].size());
+        EXPECT_EQ(memcmp(ptr, transactions[i].data(), transactions[i].size()), 0);
+        EXPECT_EQ((next - ptr) % 8, 0);
+        ptr = next;
+    }
+    EXPECT_EQ(ptr, data.data() + tick.fileOffset + tick.record.size);
+
+    ASSERT_TRUE(reader.nextTick(tick));
+    EXPECT_EQ(tick.record.tick, 1001);
+    EXPECT_EQ(tick.tickData, nullptr);
+    EXPECT_EQ(tick.record.numberOfTransactions, 0);
+
+    ASSERT_TRUE(reader.nextTick(tick));
+    EXPECT_EQ(tick.record.tick, 1003);
+    ASSERT_NE(tick.tickData, nullptr);
+    EXPECT_EQ(memcmp(tick.tickData, tickData.get(), sizeof(TickData)), 0);
+
+    EXPECT_FALSE(reader.nextTick(tick));
+    EXPECT_TRUE(reader.isComplete());
+
+    // random access with index
+    const EpochArchiveIndexEntry entry = reader.indexEntry(1);
+    EXPECT_EQ(entry.tick, 1001);
+    reader.seek(entry.fileOffset);
+    ASSERT_TRUE(reader.nextTick(tick));
+    EXPECT_EQ(tick.record.tick, 1001);
+
+    // corrupted record is detected
+    data[reader.indexEntry(2).fileOffset + sizeof(EpochArchiveTickRecord) + 10] ^= 1;
+    reader.seek(reader.indexEntry(2).fileOffset);
+    EXPECT_FALSE(reader.nextTick(tick));
+    EXPECT_FALSE(reader.isComplete());
+
+    // corrupted index is detected
+    data[reader.getFooter().indexOffset] ^= 1;
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    EXPECT_FALSE(reader.hasIndex());
+
+    // new epoch overwrites file, ticks exceeding the limit are dropped and reported in footer
+    writer.beginEpoch(123, 2000);
+    for (unsigned int t = 2000; t < 2000 + maxTicks; ++t)
+        EXPECT_TRUE(writer.addTick(t, nullptr, quorumTick, 451, nullptr, 0));
+    EXPECT_FALSE(writer.addTick(2000 + maxTicks, nullptr, quorumTick, 451, nullptr, 0));
+    EXPECT_TRUE(writer.isIncomplete());
+    writer.endEpoch();
+    writer.flush();
+
+    data = loadArchive(L"archive.123", directory);
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    ASSERT_TRUE(reader.hasIndex());
+    EXPECT_EQ(reader.getHeader().initialTick, 2000);
+    EXPECT_EQ(reader.getFooter().numberOfRecords, maxTicks);
+    EXPECT_EQ(reader.getFooter().incomplete, 1);
+    ticksRead = 0;
+    while (reader.nextTick(tick))
+        EXPECT_EQ(tick.record.tick, 2000 + ticksRead++);
+    EXPECT_EQ(ticksRead, maxTicks);
+    EXPECT_TRUE(reader.isComplete());
+
+    writer.deinit();
+    remove("test_epoch_archive/archive.123");
+}
+
+TEST(TestCoreEpochArchive, ReopenAfterRestart)
+{
+    const CHAR16* directory = L"test_epoch_archive";
+    Tick quorumTick;
+    setMem(&quorumTick, sizeof(quorumTick), 0);
+    EpochArchiveReader reader;
+    EpochArchiveReader::TickView tick;
+
+    {
+        EpochArchiveWriter writer;
+        ASSERT_TRUE(writer.init(directory, 100, EpochArchiveWriter::maxRecordSize()));
+        writer.beginEpoch(124, 1000);
+        for (unsigned int t = 1000; t < 1003; ++t)
+            EXPECT_TRUE(writer.addTick(t, nullptr, quorumTick, 451, nullptr, 0));
+        writer.flush();
+        writer.deinit();
+    }
+
+    // node stopped while writing a record
+    const long long sizeOfRecords = getFileSize(L"archive.124", directory);
+    const unsigned char partialRecord[20] = { 0x54, 0x49, 0x43, 0x4b };
+    EXPECT_EQ(append(L"archive.124", sizeof(partialRecord), partialRecord, directory), sizeof(partialRecord));
+
+    // restarted node continues file, cuts off partial record, and skips ticks that are already archived
+    {
+        EpochArchiveWriter writer;
+        ASSERT_TRUE(writer.init(directory, 100, EpochArchiveWriter::maxRecordSize()));
+        writer.beginEpoch(124, 1000);
+        EXPECT_TRUE(writer.reopen(1002));
+        EXPECT_EQ(writer.recordCount(), 3);
+        EXPECT_EQ(getFileSize(L"archive.124", directory), sizeOfRecords);
+        for (unsigned int t = 1002; t < 1005; ++t)
+            EXPECT_TRUE(writer.addTick(t, nullptr, quorumTick, 451, nullptr, 0));
+        EXPECT_EQ(writer.recordCount(), 5);
+        writer.endEpoch();
+        writer.flush();
+        EXPECT_FALSE(writer.isEnding());
+        EXPECT_FALSE(writer.isIncomplete());
+        writer.deinit();
+    }
+
+    std::vector<unsigned char> data = loadArchive(L"archive.124", directory);
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    ASSERT_TRUE(reader.hasIndex());
+    EXPECT_EQ(reader.getFooter().numberOfRecords, 5);
+    EXPECT_EQ(reader.getFooter().incomplete, 0);
+    unsigned int ticksRead = 0;
+    while (reader.nextTick(tick))
+        EXPECT_EQ(tick.record.tick, 1000 + ticksRead++);
+    EXPECT_EQ(ticksRead, 5);
+    EXPECT_TRUE(reader.isComplete());
+    EXPECT_EQ(reader.indexEntry(4).tick, 1004);
+
+    // restart later in the epoch: index of ended epoch is cut off, missing ticks are reported in footer
+    {
+        EpochArchiveWriter writer;
+        ASSERT_TRUE(writer.init(directory, 100, EpochArchiveWriter::maxRecordSize()));
+        writer.beginEpoch(124, 1000);
+        EXPECT_TRUE(writer.reopen(1010));
+        EXPECT_EQ(writer.recordCount(), 5);
+        EXPECT_TRUE(writer.isIncomplete());
+        EXPECT_TRUE(writer.addTick(1010, nullptr, quorumTick, 451, nullptr, 0));
+        writer.endEpoch();
+        writer.flush();
+        writer.deinit();
+    }
+
+    data = loadArchive(L"archive.124", directory);
+    ASSERT_TRUE(reader.init(data.data(), data.size()));
+    ASSERT_TRUE(reader.hasIndex());
+    EXPECT_EQ(reader.getFooter().numberOfRecords, 6);
+    EXPECT_EQ(reader.getFooter().incomplete, 1);
+    EXPECT_EQ(reader.indexEntry(5).tick, 1010);
+
+    // archive of other epoch is not continued
+    {
+        EpochArchiveWriter writer;
+        ASSERT_TRUE(writer.init(directory, 100, EpochArchiveWriter::maxRecordSize()));
+        writer.beginEpoch(124, 2000);
+        EXPECT_FALSE(writer.reopen(2000));
+        writer.deinit();
+    }
+
+    remove("test_epoch_archive/archive.124");
+}
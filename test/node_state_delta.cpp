@@ -0,0 +1,100 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/node_state_delta.h"
+
+#include <vector>
+
+
+TEST(TestCoreNodeStateDelta, DirtyPageBitmap)
+{
+    DirtyPageBitmap<256> bitmap;
+    bitmap.clearAll();
+    EXPECT_EQ(bitmap.pages(), 256);
+    EXPECT_EQ(bitmap.countDirtyPages(), 0);
+
+    bitmap.markPage(0);
+    bitmap.markPage(63);
+    bitmap.markPage(64);
+    bitmap.markPage(255);
+    EXPECT_EQ(bitmap.countDirtyPages(), 4);
+    EXPECT_TRUE(bitmap.isPageDirty(63));
+    EXPECT_TRUE(bitmap.isPageDirty(64));
+    EXPECT_FALSE(bitmap.isPageDirty(65));
+
+    unsigned long long flags[4] = { 0, 0x3, 0, 0x8000000000000000ULL };
+    bitmap.markPages(flags);
+    EXPECT_EQ(bitmap.countDirtyPages(), 5);
+    EXPECT_TRUE(bitmap.isPageDirty(65));
+
+    bitmap.markAll();
+    EXPECT_EQ(bitmap.countDirtyPages(), 256);
+    bitmap.clearAll();
+    EXPECT_EQ(bitmap.countDirtyPages(), 0);
+}
+
+TEST(TestCoreNodeStateDelta, WriteAndApplyDelta)
+{
+    constexpr unsigned int pageSize = 16;
+    constexpr unsigned long long numberOfPages = 128;
+    std::vector<unsigned char> region(pageSize * numberOfPages), restored(pageSize * numberOfPages, 0);
+    for (size_t i = 0; i < region.size(); ++i)
+        region[i] = (unsigned char)(i * 7 + 1);
+
+    DirtyPageBitmap<numberOfPages> dirtyPages;
+    dirtyPages.clearAll();
+    dirtyPages.markPage(3);
+    dirtyPages.markPage(4);
+    dirtyPages.markPage(5);
+    dirtyPages.markPage(100);
+
+    std::vector<unsigned char> buffer(4096);
+    NodeStateDeltaWriter writer;
+    writer.init(buffer.data(), buffer.size(), 123, 2, 4567);
+    EXPECT_TRUE(writer.addDirtyPages(1, dirtyPages, region.data(), pageSize));
+    const unsigned char small[3] = { 1, 2, 3 };
+    EXPECT_TRUE(writer.addRecord(7, 11, small, sizeof(small)));
+
+    // consecutive dirty pages are merged
+    EXPECT_EQ(writer.numberOfRecords(), 3);
+    EXPECT_EQ(writer.size(), sizeof(NodeStateDeltaHeader) + 3 * sizeof(NodeStateDeltaRecord) + 3 * pageSize + pageSize + 8);
+
+    // wrong epoch or sequence number is rejected
+    NodeStateDeltaReader reader;
+    EXPECT_FALSE(reader.init(buffer.data(), writer.size(), 124, 2));
+    EXPECT_FALSE(reader.init(buffer.data(), writer.size(), 123, 1));
+    EXPECT_FALSE(reader.init(buffer.data(), writer.size() - 8, 123, 2));
+
+    ASSERT_TRUE(reader.init(buffer.data(), writer.size(), 123, 2));
+    EXPECT_EQ(reader.getHeader().tick, 4567);
+    unsigned int records = 0;
+    while (const NodeStateDeltaRecord* record = reader.nextRecord())
+    {
+        ++records;
+        if (record->type == 1)
+        {
+            ASSERT_LE(record->offset + record->size, restored.size());
+            memcpy(restored.data() + record->offset, NodeStateDeltaReader::recordData(record), record->size);
+        }
+        else
+        {
+            EXPECT_EQ(record->type, 7);
+            EXPECT_EQ(record->offset, 11);
+            EXPECT_EQ(record->size, 3);
+            EXPECT_EQ(memcmp(NodeStateDeltaReader::recordData(record), small, 3), 0);
+        }
+    }
+    EXPECT_EQ(records, 3);
+    EXPECT_TRUE(reader.isComplete());
+
+    for (unsigned long long page = 0; page < numberOfPages; ++page)
+    {
+        const bool expectRestored = dirtyPages.isPageDirty(page);
+        EXPECT_EQ(memcmp(restored.data() + page * pageSize, region.data() + page * pageSize, pageSize) == 0, expectRestored);
+    }
+
+    // capacity exceeded
+    writer.init(buffer.data(), 64, 123, 1, 4567);
+    EXPECT_FALSE(writer.addDirtyPages(1, dirtyPages, region.data(), pageSize));
+}
@@ -0,0 +1,362 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/outbound_queue.h"
+#include "../src/network_messages/assets.h"
+#include "../src/network_messages/contract.h"
+
+#include <algorithm>
+#include <vector>
+
+
+static std::vector<unsigned char> makeMessage(unsigned char type, unsigned int payloadSize, unsigned int dejavu)
+{
+    std::vector<unsigned char> buffer(sizeof(RequestResponseHeader) + payloadSize);
+    for (size_t i = sizeof(RequestResponseHeader); i < buffer.size(); ++i)
+        buffer[i] = (unsigned char)(i + type);
+    RequestResponseHeader* header = (RequestResponseHeader*)buffer.data();
+    header->checkAndSetSize((unsigned int)buffer.size());
+    header->setType(type);
+    header->setDejavu(dejavu);
+    return buffer;
+}
+
+// Split transmitted data into message types
+static std::vector<unsigned char> messageTypes(const std::vector<char>& fragment, unsigned int size)
+{
+    std::vector<unsigned char> types;
+    for (unsigned int offset = 0; offset < size; )
+    {
+        const RequestResponseHeader* header = (const RequestResponseHeader*)&fragment[offset];
+        types.push_back(header->type());
+        offset += header->size();
+    }
+    return types;
+}
+
+TEST(TestCoreOutboundQueue, ConsensusBeforeQueries)
+{
+    initOutboundPriorities();
+    setMem(outboundQueueingTimeMax, sizeof(outboundQueueingTimeMax), 0);
+    constexpr unsigned int memorySize = 8 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(queue.fill(fragment.data(), 0), 0);
+
+    // many query responses are queued before a tick
+    const std::vector<unsigned char> query = makeMessage(RespondOwnedAssets::type, 60000, 1);
+    for (int i = 0; i < 50; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 100, true), OUTBOUND_PUSHED);
+    const std::vector<unsigned char> tick = makeMessage(BroadcastTick::type, sizeof(Tick), 2);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 200, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.size(), 50 * query.size() + tick.size());
+
+    // tick is sent first, queries only up to quantum in one transmission
+    unsigned int size = queue.fill(fragment.data(), 1000);
+    std::vector<unsigned char> types = messageTypes(fragment, size);
+    ASSERT_EQ(types.size(), 1 + outboundQuantum[OUTBOUND_PRIORITY_QUERIES] / query.size());
+    EXPECT_EQ(types[0], BroadcastTick::type);
+    EXPECT_EQ(types[1], RespondOwnedAssets::type);
+    EXPECT_EQ(memcmp(fragment.data(), tick.data(), tick.size()), 0);
+    EXPECT_EQ(memcmp(fragment.data() + tick.size(), query.data(), query.size()), 0);
+    EXPECT_EQ(outboundQueueingTimeMax[OUTBOUND_PRIORITY_CONSENSUS], 800);
+    EXPECT_EQ(outboundQueueingTimeMax[OUTBOUND_PRIORITY_QUERIES], 900);
+
+    // compact votes of catching-up nodes are consensus messages as well
+    EXPECT_EQ(outboundPriorityOfMessageType[CompactQuorumTick::type], OUTBOUND_PRIORITY_CONSENSUS);
+
+    // tick pushed later is sent before remaining queries
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 2000, true), OUTBOUND_PUSHED);
+    size = queue.fill(fragment.data(), 3000);
+    types = messageTypes(fragment, size);
+    EXPECT_EQ(types[0], BroadcastTick::type);
+
+    unsigned int numberOfQueries = 0;
+    while (!queue.isEmpty())
+    {
+        size = queue.fill(fragment.data(), 4000);
+        ASSERT_GT(size, 0);
+        types = messageTypes(fragment, size);
+        numberOfQueries += (unsigned int)types.size();
+    }
+    EXPECT_EQ(numberOfQueries, 50 - 2 * (outboundQuantum[OUTBOUND_PRIORITY_QUERIES] / query.size()));
+    EXPECT_EQ(queue.size(), 0);
+}
+
+TEST(TestCoreOutboundQueue, WeightedRoundRobin)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 32 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    const std::vector<unsigned char> transaction = makeMessage(BROADCAST_TRANSACTION, 1000, 3);
+    const std::vector<unsigned char> query = makeMessage(RespondContractFunction::type, 1000, 4);
+    for (int i = 0; i < 2000; ++i)
+    {
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_PUSHED);
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+    }
+
+    // bandwidth is shared according to quantums
+    unsigned long long transactionBytes = 0, queryBytes = 0;
+    for (int round = 0; round < 3; ++round)
+    {
+        const unsigned int size = queue.fill(fragment.data(), 0);
+        for (unsigned char type : messageTypes(fragment, size))
+        {
+            if (type == BROADCAST_TRANSACTION)
+                transactionBytes += transaction.size();
+            else
+                queryBytes += query.size();
+        }
+    }
+    EXPECT_EQ(transactionBytes / transaction.size(), 3 * outboundQuantum[OUTBOUND_PRIORITY_TRANSACTIONS] / transaction.size());
+    EXPECT_EQ(queryBytes / query.size(), 3 * outboundQuantum[OUTBOUND_PRIORITY_QUERIES] / query.size());
+
+    // message larger than quantum is sent after several rounds
+    queue.reset();
+    const std::vector<unsigned char> largeQuery = makeMessage(RespondContractFunction::type, 3 * outboundQuantum[OUTBOUND_PRIORITY_QUERIES], 5);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)largeQuery.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.fill(fragment.data(), 0), largeQuery.size());
+    EXPECT_TRUE(queue.isEmpty());
+
+    // buffer of class is full, other classes are not affected
+    while (queue.push((const RequestResponseHeader*)transaction.data(), 0, true) == OUTBOUND_PUSHED)
+        ;
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.size(OUTBOUND_PRIORITY_TRANSACTIONS), memorySize / 8 / (transaction.size() + 8) * transaction.size());
+
+    // space freed by transmission is reused (rest of response with dropped message is still dropped)
+    queue.fill(fragment.data(), 0);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_DROPPED);
+    const std::vector<unsigned char> otherTransaction = makeMessage(BROADCAST_TRANSACTION, 1000, 6);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)otherTransaction.data(), 0, true), OUTBOUND_PUSHED);
+}
+
+TEST(TestCoreOutboundQueue, EndResponseKeepsOrder)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 32 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    // response to RequestTickTransactions with more transactions than one round
+    const std::vector<unsigned char> transaction = makeMessage(BROADCAST_TRANSACTION, 1000, 77);
+    const unsigned int numberOfTransactions = 2 * outboundQuantum[OUTBOUND_PRIORITY_TRANSACTIONS] / (unsigned int)transaction.size();
+    for (unsigned int i = 0; i < numberOfTransactions; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_PUSHED);
+    const std::vector<unsigned char> endResponse = makeMessage(EndResponse::type, 0, 77);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)endResponse.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.size(OUTBOUND_PRIORITY_TRANSACTIONS), numberOfTransactions * transaction.size() + endResponse.size());
+
+    // EndResponse of other request without data is a query
+    const std::vector<unsigned char> otherEndResponse = makeMessage(EndResponse::type, 0, 78);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)otherEndResponse.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.size(OUTBOUND_PRIORITY_QUERIES), otherEndResponse.size());
+
+    std::vector<unsigned char> types;
+    while (!queue.isEmpty())
+    {
+        const unsigned int size = queue.fill(fragment.data(), 0);
+        const std::vector<unsigned char> fragmentTypes = messageTypes(fragment, size);
+        types.insert(types.end(), fragmentTypes.begin(), fragmentTypes.end());
+    }
+    ASSERT_EQ(types.size(), numberOfTransactions + 2);
+    EXPECT_EQ(types.back(), EndResponse::type);
+    EXPECT_EQ(std::count(types.begin(), types.end(), (unsigned char)BROADCAST_TRANSACTION), numberOfTransactions);
+}
+
+TEST(TestCoreOutboundQueue, FlowControl)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 8 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    // queries exceeding high watermark make peer congested
+    const std::vector<unsigned char> query = makeMessage(RespondOwnedAssets::type, 100000, 11);
+    unsigned int numberOfQueries = 0;
+    while (!queue.isCongested())
+    {
+        ASSERT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+        ++numberOfQueries;
+    }
+    EXPECT_GT(queue.size(), memorySize / 8 * outboundHighWatermarkEighths);
+
+    // rest of response is dropped including EndResponse, other classes are still accepted
+    const std::vector<unsigned char> otherQuery = makeMessage(RespondOwnedAssets::type, 100, 12);
+    const std::vector<unsigned char> endResponse = makeMessage(EndResponse::type, 0, 11);
+    const std::vector<unsigned char> transaction = makeMessage(BROADCAST_TRANSACTION, 1000, 13);
+    const std::vector<unsigned char> tick = makeMessage(BroadcastTick::type, sizeof(Tick), 14);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)otherQuery.data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)endResponse.data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.size(OUTBOUND_PRIORITY_QUERIES), numberOfQueries * query.size());
+
+    // congestion ends when buffered data is below low watermark
+    while (queue.isCongested())
+    {
+        ASSERT_GT(queue.fill(fragment.data(), 0), 0);
+        if (queue.isCongested())
+            EXPECT_GE(queue.size(), memorySize / 8 * outboundLowWatermarkEighths);
+    }
+    EXPECT_LT(queue.size(), memorySize / 8 * outboundLowWatermarkEighths);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)otherQuery.data(), 0, true), OUTBOUND_PUSHED);
+
+    // transactions are dropped if their buffer is full, peer needs to be closed if consensus buffer is full
+    while (queue.push((const RequestResponseHeader*)transaction.data(), 0, true) == OUTBOUND_PUSHED)
+        ;
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_DROPPED);
+    OutboundPushResult result;
+    while ((result = queue.push((const RequestResponseHeader*)tick.data(), 0, true)) == OUTBOUND_PUSHED)
+        ;
+    EXPECT_EQ(result, OUTBOUND_FULL);
+}
+
+TEST(TestCoreOutboundQueue, DejavuCollision)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 8 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    // make peer congested with response that has the same lower bits of the dejavu as the following responses
+    const std::vector<unsigned char> query = makeMessage(RespondOwnedAssets::type, 100000, 11);
+    while (!queue.isCongested())
+        ASSERT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_DROPPED);
+
+    // other responses of same set do not make the rest of the dropped response look complete
+    const std::vector<unsigned char> otherQuery = makeMessage(RespondOwnedAssets::type, 100, 11 + 64);
+    const std::vector<unsigned char> transaction = makeMessage(BROADCAST_TRANSACTION, 1000, 11 + 128);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)otherQuery.data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(EndResponse::type, 0, 11).data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(EndResponse::type, 0, 11 + 64).data(), 0, true), OUTBOUND_DROPPED);
+
+    // if all entries of a set belong to dropped responses, new responses of the set are dropped as well
+    for (unsigned int i = 0; i < OutboundQueue::recentResponseWays; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(RespondOwnedAssets::type, 100, 5 + i * 16).data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 5 + 64).data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BroadcastTick::type, sizeof(Tick), 5 + 64).data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 6).data(), 0, true), OUTBOUND_PUSHED);
+
+    while (queue.isCongested())
+        ASSERT_GT(queue.fill(fragment.data(), 0), 0);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 5 + 64).data(), 0, true), OUTBOUND_PUSHED);
+    while (!queue.isEmpty())
+        queue.fill(fragment.data(), 0);
+
+    // least recently used entry is replaced, so EndResponse of a response with more recent data keeps its priority
+    const std::vector<unsigned char> responseTransaction = makeMessage(BROADCAST_TRANSACTION, 1000, 7);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)responseTransaction.data(), 0, true), OUTBOUND_PUSHED);
+    for (unsigned int i = 1; i < OutboundQueue::recentResponseWays; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(RespondOwnedAssets::type, 100, 7 + i * 16).data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)responseTransaction.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(RespondOwnedAssets::type, 100, 7 + 64).data(), 0, true), OUTBOUND_PUSHED);
+    const unsigned long long transactionSize = queue.size(OUTBOUND_PRIORITY_TRANSACTIONS);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(EndResponse::type, 0, 7).data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.size(OUTBOUND_PRIORITY_TRANSACTIONS), transactionSize + sizeof(RequestResponseHeader));
+}
+
+TEST(TestCoreOutboundQueue, DroppedEntriesAreReleased)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 8 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    // broadcasts dropped because transaction buffer is full do not block later responses of peer that is not congested
+    while (queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 1000).data(), 0, false) == OUTBOUND_PUSHED)
+        ;
+    for (unsigned int i = 0; i < 200; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 2000 + i).data(), 0, false), OUTBOUND_DROPPED);
+    EXPECT_FALSE(queue.isCongested());
+    for (unsigned int i = 0; i < 64; ++i)
+    {
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(RespondOwnedAssets::type, 100, 3000 + i).data(), 0, true), OUTBOUND_PUSHED);
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(EndResponse::type, 0, 3000 + i).data(), 0, true), OUTBOUND_PUSHED);
+    }
+
+    // dropped responses without EndResponse (such as single transactions) block their set only until they age out
+    for (unsigned int i = 0; i < 64; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BROADCAST_TRANSACTION, 1000, 4000 + i).data(), 0, true), OUTBOUND_DROPPED);
+    EXPECT_FALSE(queue.isCongested());
+    const std::vector<unsigned char> query = makeMessage(RespondOwnedAssets::type, 100, 5000);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_DROPPED);
+    for (unsigned int i = 0; i < OutboundQueue::recentResponseMaxAge; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(BroadcastTick::type, sizeof(Tick), 6000 + i).data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)makeMessage(EndResponse::type, 0, 5000).data(), 0, true), OUTBOUND_PUSHED);
+}
+
+TEST(TestCoreOutboundQueue, BatchedMessages)
+{
+    initOutboundPriorities();
+    constexpr unsigned int memorySize = 8 * 1024 * 1024;
+    std::vector<char> memory(memorySize), fragment(memorySize);
+    OutboundQueue queue;
+    queue.init(memory.data(), memorySize);
+
+    // ticks and small transactions are packed into containers per class, large messages and single ones are not
+    const std::vector<unsigned char> tick = makeMessage(BroadcastTick::type, sizeof(Tick), 1);
+    const std::vector<unsigned char> transaction = makeMessage(BROADCAST_TRANSACTION, 200, 0);
+    const std::vector<unsigned char> query = makeMessage(RespondOwnedAssets::type, 60000, 2);
+    const std::vector<unsigned char> endResponse = makeMessage(EndResponse::type, 0, 2);
+    for (int i = 0; i < 3; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 0, true), OUTBOUND_PUSHED);
+    for (int i = 0; i < 500; ++i)
+        EXPECT_EQ(queue.push((const RequestResponseHeader*)transaction.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)query.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)endResponse.data(), 0, true), OUTBOUND_PUSHED);
+    const unsigned long long queuedSize = queue.size();
+
+    unsigned int size = queue.fill(fragment.data(), 0, true);
+    EXPECT_TRUE(queue.isEmpty());
+    std::vector<unsigned char> types = messageTypes(fragment, size);
+    ASSERT_EQ(types.size(), 5);
+    EXPECT_EQ(types[0], BatchedMessages::type);
+    EXPECT_EQ(types[1], BatchedMessages::type);
+    EXPECT_EQ(types[2], BatchedMessages::type);
+    EXPECT_EQ(types[3], RespondOwnedAssets::type);
+    EXPECT_EQ(types[4], EndResponse::type);
+    EXPECT_EQ(size, queuedSize + 3 * sizeof(RequestResponseHeader));
+
+    // unpacking the containers yields the original messages in order
+    std::vector<unsigned char> unpackedTypes;
+    unsigned int offset = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        const RequestResponseHeader* batch = (const RequestResponseHeader*)&fragment[offset];
+        EXPECT_LE(batch->size(), outboundMaxBatchSize);
+        const std::vector<char> payload(fragment.begin() + offset + sizeof(RequestResponseHeader), fragment.begin() + offset + batch->size());
+        const std::vector<unsigned char> batchedTypes = messageTypes(payload, (unsigned int)payload.size());
+        unpackedTypes.insert(unpackedTypes.end(), batchedTypes.begin(), batchedTypes.end());
+        offset += batch->size();
+    }
+    ASSERT_EQ(unpackedTypes.size(), 503);
+    EXPECT_EQ(std::count(unpackedTypes.begin(), unpackedTypes.begin() + 3, BroadcastTick::type), 3);
+    EXPECT_EQ(std::count(unpackedTypes.begin() + 3, unpackedTypes.end(), BROADCAST_TRANSACTION), 500);
+    EXPECT_EQ(memcmp(&fragment[sizeof(RequestResponseHeader)], tick.data(), tick.size()), 0);
+
+    // single small message and messages to peers without support are not packed
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 0, true), OUTBOUND_PUSHED);
+    size = queue.fill(fragment.data(), 0, true);
+    EXPECT_EQ(size, tick.size());
+    EXPECT_EQ(memcmp(fragment.data(), tick.data(), tick.size()), 0);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.push((const RequestResponseHeader*)tick.data(), 0, true), OUTBOUND_PUSHED);
+    EXPECT_EQ(queue.fill(fragment.data(), 0), 2 * tick.size());
+}
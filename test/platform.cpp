@@ -4,6 +4,13 @@
 #include "../src/platform/read_write_lock.h"
 #include "../src/platform/stack_size_tracker.h"
 #include "../src/platform/custom_stack.h"
+#include "../src/platform/compression.h"
+#include "../src/platform/file_io.h"
+#include "../src/platform/histogram.h"
+
+#include <memory>
+#include <random>
+#include <vector>
 
 TEST(TestCoreReadWriteLock, SimpleSingleThread)
 {
@@ -165,3 +172,191 @@ TEST(TestCoreCustomStack, SimpleTest)
     auto size4 = s.maxStackUsed();
     EXPECT_GT(size4, size3);
 }
+
+static std::vector<unsigned char> compressForTest(const std::vector<unsigned char>& raw, unsigned int slotSize)
+{
+    std::unique_ptr<SnapshotCompressor> compressor(new SnapshotCompressor);
+    std::vector<unsigned char> scratch(SnapshotCompressor::scratchSize(slotSize));
+    std::vector<unsigned char> compressed(SnapshotCompressor::compressBound(raw.size(), slotSize));
+    const unsigned long long size = compressor->compress(raw.data(), raw.size(), slotSize, compressed.data(), compressed.size(), scratch.data());
+    EXPECT_GT(size, 0ull);
+    compressed.resize(size);
+    return compressed;
+}
+
+static bool decompressForTest(const std::vector<unsigned char>& compressed, std::vector<unsigned char>& raw)
+{
+    SnapshotDecompressor decompressor;
+    if (!decompressor.init(compressed.data(), compressed.size(), raw.data(), raw.size()))
+        return false;
+    while (decompressor.decodeNextBlock())
+    {
+    }
+    return decompressor.isComplete();
+}
+
+TEST(TestCoreCompression, SparseSlots)
+{
+    // sparse hash map with 64 byte slots spanning multiple blocks
+    constexpr unsigned int slotSize = 64;
+    std::vector<unsigned char> raw(slotSize * 100000, 0);
+    std::mt19937_64 gen(42);
+    for (int i = 0; i < 3000; ++i)
+    {
+        unsigned char* slot = raw.data() + (gen() % 100000) * slotSize;
+        for (unsigned int j = 0; j < 40; ++j)
+            slot[j] = (unsigned char)gen();
+    }
+    // completely filled region
+    for (unsigned int i = 50000 * slotSize; i < 60000 * slotSize; ++i)
+        raw[i] = (unsigned char)(i * 13);
+
+    for (unsigned int testSlotSize : { slotSize, 0u })
+    {
+        std::vector<unsigned char> compressed = compressForTest(raw, testSlotSize);
+        EXPECT_LT(compressed.size(), raw.size() / 4);
+        std::vector<unsigned char> decompressed(raw.size(), 0xcd);
+        EXPECT_TRUE(decompressForTest(compressed, decompressed));
+        EXPECT_TRUE(decompressed == raw);
+    }
+}
+
+TEST(TestCoreCompression, IncompressibleAndCorrupted)
+{
+    std::vector<unsigned char> raw(5 * 1024 * 1024 + 17);
+    std::mt19937_64 gen(1);
+    for (auto& b : raw)
+        b = (unsigned char)gen();
+
+    // random data is stored uncompressed
+    std::vector<unsigned char> compressed = compressForTest(raw, 0);
+    EXPECT_EQ(compressed.size(), SnapshotCompressor::compressBound(raw.size(), 0));
+    std::vector<unsigned char> decompressed(raw.size());
+    EXPECT_TRUE(decompressForTest(compressed, decompressed));
+    EXPECT_TRUE(decompressed == raw);
+
+    // slot size not matching total size is ignored
+    std::vector<unsigned char> zeros(1000, 0);
+    compressed = compressForTest(zeros, 48);
+    EXPECT_EQ(((const CompressedFileHeader*)compressed.data())->slotSize, 0u);
+    decompressed.assign(zeros.size(), 1);
+    EXPECT_TRUE(decompressForTest(compressed, decompressed));
+    EXPECT_TRUE(decompressed == zeros);
+
+    // wrong raw size and corrupted data are detected
+    decompressed.resize(zeros.size() + 1);
+    EXPECT_FALSE(decompressForTest(compressed, decompressed));
+    decompressed.resize(zeros.size());
+    compressed.back() ^= 0x55;
+    EXPECT_FALSE(decompressForTest(compressed, decompressed));
+    compressed.resize(compressed.size() - 1);
+    EXPECT_FALSE(decompressForTest(compressed, decompressed));
+}
+
+TEST(TestCoreCompression, LzRoundTrip)
+{
+    std::unique_ptr<SnapshotCompressor> compressor(new SnapshotCompressor);
+    std::mt19937_64 gen(7);
+    for (unsigned int size : { 0u, 1u, 8u, 9u, 100u, 4096u, 300000u })
+    {
+        // repeating patterns with random parts and long runs
+        std::vector<unsigned char> data(size);
+        for (unsigned int i = 0; i < size; ++i)
+            data[i] = (i % 1000 < 300) ? 0 : ((i % 7 == 0) ? (unsigned char)gen() : (unsigned char)(i % 37));
+        std::vector<unsigned char> compressed(size + size / 255 + 16);
+        const unsigned int compressedSize = compressor->lzCompress(data.data(), size, compressed.data(), (unsigned int)compressed.size());
+        ASSERT_GT(compressedSize, 0u);
+        std::vector<unsigned char> decompressed(size);
+        EXPECT_TRUE(compression::lzDecompress(compressed.data(), compressedSize, decompressed.data(), size));
+        EXPECT_TRUE(decompressed == data);
+        if (size >= 4096)
+            EXPECT_LT(compressedSize, size / 2);
+    }
+}
+
+TEST(TestCoreLatencyHistogram, Percentiles)
+{
+    // buckets cover all values without gaps and are at most 25% wide
+    for (unsigned int bucket = 1; bucket < LatencyHistogram::numberOfBuckets; ++bucket)
+    {
+        const unsigned long long lowerBound = LatencyHistogram::upperBoundOf(bucket - 1) + 1;
+        EXPECT_EQ(LatencyHistogram::bucketOf(lowerBound), bucket);
+        EXPECT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::upperBoundOf(bucket)), bucket);
+        EXPECT_LE(LatencyHistogram::upperBoundOf(bucket) - lowerBound, lowerBound / 4);
+    }
+    EXPECT_EQ(LatencyHistogram::upperBoundOf(LatencyHistogram::numberOfBuckets - 1), 0xFFFFFFFFFFFFFFFFULL);
+
+    std::unique_ptr<LatencyHistogram> histogram(new LatencyHistogram);
+    histogram->reset();
+    EXPECT_EQ(histogram->count(), 0ull);
+    EXPECT_EQ(histogram->percentile(500), 0ull);
+
+    // values 1 to 1000 and one outlier
+    for (unsigned long long value = 1; value <= 1000; ++value)
+        histogram->add(value);
+    histogram->add(1000000);
+    EXPECT_EQ(histogram->count(), 1001ull);
+    EXPECT_EQ(histogram->max(), 1000000ull);
+    for (unsigned int permille : { 500u, 900u, 990u })
+    {
+        const unsigned long long exactValue = (1001ull * permille + 999) / 1000;
+        EXPECT_GE(histogram->percentile(permille), exactValue);
+        EXPECT_LE(histogram->percentile(permille), exactValue + exactValue / 4);
+    }
+    EXPECT_EQ(histogram->percentile(1000), 1000000ull);
+
+    histogram->reset();
+    histogram->add(5);
+    EXPECT_EQ(histogram->percentile(0), 5ull);
+    EXPECT_EQ(histogram->percentile(1000), 5ull);
+}
+
+TEST(TestCoreFileIO, SaveAndLoad)
+{
+    const CHAR16* directory = L"test_file_io";
+    createDir(directory);
+    EXPECT_TRUE(checkDir(directory));
+
+    // blocks are written with current block size, force several blocks and partial last block
+    writingBlockSize = readingBlockSize = WRITING_CHUNK_SIZE;
+    std::vector<unsigned char> data(3 * WRITING_CHUNK_SIZE + 123);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (unsigned char)(i * 31 + (i >> 8));
+    EXPECT_EQ(save(L"raw.dat", data.size(), data.data(), directory), (long long)data.size());
+    EXPECT_EQ(getFileSize(L"raw.dat", directory), (long long)data.size());
+
+    std::vector<unsigned char> loaded(data.size());
+    EXPECT_EQ(load(L"raw.dat", loaded.size(), loaded.data(), directory), (long long)loaded.size());
+    EXPECT_TRUE(loaded == data);
+
+    // loading more than file size and missing files fail
+    loaded.resize(data.size() + 1);
+    EXPECT_LT(load(L"raw.dat", loaded.size(), loaded.data(), directory), 0);
+    EXPECT_LT(load(L"missing.dat", data.size(), loaded.data(), directory), 0);
+    EXPECT_LT(getFileSize(L"missing.dat", directory), 0);
+
+    // non-ASCII file names are rejected in NO_UEFI build instead of being truncated to another name
+    EXPECT_LT(save(L"r\u00e4w.dat", data.size(), data.data(), directory), 0);
+    EXPECT_LT(getFileSize(L"r\u00e4w.dat", directory), 0);
+
+    // compressed file
+    std::vector<unsigned char> sparse(64 * 100000, 0);
+    for (size_t i = 0; i < sparse.size(); i += 64 * 97)
+        sparse[i] = (unsigned char)i | 1;
+    EXPECT_EQ(saveCompressed(L"sparse.dat", sparse.size(), sparse.data(), 64, directory), (long long)sparse.size());
+    const long long compressedSize = getFileSize(L"sparse.dat", directory);
+    EXPECT_GT(compressedSize, 0);
+    EXPECT_LT(compressedSize, (long long)sparse.size() / 4);
+    std::vector<unsigned char> sparseLoaded(sparse.size(), 0xcd);
+    EXPECT_EQ(loadCompressed(L"sparse.dat", sparseLoaded.size(), sparseLoaded.data(), directory), (long long)sparse.size());
+    EXPECT_TRUE(sparseLoaded == sparse);
+
+    // raw file can be loaded with loadCompressed()
+    loaded.resize(data.size());
+    EXPECT_EQ(loadCompressed(L"raw.dat", loaded.size(), loaded.data(), directory), (long long)loaded.size());
+    EXPECT_TRUE(loaded == data);
+
+    writingBlockSize = readingBlockSize = MAX_IO_BLOCK_SIZE;
+    remove("test_file_io/raw.dat");
+    remove("test_file_io/sparse.dat");
+}
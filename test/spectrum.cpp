@@ -238,8 +238,12 @@ void SpectrumTest::dust_attack(unsigned int transferMinAmount, unsigned int tran
 
         // Should trigger anti-dust
         beforeAntiDust();
+        spectrumDirtyPagesSinceSnapshot.clearAll();
         ASSERT_TRUE(transfer(richId, randomId, transferMinAmount));
         afterAntiDust();
+
+        // Reorganization moves entities, so all pages need to be saved in next delta snapshot
+        EXPECT_EQ(spectrumDirtyPagesSinceSnapshot.countDirtyPages(), SPECTRUM_CAPACITY / 64);
     }
 }
 
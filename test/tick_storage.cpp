@@ -7,9 +7,14 @@
 #define MAX_NUMBER_OF_TICKS_PER_EPOCH 50
 #undef TICKS_TO_KEEP_FROM_PRIOR_EPOCH
 #define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 5
+#define TICK_STORAGE_AUTOSAVE_MODE 1
+#define TICK_STORAGE_EAGER_LOAD_TICKS 10
+#define TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS 4
 #include "../src/tick_storage.h"
 
+#include <filesystem>
 #include <random>
+#include <vector>
 
 
 class TestTickStorage : public TickStorage
@@ -43,6 +48,15 @@ public:
 
 TestTickStorage ts;
 
+// Begin epoch and clear all of its storage, which is done step by step by the main loop in the node
+void beginEpochAndClear(unsigned int tick0)
+{
+    ts.beginEpoch(tick0);
+    while (ts.continueClearing())
+    {
+    }
+}
+
 void addTick(unsigned int tick, unsigned long long seed, unsigned short maxTransactions)
 {
     // use pseudo-random sequence
@@ -165,7 +179,7 @@ TEST(TestCoreTickStorage, EpochTransition) {
             thirdEpochSeeds[i] = gen64();
 
         // first epoch
-        ts.beginEpoch(firstEpochTick0);
+        beginEpochAndClear(firstEpochTick0);
         ts.checkStateConsistencyWithAssert();
 
         // add ticks
@@ -177,7 +191,7 @@ TEST(TestCoreTickStorage, EpochTransition) {
             checkTick(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions);
 
         // Epoch transistion
-        ts.beginEpoch(secondEpochTick0);
+        beginEpochAndClear(secondEpochTick0);
         ts.checkStateConsistencyWithAssert();
 
         // add ticks
@@ -192,7 +206,7 @@ TEST(TestCoreTickStorage, EpochTransition) {
             checkTick(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, previousEpoch);
 
         // Epoch transistion
-        ts.beginEpoch(thirdEpochTick0);
+        beginEpochAndClear(thirdEpochTick0);
         ts.checkStateConsistencyWithAssert();
 
         // add ticks
@@ -208,3 +222,186 @@ TEST(TestCoreTickStorage, EpochTransition) {
         ts.deinit();
     }
 }
+
+TEST(TestCoreTickStorage, ClearingInSteps) {
+
+    // each step clears a few MB, which are about 14 ticks with the number of computors of the network
+    constexpr unsigned long long bytesPerTick = sizeof(TickData) + NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned long long) + NUMBER_OF_COMPUTORS * sizeof(Tick);
+    constexpr unsigned int stepTicks = 4 * 1024 * 1024 / bytesPerTick;
+    static_assert(stepTicks < MAX_NUMBER_OF_TICKS_PER_EPOCH, "Test requires multiple steps");
+
+    ts.init();
+    ts.beginEpoch(1000);
+    unsigned int steps = 1;
+    while (ts.isClearing())
+    {
+        EXPECT_TRUE(ts.tickInCurrentEpochStorage(1000 + steps * stepTicks - 1));
+        EXPECT_FALSE(ts.tickInCurrentEpochStorage(1000 + steps * stepTicks));
+        EXPECT_EQ(ts.continueClearing(), (steps + 1) * stepTicks < MAX_NUMBER_OF_TICKS_PER_EPOCH);
+        ++steps;
+    }
+    EXPECT_EQ(steps, (MAX_NUMBER_OF_TICKS_PER_EPOCH + stepTicks - 1) / stepTicks);
+    EXPECT_TRUE(ts.tickInCurrentEpochStorage(1000 + MAX_NUMBER_OF_TICKS_PER_EPOCH - 1));
+    EXPECT_FALSE(ts.continueClearing());
+
+    ts.deinit();
+}
+
+TEST(TestCoreTickStorage, TransactionDigestsOfPreviousEpochRemoved) {
+
+    ts.init();
+    ts.beginEpoch(1000);
+
+    ts.addTransaction(1000, 0, 10);
+    const Transaction* transaction = ts.tickTransactions(ts.tickTransactionOffsets(1000, 0));
+    m256i digest;
+    digest.setRandomValue();
+    ts.transactionsDigestAccess.insertTransaction(digest, transaction);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), transaction);
+
+    // digests of previous epoch are not found after epoch transition
+    ts.beginEpoch(1010);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), nullptr);
+    EXPECT_EQ(ts.tickData.getByTickIfNotEmpty(1010), nullptr);
+
+    ts.addTransaction(1010, 0, 10);
+    transaction = ts.tickTransactions(ts.tickTransactionOffsets(1010, 0));
+    ts.transactionsDigestAccess.insertTransaction(digest, transaction);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), transaction);
+
+    ts.deinit();
+}
+
+TEST(TestCoreTickStorage, TransactionDigestsProbing) {
+
+    ts.init();
+    ts.beginEpoch(1000);
+
+    ts.addTransaction(1000, 0, 10);
+    ts.addTransaction(1000, 1, 20);
+    const Transaction* transaction0 = ts.tickTransactions(ts.tickTransactionOffsets(1000, 0));
+    const Transaction* transaction1 = ts.tickTransactions(ts.tickTransactionOffsets(1000, 1));
+
+    // digests with same home bucket and fingerprint fill the probed buckets, then the overflow entries
+    constexpr unsigned int maxProbedDigests = TickStorage::TransactionsDigestAccess::slotsPerBucket * TickStorage::TransactionsDigestAccess::maxProbeBuckets;
+    constexpr unsigned int maxDigests = maxProbedDigests + TickStorage::TransactionsDigestAccess::overflowCapacity;
+    std::vector<m256i> digests(maxDigests + 1);
+    for (unsigned int i = 0; i <= maxDigests; ++i)
+    {
+        digests[i].setRandomValue();
+        digests[i].m256i_u64[0] = 12345;
+        digests[i].m256i_u32[7] = 0xabcd0000;
+    }
+    for (unsigned int i = 0; i < maxProbedDigests; ++i)
+        EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digests[i], (i & 1) ? transaction1 : transaction0));
+    EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digests[3], transaction1));
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[maxProbedDigests]), nullptr);
+    for (unsigned int i = maxProbedDigests; i < maxDigests; ++i)
+        EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digests[i], (i & 1) ? transaction1 : transaction0));
+    EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digests[maxProbedDigests + 3], transaction1));
+    EXPECT_FALSE(ts.transactionsDigestAccess.insertTransaction(digests[maxDigests], transaction0));
+    for (unsigned int i = 0; i < maxDigests; ++i)
+        EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[i]), (i & 1) ? transaction1 : transaction0);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[maxDigests]), nullptr);
+
+    // other buckets are not affected
+    m256i digest;
+    digest.setRandomValue();
+    digest.m256i_u64[0] = 54321;
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), nullptr);
+    EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digest, transaction1));
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), transaction1);
+
+    // slots are free again in new epoch
+    ts.beginEpoch(1010);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[0]), nullptr);
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[maxProbedDigests]), nullptr);
+    ts.addTransaction(1010, 0, 10);
+    transaction0 = ts.tickTransactions(ts.tickTransactionOffsets(1010, 0));
+    EXPECT_TRUE(ts.transactionsDigestAccess.insertTransaction(digests[maxDigests], transaction0));
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[maxDigests]), transaction0);
+
+    ts.deinit();
+}
+
+TEST(TestCoreTickStorage, LazyLoadSnapshot) {
+
+    CHAR16 directory[] = L"test_tick_storage";
+    const unsigned short epoch = 123;
+    const unsigned int tick0 = 1000;
+    const int savedTicks = 41;
+    const unsigned short maxTransactions = 20;
+
+    std::mt19937_64 gen64(4321);
+    unsigned long long seeds[MAX_NUMBER_OF_TICKS_PER_EPOCH];
+    for (int i = 0; i < MAX_NUMBER_OF_TICKS_PER_EPOCH; ++i)
+        seeds[i] = gen64();
+
+    ts.init();
+    beginEpochAndClear(tick0);
+    ts.initMetaData(epoch);
+    for (int i = 0; i < savedTicks; ++i)
+        addTick(tick0 + i, seeds[i], maxTransactions);
+    EXPECT_EQ(ts.trySaveToFile(epoch, tick0 + savedTicks - 1, directory), 0);
+
+    // clear storage and load snapshot: only the segments with the most recent ticks are loaded
+    ts.beginEpoch(tick0);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    EXPECT_TRUE(ts.isLazyLoading());
+    EXPECT_EQ(ts.getPreloadTick(), tick0 + savedTicks - 1);
+    const int firstEagerTick = (savedTicks - TICK_STORAGE_EAGER_LOAD_TICKS) / TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS * TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS;
+    for (int i = firstEagerTick; i < savedTicks; ++i)
+    {
+        EXPECT_TRUE(ts.checkTickLoaded(tick0 + i));
+        checkTick(tick0 + i, seeds[i], maxTransactions);
+    }
+    EXPECT_FALSE(ts.checkTickLoaded(tick0 + firstEagerTick - 1));
+    EXPECT_EQ(ts.tickData.getByTickInCurrentEpoch(tick0 + firstEagerTick - 1).epoch, 0);
+
+    // tick after end of snapshot is available
+    EXPECT_TRUE(ts.checkTickLoaded(tick0 + savedTicks));
+
+    // requested tick is loaded first
+    EXPECT_FALSE(ts.checkTickLoaded(tick0 + 1));
+    EXPECT_TRUE(ts.continueLazyLoading());
+    EXPECT_TRUE(ts.checkTickLoaded(tick0 + 1));
+    checkTick(tick0 + 1, seeds[1], maxTransactions);
+    EXPECT_FALSE(ts.checkTickLoaded(tick0 + TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS));
+
+    // segment failing to load stays unavailable and is retried
+    std::filesystem::rename("test_tick_storage", "test_tick_storage_moved");
+    EXPECT_FALSE(ts.checkTickLoaded(tick0 + TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS));
+    EXPECT_TRUE(ts.continueLazyLoading());
+    EXPECT_FALSE(ts.checkTickLoaded(tick0 + TICK_STORAGE_LAZY_LOAD_SEGMENT_TICKS));
+    EXPECT_TRUE(ts.isLazyLoading());
+    std::filesystem::rename("test_tick_storage_moved", "test_tick_storage");
+
+    // load remaining ticks
+    EXPECT_TRUE(ts.completeLazyLoading());
+    EXPECT_FALSE(ts.isLazyLoading());
+    for (int i = 0; i < savedTicks; ++i)
+    {
+        EXPECT_TRUE(ts.checkTickLoaded(tick0 + i));
+        checkTick(tick0 + i, seeds[i], maxTransactions);
+    }
+    ts.checkStateConsistencyWithAssert();
+
+    // if segments keep failing, loading is given up, their ticks stay unavailable, and the snapshot is not overwritten
+    ts.beginEpoch(tick0);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    std::filesystem::rename("test_tick_storage", "test_tick_storage_moved");
+    EXPECT_FALSE(ts.completeLazyLoading());
+    EXPECT_FALSE(ts.isLazyLoading());
+    EXPECT_FALSE(ts.continueLazyLoading());
+    EXPECT_FALSE(ts.checkTickLoaded(tick0));
+    EXPECT_TRUE(ts.checkTickLoaded(tick0 + savedTicks - 1));
+    EXPECT_NE(ts.trySaveToFile(epoch, tick0 + savedTicks - 1, directory), 0);
+    std::filesystem::rename("test_tick_storage_moved", "test_tick_storage");
+
+    // new epoch is not affected
+    ts.beginEpoch(tick0 + savedTicks);
+    EXPECT_TRUE(ts.checkTickLoaded(tick0 + savedTicks));
+
+    ts.deinit();
+    std::filesystem::remove_all("test_tick_storage");
+}
@@ -0,0 +1,166 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 50
+#undef TICKS_TO_KEEP_FROM_PRIOR_EPOCH
+#define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 5
+#define TICK_STORAGE_RETENTION_TICKS 10
+
+// tick_storage.cpp tests the same class with other settings in the same test binary, so rename it here
+#define TickStorage TickStorageWithRetention
+#include "../src/tick_storage.h"
+#undef TickStorage
+
+#include <random>
+
+
+static TickStorageWithRetention ts;
+
+// Computors with index divisible by 7 do not vote. Computors with index divisible by 3 vote for a minority digest
+// (different fields shared by all votes), the others form the majority.
+static bool hasVote(unsigned int computorIndex)
+{
+    return computorIndex % 7 != 0;
+}
+
+static bool isMajorityVote(unsigned int computorIndex)
+{
+    return hasVote(computorIndex) && computorIndex % 3 != 0;
+}
+
+static void makeVote(unsigned int tick, unsigned int computorIndex, Tick& vote)
+{
+    // fields shared by the votes of a group
+    std::mt19937_64 sharedGen(tick * 2ULL + !isMajorityVote(computorIndex));
+    unsigned long long* words = (unsigned long long*)&vote;
+    for (unsigned int i = 0; i < sizeof(Tick) / 8; ++i)
+        words[i] = sharedGen();
+
+    // fields of each computor
+    std::mt19937_64 gen(tick * 1000ULL + computorIndex);
+    vote.computorIndex = computorIndex;
+    vote.epoch = 1234;
+    vote.tick = tick;
+    vote.saltedResourceTestingDigest = gen();
+    for (int i = 0; i < 4; ++i)
+    {
+        vote.saltedSpectrumDigest.m256i_u64[i] = gen();
+        vote.saltedUniverseDigest.m256i_u64[i] = gen();
+        vote.saltedComputerDigest.m256i_u64[i] = gen();
+    }
+    for (int i = 0; i < SIGNATURE_SIZE; ++i)
+        vote.signature[i] = (unsigned char)gen();
+}
+
+// Compact older ticks like the main loop and add votes of tick like the tick processor
+static void addTick(unsigned int tick)
+{
+    while (ts.continueCompaction(tick))
+        ;
+    ASSERT_TRUE(ts.ticks.isStoredInFull(tick));
+    Tick* votes = ts.ticks.getByTickInCurrentEpoch(tick);
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; ++i)
+    {
+        EXPECT_EQ(votes[i].epoch, 0);
+        if (hasVote(i))
+            makeVote(tick, i, votes[i]);
+    }
+}
+
+static void checkFullTick(const Tick* votes, unsigned int tick)
+{
+    Tick expected;
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; ++i)
+    {
+        if (hasVote(i))
+        {
+            makeVote(tick, i, expected);
+            EXPECT_EQ(memcmp(&votes[i], &expected, sizeof(Tick)), 0);
+        }
+        else
+        {
+            EXPECT_EQ(votes[i].epoch, 0);
+        }
+    }
+}
+
+static void checkCompactedTick(unsigned int tick)
+{
+    EXPECT_TRUE(ts.ticks.isCompacted(tick));
+    EXPECT_FALSE(ts.ticks.isStoredInFull(tick));
+    Tick vote, expected;
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; ++i)
+    {
+        // minority votes are lost by compaction
+        EXPECT_EQ(ts.ticks.getCompacted(tick, i, vote), isMajorityVote(i));
+        if (isMajorityVote(i))
+        {
+            makeVote(tick, i, expected);
+            EXPECT_EQ(memcmp(&vote, &expected, sizeof(Tick)), 0);
+        }
+    }
+}
+
+TEST(TestCoreTickStorageRetention, CompactionAndEpochTransition)
+{
+    ts.init();
+
+    // first epoch: more ticks than the ring buffer holds, so slots are reused several times
+    constexpr unsigned int firstEpochTick0 = 1000;
+    constexpr unsigned int firstEpochTicks = 4 * TICK_STORAGE_RETENTION_TICKS + 3;
+    ts.beginEpoch(firstEpochTick0);
+    while (ts.continueClearing())
+        ;
+    for (unsigned int tick = firstEpochTick0; tick < firstEpochTick0 + firstEpochTicks; ++tick)
+    {
+        addTick(tick);
+
+        // the last ticks are always stored in full, the ticks before are compacted
+        const unsigned int fullBegin = (tick >= firstEpochTick0 + TICK_STORAGE_RETENTION_TICKS / 2) ? tick - TICK_STORAGE_RETENTION_TICKS / 2 : firstEpochTick0;
+        for (unsigned int t = fullBegin; t <= tick; ++t)
+        {
+            ASSERT_TRUE(ts.ticks.isStoredInFull(t));
+            checkFullTick(ts.ticks.getByTickInCurrentEpoch(t), t);
+        }
+        for (unsigned int t = firstEpochTick0; t < fullBegin; ++t)
+            checkCompactedTick(t);
+    }
+    EXPECT_FALSE(ts.ticks.isStoredInFull(firstEpochTick0 + firstEpochTicks + TICK_STORAGE_RETENTION_TICKS));
+
+    // seamless epoch transition: the ticks to keep are copied from the ring buffer with all votes
+    constexpr unsigned int secondEpochTick0 = firstEpochTick0 + firstEpochTicks;
+    ts.beginEpoch(secondEpochTick0);
+    for (unsigned int tick = secondEpochTick0 - TICKS_TO_KEEP_FROM_PRIOR_EPOCH; tick < secondEpochTick0; ++tick)
+    {
+        ASSERT_TRUE(ts.tickInPreviousEpochStorage(tick));
+        checkFullTick(ts.ticks.getByTickInPreviousEpoch(tick), tick);
+    }
+    EXPECT_FALSE(ts.ticks.isCompacted(firstEpochTick0));
+    EXPECT_FALSE(ts.ticks.isCompacted(secondEpochTick0 - 1));
+
+    // second epoch: ring buffer is cleared, compaction restarts at new initial tick
+    constexpr unsigned int secondEpochTicks = 2 * TICK_STORAGE_RETENTION_TICKS;
+    while (ts.continueClearing())
+        ;
+    constexpr unsigned int secondEpochLastTick = secondEpochTick0 + secondEpochTicks - 1;
+    for (unsigned int tick = secondEpochTick0; tick <= secondEpochLastTick; ++tick)
+        addTick(tick);
+    for (unsigned int tick = secondEpochTick0; tick < secondEpochLastTick - TICK_STORAGE_RETENTION_TICKS / 2; ++tick)
+        checkCompactedTick(tick);
+    for (unsigned int tick = secondEpochLastTick - TICK_STORAGE_RETENTION_TICKS / 2; tick <= secondEpochLastTick; ++tick)
+        checkFullTick(ts.ticks.getByTickInCurrentEpoch(tick), tick);
+
+    // tick without any votes is compacted to nothing
+    const unsigned int emptyTick = secondEpochTick0 + secondEpochTicks;
+    while (ts.continueCompaction(emptyTick + TICK_STORAGE_RETENTION_TICKS))
+        ;
+    ASSERT_TRUE(ts.ticks.isCompacted(emptyTick));
+    Tick vote;
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; ++i)
+        EXPECT_FALSE(ts.ticks.getCompacted(emptyTick, i, vote));
+
+    ts.deinit();
+}
@@ -0,0 +1,96 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/transaction_inventory.h"
+
+#include <vector>
+
+
+static std::vector<unsigned char> makeTransaction(unsigned int tick, unsigned short inputSize)
+{
+    std::vector<unsigned char> buffer(MAX_TRANSACTION_SIZE, 0);
+    Transaction* transaction = (Transaction*)buffer.data();
+    transaction->sourcePublicKey.m256i_u32[0] = tick * 3 + inputSize;
+    transaction->tick = tick;
+    transaction->inputSize = inputSize;
+    buffer.resize(transaction->totalSize());
+    return buffer;
+}
+
+static m256i makeDigest(unsigned long long value)
+{
+    m256i digest = m256i::zero();
+    digest.m256i_u64[0] = value;
+    digest.m256i_u64[1] = ~value;
+    return digest;
+}
+
+TEST(TestCoreTransactionInventory, AddAndGet)
+{
+    TransactionInventory inventory;
+    EXPECT_TRUE(inventory.init(64 * 1024, 1024));
+
+    std::vector<unsigned char> transaction = makeTransaction(100, 32);
+    std::vector<unsigned char> output(MAX_TRANSACTION_SIZE);
+    EXPECT_FALSE(inventory.get(makeDigest(1), (Transaction*)output.data()));
+    EXPECT_TRUE(inventory.add(makeDigest(1), (const Transaction*)transaction.data(), 1));
+    EXPECT_FALSE(inventory.add(makeDigest(1), (const Transaction*)transaction.data(), 2));
+    EXPECT_TRUE(inventory.get(makeDigest(1), (Transaction*)output.data()));
+    EXPECT_EQ(memcmp(output.data(), transaction.data(), transaction.size()), 0);
+    EXPECT_FALSE(inventory.get(makeDigest(2), (Transaction*)output.data()));
+
+    inventory.reset();
+    EXPECT_FALSE(inventory.get(makeDigest(1), (Transaction*)output.data()));
+
+    inventory.deinit();
+}
+
+TEST(TestCoreTransactionInventory, RequestTimeout)
+{
+    TransactionInventory inventory;
+    EXPECT_TRUE(inventory.init(64 * 1024, 1024));
+
+    // announced transaction is requested once until timeout expires
+    EXPECT_TRUE(inventory.request(makeDigest(5), 1000, 100));
+    EXPECT_FALSE(inventory.request(makeDigest(5), 1050, 100));
+    EXPECT_TRUE(inventory.request(makeDigest(5), 1100, 100));
+    EXPECT_FALSE(inventory.request(makeDigest(5), 1150, 100));
+
+    // stored transaction is never requested
+    std::vector<unsigned char> transaction = makeTransaction(100, 0);
+    EXPECT_TRUE(inventory.add(makeDigest(5), (const Transaction*)transaction.data(), 1200));
+    EXPECT_FALSE(inventory.request(makeDigest(5), 5000, 100));
+
+    inventory.deinit();
+}
+
+TEST(TestCoreTransactionInventory, RingBufferOverwrite)
+{
+    constexpr unsigned long long bufferSize = 64 * 1024;
+    TransactionInventory inventory;
+    EXPECT_TRUE(inventory.init(bufferSize, 4096));
+
+    // add more transactions than fit into the ring buffer, only the most recent ones are kept
+    constexpr unsigned int numberOfTransactions = 1000;
+    std::vector<std::vector<unsigned char>> transactions;
+    unsigned long long totalSize = 0;
+    for (unsigned int i = 0; i < numberOfTransactions; i++)
+    {
+        transactions.push_back(makeTransaction(i, (unsigned short)(i * 37 % 512)));
+        totalSize += transactions.back().size();
+        EXPECT_TRUE(inventory.add(makeDigest(i + 1), (const Transaction*)transactions.back().data(), i + 1));
+    }
+    ASSERT_GT(totalSize, 2 * bufferSize);
+
+    std::vector<unsigned char> output(MAX_TRANSACTION_SIZE);
+    EXPECT_FALSE(inventory.get(makeDigest(1), (Transaction*)output.data()));
+    EXPECT_TRUE(inventory.request(makeDigest(1), numberOfTransactions + 1, 100));
+    for (unsigned int i = numberOfTransactions - 50; i < numberOfTransactions; i++)
+    {
+        EXPECT_TRUE(inventory.get(makeDigest(i + 1), (Transaction*)output.data()));
+        EXPECT_EQ(memcmp(output.data(), transactions[i].data(), transactions[i].size()), 0);
+    }
+
+    inventory.deinit();
+}
@@ -0,0 +1,514 @@
+#define NO_UEFI
+#define NDEBUG
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Settings usually defined in private_settings.h. Loopback addresses are never added as public peers by the peer
+// logic, so the simulator fills the list of public peers directly.
+static const unsigned char knownPublicPeers[][4] = { { 127, 0, 0, 1 } };
+static const unsigned char whiteListPeers[][4] = { { 127, 0, 0, 1 } };
+
+#include "../../src/network_core/peers.h"
+#include "../../src/network_messages/public_peers.h"
+#include "../../src/network_messages/tick.h"
+#include "../../src/four_q.h"
+
+// Local cluster simulator for benchmarking the networking and consensus message flow on an ordinary Linux machine.
+//
+// Each node is a process that runs the peer layer of the node (peers.h on top of the socket backend in
+// tcp4_posix.h) and listens on 127.0.0.<node number>. Processes are used because the peer layer keeps its state in
+// globals. The 676 synthetic computors (deterministic seeds) are distributed to the nodes round-robin. A node signs
+// BroadcastTick votes of its computors for its current tick and disseminates them and all valid votes it receives,
+// like the node does. When a quorum of votes for the current tick has been received, the node moves on to the next
+// tick. Requests are processed by the main thread (instead of request processors), so one core per node verifies
+// signatures.
+//
+// Usage: cluster_simulator [number of nodes (default 4)] [seconds to measure (default 30)] [port (default 21841)]
+//
+// Linux only (epoll sockets). Build with GCC in this directory, linking test/stdlib_impl.cpp like the NO_UEFI tests.
+// The directory linux contains replacements of the MSVC intrinsics used by the node:
+// g++ -std=c++20 -O2 -march=native -fshort-wchar -D__cdecl= -Wno-volatile -Ilinux -I../../src cluster_simulator.cpp ../../test/stdlib_impl.cpp -o cluster_simulator
+//
+// Reports ticks per second, vote latency from signing to receiving (average, percentiles, maximum), and traffic and
+// queue statistics of each node.
+
+static constexpr unsigned int tickWindow = 16;
+static constexpr unsigned long long warmUpMilliseconds = 3000;
+static constexpr unsigned long long rebroadcastMilliseconds = 1000;
+static constexpr unsigned int numberOfLatencyBuckets = 32; // bucket b counts latencies in [2^b, 2^(b+1)) microseconds
+
+struct NodeResult
+{
+    unsigned int ticks;
+    unsigned int connectedPeers;
+    double seconds;
+    unsigned long long votes;
+    unsigned long long latencySum; // in microseconds
+    unsigned long long latencyMax;
+    unsigned long long latencyBuckets[numberOfLatencyBuckets];
+    unsigned long long receivedBytes, transmittedBytes;
+    unsigned long long duplicateMessages, discardedMessages, droppedMessages, receivedBatches;
+    unsigned long long consensusQueueingTime; // average in microseconds
+};
+
+static unsigned long long frequency;
+static unsigned int numberOfNodes, nodeIndex;
+static unsigned short port;
+
+static m256i computorPublicKeys[NUMBER_OF_COMPUTORS];
+static std::vector<unsigned short> ownComputorIndices;
+static std::vector<m256i> ownComputorSubseeds;
+
+static unsigned int currentTick = 1;
+static unsigned int slotTicks[tickWindow];
+static unsigned short slotVotes[tickWindow];
+static unsigned long long slotVoteFlags[tickWindow][(NUMBER_OF_COMPUTORS + 63) / 64];
+static unsigned long long lastProgressTime;
+static bool measuring = false;
+static NodeResult result;
+
+static unsigned long long measureFrequency()
+{
+    timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    const unsigned long long beginTick = __rdtsc();
+    usleep(200000);
+    const unsigned long long endTick = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const unsigned long long nanoseconds = (end.tv_sec - begin.tv_sec) * 1000000000ULL + end.tv_nsec - begin.tv_nsec;
+    return (endTick - beginTick) * 1000000000ULL / nanoseconds;
+}
+
+// Seed of 55 lower case letters, unique for each of the 26 * 26 computors
+static void getComputorSeed(unsigned int computorIndex, unsigned char* seed)
+{
+    for (unsigned int i = 0; i < 55; i++)
+        seed[i] = 'a' + (i * 7) % 26;
+    seed[0] = 'a' + computorIndex % 26;
+    seed[1] = 'a' + computorIndex / 26;
+    seed[55] = 0;
+}
+
+static void initComputors()
+{
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        unsigned char seed[56];
+        m256i subseed, privateKey;
+        getComputorSeed(computorIndex, seed);
+        getSubseed(seed, subseed.m256i_u8);
+        getPrivateKey(subseed.m256i_u8, privateKey.m256i_u8);
+        getPublicKey(privateKey.m256i_u8, computorPublicKeys[computorIndex].m256i_u8);
+        if (computorIndex % numberOfNodes == nodeIndex)
+        {
+            ownComputorIndices.push_back(computorIndex);
+            ownComputorSubseeds.push_back(subseed);
+        }
+    }
+}
+
+// Count vote of computor for tick in the window of upcoming ticks. Returns false if it is outside or already counted.
+static bool countVote(const Tick& tick)
+{
+    if (tick.tick < currentTick || tick.tick >= currentTick + tickWindow)
+    {
+        return false;
+    }
+    const unsigned int slot = tick.tick % tickWindow;
+    if (slotTicks[slot] != tick.tick)
+    {
+        slotTicks[slot] = tick.tick;
+        slotVotes[slot] = 0;
+        memset(slotVoteFlags[slot], 0, sizeof(slotVoteFlags[slot]));
+    }
+    unsigned long long& flags = slotVoteFlags[slot][tick.computorIndex >> 6];
+    if (flags & (1ULL << (tick.computorIndex & 63)))
+    {
+        return false;
+    }
+    flags |= (1ULL << (tick.computorIndex & 63));
+    slotVotes[slot]++;
+    return true;
+}
+
+// Sign votes of own computors for current tick and disseminate them. The signing time is stored in the vote for
+// measuring the latency, which also makes votes that are sent again unique for the dejavu filter.
+static void broadcastOwnVotes()
+{
+    struct
+    {
+        RequestResponseHeader header;
+        BroadcastTick broadcastTick;
+    } vote;
+    vote.header.setSize<sizeof(vote)>();
+    vote.header.setType(BroadcastTick::type);
+    vote.header.setDejavu(0);
+    Tick& tick = vote.broadcastTick.tick;
+    for (size_t i = 0; i < ownComputorIndices.size(); i++)
+    {
+        memset(&tick, 0, sizeof(tick));
+        tick.computorIndex = ownComputorIndices[i];
+        tick.epoch = 1;
+        tick.tick = currentTick;
+        tick.prevResourceTestingDigest = __rdtsc();
+        m256i digest;
+        KangarooTwelve(&tick, sizeof(Tick) - SIGNATURE_SIZE, &digest, sizeof(digest));
+        sign(ownComputorSubseeds[i].m256i_u8, computorPublicKeys[tick.computorIndex].m256i_u8, digest.m256i_u8, tick.signature);
+        countVote(tick);
+        enqueueResponse(NULL, &vote.header);
+    }
+}
+
+static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
+{
+    if (!header->checkPayloadSize(sizeof(BroadcastTick)))
+    {
+        return;
+    }
+    const Tick& tick = header->getPayload<BroadcastTick>()->tick;
+    if (tick.computorIndex >= NUMBER_OF_COMPUTORS || tick.tick + tickWindow < currentTick || tick.tick >= currentTick + tickWindow)
+    {
+        return;
+    }
+    m256i digest;
+    KangarooTwelve(&tick, sizeof(Tick) - SIGNATURE_SIZE, &digest, sizeof(digest));
+    if (!verify(computorPublicKeys[tick.computorIndex].m256i_u8, digest.m256i_u8, tick.signature))
+    {
+        return;
+    }
+
+    if (measuring)
+    {
+        const unsigned long long latency = (__rdtsc() - tick.prevResourceTestingDigest) * 1000000 / frequency;
+        unsigned int bucket = 0;
+        while (bucket + 1 < numberOfLatencyBuckets && (2ULL << bucket) <= latency)
+            bucket++;
+        result.votes++;
+        result.latencySum += latency;
+        result.latencyBuckets[bucket]++;
+        if (result.latencyMax < latency)
+            result.latencyMax = latency;
+    }
+    countVote(tick);
+    if (header->isDejavuZero())
+    {
+        enqueueResponse(NULL, header);
+    }
+}
+
+static void processRequests()
+{
+    while (requestQueueElementTail != requestQueueElementHead)
+    {
+        RequestResponseHeader* header = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
+        Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+        switch (header->type())
+        {
+        case ExchangePublicPeers::type:
+            peer->exchangedPublicPeers = TRUE;
+            break;
+
+        case BroadcastTick::type:
+            processBroadcastTick(peer, header);
+            break;
+        }
+
+        requestQueueBufferTail += header->size();
+        if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+        {
+            requestQueueBufferTail = 0;
+        }
+        requestQueueElementTail++;
+        numberOfProcessedRequests++;
+    }
+}
+
+static void sendResponses()
+{
+    while (responseQueueElementTail != responseQueueElementHead)
+    {
+        RequestResponseHeader* header = (RequestResponseHeader*)&responseQueueBuffer[responseQueueElements[responseQueueElementTail].offset];
+        if (responseQueueElements[responseQueueElementTail].peer)
+        {
+            push(responseQueueElements[responseQueueElementTail].peer, header);
+        }
+        else
+        {
+            pushToSeveral(header);
+        }
+        responseQueueBufferTail += header->size();
+        if (responseQueueBufferTail > RESPONSE_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+        {
+            responseQueueBufferTail = 0;
+        }
+        responseQueueElementTail++;
+    }
+}
+
+static void greetPeer(Peer* peer)
+{
+    struct
+    {
+        RequestResponseHeader header;
+        ExchangePublicPeers payload;
+    } exchangePublicPeers;
+    exchangePublicPeers.header.setSize<sizeof(exchangePublicPeers)>();
+    exchangePublicPeers.header.randomizeDejavu();
+    exchangePublicPeers.header.setType(ExchangePublicPeers::type);
+    for (unsigned int j = 0; j < NUMBER_OF_EXCHANGED_PEERS; j++)
+    {
+        exchangePublicPeers.payload.peers[j] = publicPeers[random(numberOfPublicPeers)].address;
+    }
+    push(peer, &exchangePublicPeers.header);
+
+    RequestResponseHeader batchedMessages;
+    batchedMessages.setSize<sizeof(batchedMessages)>();
+    batchedMessages.setDejavu(0);
+    batchedMessages.setType(BatchedMessages::type);
+    push(peer, &batchedMessages);
+}
+
+static bool initNode()
+{
+    const unsigned char stationAddress[4] = { 127, 0, 0, (unsigned char)(nodeIndex + 1) };
+    if (!initPosixTcp4(stationAddress))
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < numberOfNodes; i++)
+    {
+        if (i != nodeIndex)
+        {
+            publicPeers[numberOfPublicPeers].isVerified = true;
+            publicPeers[numberOfPublicPeers].address = IPv4Address{ { 127, 0, 0, (unsigned char)(i + 1) } };
+            numberOfPublicPeers++;
+        }
+    }
+
+    if (!allocatePool(536870912, (void**)&dejavu0) || !allocatePool(536870912, (void**)&dejavu1)
+        || !allocatePool(REQUEST_QUEUE_BUFFER_SIZE, (void**)&requestQueueBuffer)
+        || !allocatePool(RESPONSE_QUEUE_BUFFER_SIZE, (void**)&responseQueueBuffer))
+    {
+        return false;
+    }
+    initOutboundPriorities();
+    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    {
+        peers[i].receiveData.FragmentCount = 1;
+        peers[i].transmitData.FragmentCount = 1;
+        if (!allocatePool(BUFFER_SIZE, &peers[i].receiveBuffer)
+            || !allocatePool(BUFFER_SIZE, &peers[i].transmitData.FragmentTable[0].FragmentBuffer)
+            || !allocatePool(BUFFER_SIZE, (void**)&peers[i].dataToTransmit))
+        {
+            return false;
+        }
+        peers[i].outboundQueue.init(peers[i].dataToTransmit, BUFFER_SIZE);
+        peers[i].connectAcceptToken.CompletionToken.Status = -1;
+        peers[i].receiveToken.CompletionToken.Status = -1;
+        peers[i].receiveToken.Packet.RxData = &peers[i].receiveData;
+        peers[i].transmitToken.CompletionToken.Status = -1;
+        peers[i].transmitToken.Packet.TxData = &peers[i].transmitData;
+    }
+    return initTcp4(port);
+}
+
+static void runNode(unsigned long long seconds, int resultPipe)
+{
+    disableConsoleLogging = true;
+    memset(&result, 0, sizeof(result));
+    initComputors();
+    if (!initNode())
+    {
+        printf("Node %u: initialization failed\n", nodeIndex + 1);
+        exit(1);
+    }
+
+    unsigned int salt;
+    _rdrand32_step(&salt);
+    const unsigned long long startTime = __rdtsc();
+    const unsigned long long measurementStartTime = startTime + warmUpMilliseconds * frequency / 1000;
+    const unsigned long long endTime = measurementStartTime + seconds * frequency;
+    lastProgressTime = startTime;
+    unsigned long long now;
+    while ((now = __rdtsc()) < endTime)
+    {
+        if (!measuring && now >= measurementStartTime)
+        {
+            measuring = true;
+            lastProgressTime = now;
+            broadcastOwnVotes();
+        }
+
+        peerTcp4Protocol->Poll(peerTcp4Protocol);
+        for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+        {
+            if (peerConnectionNewlyEstablished(i))
+            {
+                greetPeer(&peers[i]);
+            }
+            peerReceiveAndTransmit(i, salt);
+            peerReconnectIfInactive(i, port);
+        }
+
+        processRequests();
+
+        // move on as long as the quorum of the current tick is reached
+        while (slotTicks[currentTick % tickWindow] == currentTick && slotVotes[currentTick % tickWindow] >= QUORUM)
+        {
+            currentTick++;
+            lastProgressTime = now;
+            if (measuring)
+            {
+                result.ticks++;
+                broadcastOwnVotes();
+            }
+        }
+        if (measuring && now - lastProgressTime >= rebroadcastMilliseconds * frequency / 1000)
+        {
+            // votes may have been lost, for example if sent before connections were established
+            lastProgressTime = now;
+            broadcastOwnVotes();
+        }
+
+        sendResponses();
+    }
+
+    result.seconds = (double)(now - measurementStartTime) / frequency;
+    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    {
+        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers)
+            result.connectedPeers++;
+    }
+    result.receivedBytes = numberOfReceivedBytes;
+    result.transmittedBytes = numberOfTransmittedBytes;
+    result.duplicateMessages = numberOfDuplicateRequests;
+    result.discardedMessages = numberOfDiscardedRequests;
+    result.droppedMessages = numberOfDroppedOutboundMessages;
+    result.receivedBatches = numberOfReceivedBatches;
+    if (outboundQueueingTimeDenominator[OUTBOUND_PRIORITY_CONSENSUS])
+    {
+        result.consensusQueueingTime = outboundQueueingTimeNumerator[OUTBOUND_PRIORITY_CONSENSUS] / outboundQueueingTimeDenominator[OUTBOUND_PRIORITY_CONSENSUS] * 1000000 / frequency;
+    }
+    if (write(resultPipe, &result, sizeof(result)) != sizeof(result))
+    {
+        exit(1);
+    }
+    exit(0);
+}
+
+// Upper bound of latency bucket that contains the given fraction of the votes
+static unsigned long long latencyPercentile(const NodeResult& result, double fraction)
+{
+    unsigned long long count = 0;
+    for (unsigned int bucket = 0; bucket < numberOfLatencyBuckets; bucket++)
+    {
+        count += result.latencyBuckets[bucket];
+        if (count >= result.votes * fraction)
+            return ((2ULL << bucket) < result.latencyMax) ? (2ULL << bucket) : result.latencyMax;
+    }
+    return result.latencyMax;
+}
+
+static void printLatencies(const NodeResult& result)
+{
+    if (!result.votes)
+    {
+        printf("no votes received");
+        return;
+    }
+    printf("%.2f / %.2f / %.2f / %.2f ms", result.latencySum / 1000.0 / result.votes,
+        latencyPercentile(result, 0.5) / 1000.0, latencyPercentile(result, 0.99) / 1000.0, result.latencyMax / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    numberOfNodes = (argc > 1) ? atoi(argv[1]) : 4;
+    const unsigned long long seconds = (argc > 2) ? atoi(argv[2]) : 30;
+    port = (argc > 3) ? (unsigned short)atoi(argv[3]) : 21841;
+    if (numberOfNodes < 2 || numberOfNodes > 254 || !seconds)
+    {
+        printf("Usage: %s [number of nodes (2-254)] [seconds] [port]\n", argv[0]);
+        return 1;
+    }
+
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+#if defined (__AVX512F__)
+    initAVX512FourQConstants();
+#endif
+
+    frequency = measureFrequency();
+    printf("Running %u nodes on 127.0.0.1-%u port %u for %llu seconds (after %llu ms warm-up)...\n",
+        numberOfNodes, numberOfNodes, port, seconds, warmUpMilliseconds);
+    fflush(stdout);
+
+    std::vector<int> resultPipes(numberOfNodes);
+    std::vector<pid_t> processes(numberOfNodes);
+    for (nodeIndex = 0; nodeIndex < numberOfNodes; nodeIndex++)
+    {
+        int fds[2];
+        if (pipe(fds))
+        {
+            printf("Cannot create pipe\n");
+            return 1;
+        }
+        processes[nodeIndex] = fork();
+        if (processes[nodeIndex] == 0)
+        {
+            close(fds[0]);
+            runNode(seconds, fds[1]);
+        }
+        close(fds[1]);
+        resultPipes[nodeIndex] = fds[0];
+    }
+
+    NodeResult total;
+    memset(&total, 0, sizeof(total));
+    double minTicksPerSecond = 0;
+    printf("node | ticks/s | votes/s | vote latency avg / p50 / p99 / max | peers | received MB | transmitted MB | duplicates | discarded | dropped | batches | consensus queueing\n");
+    for (unsigned int i = 0; i < numberOfNodes; i++)
+    {
+        NodeResult result;
+        int status = 0;
+        const bool received = read(resultPipes[i], &result, sizeof(result)) == sizeof(result);
+        waitpid(processes[i], &status, 0);
+        close(resultPipes[i]);
+        if (!received)
+        {
+            printf("%4u | failed\n", i + 1);
+            continue;
+        }
+
+        const double ticksPerSecond = result.ticks / result.seconds;
+        printf("%4u | %7.2f | %7.0f | ", i + 1, ticksPerSecond, result.votes / result.seconds);
+        printLatencies(result);
+        printf(" | %5u | %11.1f | %14.1f | %10llu | %9llu | %7llu | %7llu | %llu mcs\n", result.connectedPeers,
+            result.receivedBytes / 1048576.0, result.transmittedBytes / 1048576.0, result.duplicateMessages,
+            result.discardedMessages, result.droppedMessages, result.receivedBatches, result.consensusQueueingTime);
+
+        if (!total.seconds || ticksPerSecond < minTicksPerSecond)
+            minTicksPerSecond = ticksPerSecond;
+        total.seconds += result.seconds;
+        total.ticks += result.ticks;
+        total.votes += result.votes;
+        total.latencySum += result.latencySum;
+        if (total.latencyMax < result.latencyMax)
+            total.latencyMax = result.latencyMax;
+        for (unsigned int bucket = 0; bucket < numberOfLatencyBuckets; bucket++)
+            total.latencyBuckets[bucket] += result.latencyBuckets[bucket];
+    }
+    if (total.seconds)
+    {
+        printf("Total: %.2f ticks/s (slowest node %.2f), vote latency avg / p50 / p99 / max = ", total.ticks / total.seconds, minTicksPerSecond);
+        printLatencies(total);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Replacement of the MSVC intrinsics header for building the cluster simulator with GCC on Linux
+
+#include <x86intrin.h>
+
+// MSVC does not require 32-byte alignment when dereferencing __m256i pointers, which the node code relies on
+#define __m256i __m256i_u
+
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+
+static inline long _InterlockedIncrement(volatile long* p) { return __sync_add_and_fetch(p, 1); }
+static inline long _InterlockedDecrement(volatile long* p) { return __sync_sub_and_fetch(p, 1); }
+static inline long long _InterlockedIncrement64(volatile long long* p) { return __sync_add_and_fetch(p, 1); }
+static inline long long _InterlockedDecrement64(volatile long long* p) { return __sync_sub_and_fetch(p, 1); }
+static inline char _InterlockedCompareExchange8(volatile char* p, char exchange, char comparand) { return __sync_val_compare_and_swap(p, comparand, exchange); }
+static inline long _InterlockedCompareExchange(volatile long* p, long exchange, long comparand) { return __sync_val_compare_and_swap(p, comparand, exchange); }
+static inline long long _InterlockedCompareExchange64(volatile long long* p, long long exchange, long long comparand) { return __sync_val_compare_and_swap(p, comparand, exchange); }
+
+static inline unsigned long long _umul128(unsigned long long a, unsigned long long b, unsigned long long* high)
+{
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    *high = (unsigned long long)(product >> 64);
+    return (unsigned long long)product;
+}
+
+static inline unsigned long long __shiftleft128(unsigned long long low, unsigned long long high, unsigned char shift)
+{
+    shift &= 63;
+    return shift ? (high << shift) | (low >> (64 - shift)) : high;
+}
+
+static inline unsigned long long __shiftright128(unsigned long long low, unsigned long long high, unsigned char shift)
+{
+    shift &= 63;
+    return shift ? (low >> shift) | (high << (64 - shift)) : low;
+}
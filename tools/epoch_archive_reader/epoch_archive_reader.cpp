@@ -0,0 +1,104 @@
+#define NO_UEFI
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../../src/epoch_archive.h"
+
+// Check and list contents of epoch archive file written by node with EPOCH_ARCHIVE enabled.
+//
+// Usage: epoch_archive_reader <archive file> [-t]
+//   -t: also list transactions (digest, source, destination, amount, input type and size)
+
+static void printHex(const m256i& value)
+{
+    for (int i = 0; i < 32; i++)
+        printf("%02x", value.m256i_u8[i]);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <archive file> [-t]\n", argv[0]);
+        return 1;
+    }
+    const bool listTransactions = (argc > 2 && strcmp(argv[2], "-t") == 0);
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    unsigned char block[1 << 16];
+    size_t readSize;
+    while ((readSize = fread(block, 1, sizeof(block), file)) > 0)
+        data.insert(data.end(), block, block + readSize);
+    fclose(file);
+
+    EpochArchiveReader reader;
+    if (!reader.init(data.data(), data.size()))
+    {
+        printf("Invalid archive header (or archive written with different TickData size)\n");
+        return 1;
+    }
+    printf("Epoch %u, initial tick %u, %s\n", reader.getHeader().epoch, reader.getHeader().initialTick,
+        (reader.hasIndex()) ? "complete epoch with index" : "no index (epoch not finished)");
+
+    EpochArchiveReader::TickView tick;
+    unsigned int numberOfTicks = 0, numberOfMissingTicks = 0;
+    unsigned long long numberOfTransactions = 0;
+    unsigned int expectedTick = reader.getHeader().initialTick;
+    while (reader.nextTick(tick))
+    {
+        if (tick.record.tick != expectedTick)
+        {
+            printf("Ticks %u to %u are missing\n", expectedTick, tick.record.tick - 1);
+            numberOfMissingTicks += tick.record.tick - expectedTick;
+        }
+        expectedTick = tick.record.tick + 1;
+        ++numberOfTicks;
+        numberOfTransactions += tick.record.numberOfTransactions;
+
+        printf("tick %u: %s, %u transactions, %u quorum votes, transaction digest ", tick.record.tick,
+            (tick.tickData) ? "tick data" : "empty", tick.record.numberOfTransactions, tick.record.numberOfQuorumVotes);
+        printHex(tick.quorumTick.transactionDigest);
+        printf("\n");
+
+        if (listTransactions)
+        {
+            const unsigned char* ptr = tick.transactions;
+            for (unsigned int i = 0; i < tick.record.numberOfTransactions; i++)
+            {
+                Transaction transaction;
+                const unsigned char* next = EpochArchiveReader::nextTransaction(ptr, transaction);
+                m256i digest;
+                KangarooTwelve(ptr, transaction.totalSize(), &digest, sizeof(digest));
+                printf("  ");
+                printHex(digest);
+                printf(" from ");
+                printHex(transaction.sourcePublicKey);
+                printf(" to ");
+                printHex(transaction.destinationPublicKey);
+                printf(" amount %lld, input type %u, input size %u\n", transaction.amount, transaction.inputType, transaction.inputSize);
+                ptr = next;
+            }
+        }
+    }
+
+    if (!reader.isComplete())
+    {
+        printf("Archive is corrupted after %u ticks\n", numberOfTicks);
+        return 1;
+    }
+    if (reader.hasIndex() && (reader.getFooter().numberOfRecords != numberOfTicks || reader.getFooter().incomplete))
+    {
+        printf("Archive is incomplete: %u records in index, node reported %s\n", reader.getFooter().numberOfRecords,
+            (reader.getFooter().incomplete) ? "missing ticks" : "no missing ticks");
+    }
+    printf("%u ticks, %llu transactions, %u ticks missing\n", numberOfTicks, numberOfTransactions, numberOfMissingTicks);
+    return 0;
+}
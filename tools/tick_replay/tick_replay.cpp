@@ -0,0 +1,508 @@
+#define NO_UEFI
+#define DEFINE_VARIABLES_SHARED_BETWEEN_COMPILE_UNITS
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// workaround for name clash with stdlib
+#define system qubicSystemStruct
+
+// Tick storage snapshot support is needed independent of the settings of the node
+#include "private_settings.h"
+#undef TICK_STORAGE_AUTOSAVE_MODE
+#define TICK_STORAGE_AUTOSAVE_MODE 1
+#undef TICK_STORAGE_EAGER_LOAD_TICKS
+#define TICK_STORAGE_EAGER_LOAD_TICKS 0
+
+#include "contract_core/contract_def.h"
+#include "contract_core/contract_exec.h"
+#include "contract_core/qpi_spectrum_impl.h"
+#include "contract_core/qpi_asset_impl.h"
+#include "contract_core/qpi_system_impl.h"
+
+#include "assets/assets.h"
+#include "spectrum.h"
+#include "system.h"
+#include "score.h"
+#include "tick_storage.h"
+#include "vote_counter.h"
+#include "digest_tree.h"
+#include "mining/mining.h"
+#include "platform/histogram.h"
+
+static Tick etalonTick;
+static TickData nextTickData;
+static BroadcastComputors broadcastedComputors;
+static m256i arbitratorPublicKey;
+static VoteCounter voteCounter;
+static ScoreFunction<DATA_LENGTH, NUMBER_OF_HIDDEN_NEURONS, NUMBER_OF_NEIGHBOR_NEURONS, MAX_DURATION, 1>* score = nullptr;
+static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+static m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
+
+#include "contract_core/qpi_ticking_impl.h"
+#include "tick_processing.h"
+
+// Deterministic replay of ticks for benchmarking the tick processing outside of the network.
+//
+// Loads the node state (system, spectrum, universe, contract states, mining state) of a snapshot saved by the node
+// with TICK_STORAGE_AUTOSAVE_MODE (directory epNNN), and the tick storage (tick data, votes, transactions) of a later
+// snapshot of the same epoch. Then the ticks following the state snapshot are processed like in processTick() of
+// qubic.cpp with the functions of tick_processing.h shared with the node, sequentially on one processor: contract system
+// procedures and the transactions of the tick. Contract procedures are called directly instead of in a contract
+// processor, and solutions are scored one after the other instead of in parallel. The digests of spectrum, universe,
+// contract states, and resource testing after each tick are checked against the salted digests of the votes of the
+// computors stored in the tick storage. The replay stops at the first tick that does not match, because the following
+// ticks would start from a diverged state.
+//
+// Not replayed: the epoch transition. Own solutions and miner scores are not recorded (no effect on the digests).
+//
+// Usage: tick_replay <state snapshot directory> <tick storage snapshot directory> [-last <tick>] [-threshold <n>]
+//   -last: last tick to replay (default: last tick with votes in the tick storage snapshot)
+//   -threshold: solution threshold of the epoch set by the operator (default SOLUTION_THRESHOLD_DEFAULT)
+//
+// Build like the NO_UEFI tests, linking test/stdlib_impl.cpp (see tick_replay.vcxproj). Needs about as much memory as
+// the node, because spectrum, universe, tick storage, and score are allocated in full size.
+//
+// Reports the processing time of each tick split into phases (BEGIN_TICK, transactions, END_TICK, digests) and a
+// summary with percentiles, which makes changes of the tick processing comparable with the same recorded ticks.
+
+enum ReplayPhase
+{
+    REPLAY_PHASE_BEGIN_TICK = 0,
+    REPLAY_PHASE_TRANSACTIONS,
+    REPLAY_PHASE_END_TICK,
+    REPLAY_PHASE_DIGESTS,
+    NUMBER_OF_REPLAY_PHASES
+};
+
+static const char* replayPhaseNames[NUMBER_OF_REPLAY_PHASES] = { "begin tick", "transactions", "end tick", "digests" };
+
+static TickStorage ts;
+static int solutionThreshold = SOLUTION_THRESHOLD_DEFAULT;
+
+static LatencyHistogram phaseCycles[NUMBER_OF_REPLAY_PHASES];
+static LatencyHistogram tickCycles;
+
+struct TickReplayStatistics
+{
+    unsigned int numberOfTransactions;
+    unsigned int numberOfContractProcedureCalls;
+    unsigned int numberOfScoredSolutions;
+    unsigned long long phaseCycles[NUMBER_OF_REPLAY_PHASES];
+};
+
+static TickReplayStatistics tickStatistics;
+
+static unsigned long long measureFrequency()
+{
+    const auto begin = std::chrono::steady_clock::now();
+    const unsigned long long beginTick = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const unsigned long long endTick = __rdtsc();
+    const auto end = std::chrono::steady_clock::now();
+    return (endTick - beginTick) * 1000000 / std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+}
+
+static unsigned long long cyclesToMicroseconds(unsigned long long cycles)
+{
+    return cycles * 1000000 / frequency;
+}
+
+static void setFileNameSuffix(CHAR16* fileName, unsigned long long fileNameLength, unsigned int number)
+{
+    fileName[fileNameLength - 4] = number / 100 + L'0';
+    fileName[fileNameLength - 3] = (number % 100) / 10 + L'0';
+    fileName[fileNameLength - 2] = number % 10 + L'0';
+}
+
+static void getSpectrumLeafDigest(unsigned long long spectrumIndex, m256i& digest)
+{
+    KangarooTwelve64To32(&spectrum[spectrumIndex], &digest);
+}
+
+static void getAssetLeafDigest(unsigned long long assetIndex, m256i& digest)
+{
+    KangarooTwelve(&assets[assetIndex], sizeof(Asset), &digest, 32);
+}
+
+// Load node state saved by saveAllNodeStates() (full snapshot with base files of suffix 000)
+static bool loadNodeState(CHAR16* directory)
+{
+    CHAR16 SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    if (load(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory) != sizeof(system))
+    {
+        printf("Cannot load system.snp\n");
+        return false;
+    }
+
+    // spectrum, universe, and contract files of suffix 000 are only in sync with system.snp if no delta has been saved
+    struct
+    {
+        unsigned short epoch;
+        unsigned short numberOfDeltas;
+    } deltaInfo;
+    CHAR16 DELTA_INFO_FILE_NAME[] = L"snapshotDeltaInfo";
+    if (load(DELTA_INFO_FILE_NAME, sizeof(deltaInfo), (unsigned char*)&deltaInfo, directory) == sizeof(deltaInfo)
+        && deltaInfo.epoch == system.epoch && deltaInfo.numberOfDeltas)
+    {
+        printf("State snapshot has %u deltas, replay needs a full snapshot (NODE_STATE_DELTAS_PER_BASE 0)\n", deltaInfo.numberOfDeltas);
+        return false;
+    }
+
+    NodeMiningState* nodeMiningState = (NodeMiningState*)malloc(sizeof(NodeMiningState));
+    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
+    if (!nodeMiningState || load(NODE_STATE_FILE_NAME, sizeof(NodeMiningState), (unsigned char*)nodeMiningState, directory) != sizeof(NodeMiningState))
+    {
+        printf("Cannot load snapshotNodeMiningState (or saved with different settings)\n");
+        free(nodeMiningState);
+        return false;
+    }
+    copyMem(&etalonTick, &nodeMiningState->etalonTick, sizeof(etalonTick));
+    copyMem(&broadcastedComputors, &nodeMiningState->broadcastedComputors, sizeof(broadcastedComputors));
+    resourceTestingDigest = nodeMiningState->resourceTestingDigest;
+    score->initMiningData(nodeMiningState->currentRandomSeed);
+    free(nodeMiningState);
+
+    setFileNameSuffix(SPECTRUM_FILE_NAME, sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]), 0);
+    if (!loadSpectrum(SPECTRUM_FILE_NAME, directory))
+    {
+        printf("Cannot load spectrum\n");
+        return false;
+    }
+
+    setFileNameSuffix(UNIVERSE_FILE_NAME, sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]), 0);
+    if (!loadUniverse(directory))
+    {
+        printf("Cannot load universe\n");
+        return false;
+    }
+
+    setFileNameSuffix(CONTRACT_FILE_NAME, sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]), 0);
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        if (loadCompressed(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory) != (long long)contractDescriptions[contractIndex].stateSize)
+        {
+            printf("Cannot load state of contract %u\n", contractIndex);
+            return false;
+        }
+    }
+
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+    if (load(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory) != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    {
+        printf("Cannot load miner solution flags\n");
+        return false;
+    }
+
+    // digests are recomputed if the snapshot digests do not match the loaded spectrum and universe
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    if (!loadDigestTree(SPECTRUM_DIGEST_FILE_NAME, directory, spectrum, spectrumSizeInBytes, spectrumDigests, spectrumDigestsSizeInByte))
+    {
+        computeDigestTree(spectrumDigests, SPECTRUM_CAPACITY, getSpectrumLeafDigest, 65536);
+    }
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    if (!loadDigestTree(UNIVERSE_DIGEST_FILE_NAME, directory, assets, ASSETS_CAPACITY * sizeof(Asset), assetDigests, assetDigestsSizeInBytes))
+    {
+        computeDigestTree(assetDigests, ASSETS_CAPACITY, getAssetLeafDigest, 65536);
+    }
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
+
+    // computer digest is computed from scratch by getComputerDigest()
+    setMem(contractStateChangeFlags, MAX_NUMBER_OF_CONTRACTS / 8, 0xff);
+
+    return true;
+}
+
+// Hook of tick_processing.h: call user procedure directly
+static bool runContractUserProcedure(const Transaction* transaction)
+{
+    tickStatistics.numberOfContractProcedureCalls++;
+    return callContractUserProcedure(transaction);
+}
+
+// Hook of tick_processing.h
+static void recordMiningSolution(const MiningSolutionTransaction* transaction, MiningSolutionStatus status)
+{
+    if (status != MINING_SOLUTION_ALREADY_SCORED)
+    {
+        tickStatistics.numberOfScoredSolutions++;
+    }
+}
+
+// Hook of tick_processing.h
+static int getSolutionThreshold()
+{
+    return solutionThreshold;
+}
+
+// Process system.tick like processTick(). Returns false if transactions of the tick are missing in the tick storage.
+static bool replayTick()
+{
+    TickReplayStatistics& statistics = tickStatistics;
+    setMem(&statistics, sizeof(statistics), 0);
+
+    if (system.tick == system.initialTick)
+    {
+        callContractSystemProcedures(INITIALIZE);
+        callContractSystemProcedures(BEGIN_EPOCH);
+    }
+
+    unsigned long long phaseBeginningTick = __rdtsc();
+    callContractSystemProcedures(BEGIN_TICK);
+    unsigned long long phaseEndTick = __rdtsc();
+    statistics.phaseCycles[REPLAY_PHASE_BEGIN_TICK] = phaseEndTick - phaseBeginningTick;
+
+    phaseBeginningTick = phaseEndTick;
+    copyMem(&nextTickData, &ts.tickData.getByTickInCurrentEpoch(system.tick), sizeof(TickData));
+    if (nextTickData.epoch == system.epoch)
+    {
+        const unsigned long long* transactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(system.tick);
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
+            {
+                if (!transactionOffsets[transactionIndex])
+                {
+                    return false;
+                }
+                const Transaction* transaction = ts.tickTransactions(transactionOffsets[transactionIndex]);
+                const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
+                if (spectrumIndex >= 0)
+                {
+                    executeTickTransaction(transaction, 0, spectrumIndex);
+                }
+                statistics.numberOfTransactions++;
+            }
+        }
+    }
+    phaseEndTick = __rdtsc();
+    statistics.phaseCycles[REPLAY_PHASE_TRANSACTIONS] = phaseEndTick - phaseBeginningTick;
+
+    phaseBeginningTick = phaseEndTick;
+    callContractSystemProcedures(END_TICK);
+    phaseEndTick = __rdtsc();
+    statistics.phaseCycles[REPLAY_PHASE_END_TICK] = phaseEndTick - phaseBeginningTick;
+
+    phaseBeginningTick = phaseEndTick;
+    getSpectrumDigest(etalonTick.saltedSpectrumDigest);
+    getUniverseDigest(etalonTick.saltedUniverseDigest);
+    getComputerDigest(etalonTick.saltedComputerDigest);
+    statistics.phaseCycles[REPLAY_PHASE_DIGESTS] = __rdtsc() - phaseBeginningTick;
+
+    return true;
+}
+
+// Count the votes of system.tick stored in the tick storage and the votes with salted digests matching etalonTick
+static void checkVotes(unsigned int& numberOfVotes, unsigned int& numberOfMatchingVotes)
+{
+    numberOfVotes = 0;
+    numberOfMatchingVotes = 0;
+    const Tick* votes = ts.ticks.getByTickInCurrentEpoch(system.tick);
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        const Tick& vote = votes[computorIndex];
+        if (vote.epoch != system.epoch || vote.tick != system.tick)
+        {
+            continue;
+        }
+        numberOfVotes++;
+
+        m256i saltedData[2];
+        m256i saltedDigest;
+        unsigned long long saltedResourceTestingDigest;
+        saltedData[0] = broadcastedComputors.computors.publicKeys[computorIndex];
+        saltedData[1].m256i_u64[0] = resourceTestingDigest;
+        KangarooTwelve(saltedData, 32 + sizeof(resourceTestingDigest), &saltedResourceTestingDigest, sizeof(saltedResourceTestingDigest));
+        if (saltedResourceTestingDigest != vote.saltedResourceTestingDigest)
+        {
+            continue;
+        }
+        saltedData[1] = etalonTick.saltedSpectrumDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        if (saltedDigest != vote.saltedSpectrumDigest)
+        {
+            continue;
+        }
+        saltedData[1] = etalonTick.saltedUniverseDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        if (saltedDigest != vote.saltedUniverseDigest)
+        {
+            continue;
+        }
+        saltedData[1] = etalonTick.saltedComputerDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        if (saltedDigest == vote.saltedComputerDigest)
+        {
+            numberOfMatchingVotes++;
+        }
+    }
+}
+
+// Advance to next tick like the tick processor after the quorum has been reached (etalonTick time, mining seed)
+static void advanceTick()
+{
+    advanceEtalonTick(ts.tickData.getByTickInCurrentEpoch(system.tick));
+    system.tick++;
+    checkAndSwitchMiningPhase();
+}
+
+static bool hasVotes(unsigned int tick)
+{
+    if (!ts.ticks.isStoredInFull(tick))
+    {
+        return false;
+    }
+    const Tick* votes = ts.ticks.getByTickInCurrentEpoch(tick);
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (votes[computorIndex].epoch == system.epoch && votes[computorIndex].tick == tick)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void printSummary(const char* name, const LatencyHistogram& histogram)
+{
+    printf("%-14s p50 %8llu us, p90 %8llu us, p99 %8llu us, max %8llu us\n", name,
+        cyclesToMicroseconds(histogram.percentile(500)), cyclesToMicroseconds(histogram.percentile(900)),
+        cyclesToMicroseconds(histogram.percentile(990)), cyclesToMicroseconds(histogram.max()));
+}
+
+static void toChar16(CHAR16* destination, unsigned int capacity, const char* source)
+{
+    unsigned int i = 0;
+    for (; source[i] && i + 1 < capacity; i++)
+        destination[i] = source[i];
+    destination[i] = 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <state snapshot directory> <tick storage snapshot directory> [-last <tick>] [-threshold <n>]\n", argv[0]);
+        return 1;
+    }
+    CHAR16 stateDirectory[1024], tickStorageDirectory[1024];
+    toChar16(stateDirectory, 1024, argv[1]);
+    toChar16(tickStorageDirectory, 1024, argv[2]);
+    unsigned int lastTick = 0xffffffff;
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-last") == 0)
+            lastTick = (unsigned int)strtoul(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "-threshold") == 0)
+            solutionThreshold = atoi(argv[i + 1]);
+    }
+
+    frequency = measureFrequency();
+    getPublicKeyFromIdentity((const unsigned char*)ARBITRATOR, (unsigned char*)&arbitratorPublicKey);
+
+    if (!initCommonBuffers() || !initSpectrum() || !initAssets() || !initContractExec() || !ts.init()
+        || !allocatePool(sizeof(*score), (void**)&score) || !allocatePool(NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (void**)&minerSolutionFlags))
+    {
+        printf("Cannot allocate memory\n");
+        return 1;
+    }
+    setMem(score, sizeof(*score), 0);
+    score->initMemory();
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        if (!allocatePool(contractDescriptions[contractIndex].stateSize, (void**)&contractStates[contractIndex]))
+        {
+            printf("Cannot allocate memory\n");
+            return 1;
+        }
+    }
+    initializeContracts();
+
+    if (!loadNodeState(stateDirectory))
+    {
+        return 1;
+    }
+    m256i computerDigest;
+    getComputerDigest(computerDigest);
+
+    ts.beginEpoch(system.initialTick);
+    if (ts.tryLoadFromFile(system.epoch, tickStorageDirectory) != 0 || !ts.completeLazyLoading())
+    {
+        printf("Cannot load tick storage snapshot of epoch %u\n", system.epoch);
+        return 1;
+    }
+
+    printf("Epoch %u, replaying from tick %u (initial tick %u), %llu Hz\n", system.epoch, system.tick, system.initialTick, frequency);
+
+    const unsigned int firstTick = system.tick;
+    unsigned long long totalCycles = 0, totalTransactions = 0;
+    bool diverged = false;
+    while (system.tick <= lastTick && ts.tickInCurrentEpochStorage(system.tick) && hasVotes(system.tick))
+    {
+        if (!replayTick())
+        {
+            printf("Tick %u: transactions missing in tick storage, stopping\n", system.tick);
+            break;
+        }
+
+        unsigned int numberOfVotes, numberOfMatchingVotes;
+        checkVotes(numberOfVotes, numberOfMatchingVotes);
+
+        const TickReplayStatistics& statistics = tickStatistics;
+
+        unsigned long long tickTotalCycles = 0;
+        for (unsigned int phase = 0; phase < NUMBER_OF_REPLAY_PHASES; phase++)
+        {
+            phaseCycles[phase].add(statistics.phaseCycles[phase]);
+            tickTotalCycles += statistics.phaseCycles[phase];
+        }
+        tickCycles.add(tickTotalCycles);
+        totalCycles += tickTotalCycles;
+        totalTransactions += statistics.numberOfTransactions;
+
+        printf("Tick %u: %4u tx (%u contract, %u solutions), %7llu us (begin %llu, tx %llu, end %llu, digests %llu), votes %u/%u %s\n",
+            system.tick, statistics.numberOfTransactions, statistics.numberOfContractProcedureCalls, statistics.numberOfScoredSolutions,
+            cyclesToMicroseconds(tickTotalCycles),
+            cyclesToMicroseconds(statistics.phaseCycles[REPLAY_PHASE_BEGIN_TICK]), cyclesToMicroseconds(statistics.phaseCycles[REPLAY_PHASE_TRANSACTIONS]),
+            cyclesToMicroseconds(statistics.phaseCycles[REPLAY_PHASE_END_TICK]), cyclesToMicroseconds(statistics.phaseCycles[REPLAY_PHASE_DIGESTS]),
+            numberOfMatchingVotes, numberOfVotes, (numberOfMatchingVotes * 2 > numberOfVotes) ? "OK" : "MISMATCH");
+
+        if (numberOfMatchingVotes * 2 <= numberOfVotes)
+        {
+            diverged = true;
+            break;
+        }
+        advanceTick();
+    }
+
+    const unsigned int numberOfTicks = system.tick - firstTick + (diverged ? 1 : 0);
+    printf("\n%u ticks, %llu transactions replayed in %llu ms", numberOfTicks, totalTransactions, cyclesToMicroseconds(totalCycles) / 1000);
+    if (totalCycles)
+    {
+        printf(" (%.1f ticks/s, %.0f tx/s)", numberOfTicks * (double)frequency / totalCycles, totalTransactions * (double)frequency / totalCycles);
+    }
+    printf("\n");
+    if (numberOfTicks)
+    {
+        printSummary("tick", tickCycles);
+        for (unsigned int phase = 0; phase < NUMBER_OF_REPLAY_PHASES; phase++)
+        {
+            printSummary(replayPhaseNames[phase], phaseCycles[phase]);
+        }
+    }
+    if (diverged)
+    {
+        printf("State diverged at tick %u\n", system.tick);
+    }
+
+    return (diverged) ? 2 : 0;
+}